@@ -407,6 +407,8 @@
 
 #if !defined(_FROM_ASM_)
 void system_halt_hook(void);
+struct ch_thread;
+void cpu_load_switch(struct ch_thread *otp);
 #endif /* _FROM_ASM_ */
 
 /**
@@ -414,7 +416,9 @@ void system_halt_hook(void);
  * @details User fields added to the end of the @p thread_t structure.
  */
 #define CH_CFG_THREAD_EXTRA_FIELDS                                          \
-  /* Add threads custom fields here.*/
+  /* CPU time accounting (cpu_load.c) */                                    \
+  uint32_t load_cycles;                                                     \
+  uint32_t load_last;
 
 /**
  * @brief   Threads initialization hook.
@@ -424,7 +428,8 @@ void system_halt_hook(void);
  *          the threads creation APIs.
  */
 #define CH_CFG_THREAD_INIT_HOOK(tp) {                                       \
-  /* Add threads initialization code here.*/                                \
+  (tp)->load_cycles = 0;                                                    \
+  (tp)->load_last = 0;                                                      \
 }
 
 /**
@@ -444,7 +449,7 @@ void system_halt_hook(void);
  * @details This hook is invoked just before switching between threads.
  */
 #define CH_CFG_CONTEXT_SWITCH_HOOK(ntp, otp) {                              \
-  /* System halt code here.*/                                               \
+  cpu_load_switch(otp);                                                     \
 }
 
 /**
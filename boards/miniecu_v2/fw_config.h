@@ -7,18 +7,42 @@
 
 // threads priority
 #define PBSTX_PRIO	(NORMALPRIO - 5)
+#define TELEMETRY_PRIO	(NORMALPRIO - 4)
 #define LOG_PRIO	(NORMALPRIO - 2)
 #define LED_PRIO	(LOWPRIO)
 #define ADC_PRIO	(NORMALPRIO + 2)
-#define RPM_PRIO	(NORMALPRIO + 1)
+#define RPM_PRIO	(NORMALPRIO + 3)
 #define PARAMLD_PRIO	(NORMALPRIO)
 
 // threads stack size
-#define PBSTX_WASZ	2048
+#define PBSTX_WASZ	2304
+#define PBSTX_TX_WASZ	1024
+#define TELEMETRY_WASZ	1536
 #define LOG_WASZ	1024
 #define LED_WASZ	128
 #define ADC_WASZ	512
 #define RPM_WASZ	256
 #define PARAMLD_WASZ	2048
 
+// ADC pipeline: TRUE - fixed point (no FPU use in ADC handlers), FALSE - float
+#define ADC_FIXED_POINT		TRUE
+// XP2 PA1, PA2 as analog inputs (ADC1 IN1, IN2) for sensor channels, disables DEBUG_ADC_FREQ
+#define ADC_XP2_INPUTS		FALSE
+
+// RPM capture DMA (TIM2_CH2, DMA1 channel 7)
+#define RPM_DMA_PRIORITY	3
+#define RPM_DMA_IRQ_PRIORITY	7
+// RPM revolution counter (TIM3)
+#define RPM_REV_IRQ_PRIORITY	6
+
+// SERIAL1 DMA transport (USART1, DMA1 channels 4, 5), FALSE - ChibiOS serial driver
+// (also set HAL_USE_SERIAL and STM32_SERIAL_USE_USART1)
+#define SERIAL1_USE_DMA		TRUE
+#define SERIAL1_DMA_PRIORITY	1
+#define SERIAL1_IRQ_PRIORITY	12
+
+// CRC16: CRC unit for parts >= CRC16_HW_MIN_LEN, shorter by slicing-by-CRC16_SLICE
+#define CRC16_USE_HW		TRUE
+#define CRC16_SLICE		8
+
 #endif /* _FW_CONFIG_H_ */
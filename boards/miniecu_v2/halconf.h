@@ -83,7 +83,7 @@
  * @brief   Enables the ICU subsystem.
  */
 #if !defined(HAL_USE_ICU) || defined(__DOXYGEN__)
-#define HAL_USE_ICU                 TRUE
+#define HAL_USE_ICU                 FALSE
 #endif
 
 /**
@@ -123,9 +123,10 @@
 
 /**
  * @brief   Enables the SERIAL subsystem.
+ * @note    USART1 is driven by fw/hw/serial1_dma.c (SERIAL1_USE_DMA).
  */
 #if !defined(HAL_USE_SERIAL) || defined(__DOXYGEN__)
-#define HAL_USE_SERIAL              TRUE
+#define HAL_USE_SERIAL              FALSE
 #endif
 
 /**
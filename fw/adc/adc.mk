@@ -1,8 +1,10 @@
 ADCSRC = ${MINIECU}/fw/adc/th_adc.c \
+	 ${MINIECU}/fw/adc/adc_channel.c \
 	 ${MINIECU}/fw/adc/adc_batt.c \
 	 ${MINIECU}/fw/adc/adc_temp.c \
 	 ${MINIECU}/fw/adc/adc_oilp.c \
 	 ${MINIECU}/fw/adc/adc_flow.c \
-	 ${MINIECU}/fw/adc/adc_cpu.c
+	 ${MINIECU}/fw/adc/adc_cpu.c \
+	 ${MINIECU}/build/pgen/channel_table.c
 
 ADCINC =
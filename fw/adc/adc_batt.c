@@ -21,7 +21,10 @@
  */
 
 #include "th_adc.h"
+#include "adc_channel.h"
 #include "param_table.h"
+#include "hw/ectl_pads.h"
+#include <math.h>
 #include <string.h>
 
 
@@ -29,6 +32,12 @@
 int32_t gp_batt_cells;
 char gp_batt_type[PT_STRING_SIZE];
 float gp_batt_voltage_trimm;
+float gp_batt_i_starter;
+float gp_batt_i_load;
+
+/* -*- module variables -*- */
+static float m_vbat_adc;	// [V] filtered on ADC input
+static const struct adc_channel *m_channel;
 
 
 /**
@@ -37,73 +46,144 @@ float gp_batt_voltage_trimm;
  */
 static float get_vbat(void)
 {
-	return gp_batt_voltage_trimm + adc_getflt_vbat();
+	return gp_batt_voltage_trimm + m_vbat_adc;
 }
 
 /* -*- battery types -*- */
 
-#define BATT_CELL_NiMH		1.0
-#define BATT_CELL_NiCd		1.0
-#define BATT_CELL_LiIon		3.0
-#define BATT_CELL_LiPo		3.0
-#define BATT_CELL_LiFePo	2.8
-#define BATT_CELL_Pb		1.66
+/* Open circuit (rested) cell voltage [mV] at 0, 10, ... 100 % of charge.
+ * Typical discharge curves at room temperature.
+ * min_cell: undervoltage level (under load).
+ */
+#define BATT_OCV_POINTS		11
+#define BATT_OCV_STEP		(100 / (BATT_OCV_POINTS - 1))
+
+static const struct batt_chemistry {
+	const char *name;
+	uint16_t min_cell;
+	uint16_t ocv[BATT_OCV_POINTS];
+} m_chemistries[] = {
+	{ BATT_TYPE__NiMH, 1000, { 1100, 1170, 1200, 1220, 1230, 1240, 1250, 1265, 1280, 1310, 1380 } },
+	{ BATT_TYPE__NiCd, 1000, { 1100, 1160, 1190, 1210, 1220, 1230, 1240, 1250, 1270, 1300, 1360 } },
+	{ BATT_TYPE__LiIon, 3000, { 3000, 3450, 3550, 3620, 3680, 3740, 3800, 3880, 3960, 4060, 4180 } },
+	{ BATT_TYPE__LiPo, 3000, { 3270, 3690, 3740, 3770, 3790, 3820, 3870, 3920, 3980, 4060, 4200 } },
+	{ BATT_TYPE__LiFePo, 2800, { 2500, 3000, 3200, 3220, 3250, 3260, 3270, 3280, 3300, 3320, 3400 } },
+	{ BATT_TYPE__Pb, 1660, { 1750, 1885, 1930, 1958, 1983, 2010, 2033, 2053, 2070, 2083, 2117 } },
+};
+
+static const struct batt_chemistry *m_chemistry = &m_chemistries[0];
+
+/** State of charge from open circuit cell voltage [%]
+ */
+static float batt_ocv_to_soc(const struct batt_chemistry *chem, float cell_mv)
+{
+	const uint16_t *ocv = chem->ocv;
+	size_t i;
+
+	if (cell_mv <= ocv[0])
+		return 0.0f;
+	if (cell_mv >= ocv[BATT_OCV_POINTS - 1])
+		return 100.0f;
 
-#define BATT_NiMH_MINV	1.15
-#define BATT_NiMH_MAXV	1.25
+	for (i = 1; i < BATT_OCV_POINTS - 1 && cell_mv > ocv[i]; i++);
 
-static uint32_t batt_get_remaining_nimh(void)
-{
-	float cell_volt = get_vbat() / gp_batt_cells;
-
-	if (cell_volt > BATT_NiMH_MAXV)
-		return 100;
-	else if (cell_volt < BATT_NiMH_MINV)
-		return 0;
-	else
-		return arduino_map(cell_volt, BATT_NiMH_MINV, BATT_NiMH_MAXV, 0, 100);
+	return BATT_OCV_STEP * ((i - 1) + (cell_mv - ocv[i - 1]) / (ocv[i] - ocv[i - 1]));
 }
 
-/* TODO: add remaining functions to other type (if possible) */
+/* -*- state of charge estimator -*- */
 
-static float m_batt_min_cell_volt = BATT_CELL_NiMH;
-static uint32_t (*m_batt_remaining_func)(void) = batt_get_remaining_nimh;
+//! SoC smoothing time constant [s]
+#define BATT_SOC_TAU		30.0f
+//! Voltage recovery time after cranking, SoC is not updated [ms]
+#define BATT_RECOVERY_MS	2000
+//! Plausible internal resistance limit [Ohm]
+#define BATT_R_MAX		1.0f
 
-/* -*- global -*- */
+static float m_soc = NAN;		// [%] smoothed
+static float m_r_int;			// [Ohm] estimated, 0 - unknown
+static float m_v_rest;			// [V] voltage before cranking
+static float m_v_crank_min;		// [V] lowest voltage while cranking
+static bool m_cranking;
+static systime_t m_last_update;
+static systime_t m_crank_end;		// 0 - no cranking since boot
 
-void on_change_batt_type(struct param_entry *p)
+/** Estimate internal resistance from cranking voltage sag
+ *
+ * Starter current is not measured, nominal BATT_I_START used.
+ */
+static void batt_crank_done(void)
 {
-#define BATT_TYPE_IS(type)	\
-	(strcasecmp(gp_batt_type, BATT_TYPE__ ## type) == 0)
+	float r;
 
-	m_batt_remaining_func = NULL;
-	if (BATT_TYPE_IS(NiMH)) {
-		m_batt_min_cell_volt = BATT_CELL_NiMH;
-		m_batt_remaining_func = batt_get_remaining_nimh;
-	}
-	else if (BATT_TYPE_IS(NiCd)) {
-		m_batt_min_cell_volt = BATT_CELL_NiCd;
-		m_batt_remaining_func = batt_get_remaining_nimh;
-	}
-	else if (BATT_TYPE_IS(LiIon)) {
-		m_batt_min_cell_volt = BATT_CELL_LiIon;
-	}
-	else if (BATT_TYPE_IS(LiPo)) {
-		m_batt_min_cell_volt = BATT_CELL_LiPo;
+	if (gp_batt_i_starter <= 0.0f || m_v_crank_min >= m_v_rest)
+		return;
+
+	r = (m_v_rest - m_v_crank_min) / gp_batt_i_starter;
+	if (r > BATT_R_MAX)
+		return;
+
+	m_r_int = (m_r_int > 0.0f) ? (m_r_int + r) / 2.0f : r;
+}
+
+static void batt_update_soc(void)
+{
+	systime_t now = osalOsGetSystemTimeX();
+	float vbat = get_vbat();
+	float ocv, soc, dt;
+
+	if (ctl_starter_state()) {
+		if (!m_cranking) {
+			m_cranking = true;
+			m_v_crank_min = vbat;
+		}
+		else if (vbat < m_v_crank_min)
+			m_v_crank_min = vbat;
+
+		return;
 	}
-	else if (BATT_TYPE_IS(LiFePo)) {
-		m_batt_min_cell_volt = BATT_CELL_LiFePo;
+
+	if (m_cranking) {
+		m_cranking = false;
+		m_crank_end = now;
+		batt_crank_done();
 	}
-	else if (BATT_TYPE_IS(Pb)) {
-		m_batt_min_cell_volt = BATT_CELL_Pb;
+
+	if (m_crank_end != 0 && now - m_crank_end < MS2ST(BATT_RECOVERY_MS))
+		return;
+
+	m_v_rest = vbat;
+
+	/* load compensation: voltage drop of ECU and ignition current */
+	ocv = vbat + gp_batt_i_load * m_r_int;
+	soc = batt_ocv_to_soc(m_chemistry, ocv * 1000.0f / gp_batt_cells);
+
+	if (isnan(m_soc)) {
+		m_soc = soc;
 	}
 	else {
-		m_batt_min_cell_volt = 0.0;
-		strcpy(gp_batt_type, p->default_value.s);
-		debug_printf(DP_ERROR, "BATT: unknown battery type");
+		dt = ST2MS(now - m_last_update) / 1000.0f;
+		m_soc += (soc - m_soc) * dt / (BATT_SOC_TAU + dt);
 	}
 
-#undef BATT_TYPE_IS
+	m_last_update = now;
+}
+
+/* -*- global -*- */
+
+void on_change_batt_type(struct param_entry *p)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_chemistries); i++) {
+		if (strcasecmp(gp_batt_type, m_chemistries[i].name) == 0) {
+			m_chemistry = &m_chemistries[i];
+			m_soc = NAN;
+			return;
+		}
+	}
+
+	m_chemistry = &m_chemistries[0];
+	m_soc = NAN;
+	strcpy(gp_batt_type, p->default_value.s);
+	debug_printf(DP_ERROR, "BATT: unknown battery type");
 }
 
 /**
@@ -116,30 +196,52 @@ uint32_t batt_get_voltage(void)
 
 /**
  * Check battery voltage
- * @return true if voltage is LOW
+ * @return true if voltage is LOW (faulted input ignored)
  */
 bool batt_check_voltage(void)
 {
-	return (m_batt_min_cell_volt * gp_batt_cells) > get_vbat();
+	return adc_channel_is_ok(m_channel)
+		&& (m_chemistry->min_cell / 1000.0f * gp_batt_cells) > get_vbat();
 }
 
 /**
- * Calculate battery fuel gauge (if possible)
+ * Calculate battery fuel gauge
  *
- * @param[out] *out calculated value
- * @return true if calculation possible
+ * @param[out] *out calculated value [%]
+ * @return true if estimate available
  */
 bool batt_get_remaining(uint32_t *out)
 {
-	if (m_batt_remaining_func == NULL)
+	if (isnan(m_soc) || !adc_channel_is_ok(m_channel))
+		return false;
+
+	*out = lroundf(m_soc);
+	return true;
+}
+
+/**
+ * Estimated internal resistance [mOhm]
+ *
+ * @return false if no cranking observed yet
+ */
+bool batt_get_resistance(uint32_t *out)
+{
+	if (m_r_int <= 0.0f)
 		return false;
 
-	*out = m_batt_remaining_func();
+	*out = m_r_int * 1000;
 	return true;
 }
 
-void adc_handle_battery(void)
+void adc_handle_battery(const struct sensor_snapshot *s)
 {
+	if (m_channel == NULL)
+		m_channel = adc_channel_find("BATT");
+
+	m_vbat_adc = SENSOR_VOLT(s->sdadc1.flt_vbat);
+
+	if (adc_channel_is_ok(m_channel))
+		batt_update_soc();
+
 	/* TODO: send event to Log */
 }
-
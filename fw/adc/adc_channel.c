@@ -0,0 +1,304 @@
+/**
+ * @file       adc_channel.c
+ * @brief      Sensor channel registry
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "adc_channel.h"
+#include <math.h>
+#include <string.h>
+
+/* Channels defined in parameters.yaml channels section,
+ * table generated by pgen (build/pgen/channel_table.c).
+ */
+
+/* -*- local -*- */
+
+/** Get filtered input value
+ *
+ * @return NAN if input not sampled
+ */
+static float get_input(const struct sensor_snapshot *s, enum adc_input input)
+{
+	switch (input) {
+	case AI_INT_TEMP:	return SENSOR_TEMP(s->adc1.flt_int_temp);
+	case AI_VRTC:		return SENSOR_VOLT(s->adc1.flt_vrtc);
+#if ADC_XP2_INPUTS
+	case AI_XP2_PA1:	return SENSOR_VOLT(s->adc1.flt_xp2_pa1);
+	case AI_XP2_PA2:	return SENSOR_VOLT(s->adc1.flt_xp2_pa2);
+#endif
+	case AI_VBAT:		return SENSOR_VOLT(s->sdadc1.flt_vbat);
+	case AI_OILP:		return SENSOR_VOLT(s->sdadc1.flt_oilp_volt);
+	case AI_TEMP:		return SENSOR_VOLT(s->sdadc1.flt_temp_volt);
+	case AI_FLOW:		return SENSOR_VOLT(s->sdadc3.flt_flow_volt);
+	default:		return NAN;
+	}
+}
+
+/** Get last raw sample of input
+ */
+static float get_raw_input(const struct sensor_snapshot *s, enum adc_input input)
+{
+	switch (input) {
+	case AI_INT_TEMP:	return SENSOR_TEMP(s->adc1.raw_int_temp);
+	case AI_VRTC:		return SENSOR_VOLT(s->adc1.raw_vrtc);
+#if ADC_XP2_INPUTS
+	case AI_XP2_PA1:	return SENSOR_VOLT(s->adc1.raw_xp2_pa1);
+	case AI_XP2_PA2:	return SENSOR_VOLT(s->adc1.raw_xp2_pa2);
+#endif
+	case AI_VBAT:		return SENSOR_VOLT(s->sdadc1.raw_vbat);
+	case AI_OILP:		return SENSOR_VOLT(s->sdadc1.raw_oilp_volt);
+	case AI_TEMP:		return SENSOR_VOLT(s->sdadc1.raw_temp_volt);
+	case AI_FLOW:		return SENSOR_VOLT(s->sdadc3.raw_flow_volt);
+	default:		return NAN;
+	}
+}
+
+static bool is_fault(enum adc_channel_health health)
+{
+	return health != ACH_OK && health != ACH_NA;
+}
+
+/** Input plausibility: range, rate of change, stuck value
+ */
+static void check_health(const struct adc_channel *ch, const struct sensor_snapshot *s,
+		systime_t now)
+{
+	struct adc_channel_state *st = ch->state;
+	enum adc_channel_health health = ACH_OK;
+	float v = get_input(s, ch->input);
+	float raw = get_raw_input(s, ch->input);
+	// no previous check (boot or just enabled)
+	bool first = st->last_update == 0 || st->health == ACH_NA;
+
+	if (ch->enabled != NULL && !ch->enabled()) {
+		st->health = ACH_NA;
+		return;
+	}
+
+	if (!isfinite(v)) {
+		health = ACH_INVALID;
+	}
+	else if (ch->range_min < ch->range_max && v < ch->range_min) {
+		health = ACH_LOW;
+	}
+	else if (ch->range_min < ch->range_max && v > ch->range_max) {
+		health = ACH_HIGH;
+	}
+	else if (ch->rate_max > 0.0f && !first) {
+		float dt = ST2MS(now - st->last_update) / 1000.0f;
+		if (dt > 0.0f && fabsf(v - st->last_input) > ch->rate_max * dt)
+			health = ACH_RATE;
+	}
+
+	if (ch->stuck_ms > 0) {
+		if (raw != st->last_raw || first) {
+			st->last_raw = raw;
+			st->stuck_since = now;
+		}
+		else if (health == ACH_OK && now - st->stuck_since >= MS2ST(ch->stuck_ms)) {
+			health = ACH_STUCK;
+		}
+	}
+
+	if (is_fault(health) && !is_fault(st->health))
+		st->faults++;
+
+	st->health = health;
+	st->last_input = v;
+}
+
+static float poly_eval(const float *c, size_t n, float x)
+{
+	float y = 0.0f;
+
+	while (n-- > 0)
+		y = y * x + c[n];
+
+	return y;
+}
+
+/** Piecewise linear interpolation, clamped on table ends
+ */
+static float lut_eval(const float *tx, const float *ty, size_t n, float x)
+{
+	size_t lo = 0, hi = n - 1;
+
+	if (x <= tx[lo])
+		return ty[lo];
+	if (x >= tx[hi])
+		return ty[hi];
+
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (tx[mid] <= x)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return ty[lo] + (ty[hi] - ty[lo]) * (x - tx[lo]) / (tx[hi] - tx[lo]);
+}
+
+/** Convert generic channel input and check alarm thresholds
+ */
+static void convert_channel(const struct adc_channel *ch, const struct sensor_snapshot *s)
+{
+	struct adc_channel_state *st = ch->state;
+	float v = get_input(s, ch->input);
+
+	if (isnan(v) || st->health != ACH_OK) {
+		st->valid = false;
+		st->alarm = false;
+		return;
+	}
+
+	if (ch->poly_size > 0)
+		v = poly_eval(ch->poly, ch->poly_size, v);
+	if (ch->lut_size > 0)
+		v = lut_eval(ch->lut_x, ch->lut_y, ch->lut_size, v);
+
+	st->value = v;
+	st->valid = true;
+	st->alarm = (ch->alarm_low != NULL && v < *ch->alarm_low)
+		|| (ch->alarm_high != NULL && v > *ch->alarm_high);
+}
+
+/* -*- public functions -*- */
+
+/** Run channels which update period elapsed
+ *
+ * Called from ADC thread every ADC_CHANNEL_TICK_MS.
+ *
+ * @param fast	use fast_period_ms (engine cranking)
+ */
+void adc_channel_process(const struct sensor_snapshot *s, bool fast)
+{
+	systime_t now = osalOsGetSystemTimeX();
+
+	for (size_t i = 0; i < adc_channel_table_size; i++) {
+		const struct adc_channel *ch = &adc_channel_table[i];
+		struct adc_channel_state *st = ch->state;
+		uint32_t period = ch->period_ms;
+
+		if (fast && ch->fast_period_ms > 0)
+			period = ch->fast_period_ms;
+
+		if (st->last_update != 0
+				&& now - st->last_update < MS2ST(period))
+			continue;
+
+		check_health(ch, s, now);
+		st->last_update = now;
+		if (ch->handler != NULL)
+			ch->handler(s);
+		else
+			convert_channel(ch, s);
+	}
+}
+
+/** Filter cutoff for input (first channel using input defines it)
+ */
+float adc_channel_get_cutoff(enum adc_input input)
+{
+	for (size_t i = 0; i < adc_channel_table_size; i++) {
+		const struct adc_channel *ch = &adc_channel_table[i];
+
+		if ((ch->inputs & AI_MASK(input)) && ch->cutoff > 0.0f)
+			return ch->cutoff;
+	}
+
+	return ADC_CHANNEL_DEFAULT_CUTOFF;
+}
+
+/** Shortest update period of channels using any of inputs
+ *
+ * @param inputs	AI_MASK() of inputs
+ * @return period [ms], UINT32_MAX if no channels
+ */
+uint32_t adc_channel_get_period(uint32_t inputs)
+{
+	uint32_t period = UINT32_MAX;
+
+	for (size_t i = 0; i < adc_channel_table_size; i++) {
+		const struct adc_channel *ch = &adc_channel_table[i];
+
+		if ((ch->inputs & inputs) && ch->period_ms < period)
+			period = ch->period_ms;
+	}
+
+	return period;
+}
+
+const struct adc_channel *adc_channel_find(const char *name)
+{
+	for (size_t i = 0; i < adc_channel_table_size; i++) {
+		if (strcmp(adc_channel_table[i].name, name) == 0)
+			return &adc_channel_table[i];
+	}
+
+	return NULL;
+}
+
+/** Get generic channel value
+ *
+ * @return false if channel has handler or input not sampled
+ */
+bool adc_channel_get_value(const struct adc_channel *ch, float *out)
+{
+	if (ch->handler != NULL || !ch->state->valid)
+		return false;
+
+	*out = ch->state->value;
+	return true;
+}
+
+/** Channel health check passed
+ *
+ * @return true for NULL (channel not defined)
+ */
+bool adc_channel_is_ok(const struct adc_channel *ch)
+{
+	return ch == NULL || ch->state->health == ACH_OK;
+}
+
+/** Check health of all channels
+ * @return true if any channel in use faulted
+ */
+bool adc_channel_check_fault(void)
+{
+	for (size_t i = 0; i < adc_channel_table_size; i++) {
+		if (is_fault(adc_channel_table[i].state->health))
+			return true;
+	}
+
+	return false;
+}
+
+/** Check alarm of generic channels
+ */
+bool adc_channel_check_alarm(void)
+{
+	for (size_t i = 0; i < adc_channel_table_size; i++) {
+		if (adc_channel_table[i].state->alarm)
+			return true;
+	}
+
+	return false;
+}
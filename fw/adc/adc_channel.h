@@ -0,0 +1,134 @@
+/**
+ * @file       adc_channel.h
+ * @brief      Sensor channel registry
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef ADC_CHANNEL_H
+#define ADC_CHANNEL_H
+
+#include "fw_common.h"
+#include "sensors.h"
+
+/** ADC inputs (filtered signals in sensor snapshot)
+ *
+ * @note pgen uses same names (without AI_ prefix) in channels section
+ */
+enum adc_input {
+	AI_INT_TEMP = 0,	//!< ADC1: CPU temperature [C°]
+	AI_VRTC,		//!< ADC1: RTC battery [V]
+	AI_XP2_PA1,		//!< ADC1: XP2 PA1 [V] (ADC_XP2_INPUTS)
+	AI_XP2_PA2,		//!< ADC1: XP2 PA2 [V] (ADC_XP2_INPUTS)
+	AI_VBAT,		//!< SDADC1: battery on ADC input [V]
+	AI_OILP,		//!< SDADC1: OIL_P [V]
+	AI_TEMP,		//!< SDADC1: TEMP [V]
+	AI_FLOW,		//!< SDADC3: FLOW [V]
+	AI_MAX
+};
+
+#define AI_MASK(input)		(1 << (input))
+
+/** Channel health (input plausibility)
+ */
+enum adc_channel_health {
+	ACH_OK = 0,
+	ACH_LOW,		//!< below range (open or short, depends on wiring)
+	ACH_HIGH,		//!< above range (open or short, depends on wiring)
+	ACH_RATE,		//!< rate of change over limit
+	ACH_STUCK,		//!< raw value not changed for stuck time
+	ACH_INVALID,		//!< NaN/Inf
+	ACH_NA			//!< not in use (disabled by parameters), not a fault
+};
+
+//! Channel handler for channels implemented in modules
+typedef void (*adc_channel_handler_t)(const struct sensor_snapshot *s);
+//! Channel in use predicate (e.g. sensor enabled by parameters)
+typedef bool (*adc_channel_enabled_t)(void);
+
+/** Channel runtime state
+ */
+struct adc_channel_state {
+	systime_t last_update;
+	float value;		//!< physical value (generic channels)
+	bool valid;
+	bool alarm;
+	/* health */
+	enum adc_channel_health health;
+	uint32_t faults;	//!< transitions to fault
+	float last_input;	//!< filtered input on last check
+	float last_raw;
+	systime_t stuck_since;
+};
+
+/** Sensor channel definition (generated by pgen from parameters.yaml)
+ *
+ * Channel with handler only calls it with snapshot.
+ * Generic channel converts its input: volts -> physical by
+ * polynomial (poly[0] + poly[1] * v + ...), then by lookup table,
+ * and checks alarm thresholds.
+ *
+ * Health of converted input checked before each update: range
+ * (range_min < range_max), rate of change and stuck raw value.
+ * Faulted generic channel is not valid, module check functions
+ * should ignore faulted channels (adc_channel_is_ok()).
+ * Channel with false enabled() is ACH_NA: not checked and not a fault
+ * (unconnected input of disabled sensor), handler still called.
+ */
+struct adc_channel {
+	const char *name;
+	uint32_t inputs;		//!< AI_MASK() of used inputs
+	enum adc_input input;		//!< converted input
+	uint32_t period_ms;		//!< update period
+	uint32_t fast_period_ms;	//!< update period while cranking, 0 - same
+	float cutoff;			//!< inputs filter cutoff [Hz], 0 - default
+	adc_channel_handler_t handler;
+	adc_channel_enabled_t enabled;	//!< NULL - always in use
+	const float *poly;
+	uint8_t poly_size;
+	const float *lut_x;		//!< ascending
+	const float *lut_y;
+	uint8_t lut_size;
+	const float *alarm_low;		//!< NULL - no alarm
+	const float *alarm_high;	//!< NULL - no alarm
+	float range_min;		//!< plausible input range
+	float range_max;
+	float rate_max;			//!< [input units/s], 0 - no check
+	uint32_t stuck_ms;		//!< 0 - no check
+	struct adc_channel_state *state;
+};
+
+//! Default input filter cutoff [Hz]
+#define ADC_CHANNEL_DEFAULT_CUTOFF	50.0f
+//! Channel processing tick
+#define ADC_CHANNEL_TICK_MS		10
+
+/* generated table */
+extern const struct adc_channel adc_channel_table[];
+extern const size_t adc_channel_table_size;
+
+void adc_channel_process(const struct sensor_snapshot *s, bool fast);
+float adc_channel_get_cutoff(enum adc_input input);
+uint32_t adc_channel_get_period(uint32_t inputs);
+const struct adc_channel *adc_channel_find(const char *name);
+bool adc_channel_get_value(const struct adc_channel *ch, float *out);
+bool adc_channel_is_ok(const struct adc_channel *ch);
+bool adc_channel_check_fault(void);
+bool adc_channel_check_alarm(void);
+
+#endif /* ADC_CHANNEL_H */
@@ -21,6 +21,12 @@
  */
 
 #include "th_adc.h"
+#include "adc_channel.h"
+
+/* -*- module variables -*- */
+static float m_int_temp;	// [C°]
+static float m_vrtc;		// [V]
+static const struct adc_channel *m_channel;
 
 
 /**
@@ -28,7 +34,7 @@
  */
 int32_t cpu_get_temperature(void)
 {
-	return adc_getflt_int_temp() * 1000;
+	return m_int_temp * 1000;
 }
 
 /**
@@ -38,6 +44,22 @@ int32_t cpu_get_temperature(void)
  */
 bool cpu_get_rtc_voltage(uint32_t *out)
 {
-	*out = adc_getflt_vrtc() * 1000;
+	*out = m_vrtc * 1000;
 	return *out > 1000;
 }
+
+/** Check internal temperature
+ */
+bool cpu_check_temperature(void)
+{
+	return adc_channel_is_ok(m_channel) && m_int_temp > 90.0;
+}
+
+void adc_handle_cpu(const struct sensor_snapshot *s)
+{
+	if (m_channel == NULL)
+		m_channel = adc_channel_find("CPU");
+
+	m_int_temp = SENSOR_TEMP(s->adc1.flt_int_temp);
+	m_vrtc = SENSOR_VOLT(s->adc1.flt_vrtc);
+}
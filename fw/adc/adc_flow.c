@@ -21,12 +21,21 @@
  */
 
 #include "th_adc.h"
+#include "th_rpm.h"
+#include "param.h"
 #include "param_table.h"
+#include "lib_crc16.h"
+#include "running_stats.h"
+#include "hw/ext_flash.h"
+#include "hw/ectl_pads.h"
 #include <math.h>
+#include <string.h>
+#include <stddef.h>
 
 /* -*- parameters -*-  */
 bool gp_flow_enable;
 float gp_flow_v0;		// V
+bool gp_flow_v0_auto;
 float gp_flow_dia1;		// mm
 float gp_flow_dia2;		// mm
 float gp_flow_cd;
@@ -38,13 +47,175 @@ int32_t gp_flow_low_ml;		// mL
 /* -*- private variabled -*- */
 static float m_C;
 static float m_A2;		// m2
-static double m_total_used_ml;
 static float m_flow_mlsec;	// mL3/sec
 
+/* integrator state */
+static uint64_t m_used_ul;	// [uL] total used
+static float m_used_frac_ul;	// [uL] integration remainder (< 1)
+static uint32_t m_used_ml;	// copy for readers
+static int64_t m_last_sqrt_sum;
+static uint32_t m_last_samples;
+static volatile bool m_refuel_request;
+
+/* per sample integration (SDADC3 callback), SDADC counts */
+static volatile int32_t m_zero_code;	// FLOW_V0
+static volatile int32_t m_band_code = INT16_MAX;	// FLOW_V0 + dead band, max - disabled
+
 #define FLOW_MAXV	3.3	// V
 #define MP3V5004DP_MINP	0.0	// Pa
 #define MP3V5004DP_MAXP	3920.0	// Pa
 
+/* -*- zero calibration -*- */
+
+/* Notes:
+ * MP3V5004DP offset drifts between sessions (0.6 .. 0.8 V),
+ * biased zero gives flow from sensor noise.
+ * While engine is stopped (no fuel flow) interval means are
+ * accumulated, when window is quiet (no flow and no pump priming)
+ * its mean becomes FLOW_V0. Parameters saved if zero moved.
+ * Zero noise is used as dead band of flow calculation.
+ */
+
+#define ZERO_WINDOW		S2ST(10)
+#define ZERO_MIN_COUNT		100	// interval means in window
+#define ZERO_MAX_STDDEV		0.005f	// [V] quiet window
+#define ZERO_MAX_STEP		0.3f	// [V] plausible drift
+#define ZERO_SAVE_DELTA		0.01f	// [V]
+#define ZERO_DEADBAND_K		3.0f	// dead band in sigmas
+
+static running_stats_t m_zero_stats;
+static systime_t m_zero_start;
+static float m_zero_noise;		// [V] stddev of last calibration
+static float m_zero_saved;		// [V] last saved FLOW_V0
+static uint32_t m_zero_count;
+
+/* -*- checkpoints -*- */
+
+/* Notes:
+ * Total used volume is checkpointed to FLASHD1_fuel partition,
+ * one record per page (sequentally, so sector erased only on entering it).
+ * Last valid record with max sequence number is loaded at startup.
+ *
+ * Flash I/O is done by log thread (sector erase takes tens of ms,
+ * ADC thread must not stall), ADC thread only posts copy of total.
+ */
+
+// 'fuel' in little endian
+#define CHECKPOINT_SIGNATURE	0x6c657566
+#define CHECKPOINT_PERIOD	S2ST(60)
+//! SST25 pages per erase sector
+#define EPAGES			(4096/256)
+
+typedef struct {
+	uint32_t signature;
+	uint32_t seq;
+	uint64_t used_ul;
+	uint16_t crc16;
+} flow_checkpoint_t;
+
+/* log thread */
+static uint32_t m_ckpt_seq;
+static uint32_t m_ckpt_page;		// next page to write
+
+/* ADC thread */
+static uint64_t m_ckpt_used_ul;		// last posted value
+static systime_t m_ckpt_time;
+
+/* posted record, protected by system lock */
+static uint64_t m_ckpt_pending_ul;
+static volatile bool m_ckpt_pending;
+
+static bool checkpoint_read(uint32_t page, flow_checkpoint_t *ckpt)
+{
+	uint8_t buff[mtdGetPageSize(&FLASHD1_fuel)];
+
+	if (blkRead(&FLASHD1_fuel, page, buff, 1) != HAL_SUCCESS)
+		return false;
+
+	memcpy(ckpt, buff, sizeof(*ckpt));
+	return ckpt->signature == CHECKPOINT_SIGNATURE &&
+		ckpt->crc16 == crc16((uint8_t *)ckpt, offsetof(flow_checkpoint_t, crc16));
+}
+
+/** Load last checkpoint
+ * Called from log thread before ADC thread starts.
+ */
+void flow_checkpoint_load(void)
+{
+	uint32_t pages = mtdGetSize(&FLASHD1_fuel) / mtdGetPageSize(&FLASHD1_fuel);
+	flow_checkpoint_t ckpt;
+	bool found = false;
+
+	for (uint32_t page = 0; page < pages; page++) {
+		if (!checkpoint_read(page, &ckpt))
+			continue;
+
+		if (!found || (int32_t)(ckpt.seq - m_ckpt_seq) > 0) {
+			found = true;
+			m_ckpt_seq = ckpt.seq;
+			m_ckpt_page = (page + 1) % pages;
+			m_used_ul = m_ckpt_used_ul = ckpt.used_ul;
+		}
+	}
+
+	m_used_ml = m_used_ul / 1000;
+	if (found)
+		debug_printf(DP_INFO, "FLOW: used %" PRIu32 " mL #%" PRIu32, m_used_ml, m_ckpt_seq);
+}
+
+/** Post total for checkpoint (ADC thread)
+ */
+static void checkpoint_save(void)
+{
+	chSysLock();
+	m_ckpt_pending_ul = m_used_ul;
+	m_ckpt_pending = true;
+	chSysUnlock();
+
+	m_ckpt_used_ul = m_used_ul;
+	m_ckpt_time = osalOsGetSystemTimeX();
+}
+
+/** Checkpoint is posted and waiting for flow_checkpoint_write()
+ */
+bool flow_checkpoint_is_pending(void)
+{
+	return m_ckpt_pending;
+}
+
+/** Write posted checkpoint
+ * Called from log thread.
+ */
+void flow_checkpoint_write(void)
+{
+	uint32_t pages = mtdGetSize(&FLASHD1_fuel) / mtdGetPageSize(&FLASHD1_fuel);
+	uint8_t buff[mtdGetPageSize(&FLASHD1_fuel)];
+	flow_checkpoint_t ckpt = {
+		.signature = CHECKPOINT_SIGNATURE,
+		.seq = m_ckpt_seq + 1
+	};
+
+	chSysLock();
+	ckpt.used_ul = m_ckpt_pending_ul;
+	m_ckpt_pending = false;
+	chSysUnlock();
+
+	ckpt.crc16 = crc16((uint8_t *)&ckpt, offsetof(flow_checkpoint_t, crc16));
+	memset(buff, 0xff, sizeof(buff));
+	memcpy(buff, &ckpt, sizeof(ckpt));
+
+	if (m_ckpt_page % EPAGES == 0)
+		mtdErase(&FLASHD1_fuel, m_ckpt_page, EPAGES);
+
+	if (blkWrite(&FLASHD1_fuel, m_ckpt_page, buff, 1) != HAL_SUCCESS) {
+		debug_printf(DP_ERROR, "FLOW: checkpoint write error");
+		return;
+	}
+
+	m_ckpt_seq = ckpt.seq;
+	m_ckpt_page = (m_ckpt_page + 1) % pages;
+}
+
 
 /* -*- global -*- */
 
@@ -54,6 +225,14 @@ void on_change_flow_params(struct param_entry *p ATTR_UNUSED)
 	m_C = gp_flow_cd / sqrtf(1 - powf(gp_flow_dia2 / gp_flow_dia1, 4));
 }
 
+/**
+ * FLOW input in use (FLOW_ENABLE)
+ */
+bool flow_is_enabled(void)
+{
+	return gp_flow_enable;
+}
+
 /**
  * Return current flow [mL/min]
  */
@@ -69,7 +248,15 @@ bool flow_get_flow(uint32_t *out)
  */
 uint32_t flow_get_used_ml(void)
 {
-	return m_total_used_ml;
+	return m_used_ml;
+}
+
+/**
+ * Reset fuel usage (tank refilled)
+ */
+void flow_refuel_done(void)
+{
+	m_refuel_request = true;
 }
 
 /**
@@ -81,7 +268,7 @@ bool flow_check_fuel(void)
 	if (gp_flow_low_ml == 0.0 || gp_flow_tank_ml == 0.0)
 		return false;
 
-	return (gp_flow_tank_ml - m_total_used_ml) <= gp_flow_low_ml;
+	return (gp_flow_tank_ml - (int32_t)m_used_ml) <= gp_flow_low_ml;
 }
 
 /**
@@ -95,7 +282,7 @@ bool flow_get_remaining(uint32_t *out)
 	if (gp_flow_tank_ml == 0.0)
 		return false;
 
-	float rem_ml = gp_flow_tank_ml - m_total_used_ml;
+	float rem_ml = gp_flow_tank_ml - (float)m_used_ml;
 	if (rem_ml > gp_flow_tank_ml)	rem_ml = gp_flow_tank_ml;
 	else if (rem_ml < 0)		rem_ml = 0;
 
@@ -103,26 +290,193 @@ bool flow_get_remaining(uint32_t *out)
 	return true;
 }
 
-void adc_handle_flow(void)
+/**
+ * Return learned sensor zero [mV], noise [uV] and calibrations count
+ */
+uint32_t flow_get_zero(uint32_t *noise_uv, uint32_t *count)
+{
+	*noise_uv = m_zero_noise * 1e6f;
+	*count = m_zero_count;
+	return gp_flow_v0 * 1000;
+}
+
+#if ADC_FIXED_POINT
+/** Integer square root (floor)
+ */
+static inline uint32_t isqrt32(uint32_t x)
+{
+	uint32_t res = 0, bit = 1UL << 30;
+
+	while (bit > x)
+		bit >>= 2;
+
+	for (; bit != 0; bit >>= 2) {
+		if (x >= res + bit) {
+			x -= res + bit;
+			res = (res >> 1) + bit;
+		}
+		else
+			res >>= 1;
+	}
+
+	return res;
+}
+#endif
+
+/** Sum of sqrt(dP) over block of SDADC3 samples
+ *
+ * Q ~ sqrt(dP) is concave, sqrt of interval mean under-reports
+ * pulsating flow, so every sample is integrated.
+ * dP ~ (count - zero count), samples in dead band give zero.
+ * Called from SDADC3 callback.
+ *
+ * @return sum of sqrt(count - zero) [sqrt(count) * 2^FLOW_SQRT_SHIFT]
+ */
+uint32_t flow_block_sqrt_sum(const int16_t *blk, size_t n)
+{
+	const int32_t zero = m_zero_code, band = m_band_code;
+#if ADC_FIXED_POINT
+	uint32_t sum = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		if (blk[i] > band)
+			sum += isqrt32((uint32_t)(blk[i] - zero) << (2 * FLOW_SQRT_SHIFT));
+	}
+
+	return sum;
+#else
+	float sum = 0.0f;
+
+	for (size_t i = 0; i < n; i++) {
+		if (blk[i] > band)
+			sum += sqrtf(blk[i] - zero);
+	}
+
+	return lrintf(sum * (1 << FLOW_SQRT_SHIFT));
+#endif
+}
+
+/** Flow for one sqrt(count) unit of flow_block_sqrt_sum() [mL/sec]
+ */
+static float flow_calc_k_mlsec(void)
+{
+	/* Notes: equation for orifice plate from
+	 * http://en.wikipedia.org/wiki/Orifice_plate
+	 *
+	 * Q = C * A2 * sqrt(2 * dP / ro), dP linear in (V - V0)
+	 */
+	float dP_count = SDADC_COUNT_VOLT * (MP3V5004DP_MAXP - MP3V5004DP_MINP) / (FLOW_MAXV - gp_flow_v0);
+	float k = m_C * m_A2 * sqrtf(2.0f * dP_count / gp_flow_ro);
+
+	return k * 1e6f / (1 << FLOW_SQRT_SHIFT);
+}
+
+/** Set zero and dead band for SDADC3 callback
+ */
+static void update_zero_codes(void)
+{
+	if (!gp_flow_enable) {
+		m_band_code = INT16_MAX;
+		return;
+	}
+
+	m_zero_code = lrintf(gp_flow_v0 / SDADC_COUNT_VOLT) - 32767;
+	m_band_code = lrintf((gp_flow_v0 + ZERO_DEADBAND_K * m_zero_noise) / SDADC_COUNT_VOLT) - 32767;
+}
+
+static void zero_restart(void)
+{
+	rstats_reset(&m_zero_stats);
+	m_zero_start = osalOsGetSystemTimeX();
+}
+
+/** Accumulate filtered voltage for zero calibration
+ */
+static void zero_update(float volt)
+{
+	if (!gp_flow_v0_auto || rpm_is_engine_running() || ctl_starter_state()) {
+		zero_restart();
+		return;
+	}
+
+	rstats_push(&m_zero_stats, volt);
+	if (chVTTimeElapsedSinceX(m_zero_start) < ZERO_WINDOW)
+		return;
+
+	float mean = m_zero_stats.mean;
+	float stddev = rstats_stddev(&m_zero_stats);
+
+	if (m_zero_stats.n >= ZERO_MIN_COUNT && stddev < ZERO_MAX_STDDEV
+			&& fabsf(mean - gp_flow_v0) < ZERO_MAX_STEP) {
+		gp_flow_v0 = mean;
+		m_zero_noise = stddev;
+		m_zero_count++;
+
+		if (fabsf(mean - m_zero_saved) > ZERO_SAVE_DELTA) {
+			m_zero_saved = mean;
+			param_save_async();
+			debug_printf(DP_INFO, "FLOW: zero %d mV", (int)(mean * 1000));
+		}
+	}
+
+	zero_restart();
+}
+
+void adc_handle_flow(const struct sensor_snapshot *s)
 {
 	static bool is_inited = false;
 	if (!is_inited) {
 		on_change_flow_params(NULL);
+		m_last_sqrt_sum = s->sdadc3.flow_sqrt_sum;
+		m_last_samples = s->sdadc3.samples;
+		m_ckpt_time = osalOsGetSystemTimeX();
+		m_zero_saved = gp_flow_v0;
+		zero_restart();
 		is_inited = true;
 	}
 
-	if (!gp_flow_enable)
-		return;
+	if (m_refuel_request) {
+		m_refuel_request = false;
+		m_used_ul = 0;
+		m_used_frac_ul = 0.0f;
+		m_used_ml = 0;
+		checkpoint_save();
+	}
 
-	/* Notes: equation for orifice plate from
-	 * http://en.wikipedia.org/wiki/Orifice_plate
+	/* Integrate all samples since last call:
+	 * SDADC3 callback sums sqrt(dP) of every sample (flow_block_sqrt_sum()),
+	 * flow is linear in that sum, interval length from samples count.
+	 * Volume accumulated in integer uL with float remainder,
+	 * so small steps are not lost on large total.
 	 */
+	uint32_t n = s->sdadc3.samples - m_last_samples;
+	int64_t sqrt_sum = s->sdadc3.flow_sqrt_sum - m_last_sqrt_sum;
+
+	m_last_samples = s->sdadc3.samples;
+	m_last_sqrt_sum = s->sdadc3.flow_sqrt_sum;
+
+	if (!gp_flow_enable || n == 0) {
+		update_zero_codes();
+		return;
+	}
+
+	/* sum was taken with previous zero, new one used from next block */
+	float k = flow_calc_k_mlsec();
+
+	zero_update(SENSOR_VOLT(s->sdadc3.flt_flow_volt));
+	update_zero_codes();
+	m_flow_mlsec = k * sqrt_sum / n;
 
-	float dP = arduino_map(adc_getflt_flow(), gp_flow_v0, FLOW_MAXV, MP3V5004DP_MINP, MP3V5004DP_MAXP);
-	float Q = m_C * m_A2 * sqrtf(2.0 * dP / gp_flow_ro);
+	float dt = n / adc_get_sample_rate(SG_SDADC3);
+	float used_ul = m_flow_mlsec * 1000.0f * dt + m_used_frac_ul;
+	uint32_t whole_ul = used_ul;
 
-	m_flow_mlsec = Q * 1e6;
+	m_used_ul += whole_ul;
+	m_used_frac_ul = used_ul - whole_ul;
+	m_used_ml = m_used_ul / 1000;
 
-	/* TODO: total fuel used calculation */
+	if (m_used_ul != m_ckpt_used_ul &&
+			chVTTimeElapsedSinceX(m_ckpt_time) >= CHECKPOINT_PERIOD)
+		checkpoint_save();
 }
 
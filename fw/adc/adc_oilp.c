@@ -21,8 +21,10 @@
  */
 
 #include "th_adc.h"
+#include "adc_channel.h"
 #include "ntc.h"
 #include "param_table.h"
+#include "th_rpm.h"
 #include <math.h>
 #include <string.h>
 
@@ -32,6 +34,17 @@ int32_t gp_oilp_r;
 float gp_oilp_sh_a;
 float gp_oilp_sh_b;
 float gp_oilp_sh_c;
+float gp_oilp_shunt;
+float gp_oilp_cal_x1;
+float gp_oilp_cal_p1;
+float gp_oilp_cal_x2;
+float gp_oilp_cal_p2;
+float gp_oilp_cal_x3;
+float gp_oilp_cal_p3;
+float gp_oilp_cal_x4;
+float gp_oilp_cal_p4;
+float gp_oilp_low;
+int32_t gp_oilp_arm_delay;
 
 
 /* -*- module variables -*- */
@@ -39,20 +52,120 @@ float gp_oilp_sh_c;
 #define OILP_AVCC	3.3
 
 static float m_oilp_temp = NAN;	// [C°]
-static void (*m_oilp_handle_func)(void) = NULL;
+static float m_oilp_pressure = NAN;	// [kPa]
+static const struct adc_channel *m_channel;
+static void (*m_oilp_handle_func)(const struct sensor_snapshot *s) = NULL;
+static systime_t m_running_since;
+static volatile bool m_low_armed;	// engine running for OILP_ARM_DELAY
+
+/* NTC table, see adc_temp.c (bad koeffs keep previous table) */
+static struct ntc_table m_ntc_tables[2];
+static const struct ntc_table *m_ntc_table = NULL;
+
+/* Pressure calibration compiled to segments on input voltage:
+ * p = k[i] * V + b[i] for V < v[i + 1], end segments extrapolated.
+ * Swapped like NTC table.
+ */
+#define OILP_CAL_POINTS		4
+#define OILP_CURRENT_MIN	4e-3	// [A]
+#define OILP_CURRENT_SPAN	16e-3	// [A]
+
+struct oilp_cal {
+	size_t size;			//!< segments
+	float v[OILP_CAL_POINTS];	//!< segment start [V]
+	float k[OILP_CAL_POINTS - 1];
+	float b[OILP_CAL_POINTS - 1];
+};
+
+static struct oilp_cal m_cal_tables[2];
+static const struct oilp_cal *m_cal = NULL;
 
 /* -*- handle funcs -*- */
 
-static void oilp_handle_ntc10k(void)
+void on_change_oilp_ntc(const struct param_entry *p ATTR_UNUSED)
+{
+	struct ntc_table *t = (m_ntc_table == &m_ntc_tables[0]) ? &m_ntc_tables[1] : &m_ntc_tables[0];
+	bool ntc_is_r1 = gp_oilp_r == OILP_R__R1;
+
+	if (!ntc_table_build(t, ntc_is_r1, OILP_AVCC, OILP_NTC_R,
+				gp_oilp_sh_a, gp_oilp_sh_b, gp_oilp_sh_c)) {
+		debug_printf(DP_ERROR, "OILP: bad Steinhart-Hart koeffs");
+		if (m_ntc_table != NULL)
+			return;
+
+		ntc_table_build(t, ntc_is_r1, OILP_AVCC, OILP_NTC_R,
+				NTC_SH_A_DEFAULT, NTC_SH_B_DEFAULT, NTC_SH_C_DEFAULT);
+	}
+
+	m_ntc_table = t;
+}
+
+static void oilp_handle_ntc10k(const struct sensor_snapshot *s)
 {
-	float ntc_r;
+	if (m_ntc_table == NULL)
+		on_change_oilp_ntc(NULL);
+
+	m_oilp_temp = ntc_table_lookup(m_ntc_table, SENSOR_VOLT(s->sdadc1.flt_oilp_volt));
+}
 
-	if (gp_oilp_r == OILP_R__R1)
-		ntc_r = ntc_get_R1(adc_getflt_oilp(), OILP_AVCC, OILP_NTC_R);
+/** Calibration input [% of span] to input voltage
+ */
+static float oilp_span_to_volt(float x)
+{
+	if (strcasecmp(gp_oilp_mode, OILP_MODE__Current) == 0)
+		return (OILP_CURRENT_MIN + OILP_CURRENT_SPAN * x / 100.0f) * gp_oilp_shunt;
 	else
-		ntc_r = ntc_get_R2(adc_getflt_oilp(), OILP_AVCC, OILP_NTC_R);
+		return OILP_AVCC * x / 100.0f;
+}
+
+/** Build pressure segments from OILP_CAL_* and OILP_SHUNT
+ */
+void on_change_oilp_cal(const struct param_entry *p ATTR_UNUSED)
+{
+	struct oilp_cal *t = (m_cal == &m_cal_tables[0]) ? &m_cal_tables[1] : &m_cal_tables[0];
+	const float x[OILP_CAL_POINTS] = { gp_oilp_cal_x1, gp_oilp_cal_x2, gp_oilp_cal_x3, gp_oilp_cal_x4 };
+	const float y[OILP_CAL_POINTS] = { gp_oilp_cal_p1, gp_oilp_cal_p2, gp_oilp_cal_p3, gp_oilp_cal_p4 };
+	float v_prev = oilp_span_to_volt(x[0]);
+
+	t->size = 0;
+	t->v[0] = v_prev;
+	for (size_t i = 1, last = 0; i < OILP_CAL_POINTS; i++) {
+		float v = oilp_span_to_volt(x[i]);
 
-	m_oilp_temp = ntc_K_to_C(ntc_get_K(ntc_r, gp_oilp_sh_a, gp_oilp_sh_b, gp_oilp_sh_c));
+		if (x[i] <= x[last])
+			continue;
+
+		t->k[t->size] = (y[i] - y[last]) / (v - v_prev);
+		t->b[t->size] = y[last] - t->k[t->size] * v_prev;
+		t->v[++t->size] = v;
+		v_prev = v;
+		last = i;
+	}
+
+	if (t->size == 0)
+		debug_printf(DP_ERROR, "OILP: need two calibration points");
+
+	m_cal = t;
+}
+
+static void oilp_handle_pressure(const struct sensor_snapshot *s)
+{
+	const struct oilp_cal *t;
+	float volt = SENSOR_VOLT(s->sdadc1.flt_oilp_volt);
+	size_t i;
+
+	if (m_cal == NULL)
+		on_change_oilp_cal(NULL);
+
+	t = m_cal;
+	if (t->size == 0) {
+		m_oilp_pressure = NAN;
+		return;
+	}
+
+	for (i = 0; i < t->size - 1 && volt >= t->v[i + 1]; i++);
+
+	m_oilp_pressure = t->k[i] * volt + t->b[i];
 }
 
 /* -*- global -*- */
@@ -63,12 +176,17 @@ void on_change_oilp_mode(struct param_entry *p)
 	(strcasecmp(gp_oilp_mode, OILP_MODE__ ## mode) == 0)
 
 	m_oilp_temp = NAN;
+	m_oilp_pressure = NAN;
 	if (OILP_MODE_IS(Disabled)) {
 		m_oilp_handle_func = NULL;
 	}
 	else if (OILP_MODE_IS(NTC10k)) {
 		m_oilp_handle_func = oilp_handle_ntc10k;
 	}
+	else if (OILP_MODE_IS(Ratiometric) || OILP_MODE_IS(Current)) {
+		on_change_oilp_cal(NULL);
+		m_oilp_handle_func = oilp_handle_pressure;
+	}
 	else {
 		m_oilp_handle_func = NULL;
 		strcpy(gp_oilp_mode, p->default_value.s);
@@ -79,11 +197,19 @@ void on_change_oilp_mode(struct param_entry *p)
 }
 
 /**
- * Return OILP temp in [mC°] if in NTC mode
+ * OIL_P input in use (OILP_MODE not Disabled)
+ */
+bool oilp_is_enabled(void)
+{
+	return m_oilp_handle_func != NULL;
+}
+
+/**
+ * Return OILP temp in [mC°] if in NTC mode and sensor is healthy
  */
 bool oilp_get_temperature(int32_t *out)
 {
-	if (!isnan(m_oilp_temp)) {
+	if (!isnan(m_oilp_temp) && adc_channel_is_ok(m_channel)) {
 		*out = m_oilp_temp * 1000;
 		return true;
 	}
@@ -92,17 +218,52 @@ bool oilp_get_temperature(int32_t *out)
 }
 
 /**
- * Return engine oil pressure
+ * Return engine oil pressure [Pa] if in pressure mode and sensor is healthy
  */
-bool oilp_get_pressure(int32_t *out ATTR_UNUSED)
+bool oilp_get_pressure(int32_t *out)
 {
-	/* TODO */
-	return false;
+	if (!isnan(m_oilp_pressure) && adc_channel_is_ok(m_channel)) {
+		*out = m_oilp_pressure * 1000;
+		return true;
+	}
+	else
+		return false;
 }
 
-void adc_handle_oilp(void)
+/**
+ * Check oil pressure, armed OILP_ARM_DELAY after engine start
+ * (pressure needs time to build up)
+ * @return true if pressure is LOW
+ */
+bool oilp_check_pressure(void)
+{
+	return m_low_armed
+		&& rpm_is_engine_running()
+		&& !isnan(m_oilp_pressure)
+		&& adc_channel_is_ok(m_channel)
+		&& m_oilp_pressure < gp_oilp_low;
+}
+
+/** Track engine running time for alarm arming
+ */
+static void update_arming(void)
 {
+	if (!rpm_is_engine_running()) {
+		m_running_since = osalOsGetSystemTimeX();
+		m_low_armed = false;
+	}
+	else if (!m_low_armed)
+		m_low_armed = chVTTimeElapsedSinceX(m_running_since) >= MS2ST(gp_oilp_arm_delay);
+}
+
+void adc_handle_oilp(const struct sensor_snapshot *s)
+{
+	if (m_channel == NULL)
+		m_channel = adc_channel_find("OILP");
+
+	update_arming();
+
 	if (m_oilp_handle_func != NULL)
-		m_oilp_handle_func();
+		m_oilp_handle_func(s);
 }
 
@@ -21,6 +21,7 @@
  */
 
 #include "th_adc.h"
+#include "adc_channel.h"
 #include "ntc.h"
 #include "param_table.h"
 
@@ -37,6 +38,15 @@ float gp_temp_sh_c;
 #define TEMP_AVCC	3.3
 
 static float m_temp;	// [C°]
+static const struct adc_channel *m_channel;
+
+/* NTC table built by on_change hook into unused buffer, then swapped.
+ * Reader (ADC thread) has higher priority than parameter writers.
+ * Table of bad koeffs is not swapped in: previous one is kept,
+ * or default koeffs used if there is none.
+ */
+static struct ntc_table m_ntc_tables[2];
+static const struct ntc_table *m_ntc_table = NULL;
 
 
 /**
@@ -49,23 +59,40 @@ int32_t temp_get_temperature(void)
 
 /**
  * Check engine temperature
- * @return true if temperature is HIGH
+ * @return true if temperature is HIGH (faulted sensor ignored)
  */
 bool temp_check_temperature(void)
 {
-	return m_temp > gp_temp_overheat || adc_getflt_int_temp() > 90.0;
+	return (adc_channel_is_ok(m_channel) && m_temp > gp_temp_overheat)
+		|| cpu_check_temperature();
 }
 
-void adc_handle_temperature(void)
+void on_change_temp_ntc(const struct param_entry *p ATTR_UNUSED)
 {
-	float ntc_r;
+	struct ntc_table *t = (m_ntc_table == &m_ntc_tables[0]) ? &m_ntc_tables[1] : &m_ntc_tables[0];
+	bool ntc_is_r1 = gp_temp_r == TEMP_R__R1;
+
+	if (!ntc_table_build(t, ntc_is_r1, TEMP_AVCC, TEMP_NTC_R,
+				gp_temp_sh_a, gp_temp_sh_b, gp_temp_sh_c)) {
+		debug_printf(DP_ERROR, "TEMP: bad Steinhart-Hart koeffs");
+		if (m_ntc_table != NULL)
+			return;
+
+		ntc_table_build(t, ntc_is_r1, TEMP_AVCC, TEMP_NTC_R,
+				NTC_SH_A_DEFAULT, NTC_SH_B_DEFAULT, NTC_SH_C_DEFAULT);
+	}
 
-	if (gp_temp_r == TEMP_R__R1)
-		ntc_r = ntc_get_R1(adc_getflt_temp(), TEMP_AVCC, TEMP_NTC_R);
-	else
-		ntc_r = ntc_get_R2(adc_getflt_temp(), TEMP_AVCC, TEMP_NTC_R);
+	m_ntc_table = t;
+}
+
+void adc_handle_temperature(const struct sensor_snapshot *s)
+{
+	if (m_ntc_table == NULL)
+		on_change_temp_ntc(NULL);
+	if (m_channel == NULL)
+		m_channel = adc_channel_find("TEMP");
 
-	m_temp = ntc_K_to_C(ntc_get_K(ntc_r, gp_temp_sh_a, gp_temp_sh_b, gp_temp_sh_c));
+	m_temp = ntc_table_lookup(m_ntc_table, SENSOR_VOLT(s->sdadc1.flt_temp_volt));
 
 	/* TODO: send event to Log */
 }
@@ -22,53 +22,166 @@
 
 #include "alert_led.h"
 #include "th_adc.h"
+#include "adc_channel.h"
+#include "sensors.h"
+#include "cpu_load.h"
+#include "log/capture.h"
+#include "hw/ectl_pads.h"
 #include "param.h"
 #include "lib/lowpassfilter2p.h"
+#include <math.h>
+#include <string.h>
 
 #ifndef BOARD_MINIECU_V2
 # error "unsupported board"
 #endif
 
+/* Sequences in one DMA block (half of circular buffer).
+ * Handlers called on half/full transfer, so interrupt rate is
+ * sample rate / ADC_BLOCK_DEPTH.
+ */
+#define ADC_BLOCK_DEPTH	128
+
 /* Enables toggling pads in adc handlers:
  * ADC1: PC13
  * SDADC1: PA1
  * SDADC3: PA2
+ *
+ * Not available if XP2 pads used as analog inputs.
  */
-#define DEBUG_ADC_FREQ	TRUE
+#if !ADC_XP2_INPUTS
+# define DEBUG_ADC_FREQ	TRUE
+#else
+# define DEBUG_ADC_FREQ	FALSE
+#endif
+
+/* ADC1 sequence: internal temp, Vrtc [, XP2 PA1, XP2 PA2] */
+#if ADC_XP2_INPUTS
+# define ADC1_CHANNELS	4
+#else
+# define ADC1_CHANNELS	2
+#endif
 
 /* -*- parameters -*- */
 // None
 
 
 /* -*- private data -*- */
-// ADC sample buffers
-static adcsample_t p_int_temp_vrtc_samples[2];
-static adcsample_t p_temp_oilp_vbat_samples[3];
-static adcsample_t p_flow_samples[1];
-
-// raw values
-static float r_int_temp;	// [C°]
-static float r_vrtc;		// [V]
-static float r_temp_volt;	// [V] before conversion to temp
-static float r_oilp_volt;	// [V] raw voltage on OIL_P
-static float r_vbat;		// [V] on ADC input (VD1 drop added later)
-static float r_flow_volt;	// [V] before conversion to FLOW
-
-// filtered values
-static float f_int_temp;
-static float f_vrtc;
-static float f_temp_volt;
-static float f_oilp_volt;
-static float f_vbat;
-static float f_flow_volt;
+// ADC sample buffers (double buffered blocks)
+static adcsample_t p_int_temp_vrtc_samples[ADC1_CHANNELS * 2 * ADC_BLOCK_DEPTH];
+static adcsample_t p_temp_oilp_vbat_samples[3 * 2 * ADC_BLOCK_DEPTH];
+static adcsample_t p_flow_samples[1 * 2 * ADC_BLOCK_DEPTH];
 
 // filters
-static LowPassFilter2p fo_int_temp;
-static LowPassFilter2p fo_vrtc;
-static LowPassFilter2p fo_temp_volt;
-static LowPassFilter2p fo_oilp_volt;
-static LowPassFilter2p fo_vbat;
-static LowPassFilter2p fo_flow_volt;
+#if ADC_FIXED_POINT
+typedef LowPassFilter2pQ adc_filter_t;
+# define adc_filter_init		lpf2pqObjectInit
+# define adc_filter_set_cutoff		lpf2pqSetCutoffFrequency
+# define adc_filter_copy_coefficients	lpf2pqCopyCoefficients
+#else
+typedef LowPassFilter2p adc_filter_t;
+# define adc_filter_init		lpf2pObjectInit
+# define adc_filter_set_cutoff		lpf2pSetCutoffFrequency
+# define adc_filter_copy_coefficients	lpf2pCopyCoefficients
+#endif
+
+static adc_filter_t fo_int_temp;
+static adc_filter_t fo_vrtc;
+static adc_filter_t fo_temp_volt;
+static adc_filter_t fo_oilp_volt;
+static adc_filter_t fo_vbat;
+static adc_filter_t fo_flow_volt;
+#if ADC_XP2_INPUTS
+static adc_filter_t fo_xp2_pa1;
+static adc_filter_t fo_xp2_pa2;
+#endif
+
+#if !ADC_FIXED_POINT
+#if ADC_XP2_INPUTS
+static LowPassFilter2p *const fo_adc1[] = { &fo_int_temp, &fo_vrtc, &fo_xp2_pa1, &fo_xp2_pa2 };
+#else
+static LowPassFilter2p *const fo_adc1[] = { &fo_int_temp, &fo_vrtc };
+#endif
+static LowPassFilter2p *const fo_sdadc1[] = { &fo_vbat, &fo_oilp_volt, &fo_temp_volt };
+
+// converted block buffers (filtered in place)
+static float p_adc1_block[ADC1_CHANNELS * ADC_BLOCK_DEPTH];
+static float p_sdadc1_block[3 * ADC_BLOCK_DEPTH];
+static float p_sdadc3_block[1 * ADC_BLOCK_DEPTH];
+#endif
+
+// handler cost, CPU cycles per sequence (last block)
+static uint32_t m_sample_cost[SG_SDADC3 + 1];
+
+/* Sample rates [Hz]: initially nominal (see measurements in th_adc()),
+ * then measured by counting samples against realtime counter.
+ */
+static float m_sample_rate[SG_SDADC3 + 1] = { 17780.0f * 2 / ADC1_CHANNELS, 5560.0f, 16680.0f };
+static float m_design_rate[SG_SDADC3 + 1];	// rate used for filter design
+
+// handler call (interrupt) and sample counters
+static volatile uint32_t m_irq_count[SG_SDADC3 + 1];
+static volatile uint32_t m_sample_count[SG_SDADC3 + 1];
+
+//! Rate measurement window
+#define RATE_MEASURE_PERIOD_MS	1000
+//! Redesign filters if rate differs more than 1 %
+#define RATE_REDESIGN_THRESHOLD	0.01f
+
+/* filter definitions, cutoff defined by sensor channels */
+static const struct adc_filter_def {
+	adc_filter_t *filter;
+	enum sensor_group group;
+	enum adc_input input;
+} m_filter_defs[] = {
+	/* SAR ADC1 */
+	{ &fo_int_temp, SG_ADC1, AI_INT_TEMP },
+	{ &fo_vrtc, SG_ADC1, AI_VRTC },
+#if ADC_XP2_INPUTS
+	{ &fo_xp2_pa1, SG_ADC1, AI_XP2_PA1 },
+	{ &fo_xp2_pa2, SG_ADC1, AI_XP2_PA2 },
+#endif
+	/* SD ADC1 */
+	{ &fo_temp_volt, SG_SDADC1, AI_TEMP },
+	{ &fo_oilp_volt, SG_SDADC1, AI_OILP },
+	{ &fo_vbat, SG_SDADC1, AI_VBAT },
+	/* SD ADC3 */
+	{ &fo_flow_volt, SG_SDADC3, AI_FLOW },
+};
+
+/* ADC1 burst scheduler
+ *
+ * CPU temperature and VRTC change in minutes, so ADC1 is not sampled
+ * continuously. Each burst converts ADC1_BURST_BLOCKS blocks (first block
+ * settles filters), period is the shortest period of channels using
+ * ADC1 inputs. VBAT bridge (VBATE) is enabled only for VRTC bursts
+ * once per VRTC_PERIOD_MS, those are longer to settle VRTC filter
+ * and VRTC published only from last block.
+ */
+#define ADC1_BURST_BLOCKS	2
+#define ADC1_VRTC_BURST_BLOCKS	4
+#define VRTC_PERIOD_MS		10000
+//! Approximate VBAT bridge resistance [Ohm], for current saved estimate
+#define VBAT_BRIDGE_R		50000.0f
+
+static volatile uint32_t m_adc1_blocks;	// blocks left in current burst
+static bool m_adc1_active;		// burst started by thread
+static bool m_adc1_vrtc;		// VRTC burst (VBATE enabled)
+static systime_t m_adc1_last_burst;
+static systime_t m_vrtc_last_burst;
+static rtcnt_t m_adc1_burst_start;
+static volatile rtcnt_t m_adc1_burst_end;
+static uint32_t m_adc1_burst_count;	// samples counter on burst start
+static sensor_volt_t m_raw_vrtc, m_flt_vrtc;	// last VRTC burst values
+
+/* scheduler statistics, CPU cycles since start */
+static uint64_t m_sched_elapsed;
+static uint64_t m_adc1_active_cycles;
+static uint64_t m_vbate_cycles;
+
+// flow integration sums (SDADC3 handler only)
+static int64_t m_flow_sqrt_sum;		// see flow_block_sqrt_sum()
+static uint32_t m_flow_samples;
 
 // thread
 static THD_WORKING_AREA(wa_adc, ADC_WASZ);
@@ -76,12 +189,49 @@ static THD_WORKING_AREA(wa_adc, ADC_WASZ);
 
 /* -*- conversion functions -*- */
 
-#define ADC_VREF	3.3
-#define SDADC_VREF	3.3
-#define SDADC_GAIN	1
+#if ADC_FIXED_POINT
+/* Fixed point build: filters run on sample counts (scaled by 2^LPF2PQ_SHIFT),
+ * conversion is linear, so it applied once per block to filtered value.
+ */
+#define ADC_VREF	3300000		/* [uV] */
+#define SDADC_VREF	3300000		/* [uV] */
+/* given in DM00046749.pdf table 66. */
+#define TEMP_V25	1430000		/* [uV] */
+#define TEMP_AVG_SLOPE	4300		/* [uV/C°] */
+
+/** convert scaled counts to voltage [uV] (ADC)
+ */
+static int32_t adc_to_voltage(int32_t y)
+{
+	return (int64_t)y * ADC_VREF / (((1 << 12) - 1) << LPF2PQ_SHIFT);
+}
+
+/** convert scaled counts to temperature [mC°]
+ */
+static int32_t adc_to_int_temp(int32_t y)
+{
+	int32_t temp_voltage = adc_to_voltage(y);
+	return (TEMP_V25 - temp_voltage) * 1000 / TEMP_AVG_SLOPE + 25000;
+}
+
+/** convert scaled counts to voltage [uV] (SDADC in SE Zero)
+ * @note see @a DM0007480.pdf Application Note
+ */
+static int32_t sdadc_sez_to_voltage(int32_t y)
+{
+	return ((int64_t)y + (32767 << LPF2PQ_SHIFT)) * SDADC_VREF
+		/ ((int64_t)SDADC_GAIN * 65535 << LPF2PQ_SHIFT);
+}
+
+#define SAMPLE(x)	((int32_t)(int16_t)(x) << LPF2PQ_SHIFT)
+
+#else /* !ADC_FIXED_POINT */
+
+#define ADC_VREF	3.3f
+#define SDADC_VREF	3.3f
 /* given in DM00046749.pdf table 66. */
-#define TEMP_V25	1.43	/* [V] */
-#define TEMP_AVG_SLOPE	4.3	/* [mV/C°] */
+#define TEMP_V25	1.43f	/* [V] */
+#define TEMP_AVG_SLOPE	4.3f	/* [mV/C°] */
 
 /** convert sample to voltage (ADC)
  */
@@ -93,7 +243,7 @@ static float adc_to_voltage(adcsample_t adc)
 static float adc_to_int_temp(adcsample_t adc)
 {
 	float temp_voltage = adc_to_voltage(adc);
-	return (TEMP_V25 - temp_voltage) * 1000. / TEMP_AVG_SLOPE + 25.;
+	return (TEMP_V25 - temp_voltage) * 1000.0f / TEMP_AVG_SLOPE + 25.0f;
 }
 
 /** convert sample to voltage (SDADC in SE Zero)
@@ -104,50 +254,292 @@ static float sdadc_sez_to_voltage(adcsample_t adc)
 	return (((int16_t) adc) + 32767) * SDADC_VREF / (SDADC_GAIN * 65535);
 }
 
+#endif /* ADC_FIXED_POINT */
+
+
+/** Add block of SDADC samples to sensor statistics
+ *
+ * Only integer sums of counts (called from ISR), conversion
+ * to volts is set by sdadc_stats_init(), done by stats reader.
+ */
+static void sdadc_block_stats(enum sensor_stat id, const adcsample_t *buffer,
+		size_t n, size_t stride)
+{
+	const int16_t *blk = (const int16_t *) buffer;
+	struct sensor_count_stats cs = {
+		.n = n,
+		.min = INT16_MAX,
+		.max = INT16_MIN
+	};
+
+	for (size_t i = 0; i < n * stride; i += stride) {
+		int32_t x = blk[i];
+
+		cs.sum += x;
+		cs.sumsq += x * x;
+		if (x < cs.min)	cs.min = x;
+		if (x > cs.max)	cs.max = x;
+	}
+
+	sensors_stats_add_counts(id, &cs);
+}
+
+/** Counts to volts for SDADC statistics (SE Zero)
+ */
+static void sdadc_stats_init(void)
+{
+	sensors_stats_set_count_scale(SS_VBAT, 32767, 3.0f * SDADC_COUNT_VOLT);	// input divider
+	sensors_stats_set_count_scale(SS_OILP, 32767, SDADC_COUNT_VOLT);
+	sensors_stats_set_count_scale(SS_TEMP, 32767, SDADC_COUNT_VOLT);
+	sensors_stats_set_count_scale(SS_FLOW, 32767, SDADC_COUNT_VOLT);
+}
+
 /* -*- callback functions -*- */
 
+static void block_done(enum sensor_group group, rtcnt_t start, size_t n)
+{
+	m_irq_count[group]++;
+	m_sample_count[group] += n;
+	static const enum cpu_load_isr isr[SG_SDADC3 + 1] = {
+		[SG_ADC1] = CLI_ADC1,
+		[SG_SDADC1] = CLI_SDADC1,
+		[SG_SDADC3] = CLI_SDADC3,
+	};
+
+	m_sample_cost[group] = (chSysGetRealtimeCounterX() - start) / n;
+	cpu_load_isr_account(isr[group], start);
+}
+
+/** ADC1 burst block (ISR)
+ *
+ * VRTC replaced by last VRTC burst values, conversion stopped
+ * on the last block of burst.
+ */
+static void adc1_burst_block(struct sensor_adc1 *s)
+{
+	if (m_adc1_vrtc && m_adc1_blocks == 1) {
+		m_raw_vrtc = s->raw_vrtc;
+		m_flt_vrtc = s->flt_vrtc;
+	}
+	else {
+		s->raw_vrtc = m_raw_vrtc;
+		s->flt_vrtc = m_flt_vrtc;
+	}
+
+	if (m_adc1_blocks > 0 && --m_adc1_blocks == 0) {
+		m_adc1_burst_end = chSysGetRealtimeCounterX();
+
+		chSysLockFromISR();
+		adcStopConversionI(&ADCD1);
+		chSysUnlockFromISR();
+	}
+}
+
+/* Block handlers: buffer holds n sequences (half of DMA buffer),
+ * published values are the last in block.
+ *
+ * Fixed point: each channel filtered by lpf2pqApplyBlock() on samples,
+ * then converted. No FPU use in ISR.
+ *
+ * Float: whole block converted, then filtered by lpf2pApplyInterleaved().
+ */
+
+#if ADC_FIXED_POINT
+
 static void adc_int_temp_vrtc_cb(ADCDriver *adcp ATTR_UNUSED,
-		adcsample_t *buffer, size_t n ATTR_UNUSED)
+		adcsample_t *buffer, size_t n)
 {
-	r_int_temp = adc_to_int_temp(buffer[0]);
-	r_vrtc = 2 * adc_to_voltage(buffer[1]);
+	rtcnt_t start = chSysGetRealtimeCounterX();
+	const int16_t *blk = (const int16_t *) buffer;
+	const adcsample_t *last = buffer + ADC1_CHANNELS * (n - 1);
+	struct sensor_adc1 s;
+
+	s.raw_int_temp = adc_to_int_temp(SAMPLE(last[0]));
+	s.raw_vrtc = 2 * adc_to_voltage(SAMPLE(last[1]));
+
+	s.flt_int_temp = adc_to_int_temp(lpf2pqApplyBlock(&fo_int_temp, blk + 0, n, ADC1_CHANNELS));
+	s.flt_vrtc = 2 * adc_to_voltage(lpf2pqApplyBlock(&fo_vrtc, blk + 1, n, ADC1_CHANNELS));
+
+#if ADC_XP2_INPUTS
+	s.raw_xp2_pa1 = adc_to_voltage(SAMPLE(last[2]));
+	s.raw_xp2_pa2 = adc_to_voltage(SAMPLE(last[3]));
+	s.flt_xp2_pa1 = adc_to_voltage(lpf2pqApplyBlock(&fo_xp2_pa1, blk + 2, n, ADC1_CHANNELS));
+	s.flt_xp2_pa2 = adc_to_voltage(lpf2pqApplyBlock(&fo_xp2_pa2, blk + 3, n, ADC1_CHANNELS));
+#endif
 
-	f_int_temp = lpf2pApply(&fo_int_temp, r_int_temp);
-	f_vrtc = lpf2pApply(&fo_vrtc, r_vrtc);
+	adc1_burst_block(&s);
+	sensors_publish(SG_ADC1, &s);
 
 #if DEBUG_ADC_FREQ
 	palTogglePad(GPIOC, GPIOC_XP2_PC13);
 #endif
+	block_done(SG_ADC1, start, n);
 }
 
 static void adc_temp_oilp_vbat_cb(ADCDriver *adcp ATTR_UNUSED,
-		adcsample_t *buffer, size_t n ATTR_UNUSED)
+		adcsample_t *buffer, size_t n)
 {
-	r_vbat = 3 * sdadc_sez_to_voltage(buffer[0]);	// AIN4P
-	r_oilp_volt = sdadc_sez_to_voltage(buffer[1]);	// AIN5P
-	r_temp_volt = sdadc_sez_to_voltage(buffer[2]);	// AIN6P
+	rtcnt_t start = chSysGetRealtimeCounterX();
+	const int16_t *blk = (const int16_t *) buffer;
+	const adcsample_t *last = buffer + 3 * (n - 1);
+	struct sensor_sdadc1 s;
+
+	s.raw_vbat = 3 * sdadc_sez_to_voltage(SAMPLE(last[0]));	// AIN4P
+	s.raw_oilp_volt = sdadc_sez_to_voltage(SAMPLE(last[1]));	// AIN5P
+	s.raw_temp_volt = sdadc_sez_to_voltage(SAMPLE(last[2]));	// AIN6P
 
-	f_vbat = lpf2pApply(&fo_vbat, r_vbat);
-	f_oilp_volt = lpf2pApply(&fo_oilp_volt, r_oilp_volt);
-	f_temp_volt = lpf2pApply(&fo_temp_volt, r_temp_volt);
+	s.flt_vbat = 3 * sdadc_sez_to_voltage(lpf2pqApplyBlock(&fo_vbat, blk + 0, n, 3));
+	s.flt_oilp_volt = sdadc_sez_to_voltage(lpf2pqApplyBlock(&fo_oilp_volt, blk + 1, n, 3));
+	s.flt_temp_volt = sdadc_sez_to_voltage(lpf2pqApplyBlock(&fo_temp_volt, blk + 2, n, 3));
+
+	capture_sdadc1_block(buffer, n);
+	sdadc_block_stats(SS_VBAT, buffer + 0, n, 3);
+	sdadc_block_stats(SS_OILP, buffer + 1, n, 3);
+	sdadc_block_stats(SS_TEMP, buffer + 2, n, 3);
+	sensors_publish(SG_SDADC1, &s);
 
 #if DEBUG_ADC_FREQ
 	palTogglePad(GPIOA, GPIOA_XP2_PA1);
 #endif
+	block_done(SG_SDADC1, start, n);
 }
 
 static void adc_flow_cb(ADCDriver *adcp ATTR_UNUSED,
-		adcsample_t *buffer, size_t n ATTR_UNUSED)
+		adcsample_t *buffer, size_t n)
 {
-	r_flow_volt = sdadc_sez_to_voltage(buffer[0]);	// AIN6P
+	rtcnt_t start = chSysGetRealtimeCounterX();
+	const int16_t *blk = (const int16_t *) buffer;
+	struct sensor_sdadc3 s;
+
+	m_flow_sqrt_sum += flow_block_sqrt_sum(blk, n);
+	m_flow_samples += n;
+	s.flow_sqrt_sum = m_flow_sqrt_sum;
+	s.samples = m_flow_samples;
+
+	s.raw_flow_volt = sdadc_sez_to_voltage(SAMPLE(buffer[n - 1]));	// AIN6P
 
-	f_flow_volt = lpf2pApply(&fo_flow_volt, r_flow_volt);
+	s.flt_flow_volt = sdadc_sez_to_voltage(lpf2pqApplyBlock(&fo_flow_volt, blk, n, 1));
+
+	sdadc_block_stats(SS_FLOW, buffer, n, 1);
+	sensors_publish(SG_SDADC3, &s);
 
 #if DEBUG_ADC_FREQ
 	palTogglePad(GPIOA, GPIOA_XP2_PA2);
 #endif
+	block_done(SG_SDADC3, start, n);
 }
 
+#else /* !ADC_FIXED_POINT */
+
+static void adc_int_temp_vrtc_cb(ADCDriver *adcp ATTR_UNUSED,
+		adcsample_t *buffer, size_t n)
+{
+	rtcnt_t start = chSysGetRealtimeCounterX();
+	struct sensor_adc1 s;
+	float *blk = p_adc1_block;
+	size_t i;
+
+	for (i = 0; i < ADC1_CHANNELS * n; i += ADC1_CHANNELS) {
+		blk[i + 0] = adc_to_int_temp(buffer[i + 0]);
+		blk[i + 1] = 2 * adc_to_voltage(buffer[i + 1]);
+#if ADC_XP2_INPUTS
+		blk[i + 2] = adc_to_voltage(buffer[i + 2]);
+		blk[i + 3] = adc_to_voltage(buffer[i + 3]);
+#endif
+	}
+
+	i -= ADC1_CHANNELS;	// last sequence
+	s.raw_int_temp = blk[i + 0];
+	s.raw_vrtc = blk[i + 1];
+#if ADC_XP2_INPUTS
+	s.raw_xp2_pa1 = blk[i + 2];
+	s.raw_xp2_pa2 = blk[i + 3];
+#endif
+
+	lpf2pApplyInterleaved(fo_adc1, blk, ADC1_CHANNELS, n);
+	s.flt_int_temp = blk[i + 0];
+	s.flt_vrtc = blk[i + 1];
+#if ADC_XP2_INPUTS
+	s.flt_xp2_pa1 = blk[i + 2];
+	s.flt_xp2_pa2 = blk[i + 3];
+#endif
+
+	adc1_burst_block(&s);
+	sensors_publish(SG_ADC1, &s);
+
+#if DEBUG_ADC_FREQ
+	palTogglePad(GPIOC, GPIOC_XP2_PC13);
+#endif
+	block_done(SG_ADC1, start, n);
+}
+
+static void adc_temp_oilp_vbat_cb(ADCDriver *adcp ATTR_UNUSED,
+		adcsample_t *buffer, size_t n)
+{
+	rtcnt_t start = chSysGetRealtimeCounterX();
+	struct sensor_sdadc1 s;
+	float *blk = p_sdadc1_block;
+	size_t i;
+
+	for (i = 0; i < 3 * n; i += 3) {
+		blk[i + 0] = 3 * sdadc_sez_to_voltage(buffer[i + 0]);	// AIN4P
+		blk[i + 1] = sdadc_sez_to_voltage(buffer[i + 1]);	// AIN5P
+		blk[i + 2] = sdadc_sez_to_voltage(buffer[i + 2]);	// AIN6P
+	}
+
+	s.raw_vbat = blk[i - 3];
+	s.raw_oilp_volt = blk[i - 2];
+	s.raw_temp_volt = blk[i - 1];
+
+	lpf2pApplyInterleaved(fo_sdadc1, blk, 3, n);
+	s.flt_vbat = blk[i - 3];
+	s.flt_oilp_volt = blk[i - 2];
+	s.flt_temp_volt = blk[i - 1];
+
+	capture_sdadc1_block(buffer, n);
+	sdadc_block_stats(SS_VBAT, buffer + 0, n, 3);
+	sdadc_block_stats(SS_OILP, buffer + 1, n, 3);
+	sdadc_block_stats(SS_TEMP, buffer + 2, n, 3);
+	sensors_publish(SG_SDADC1, &s);
+
+#if DEBUG_ADC_FREQ
+	palTogglePad(GPIOA, GPIOA_XP2_PA1);
+#endif
+	block_done(SG_SDADC1, start, n);
+}
+
+static void adc_flow_cb(ADCDriver *adcp ATTR_UNUSED,
+		adcsample_t *buffer, size_t n)
+{
+	rtcnt_t start = chSysGetRealtimeCounterX();
+	struct sensor_sdadc3 s;
+	float *blk = p_sdadc3_block;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		blk[i] = sdadc_sez_to_voltage(buffer[i]);	// AIN6P
+
+	m_flow_sqrt_sum += flow_block_sqrt_sum((const int16_t *)buffer, n);
+	m_flow_samples += n;
+	s.flow_sqrt_sum = m_flow_sqrt_sum;
+	s.samples = m_flow_samples;
+
+	s.raw_flow_volt = blk[n - 1];
+
+	lpf2pApplyBlock(&fo_flow_volt, blk, n);
+	s.flt_flow_volt = blk[n - 1];
+
+	sdadc_block_stats(SS_FLOW, buffer, n, 1);
+	sensors_publish(SG_SDADC3, &s);
+
+#if DEBUG_ADC_FREQ
+	palTogglePad(GPIOA, GPIOA_XP2_PA2);
+#endif
+	block_done(SG_SDADC3, start, n);
+}
+
+#endif /* ADC_FIXED_POINT */
+
 static void adc_error_cb(ADCDriver *adcd ATTR_UNUSED, adcerror_t err ATTR_UNUSED)
 {
 	alert_component(ALS_ADC, AL_FAIL);
@@ -156,10 +548,10 @@ static void adc_error_cb(ADCDriver *adcd ATTR_UNUSED, adcerror_t err ATTR_UNUSED
 
 /* -*- configuration -*- */
 
-/* internal chip temperature, V rtc config */
+/* internal chip temperature, V rtc [, XP2 PA1 (IN1), PA2 (IN2)] config */
 static const ADCConversionGroup adc1group = {
 	.circular = TRUE,
-	.num_channels = 2,
+	.num_channels = ADC1_CHANNELS,
 	.end_cb = adc_int_temp_vrtc_cb,
 	.error_cb = adc_error_cb,
 	.u.adc = {
@@ -170,13 +562,22 @@ static const ADCConversionGroup adc1group = {
 		.smpr = {
 			ADC_SMPR1_SMP_SENSOR(ADC_SAMPLE_239P5) |
 				ADC_SMPR1_SMP_VBAT(ADC_SAMPLE_239P5),
+#if ADC_XP2_INPUTS
+			ADC_SMPR2_SMP_AN1(ADC_SAMPLE_239P5) |
+				ADC_SMPR2_SMP_AN2(ADC_SAMPLE_239P5)
+#else
 			0
+#endif
 		},
 		.sqr = {
 			0,
 			0,
 			ADC_SQR3_SQ1_N(ADC_CHANNEL_SENSOR) |
 				ADC_SQR3_SQ2_N(ADC_CHANNEL_VBAT) |
+#if ADC_XP2_INPUTS
+				ADC_SQR3_SQ3_N(ADC_CHANNEL_IN1) |
+				ADC_SQR3_SQ4_N(ADC_CHANNEL_IN2) |
+#endif
 				0
 		}
 	}
@@ -235,32 +636,159 @@ static const ADCConversionGroup sdadc3group = {
 	}
 };
 
-/* -*- low-level getters -*- */
+/* -*- sample rate measurement -*- */
+
+/** Design filters of group for current sample rate
+ *
+ * Coefficients calculated in thread and copied with ISRs locked
+ * (with enable flag / cutoff, else filter stays pass-through),
+ * filter state is kept.
+ */
+static void design_filters(enum sensor_group group)
+{
+	float rate = m_sample_rate[group];
+
+	for (size_t i = 0; i < ARRAY_SIZE(m_filter_defs); i++) {
+		const struct adc_filter_def *def = &m_filter_defs[i];
+		adc_filter_t tmp;
+
+		if (def->group != group)
+			continue;
 
-#define MAKE_GETTER(name, var)			\
-	float adc_getflt_ ## name (void) {	\
-		return f_ ## var;		\
-	}					\
-	float adc_getraw_ ## name (void) {	\
-		return r_ ## var;		\
+		adc_filter_init(&tmp);
+		adc_filter_set_cutoff(&tmp, rate, adc_channel_get_cutoff(def->input));
+
+		chSysLock();
+		adc_filter_copy_coefficients(def->filter, &tmp);
+		chSysUnlock();
 	}
 
-MAKE_GETTER(temp, temp_volt);
-MAKE_GETTER(oilp, oilp_volt);
-MAKE_GETTER(flow, flow_volt);
-MAKE_GETTER(vbat, vbat);
-MAKE_GETTER(vrtc, vrtc);
-MAKE_GETTER(int_temp, int_temp);
+	m_design_rate[group] = rate;
+}
 
-#undef MAKE_GETTER
+/** Set measured rate, redesign filters if changed
+ */
+static void update_rate(enum sensor_group group, float rate)
+{
+	m_sample_rate[group] = rate;
+	if (fabsf(rate - m_design_rate[group]) > m_design_rate[group] * RATE_REDESIGN_THRESHOLD)
+		design_filters(group);
+}
 
-/* -*- module thread -*- */
+/** Estimate sample rates, redesign filters on change
+ *
+ * Called from ADC thread loop, measures once per RATE_MEASURE_PERIOD_MS.
+ */
+static void measure_rates(void)
+{
+	static rtcnt_t last_time;
+	static uint32_t last_count[SG_SDADC3 + 1];
+	static bool started = false;
+	rtcnt_t now = chSysGetRealtimeCounterX();
+	uint32_t count[SG_SDADC3 + 1];
+	size_t g;
+
+	if (started && now - last_time < STM32_SYSCLK / 1000 * RATE_MEASURE_PERIOD_MS)
+		return;
+
+	for (g = 0; g <= SG_SDADC3; g++)
+		count[g] = m_sample_count[g];
+
+	if (started) {
+		float dt = (float)(now - last_time) / STM32_SYSCLK;
+
+		/* ADC1 measured by burst scheduler */
+		for (g = SG_SDADC1; g <= SG_SDADC3; g++) {
+			uint32_t n = count[g] - last_count[g];
+			if (n == 0)
+				continue;	// stalled, keep last estimate
+
+			update_rate(g, n / dt);
+		}
+	}
+
+	started = true;
+	last_time = now;
+	memcpy(last_count, count, sizeof(last_count));
+}
+
+/* -*- ADC1 burst scheduler -*- */
+
+/** Finish completed burst: disable internal channels, measure in-burst rate
+ */
+static void adc1_burst_finish(void)
+{
+	rtcnt_t now = chSysGetRealtimeCounterX();
+	rtcnt_t active = m_adc1_burst_end - m_adc1_burst_start;
+
+	adcSTM32DisableTSVREFE();
+	if (m_adc1_vrtc) {
+		adcSTM32DisableVBATE();
+		m_vbate_cycles += now - m_adc1_burst_start;
+	}
+
+	m_adc1_active_cycles += active;
+	if (active > 0)
+		update_rate(SG_ADC1, (float)(m_sample_count[SG_ADC1] - m_adc1_burst_count)
+				* STM32_SYSCLK / active);
 
-void adc_handle_battery(void);
-void adc_handle_temperature(void);
-void adc_handle_oilp(void);
-void adc_handle_flow(void);
+	m_adc1_active = false;
+}
+
+static void adc1_burst_start(bool vrtc)
+{
+	systime_t now = osalOsGetSystemTimeX();
+
+	adcSTM32EnableTSVREFE();
+	if (vrtc) {
+		adcSTM32EnableVBATE();
+		m_vrtc_last_burst = now;
+	}
+
+	m_adc1_vrtc = vrtc;
+	m_adc1_blocks = (vrtc) ? ADC1_VRTC_BURST_BLOCKS : ADC1_BURST_BLOCKS;
+	m_adc1_burst_count = m_sample_count[SG_ADC1];
+	m_adc1_burst_start = chSysGetRealtimeCounterX();
+	m_adc1_last_burst = now;
+	m_adc1_active = true;
+
+	adcStartConversion(&ADCD1, &adc1group, p_int_temp_vrtc_samples, 2 * ADC_BLOCK_DEPTH);
+}
+
+/** Start ADC1 burst when due, called every thread tick
+ */
+static void adc1_schedule(void)
+{
+	static rtcnt_t last_tick;
+	static bool started = false;
+	rtcnt_t tick = chSysGetRealtimeCounterX();
+	uint32_t period;
+
+	if (started)
+		m_sched_elapsed += tick - last_tick;
+	last_tick = tick;
+
+	if (m_adc1_active) {
+		if (m_adc1_blocks > 0)
+			return;		// burst in progress
 
+		adc1_burst_finish();
+	}
+
+	period = adc_channel_get_period(AI_MASK(AI_INT_TEMP) | AI_MASK(AI_VRTC)
+			| AI_MASK(AI_XP2_PA1) | AI_MASK(AI_XP2_PA2));
+	if (period > VRTC_PERIOD_MS)
+		period = VRTC_PERIOD_MS;
+
+	if (!started || chVTTimeElapsedSinceX(m_vrtc_last_burst) >= MS2ST(VRTC_PERIOD_MS))
+		adc1_burst_start(true);
+	else if (chVTTimeElapsedSinceX(m_adc1_last_burst) >= MS2ST(period))
+		adc1_burst_start(false);
+
+	started = true;
+}
+
+/* -*- module thread -*- */
 
 static THD_FUNCTION(th_adc, arg ATTR_UNUSED)
 {
@@ -272,16 +800,16 @@ static THD_FUNCTION(th_adc, arg ATTR_UNUSED)
 	palSetPadMode(GPIOA, GPIOA_XP2_PA2, PAL_MODE_OUTPUT_PUSHPULL);
 	palSetPadMode(GPIOC, GPIOC_XP2_PC13, PAL_MODE_OUTPUT_PUSHPULL);
 #endif
+#if ADC_XP2_INPUTS
+	palSetPadMode(GPIOA, GPIOA_XP2_PA1, PAL_MODE_INPUT_ANALOG);
+	palSetPadMode(GPIOA, GPIOA_XP2_PA2, PAL_MODE_INPUT_ANALOG);
+#endif
 
 	/* Init low pass filters */
-	lpf2pObjectInit(&fo_int_temp);
-	lpf2pObjectInit(&fo_vrtc);
-	lpf2pObjectInit(&fo_temp_volt);
-	lpf2pObjectInit(&fo_oilp_volt);
-	lpf2pObjectInit(&fo_vbat);
-	lpf2pObjectInit(&fo_flow_volt);
-
-	/* Experimental freq's:
+	for (size_t i = 0; i < ARRAY_SIZE(m_filter_defs); i++)
+		adc_filter_init(m_filter_defs[i].filter);
+
+	/* Experimental freq's (with depth 1, pads toggled on each sample):
 	 * PC13:	8.935 kHz	111 uS
 	 * PA1:		2.78 kHz	350 uS
 	 * PA2:		8.34 kHz	120 uS
@@ -291,23 +819,20 @@ static THD_FUNCTION(th_adc, arg ATTR_UNUSED)
 	 * ADC1:	17.78 kHz	2 * 17.1 us => 29.24 kHz
 	 * SDADC1:	5.56 kHz	16600 / 3 => 5.5(3) kHz
 	 * SDADC3:	16.68 kHz	16600 / 1 => 16.6 kHz
+	 *
+	 * With ADC_BLOCK_DEPTH 128 handlers run at ~139 Hz, ~43 Hz and ~130 Hz.
+	 *
+	 * These are start values only, real rates measured by measure_rates().
 	 */
-
-	/* SAR ADC1 */
-	lpf2pSetCutoffFrequency(&fo_int_temp, 17780.0, 50.0);
-	lpf2pSetCutoffFrequency(&fo_vrtc, 17780.0, 50.0);
-	/* SD ADC1 */
-	lpf2pSetCutoffFrequency(&fo_temp_volt, 5560.0, 10.0);
-	lpf2pSetCutoffFrequency(&fo_oilp_volt, 5560.0, 10.0);
-	lpf2pSetCutoffFrequency(&fo_vbat, 5560.0, 10.0);
-	/* SD ADC3 */
-	lpf2pSetCutoffFrequency(&fo_flow_volt, 16680.0, 50.0);
+	design_filters(SG_ADC1);
+	design_filters(SG_SDADC1);
+	design_filters(SG_SDADC3);
+	sdadc_stats_init();
 
 	/* ADC1 */
 	adcStart(&ADCD1, NULL);
 	adcSTM32Calibrate(&ADCD1);
-	adcSTM32EnableTSVREFE();	/* enable thermometer */
-	adcSTM32EnableVBATE();		/* enable Vrtc bat, TODO: enable once in 10-sec */
+	/* thermometer and Vrtc bat enabled by burst scheduler */
 
 	/* SDADC1 */
 	adcStart(&SDADCD1, &sdadc1cfg);
@@ -317,24 +842,79 @@ static THD_FUNCTION(th_adc, arg ATTR_UNUSED)
 	adcStart(&SDADCD3, &sdadc3cfg);
 	adcSTM32Calibrate(&SDADCD3);
 
-	/* Start continous conversions */
-	adcStartConversion(&ADCD1, &adc1group, p_int_temp_vrtc_samples, 1);
-	adcStartConversion(&SDADCD1, &sdadc1group, p_temp_oilp_vbat_samples, 1);
-	adcStartConversion(&SDADCD3, &sdadc3group, p_flow_samples, 1);
+	/* Start continous conversions, ADC1 in bursts */
+	adcStartConversion(&SDADCD1, &sdadc1group, p_temp_oilp_vbat_samples, 2 * ADC_BLOCK_DEPTH);
+	adcStartConversion(&SDADCD3, &sdadc3group, p_flow_samples, 2 * ADC_BLOCK_DEPTH);
 
 	alert_component(ALS_ADC, AL_NORMAL);
 	while (true) {
-		chThdSleepMilliseconds(20);
+		struct sensor_snapshot snap;
 
-		adc_handle_battery();
-		adc_handle_temperature();
-		adc_handle_oilp();
-		adc_handle_flow();
+		chThdSleepMilliseconds(ADC_CHANNEL_TICK_MS);
+		adc1_schedule();
+		measure_rates();
+		sensors_get_snapshot(&snap);
+
+		/* each channel runs at its own rate, fast while cranking */
+		adc_channel_process(&snap, ctl_starter_state());
 	}
 
 	return MSG_OK;
 }
 
+/** ADC handler cost of last block [CPU cycles per sequence]
+ */
+uint32_t adc_get_sample_cost(enum sensor_group group)
+{
+	return m_sample_cost[group];
+}
+
+/** Sample rate of group [Hz] (measured)
+ */
+float adc_get_sample_rate(enum sensor_group group)
+{
+	return m_sample_rate[group];
+}
+
+/** ADC1 burst scheduler statistics
+ *
+ * @param[out] adc1_duty	ADC1 conversion time [%]
+ * @param[out] vbate_duty	VBAT bridge enabled time [%]
+ * @param[out] cpu_saved	ADC1 handlers CPU load avoided [%]
+ * @return estimated VBAT bridge current saved [uA]
+ */
+float adc_get_schedule_stats(float *adc1_duty, float *vbate_duty, float *cpu_saved)
+{
+	float elapsed = m_sched_elapsed;
+	float duty, rate, vrtc;
+
+	if (elapsed == 0.0f)
+		elapsed = 1.0f;
+
+	duty = m_adc1_active_cycles / elapsed;
+	rate = m_sample_rate[SG_ADC1];
+	vrtc = SENSOR_VOLT(m_flt_vrtc);
+
+	if (adc1_duty != NULL)
+		*adc1_duty = duty * 100.0f;
+	if (vbate_duty != NULL)
+		*vbate_duty = m_vbate_cycles / elapsed * 100.0f;
+
+	/* continuous conversion: handler cost for every sequence */
+	if (cpu_saved != NULL)
+		*cpu_saved = m_sample_cost[SG_ADC1] * rate * (1.0f - duty)
+			/ STM32_SYSCLK * 100.0f;
+
+	return vrtc / VBAT_BRIDGE_R * (1.0f - m_vbate_cycles / elapsed) * 1e6f;
+}
+
+/** Handler calls (DMA half/full transfer interrupts) count
+ */
+uint32_t adc_get_irq_count(enum sensor_group group)
+{
+	return m_irq_count[group];
+}
+
 void adc_init(void)
 {
 	chThdCreateStatic(wa_adc, sizeof(wa_adc), ADC_PRIO, th_adc, NULL);
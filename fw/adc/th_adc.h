@@ -24,43 +24,51 @@
 #define TH_ADC_H
 
 #include "fw_common.h"
+#include "sensors.h"
+
+//! SDADC SE Zero input [V] = (count + 32767) * SDADC_COUNT_VOLT
+#define SDADC_GAIN		1
+#define SDADC_COUNT_VOLT	(3.3f / (SDADC_GAIN * 65535))
+//! flow_block_sqrt_sum() fraction bits
+#define FLOW_SQRT_SHIFT		7
 
 void adc_init(void);
+uint32_t adc_get_sample_cost(enum sensor_group group);
+float adc_get_sample_rate(enum sensor_group group);
+uint32_t adc_get_irq_count(enum sensor_group group);
+float adc_get_schedule_stats(float *adc1_duty, float *vbate_duty, float *cpu_saved);
 
 /* subsystem functions */
 
 uint32_t batt_get_voltage(void);
 bool batt_check_voltage(void);
 bool batt_get_remaining(uint32_t *out);
+bool batt_get_resistance(uint32_t *out);
 
 int32_t cpu_get_temperature(void);
 bool cpu_get_rtc_voltage(uint32_t *out);
+bool cpu_check_temperature(void);
 
 int32_t temp_get_temperature(void);
 bool temp_check_temperature(void);
 
 bool oilp_get_pressure(int32_t *out);
+bool oilp_check_pressure(void);
 bool oilp_get_temperature(int32_t *out);
+bool oilp_is_enabled(void);
 
 bool flow_get_flow(uint32_t *out);
+bool flow_is_enabled(void);
 uint32_t flow_get_used_ml(void);
 bool flow_check_fuel(void);
 bool flow_get_remaining(uint32_t *out);
+void flow_refuel_done(void);
+uint32_t flow_get_zero(uint32_t *noise_uv, uint32_t *count);
+uint32_t flow_block_sqrt_sum(const int16_t *blk, size_t n);
+void flow_checkpoint_load(void);
+bool flow_checkpoint_is_pending(void);
+void flow_checkpoint_write(void);
 
-// get raw adc values
-float adc_getraw_temp(void);
-float adc_getraw_oilp(void);
-float adc_getraw_flow(void);
-float adc_getraw_vbat(void);
-float adc_getraw_vrtc(void);
-float adc_getraw_int_temp(void);
-
-// get filtered adc values
-float adc_getflt_temp(void);
-float adc_getflt_oilp(void);
-float adc_getflt_flow(void);
-float adc_getflt_vbat(void);
-float adc_getflt_vrtc(void);
-float adc_getflt_int_temp(void);
+/* raw and filtered adc values: see sensors_get_snapshot() */
 
 #endif /* TH_ADC_H */
@@ -22,6 +22,7 @@
 
 #include "alert_led.h"
 #include "hw/led.h"
+#include "log/capture.h"
 
 /* local variables */
 
@@ -72,6 +73,9 @@ void alert_component(enum alert_source src, enum alert_status st)
 {
 	osalDbgAssert((src < ALS_MAX), "alert source");
 
+	if (st == AL_FAIL && al_status[src] != AL_FAIL)
+		capture_trigger(CC_ALERT, src);
+
 	al_status[src] = st;
 }
 
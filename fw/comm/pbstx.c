@@ -23,16 +23,247 @@
 #include "pbstx.h"
 #include "lib_crc16.h"
 #include "alert_led.h"
+#include <string.h>
+#if SERIAL1_USE_DMA
+# include "hw/serial1_dma.h"
+#endif
 
 #define PBSTX_STX		0xae
 
 #define SER_TIMEOUT		MS2ST(100)
 #define SER_PAYLOAD_TIMEOUT	MS2ST(500)
 
-struct pbstx_header {
-	uint8_t seq;
+/* -*- local -*- */
+
+#if SERIAL1_USE_DMA
+/** Update per frame cycles average
+ */
+static void account_cycles(uint32_t *avg, rtcnt_t start)
+{
+	int32_t cycles = chSysGetRealtimeCounterX() - start;
+
+	*avg += (cycles - (int32_t)*avg) / 8;
+}
+
+/** CRC of ring data at offset, frame may wrap ring end
+ */
+static uint16_t dma_rx_crc16(size_t offset, size_t n, uint16_t crc)
+{
+	while (n > 0) {
+		const uint8_t *p;
+		size_t len = serial1_dma_rx_span(offset, &p);
+
+		if (len > n)
+			len = n;
+
+		crc = crc16part(p, len, crc);
+		offset += len;
+		n -= len;
+	}
+
+	return crc;
+}
+
+static void dma_rx_copy(size_t offset, size_t n, uint8_t *dst)
+{
+	while (n > 0) {
+		const uint8_t *p;
+		size_t len = serial1_dma_rx_span(offset, &p);
+
+		if (len > n)
+			len = n;
+
+		memcpy(dst, p, len);
+		dst += len;
+		offset += len;
+		n -= len;
+	}
+}
+
+/** Receive from SERIAL1 DMA ring
+ *
+ * Header and crc are checked in place, payload copied once,
+ * because DMA reuses the ring while message is decoded.
+ */
+static msg_t pbstxReceiveDMA(PBStxDev *instp, pbstx_message_t *msg)
+{
+	msg_t ret;
+	size_t avail, skip, frame_size;
 	uint16_t len;
-} __attribute__((packed));
+	rtcnt_t start;
+
+	// 1. wait STX, skip garbage
+	ret = serial1_dma_rx_wait(1, SER_TIMEOUT);
+	if (ret != MSG_OK)
+		return ret;
+
+	avail = serial1_dma_rx_available();
+	for (skip = 0; skip < avail && serial1_dma_rx_peek(skip) != PBSTX_STX; skip++);
+	serial1_dma_rx_consume(skip);
+	instp->stats.rx_dropped += skip;
+	if (skip == avail)
+		return MSG_RESET;
+
+	// 2. header
+	ret = serial1_dma_rx_wait(PBSTX_HEADER_BYTES, SER_TIMEOUT);
+	if (ret != MSG_OK) {
+		instp->stats.rx_timeouts++;
+		goto resync;
+	}
+
+	len = serial1_dma_rx_peek(2) | (serial1_dma_rx_peek(3) << 8);
+	if (len > PBSTX_PAYLOAD_BYTES) {
+		/* overflow */
+		instp->stats.rx_overflows++;
+		ret = MSG_RESET;
+		goto resync;
+	}
+
+	// 3. wait payload and crc16
+	frame_size = PBSTX_HEADER_BYTES + len + PBSTX_CRC_BYTES;
+	ret = serial1_dma_rx_wait(frame_size, SER_PAYLOAD_TIMEOUT);
+	if (ret != MSG_OK) {
+		instp->stats.rx_timeouts++;
+		goto resync;
+	}
+
+	start = chSysGetRealtimeCounterX();
+
+	// 4. check crc in place
+	instp->rx_checksum = dma_rx_crc16(1, PBSTX_HEADER_BYTES - 1 + len, 0);
+	msg->checksum = serial1_dma_rx_peek(frame_size - 2) |
+		(serial1_dma_rx_peek(frame_size - 1) << 8);
+
+	if (instp->rx_checksum != msg->checksum) {
+		instp->stats.rx_crc_errors++;
+		ret = MSG_RESET;
+		goto resync;
+	}
+
+	msg->size = len;
+	msg->seq = instp->rx_seq = serial1_dma_rx_peek(1);
+
+	// 5. copy payload, check that ring not overran meanwhile
+	dma_rx_copy(PBSTX_HEADER_BYTES, len, msg->payload);
+	if (!serial1_dma_rx_consume(frame_size)) {
+		alert_component(ALS_COMM, AL_FAIL);
+		return MSG_RESET;
+	}
+
+	instp->stats.rx_frames++;
+	instp->stats.rx_bytes += frame_size;
+	account_cycles(&instp->stats.rx_cycles, start);
+	alert_component(ALS_COMM, AL_NORMAL);
+	return MSG_OK;
+
+resync:
+	/* drop STX only, next frame may start inside the broken one */
+	serial1_dma_rx_consume(1);
+	instp->stats.rx_resyncs++;
+	alert_component(ALS_COMM, AL_FAIL);
+	return ret;
+}
+#endif /* SERIAL1_USE_DMA */
+
+/** Drop n bytes from receive buffer
+ */
+static void rx_buf_drop(PBStxDev *instp, size_t n)
+{
+	instp->rx_len -= n;
+	memmove(instp->rx_buf, instp->rx_buf + n, instp->rx_len);
+}
+
+/** Receive from BaseChannel
+ *
+ * Frame collected in rx_buf reading exactly missing bytes.
+ * On error only STX dropped and buffered bytes parsed again.
+ */
+static msg_t pbstxReceiveChannel(PBStxDev *instp, pbstx_message_t *msg)
+{
+	uint8_t *buf = instp->rx_buf;
+	msg_t ret;
+	size_t need;
+	uint16_t len = 0;
+
+	// 1. skip garbage before STX
+	if (instp->rx_len > 0 && buf[0] != PBSTX_STX) {
+		const uint8_t *stx = memchr(buf, PBSTX_STX, instp->rx_len);
+		size_t skip = (stx != NULL) ? (size_t)(stx - buf) : instp->rx_len;
+
+		rx_buf_drop(instp, skip);
+		instp->stats.rx_dropped += skip;
+	}
+
+	// 2. wait STX
+	if (instp->rx_len == 0) {
+		ret = chnGetTimeout(instp->chp, SER_TIMEOUT);
+		if (ret < 0)
+			return ret;
+
+		if (ret != PBSTX_STX) {
+			instp->stats.rx_dropped++;
+			return MSG_RESET;
+		}
+
+		buf[instp->rx_len++] = ret;
+	}
+
+	// 3. read header, then payload and crc16
+	while (true) {
+		need = PBSTX_HEADER_BYTES;
+		if (instp->rx_len >= PBSTX_HEADER_BYTES) {
+			len = buf[2] | (buf[3] << 8);
+			if (len > PBSTX_PAYLOAD_BYTES) {
+				/* overflow */
+				instp->stats.rx_overflows++;
+				ret = MSG_RESET;
+				goto resync;
+			}
+
+			need = PBSTX_HEADER_BYTES + len + PBSTX_CRC_BYTES;
+		}
+
+		if (instp->rx_len >= need)
+			break;
+
+		instp->rx_len += chnReadTimeout(instp->chp, buf + instp->rx_len,
+				need - instp->rx_len, SER_PAYLOAD_TIMEOUT);
+		if (instp->rx_len < need) {
+			instp->stats.rx_timeouts++;
+			ret = MSG_TIMEOUT;
+			goto resync;
+		}
+	}
+
+	// 4. check crc && process pkt
+	instp->rx_checksum = crc16(buf + 1, need - 1 - PBSTX_CRC_BYTES);
+	msg->checksum = buf[need - 2] | (buf[need - 1] << 8);
+
+	if (instp->rx_checksum != msg->checksum) {
+		instp->stats.rx_crc_errors++;
+		ret = MSG_RESET;
+		goto resync;
+	}
+
+	msg->size = len;
+	msg->seq = instp->rx_seq = buf[1];
+	memcpy(msg->payload, buf + PBSTX_HEADER_BYTES, len);
+	rx_buf_drop(instp, need);
+
+	instp->stats.rx_frames++;
+	instp->stats.rx_bytes += need;
+	alert_component(ALS_COMM, AL_NORMAL);
+	return MSG_OK;
+
+resync:
+	/* drop STX only, next frame may start inside the broken one */
+	rx_buf_drop(instp, 1);
+	instp->stats.rx_resyncs++;
+	alert_component(ALS_COMM, AL_FAIL);
+	return ret;
+}
+
+/* -*- public functions -*- */
 
 /**
  * Initialize PBSTX protocol object
@@ -44,85 +275,47 @@ void pbstxObjectInit(PBStxDev *instp, BaseChannel *chp)
 
 	instp->chp = chp;
 	instp->rx_seq = instp->tx_seq = 0;
+#if SERIAL1_USE_DMA
+	instp->dma = serial1_dma_is_channel(chp);
+#else
+	instp->dma = false;
+#endif
+	instp->rx_len = 0;
+	memset(&instp->stats, 0, sizeof(instp->stats));
 	osalMutexObjectInit(&instp->tx_mutex);
 }
 
 /**
  * Receive one message
  *
+ * Parser keeps received bytes between calls and after errors,
+ * a broken frame costs only its STX byte.
+ *
  * @return MSG_OK if message parsed,
  *         MSG_RESET if error occurs
  *         Q_TIMEOUT if timedout, in that case restart receiving with same *msg
  *
  * @todo use rx_seq to calculate missing message count
- * @todo rx/tx statistics counters
  */
 msg_t pbstxReceive(PBStxDev *instp, pbstx_message_t *msg)
 {
-	msg_t ret;
-
 	osalDbgCheck(instp != NULL);
 	osalDbgCheck(msg != NULL);
 
-	while (!chThdShouldTerminateX()) {
-		struct pbstx_header hdr;
+#if SERIAL1_USE_DMA
+	if (instp->dma)
+		return pbstxReceiveDMA(instp, msg);
+#endif
 
-		// 1. wait STX
-		ret = chnGetTimeout(instp->chp, SER_TIMEOUT);
-		if (ret != PBSTX_STX)
-			return ret;
-
-		// 2. read header
-		ret = chnReadTimeout(instp->chp, (uint8_t*)&hdr, sizeof(hdr), SER_TIMEOUT);
-		if (ret < 0) {
-			alert_component(ALS_COMM, AL_FAIL);
-			return ret;
-		}
-
-		instp->rx_checksum = crc16((uint8_t*)&hdr, sizeof(hdr));
-		msg->size = hdr.len;
-		msg->seq = instp->rx_seq = hdr.seq;
-
-		if (msg->size > PBSTX_PAYLOAD_BYTES) {
-			/* overflow */
-			alert_component(ALS_COMM, AL_FAIL);
-			return MSG_RESET;
-		}
-
-		// 3. read payload
-		ret = chnReadTimeout(instp->chp, msg->payload, msg->size, SER_PAYLOAD_TIMEOUT);
-		if (ret < 0) {
-			alert_component(ALS_COMM, AL_FAIL);
-			return ret;
-		}
-
-		instp->rx_checksum = crc16part(msg->payload, msg->size, instp->rx_checksum);
-
-		// 4. read crc16
-		ret = chnReadTimeout(instp->chp, (uint8_t*)&msg->checksum, sizeof(msg->checksum), SER_TIMEOUT);
-		if (ret < 0) {
-			alert_component(ALS_COMM, AL_FAIL);
-			return ret;
-		}
-
-		// 5. check crc && process pkt
-		if (instp->rx_checksum == msg->checksum) {
-			alert_component(ALS_COMM, AL_NORMAL);
-			return MSG_OK;
-		}
-		else {
-			alert_component(ALS_COMM, AL_FAIL);
-			return MSG_RESET;
-		}
-	}
-
-	return MSG_RESET;
+	return pbstxReceiveChannel(instp, msg);
 }
 
 /**
  * Send pbstx_message_t
  *
  * This function will calculate checksum.
+ * Header and crc16 are placed around payload in msg,
+ * so frame is written at once.
  */
 msg_t pbstxSend(PBStxDev *instp, pbstx_message_t *msg)
 {
@@ -133,21 +326,36 @@ msg_t pbstxSend(PBStxDev *instp, pbstx_message_t *msg)
 	chMtxLock(&instp->tx_mutex);
 
 	msg_t ret;
-	uint8_t header[] = { PBSTX_STX, instp->tx_seq++, msg->size & 0xff, msg->size >> 8 };
+	rtcnt_t start ATTR_UNUSED = chSysGetRealtimeCounterX();
+	size_t frame_size = PBSTX_HEADER_BYTES + msg->size + PBSTX_CRC_BYTES;
 
-	msg->checksum = crc16(header + 1, sizeof(header) - 1);
-	msg->checksum = crc16part(msg->payload, msg->size, msg->checksum);
+	msg->header[0] = PBSTX_STX;
+	msg->header[1] = instp->tx_seq++;
+	msg->header[2] = msg->size & 0xff;
+	msg->header[3] = msg->size >> 8;
 
-	ret = chnWriteTimeout(instp->chp, header, sizeof(header), SER_TIMEOUT);
-	if (ret < 0) goto unlock_ret;
+	msg->checksum = crc16(msg->header + 1, PBSTX_HEADER_BYTES - 1);
+	msg->checksum = crc16part(msg->payload, msg->size, msg->checksum);
+	msg->payload[msg->size] = msg->checksum & 0xff;
+	msg->payload[msg->size + 1] = msg->checksum >> 8;
 
-	ret = chnWriteTimeout(instp->chp, msg->payload, msg->size, SER_PAYLOAD_TIMEOUT);
-	if (ret < 0) goto unlock_ret;
+#if SERIAL1_USE_DMA
+	if (instp->dma) {
+		account_cycles(&instp->stats.tx_cycles, start);
+		ret = serial1_dma_send(msg->header, frame_size, SER_PAYLOAD_TIMEOUT);
+	}
+	else
+#endif
+	{
+		ret = (chnWriteTimeout(instp->chp, msg->header, frame_size, SER_PAYLOAD_TIMEOUT) == frame_size) ?
+			MSG_OK : MSG_TIMEOUT;
+	}
 
-	ret = chnWriteTimeout(instp->chp, (uint8_t*)&msg->checksum, sizeof(msg->checksum), SER_TIMEOUT);
+	if (ret == MSG_OK) {
+		instp->stats.tx_frames++;
+		instp->stats.tx_bytes += frame_size;
+	}
 
-unlock_ret:
 	chMtxUnlock(&instp->tx_mutex);
 	return ret;
 }
-
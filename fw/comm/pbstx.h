@@ -28,6 +28,23 @@
 
 
 #define PBSTX_PAYLOAD_BYTES	256
+#define PBSTX_HEADER_BYTES	4	//!< STX, SEQ, LEN[2]
+#define PBSTX_CRC_BYTES		2
+#define PBSTX_FRAME_BYTES	(PBSTX_HEADER_BYTES + PBSTX_PAYLOAD_BYTES + PBSTX_CRC_BYTES)
+
+struct pbstx_stats {
+	uint32_t tx_frames;
+	uint32_t tx_bytes;
+	uint32_t rx_frames;
+	uint32_t rx_bytes;
+	uint32_t tx_cycles;		//!< per frame, average (DMA only)
+	uint32_t rx_cycles;		//!< per frame, average (DMA only)
+	uint32_t rx_crc_errors;
+	uint32_t rx_overflows;		//!< length > PBSTX_PAYLOAD_BYTES
+	uint32_t rx_timeouts;		//!< incomplete frames
+	uint32_t rx_resyncs;		//!< parser restarts from next STX
+	uint32_t rx_dropped;		//!< bytes skipped looking for STX
+};
 
 typedef struct PBstxDev {
 	BaseChannel *chp;
@@ -35,13 +52,24 @@ typedef struct PBstxDev {
 	uint16_t rx_checksum;
 	uint8_t rx_seq;
 	uint8_t tx_seq;
+	bool dma;			//!< SERIAL1 DMA: frames sent and parsed in place
+	struct pbstx_stats stats;
+	/* receive buffer (not used by DMA, ring is parsed in place) */
+	uint16_t rx_len;
+	uint8_t rx_buf[PBSTX_FRAME_BYTES];
 } PBStxDev;
 
+/** Message buffer
+ *
+ * header, payload and crc are contiguous, so frame is sent
+ * by one write (one DMA transaction).
+ */
 typedef struct pbstx_message {
 	uint8_t seq;
 	uint16_t size;
 	uint16_t checksum;
-	uint8_t payload[PBSTX_PAYLOAD_BYTES];
+	uint8_t header[PBSTX_HEADER_BYTES];
+	uint8_t payload[PBSTX_PAYLOAD_BYTES + PBSTX_CRC_BYTES];
 } pbstx_message_t;
 
 
@@ -0,0 +1,809 @@
+/**
+ * @file       comm/telemetry.c
+ * @brief      Telemetry publisher
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "alert_led.h"
+#include "telemetry.h"
+#include "th_comm_pbstx.h"
+#include "param.h"
+#include "adc/th_adc.h"
+#include "adc/adc_channel.h"
+#include "th_rpm.h"
+#include "sensors.h"
+#include "cpu_load.h"
+#include "command.h"
+#include "hw/rtc_time.h"
+#include "hw/ectl_pads.h"
+#include <string.h>
+
+/* Notes:
+ * Telemetry streams (Status, SensorHealth, SensorStats and Telemetry
+ * field groups) are sampled and encoded once by telemetry thread.
+ * Encoded buffer is posted to queue of each subscriber the stream is due for,
+ * with reference count, session thread sends it at own link speed
+ * and releases. Slow link only loses own frames (queue full),
+ * publisher never waits for send. Buffer has frame header and crc space,
+ * so last holder sends it without copy.
+ *
+ * Every subscriber has own interval for each stream (TelemetryRequest).
+ * Stream timers are kept in hashed timer wheel: slot = deadline % TLM_WHEEL_SLOTS,
+ * each slot list ordered by deadline, so on tick only heads of elapsed slots
+ * are checked and next wakeup is minimum of slot heads.
+ * Subscribers due at same tick with same Telemetry groups share one buffer.
+ *
+ * Status.link differs per port, so Status is encoded without it,
+ * session appends second Message.status with only link field,
+ * protobuf decoder merges both into one Status.
+ */
+
+/* global parameters (defined in th_comm_pbstx.c) */
+
+extern int32_t gp_engine_id;
+extern int32_t gp_status_period;
+extern bool gp_debug_enable_adc_raw;
+
+/* -*- private data -*- */
+
+#define ALLOC_TIMEOUT		MS2ST(20)
+#define TICK			MS2ST(TLM_TICK_MS)
+#define EVT_RECONFIG		EVENT_MASK(0)
+
+static tlm_buffer_t m_buffers[TLM_BUFFERS];
+static msg_t m_free_mb_buf[TLM_BUFFERS];
+static MAILBOX_DECL(m_free_mb, m_free_mb_buf, TLM_BUFFERS);
+static bool m_pool_ready;
+
+static tlm_subscriber_t *m_subscribers[TLM_MAX_SUBSCRIBERS];
+static THD_WORKING_AREA(wa_telemetry, TELEMETRY_WASZ);
+static thread_t *m_thread;
+
+/* timer wheel, protected by m_wheel_mtx (also subscribers and their timers) */
+static MUTEX_DECL(m_wheel_mtx);
+static struct tlm_timer *m_wheel[TLM_WHEEL_SLOTS];
+static uint32_t m_now;			// current tick
+static uint32_t m_last_tick;		// last processed tick
+static systime_t m_now_time;		// system time of m_now
+
+/* SensorStats windows taken for due subscribers (telemetry thread) */
+static struct {
+	running_stats_t stats[SS_MAX];
+	uint32_t period_ms;
+} m_stats_due[TLM_MAX_SUBSCRIBERS];
+
+/* -*- buffers -*- */
+
+/** Get free buffer
+ *
+ * @return NULL if no free buffer in @a timeout (or before telemetry_init())
+ */
+tlm_buffer_t *tlm_alloc(systime_t timeout)
+{
+	msg_t p;
+
+	if (!m_pool_ready || chMBFetch(&m_free_mb, &p, timeout) != MSG_OK)
+		return NULL;
+
+	tlm_buffer_t *buf = (tlm_buffer_t *)p;
+	buf->refs = 1;
+	buf->flags = 0;
+	buf->msg.size = 0;
+	return buf;
+}
+
+/** Drop one reference, last returns buffer to pool
+ */
+void tlm_release(tlm_buffer_t *buf)
+{
+	chSysLock();
+	osalDbgAssert(buf->refs > 0, "double release");
+	if (--buf->refs == 0) {
+		chMBPostI(&m_free_mb, (msg_t)buf);
+		chSchRescheduleS();
+	}
+	chSysUnlock();
+}
+
+/** Caller holds the only reference (published buffer)
+ *
+ * Published buffer gets no new references, so result holds
+ * until caller releases it: buffer may be modified (framed in place).
+ */
+bool tlm_is_exclusive(tlm_buffer_t *buf)
+{
+	bool ret;
+
+	chSysLock();
+	ret = buf->refs == 1;
+	chSysUnlock();
+
+	return ret;
+}
+
+/** Queue buffer to subscribers in @a sub_mask and drop publisher reference
+ */
+void tlm_publish_to(tlm_buffer_t *buf, uint32_t sub_mask)
+{
+	chSysLock();
+	for (size_t i = 0; i < TLM_MAX_SUBSCRIBERS; i++) {
+		tlm_subscriber_t *sub = m_subscribers[i];
+
+		if (sub == NULL || !(sub_mask & (1 << i)))
+			continue;
+
+		if (chMBPostI(&sub->mb, (msg_t)buf) == MSG_OK)
+			buf->refs++;
+		else
+			sub->dropped++;
+	}
+	chSchRescheduleS();
+	chSysUnlock();
+
+	tlm_release(buf);
+}
+
+/** Queue buffer to all subscribers
+ */
+void tlm_publish(tlm_buffer_t *buf)
+{
+	tlm_publish_to(buf, UINT32_MAX);
+}
+
+/* -*- timer wheel -*- */
+
+static uint32_t interval_ticks(const struct tlm_timer *t)
+{
+	uint32_t ms = (t->interval_ms == TLM_INTERVAL_DEFAULT) ? (uint32_t)gp_status_period : t->interval_ms;
+	uint32_t ticks = (ms + TLM_TICK_MS / 2) / TLM_TICK_MS;
+
+	return (ticks > 0) ? ticks : 1;
+}
+
+static bool is_due(uint32_t deadline)
+{
+	return (int32_t)(deadline - m_now) <= 0;
+}
+
+static void advance_clock(void)
+{
+	uint32_t n = chVTTimeElapsedSinceX(m_now_time) / TICK;
+
+	m_now += n;
+	m_now_time += n * TICK;
+}
+
+static void wheel_insert(struct tlm_timer *t)
+{
+	struct tlm_timer **pp = &m_wheel[t->deadline % TLM_WHEEL_SLOTS];
+
+	while (*pp != NULL && (int32_t)((*pp)->deadline - t->deadline) <= 0)
+		pp = &(*pp)->next;
+
+	t->next = *pp;
+	*pp = t;
+}
+
+static void wheel_remove(struct tlm_timer *t)
+{
+	struct tlm_timer **pp = &m_wheel[t->deadline % TLM_WHEEL_SLOTS];
+
+	while (*pp != NULL && *pp != t)
+		pp = &(*pp)->next;
+
+	if (*pp != NULL)
+		*pp = t->next;
+}
+
+/** Pop timers of elapsed ticks, reschedule them
+ *
+ * @param[out] due	due streams mask of each subscriber
+ * @return true if any stream is due
+ */
+static bool wheel_collect(uint32_t due[TLM_MAX_SUBSCRIBERS])
+{
+	uint32_t n = m_now - m_last_tick;
+	bool any = false;
+
+	if (n > TLM_WHEEL_SLOTS)
+		n = TLM_WHEEL_SLOTS;
+
+	for (uint32_t i = 0; i < n; i++) {
+		struct tlm_timer **slot = &m_wheel[(m_now - i) % TLM_WHEEL_SLOTS];
+
+		while (*slot != NULL && is_due((*slot)->deadline)) {
+			struct tlm_timer *t = *slot;
+
+			*slot = t->next;
+			due[t->sub] |= TS_MASK(t->stream);
+			any = true;
+
+			/* keep cadence, skip missed periods */
+			t->deadline += interval_ticks(t);
+			if (is_due(t->deadline))
+				t->deadline = m_now + interval_ticks(t);
+
+			wheel_insert(t);
+		}
+	}
+
+	m_last_tick = m_now;
+	return any;
+}
+
+/** Time to nearest deadline (TIME_INFINITE if no timers)
+ */
+static systime_t wheel_next_timeout(void)
+{
+	uint32_t ticks = UINT32_MAX;
+	systime_t elapsed;
+
+	for (size_t i = 0; i < TLM_WHEEL_SLOTS; i++) {
+		if (m_wheel[i] != NULL && m_wheel[i]->deadline - m_now < ticks)
+			ticks = m_wheel[i]->deadline - m_now;
+	}
+
+	if (ticks == UINT32_MAX)
+		return TIME_INFINITE;
+
+	elapsed = chVTTimeElapsedSinceX(m_now_time);
+	return (ticks * TICK > elapsed) ? ticks * TICK - elapsed : TIME_IMMEDIATE;
+}
+
+static void set_interval(tlm_subscriber_t *sub, enum tlm_stream stream, uint32_t interval_ms)
+{
+	struct tlm_timer *t = &sub->timers[stream];
+
+	/* not subscribed (all slots taken) */
+	if (t->sub >= TLM_MAX_SUBSCRIBERS)
+		return;
+
+	if (t->interval_ms != 0)
+		wheel_remove(t);
+	else if (stream == TS_SENSOR_STATS && interval_ms != 0) {
+		/* new window */
+		for (size_t i = 0; i < SS_MAX; i++)
+			rstats_reset(&sub->stats[i]);
+		sub->stats_start = osalOsGetSystemTimeX();
+	}
+
+	t->interval_ms = interval_ms;
+	if (interval_ms == 0)
+		return;
+
+	/* first message on next tick */
+	advance_clock();
+	t->deadline = m_now + 1;
+	wheel_insert(t);
+}
+
+static uint32_t default_interval(enum tlm_stream stream)
+{
+	return (stream <= TS_SENSOR_STATS) ? TLM_INTERVAL_DEFAULT : 0;
+}
+
+/* -*- subscribers -*- */
+
+void tlm_subscribe(tlm_subscriber_t *sub)
+{
+	chMBObjectInit(&sub->mb, sub->mb_buf, TLM_QUEUE);
+	sub->dropped = 0;
+
+	for (size_t s = 0; s < TS_MAX; s++) {
+		sub->timers[s].interval_ms = 0;
+		sub->timers[s].sub = TLM_MAX_SUBSCRIBERS;
+		sub->timers[s].stream = s;
+	}
+
+	chMtxLock(&m_wheel_mtx);
+	for (size_t i = 0; i < TLM_MAX_SUBSCRIBERS; i++) {
+		if (m_subscribers[i] != NULL)
+			continue;
+
+		for (size_t s = 0; s < TS_MAX; s++) {
+			sub->timers[s].sub = i;
+			set_interval(sub, s, default_interval(s));
+		}
+
+		chSysLock();
+		m_subscribers[i] = sub;
+		chSysUnlock();
+		break;
+	}
+	chMtxUnlock(&m_wheel_mtx);
+
+	chEvtSignal(m_thread, EVT_RECONFIG);
+}
+
+/** Remove subscriber and release all queued buffers
+ */
+void tlm_unsubscribe(tlm_subscriber_t *sub)
+{
+	tlm_buffer_t *buf;
+
+	chMtxLock(&m_wheel_mtx);
+	for (size_t i = 0; i < TLM_MAX_SUBSCRIBERS; i++) {
+		if (m_subscribers[i] != sub)
+			continue;
+
+		for (size_t s = 0; s < TS_MAX; s++)
+			set_interval(sub, s, 0);
+
+		chSysLock();
+		m_subscribers[i] = NULL;
+		chSysUnlock();
+	}
+	chMtxUnlock(&m_wheel_mtx);
+
+	while ((buf = tlm_fetch(sub, TIME_IMMEDIATE)) != NULL)
+		tlm_release(buf);
+}
+
+/** Next queued buffer, caller should release it
+ *
+ * @return NULL on timeout
+ */
+tlm_buffer_t *tlm_fetch(tlm_subscriber_t *sub, systime_t timeout)
+{
+	msg_t p;
+
+	if (chMBFetch(&sub->mb, &p, timeout) != MSG_OK)
+		return NULL;
+
+	return (tlm_buffer_t *)p;
+}
+
+/** Restore default stream intervals
+ */
+void tlm_set_defaults(tlm_subscriber_t *sub)
+{
+	chMtxLock(&m_wheel_mtx);
+	for (size_t s = 0; s < TS_MAX; s++)
+		set_interval(sub, s, default_interval(s));
+	chMtxUnlock(&m_wheel_mtx);
+
+	chEvtSignal(m_thread, EVT_RECONFIG);
+}
+
+/** Set stream interval
+ *
+ * @param interval_ms	0 - disable, rounded to TLM_TICK_MS
+ * @return interval in effect [ms]
+ */
+uint32_t tlm_set_interval(tlm_subscriber_t *sub, enum tlm_stream stream, uint32_t interval_ms)
+{
+	if (stream >= TS_MAX)
+		return 0;
+
+	if (interval_ms != 0) {
+		if (interval_ms > TLM_INTERVAL_MAX_MS)
+			interval_ms = TLM_INTERVAL_MAX_MS;
+
+		interval_ms = (interval_ms + TLM_TICK_MS / 2) / TLM_TICK_MS * TLM_TICK_MS;
+		if (interval_ms < TLM_TICK_MS)
+			interval_ms = TLM_TICK_MS;
+	}
+
+	chMtxLock(&m_wheel_mtx);
+	set_interval(sub, stream, interval_ms);
+	chMtxUnlock(&m_wheel_mtx);
+
+	chEvtSignal(m_thread, EVT_RECONFIG);
+	return tlm_get_interval(sub, stream);
+}
+
+/** Stream interval [ms], 0 - disabled
+ */
+uint32_t tlm_get_interval(tlm_subscriber_t *sub, enum tlm_stream stream)
+{
+	uint32_t interval_ms;
+
+	if (stream >= TS_MAX)
+		return 0;
+
+	interval_ms = sub->timers[stream].interval_ms;
+	return (interval_ms == TLM_INTERVAL_DEFAULT) ? (uint32_t)gp_status_period : interval_ms;
+}
+
+/* -*- publisher -*- */
+
+static void publish_message(uint32_t sub_mask, uint8_t flags, const pb_field_t messagetype[], const void *message)
+{
+	tlm_buffer_t *buf = tlm_alloc(ALLOC_TIMEOUT);
+
+	if (buf == NULL)
+		return;
+
+	if (!pbstxEncode(buf->msg.payload, PBSTX_PAYLOAD_BYTES, &buf->msg.size, messagetype, message)) {
+		alert_component(ALS_COMM, AL_FAIL);
+		tlm_release(buf);
+		return;
+	}
+
+	buf->flags = flags;
+	tlm_publish_to(buf, sub_mask);
+}
+
+/** Subscribers with @a stream due
+ */
+static uint32_t due_mask(const uint32_t due[TLM_MAX_SUBSCRIBERS], enum tlm_stream stream)
+{
+	uint32_t mask = 0;
+
+	for (size_t i = 0; i < TLM_MAX_SUBSCRIBERS; i++) {
+		if (due[i] & TS_MASK(stream))
+			mask |= 1 << i;
+	}
+
+	return mask;
+}
+
+/** Field groups, shared by Status and Telemetry
+ * @{
+ */
+
+static void fill_rpm(uint32_t *rpm, miniecu_RPMStatus *ri, const struct sensor_snapshot *snap)
+{
+	*rpm = snap->rpm.rpm;
+	ri->rev_period_us = snap->rpm.rev_period_us;
+	ri->acceleration = snap->rpm.acceleration;
+	ri->edges = rpm_get_edges(&ri->edges_lost);
+	ri->has_edges_lost = ri->edges_lost > 0;
+	ri->has_latency_us = true;
+	ri->has_latency_max_us = true;
+	ri->latency_us = rpm_get_latency(&ri->latency_max_us);
+	ri->has_limiter_cuts = true;
+	ri->limiter_cuts = rpm_get_limiter_cuts();
+	ri->has_sync = true;
+	ri->sync = (miniecu_RPMStatus_SyncState)rpm_get_sync(&ri->sync_loss);
+	ri->has_sync_loss = ri->sync != miniecu_RPMStatus_SyncState_NONE;
+	ri->has_crank_angle = rpm_get_crank_angle(&ri->crank_angle);
+}
+
+static void fill_battery(miniecu_BatteryStatus *battery)
+{
+	battery->voltage = batt_get_voltage();
+	battery->has_remaining = batt_get_remaining(&battery->remaining);
+	battery->has_resistance = batt_get_resistance(&battery->resistance);
+}
+
+static void fill_temperature(miniecu_TemperatureStatus *temperature)
+{
+	temperature->engine1 = temp_get_temperature();
+	temperature->has_engine2 = oilp_get_temperature(&temperature->engine2);
+}
+
+static void fill_cpu(miniecu_CPUStatus *cpu)
+{
+	cpu->has_load = true;
+	cpu->load = cpu_load_get();
+	cpu->has_isr_load = true;
+	cpu->isr_load = cpu_load_get_isr_total();
+	cpu->has_temperature = true;
+	cpu->temperature = cpu_get_temperature();
+	cpu->has_rtc_vbat = cpu_get_rtc_voltage(&cpu->rtc_vbat);
+}
+
+static bool fill_fuel(miniecu_FuelFlowStatus *fuel)
+{
+	if (!flow_get_flow(&fuel->flow_ml))
+		return false;
+
+	fuel->total_used_ml = flow_get_used_ml();
+	fuel->has_remaining = flow_get_remaining(&fuel->remaining);
+	fuel->has_zero_mv = true;
+	fuel->has_zero_noise_uv = true;
+	fuel->has_zero_count = true;
+	fuel->zero_mv = flow_get_zero(&fuel->zero_noise_uv, &fuel->zero_count);
+	return true;
+}
+
+static void fill_adc_raw(miniecu_ADCRawVoltages *adc_raw, const struct sensor_snapshot *snap)
+{
+	adc_raw->flt_temp = SENSOR_VOLT(snap->sdadc1.flt_temp_volt);
+	adc_raw->flt_oilp = SENSOR_VOLT(snap->sdadc1.flt_oilp_volt);
+	adc_raw->flt_flow = SENSOR_VOLT(snap->sdadc3.flt_flow_volt);
+	adc_raw->flt_vbat = SENSOR_VOLT(snap->sdadc1.flt_vbat);
+	adc_raw->flt_vrtc = SENSOR_VOLT(snap->adc1.flt_vrtc);
+
+	adc_raw->raw_temp = SENSOR_VOLT(snap->sdadc1.raw_temp_volt);
+	adc_raw->raw_oilp = SENSOR_VOLT(snap->sdadc1.raw_oilp_volt);
+	adc_raw->raw_flow = SENSOR_VOLT(snap->sdadc3.raw_flow_volt);
+	adc_raw->raw_vbat = SENSOR_VOLT(snap->sdadc1.raw_vbat);
+	adc_raw->raw_vrtc = SENSOR_VOLT(snap->adc1.raw_vrtc);
+
+	adc_raw->has_fixed_point = true;
+	adc_raw->fixed_point = ADC_FIXED_POINT;
+	adc_raw->has_cost_adc1 = true;
+	adc_raw->has_cost_sdadc1 = true;
+	adc_raw->has_cost_sdadc3 = true;
+	adc_raw->cost_adc1 = adc_get_sample_cost(SG_ADC1);
+	adc_raw->cost_sdadc1 = adc_get_sample_cost(SG_SDADC1);
+	adc_raw->cost_sdadc3 = adc_get_sample_cost(SG_SDADC3);
+
+	adc_raw->has_rate_adc1 = true;
+	adc_raw->has_rate_sdadc1 = true;
+	adc_raw->has_rate_sdadc3 = true;
+	adc_raw->rate_adc1 = adc_get_sample_rate(SG_ADC1);
+	adc_raw->rate_sdadc1 = adc_get_sample_rate(SG_SDADC1);
+	adc_raw->rate_sdadc3 = adc_get_sample_rate(SG_SDADC3);
+	adc_raw->has_irq_adc1 = true;
+	adc_raw->has_irq_sdadc1 = true;
+	adc_raw->has_irq_sdadc3 = true;
+	adc_raw->irq_adc1 = adc_get_irq_count(SG_ADC1);
+	adc_raw->irq_sdadc1 = adc_get_irq_count(SG_SDADC1);
+	adc_raw->irq_sdadc3 = adc_get_irq_count(SG_SDADC3);
+
+	adc_raw->has_adc1_duty = true;
+	adc_raw->has_vbate_duty = true;
+	adc_raw->has_cpu_saved = true;
+	adc_raw->has_current_saved = true;
+	adc_raw->current_saved = adc_get_schedule_stats(&adc_raw->adc1_duty,
+			&adc_raw->vbate_duty, &adc_raw->cpu_saved);
+}
+
+/** @} */
+
+/** Publish miniecu.Status (without link)
+ */
+static void publish_status(uint32_t sub_mask, const struct sensor_snapshot *snap)
+{
+	miniecu_Status status = miniecu_Status_init_default;
+
+	status.engine_id = gp_engine_id;
+	status.status = status_get_flags();
+
+	/* time */
+	status.system_time = time_get_systime();
+	status.has_timestamp_ms = time_is_known();
+	status.timestamp_ms = time_get_timestamp();
+
+	status.has_rpm_info = true;
+	fill_rpm(&status.rpm, &status.rpm_info, snap);
+	fill_battery(&status.battery);
+	fill_temperature(&status.temperature);
+	fill_cpu(&status.cpu);
+	status.has_oil_pressure = oilp_get_pressure(&status.oil_pressure);
+	status.has_fuel = fill_fuel(&status.fuel);
+
+	if (gp_debug_enable_adc_raw) {
+		status.has_adc_raw = true;
+		fill_adc_raw(&status.adc_raw, snap);
+	}
+
+	publish_message(sub_mask, TLM_F_STATUS, miniecu_Status_fields, &status);
+}
+
+/** Publish miniecu.Telemetry with @a groups
+ */
+static void publish_telemetry(uint32_t sub_mask, uint32_t groups, const struct sensor_snapshot *snap)
+{
+	miniecu_Telemetry tlm = miniecu_Telemetry_init_default;
+
+	tlm.engine_id = gp_engine_id;
+	tlm.system_time = time_get_systime();
+	tlm.status = status_get_flags();
+
+	if (groups & TS_MASK(TS_RPM)) {
+		tlm.has_rpm = true;
+		tlm.has_rpm_info = true;
+		fill_rpm(&tlm.rpm, &tlm.rpm_info, snap);
+	}
+	if (groups & TS_MASK(TS_TEMPERATURE)) {
+		tlm.has_temperature = true;
+		fill_temperature(&tlm.temperature);
+	}
+	if (groups & TS_MASK(TS_BATTERY)) {
+		tlm.has_battery = true;
+		fill_battery(&tlm.battery);
+	}
+	if (groups & TS_MASK(TS_FUEL))
+		tlm.has_fuel = fill_fuel(&tlm.fuel);
+	if (groups & TS_MASK(TS_OIL_PRESSURE))
+		tlm.has_oil_pressure = oilp_get_pressure(&tlm.oil_pressure);
+	if (groups & TS_MASK(TS_CPU)) {
+		tlm.has_cpu = true;
+		fill_cpu(&tlm.cpu);
+	}
+	if (groups & TS_MASK(TS_ADC_RAW)) {
+		tlm.has_adc_raw = true;
+		fill_adc_raw(&tlm.adc_raw, snap);
+	}
+
+	publish_message(sub_mask, 0, miniecu_Telemetry_fields, &tlm);
+}
+
+/** Publish Telemetry, one buffer for subscribers with same groups
+ */
+static void publish_groups(const uint32_t due[TLM_MAX_SUBSCRIBERS], const struct sensor_snapshot *snap)
+{
+	uint32_t done = 0;
+
+	for (size_t i = 0; i < TLM_MAX_SUBSCRIBERS; i++) {
+		uint32_t groups = due[i] & TS_GROUPS_MASK;
+		uint32_t mask = 0;
+
+		if (groups == 0 || (done & (1 << i)))
+			continue;
+
+		for (size_t j = i; j < TLM_MAX_SUBSCRIBERS; j++) {
+			if ((due[j] & TS_GROUPS_MASK) == groups)
+				mask |= 1 << j;
+		}
+
+		done |= mask;
+		publish_telemetry(mask, groups, snap);
+	}
+}
+
+/** Publish miniecu.SensorHealth
+ */
+static void publish_sensor_health(uint32_t sub_mask)
+{
+	miniecu_SensorHealth health = miniecu_SensorHealth_init_default;
+
+	health.engine_id = gp_engine_id;
+
+	for (size_t i = 0; i < adc_channel_table_size && i < ARRAY_SIZE(health.channels); i++) {
+		const struct adc_channel *ch = &adc_channel_table[i];
+		miniecu_SensorHealth_Channel *e = &health.channels[health.channels_count++];
+
+		strncpy(e->name, ch->name, sizeof(e->name) - 1);
+		e->health = (miniecu_SensorHealth_Health)ch->state->health;
+		e->faults = ch->state->faults;
+	}
+
+	publish_message(sub_mask, 0, miniecu_SensorHealth_fields, &health);
+}
+
+/** Take SensorStats windows (m_wheel_mtx locked)
+ *
+ * Window is taken from sensors and merged to all subscribers
+ * with stream enabled, each due subscriber gets own window since its previous message.
+ */
+static void take_sensor_stats(const uint32_t due[TLM_MAX_SUBSCRIBERS])
+{
+	running_stats_t rs[SS_MAX];
+
+	if (due_mask(due, TS_SENSOR_STATS) == 0)
+		return;
+
+	sensors_stats_take(rs);
+
+	for (size_t i = 0; i < TLM_MAX_SUBSCRIBERS; i++) {
+		tlm_subscriber_t *sub = m_subscribers[i];
+
+		if (sub == NULL || sub->timers[TS_SENSOR_STATS].interval_ms == 0)
+			continue;
+
+		for (size_t k = 0; k < SS_MAX; k++)
+			rstats_merge(&sub->stats[k], &rs[k]);
+
+		if (!(due[i] & TS_MASK(TS_SENSOR_STATS)))
+			continue;
+
+		m_stats_due[i].period_ms = ST2MS(chVTTimeElapsedSinceX(sub->stats_start));
+		sub->stats_start = osalOsGetSystemTimeX();
+
+		for (size_t k = 0; k < SS_MAX; k++) {
+			m_stats_due[i].stats[k] = sub->stats[k];
+			rstats_reset(&sub->stats[k]);
+		}
+	}
+}
+
+/** Publish miniecu.SensorStats of windows taken by take_sensor_stats()
+ */
+static void publish_sensor_stats(const uint32_t due[TLM_MAX_SUBSCRIBERS])
+{
+	miniecu_SensorStats stats;
+
+	for (size_t i = 0; i < TLM_MAX_SUBSCRIBERS; i++) {
+		if (!(due[i] & TS_MASK(TS_SENSOR_STATS)))
+			continue;
+
+		stats = (miniecu_SensorStats)miniecu_SensorStats_init_default;
+		stats.engine_id = gp_engine_id;
+		stats.period_ms = m_stats_due[i].period_ms;
+
+		for (size_t k = 0; k < SS_MAX && k < ARRAY_SIZE(stats.sensors); k++) {
+			running_stats_t *s = &m_stats_due[i].stats[k];
+			miniecu_SensorStats_Entry *e;
+
+			if (s->n == 0)
+				continue;
+
+			e = &stats.sensors[stats.sensors_count++];
+			e->sensor = (miniecu_SensorStats_Sensor)k;
+			e->count = s->n;
+			e->min = s->min;
+			e->max = s->max;
+			e->mean = s->mean;
+			e->stddev = rstats_stddev(s);
+		}
+
+		publish_message(1 << i, 0, miniecu_SensorStats_fields, &stats);
+	}
+}
+
+/** Sample and publish due streams
+ */
+static void publish_due(const uint32_t due[TLM_MAX_SUBSCRIBERS])
+{
+	struct sensor_snapshot snap;
+	uint32_t all = 0;
+
+	for (size_t i = 0; i < TLM_MAX_SUBSCRIBERS; i++)
+		all |= due[i];
+
+	if (all & (TS_MASK(TS_STATUS) | TS_GROUPS_MASK))
+		sensors_get_snapshot(&snap);
+
+	if (all & TS_MASK(TS_STATUS))
+		publish_status(due_mask(due, TS_STATUS), &snap);
+	if (all & TS_MASK(TS_SENSOR_HEALTH))
+		publish_sensor_health(due_mask(due, TS_SENSOR_HEALTH));
+	if (all & TS_MASK(TS_SENSOR_STATS))
+		publish_sensor_stats(due);
+	if (all & TS_GROUPS_MASK)
+		publish_groups(due, &snap);
+}
+
+static THD_FUNCTION(th_telemetry, arg ATTR_UNUSED)
+{
+	chRegSetThreadName("telemetry");
+
+	while (true) {
+		uint32_t due[TLM_MAX_SUBSCRIBERS] = {};
+		systime_t timeout;
+		bool any;
+
+		/* subscriber state is taken under mutex, encode and tlm_alloc()
+		 * wait are outside, so subscribe and set interval are not blocked.
+		 * Subscriber left since is skipped by tlm_publish_to().
+		 */
+		chMtxLock(&m_wheel_mtx);
+		advance_clock();
+		any = wheel_collect(due);
+		if (any)
+			take_sensor_stats(due);
+		chMtxUnlock(&m_wheel_mtx);
+
+		if (any)
+			publish_due(due);
+
+		chMtxLock(&m_wheel_mtx);
+		timeout = wheel_next_timeout();
+		chMtxUnlock(&m_wheel_mtx);
+
+		chEvtWaitAnyTimeout(EVT_RECONFIG, timeout);
+	}
+
+	return MSG_OK;
+}
+
+void telemetry_init(void)
+{
+	for (size_t i = 0; i < TLM_BUFFERS; i++)
+		chMBPost(&m_free_mb, (msg_t)&m_buffers[i], TIME_IMMEDIATE);
+
+	m_pool_ready = true;
+	m_now_time = osalOsGetSystemTimeX();
+	m_thread = chThdCreateStatic(wa_telemetry, sizeof(wa_telemetry), TELEMETRY_PRIO, th_telemetry, NULL);
+}
@@ -0,0 +1,117 @@
+/**
+ * @file       comm/telemetry.h
+ * @brief      Telemetry publisher
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef COMM_TELEMETRY_H
+#define COMM_TELEMETRY_H
+
+#include "fw_common.h"
+#include "pbstx.h"
+#include "sensors.h"
+
+/** Per subscriber queue depth
+ * One tick can bring Status, SensorHealth, SensorStats and Telemetry,
+ * plus debug text and the next Telemetry while a Status is on the wire
+ * (~40 ms at 57600 baud, 50 Hz stream).
+ */
+#define TLM_QUEUE		6
+#define TLM_MAX_SUBSCRIBERS	2
+//! Shared buffers (each holds one encoded miniecu.Message)
+#define TLM_BUFFERS		10
+//! Timer wheel tick (minimal stream interval)
+#define TLM_TICK_MS		10
+//! Timer wheel slots (power of 2), longer intervals wrap around
+#define TLM_WHEEL_SLOTS		32
+#define TLM_INTERVAL_MAX_MS	60000
+//! Interval follows STATUS_PERIOD
+#define TLM_INTERVAL_DEFAULT	UINT32_MAX
+
+/** Telemetry streams
+ * NOTE same as miniecu.TelemetryRequest.Stream
+ */
+enum tlm_stream {
+	TS_STATUS = 0,
+	TS_SENSOR_HEALTH,
+	TS_SENSOR_STATS,
+	/* miniecu.Telemetry groups */
+	TS_RPM,
+	TS_TEMPERATURE,
+	TS_BATTERY,
+	TS_FUEL,
+	TS_OIL_PRESSURE,
+	TS_CPU,
+	TS_ADC_RAW,
+	TS_MAX
+};
+
+#define TS_MASK(s)		(1 << (s))
+#define TS_GROUPS_MASK		(TS_MASK(TS_MAX) - TS_MASK(TS_RPM))
+
+/** Encoded message, shared by all subscribers
+ *
+ * Message keeps header and crc space around payload,
+ * last holder frames and sends it in place (pbstxSend()).
+ */
+typedef struct tlm_buffer {
+	uint8_t refs;			//!< subscribers not yet sent it (+ publisher)
+	uint8_t flags;			//!< TLM_F_*
+	pbstx_message_t msg;		//!< payload and size set by publisher
+} tlm_buffer_t;
+
+//! miniecu.Status without link, subscriber adds own Status.link
+#define TLM_F_STATUS		(1 << 0)
+
+/** Stream timer, linked in wheel slot deadline % TLM_WHEEL_SLOTS
+ */
+struct tlm_timer {
+	struct tlm_timer *next;		//!< next in slot, ordered by deadline
+	uint32_t deadline;		//!< [ticks]
+	uint32_t interval_ms;		//!< 0 - disabled (not linked)
+	uint8_t sub;			//!< subscriber index
+	uint8_t stream;			//!< enum tlm_stream
+};
+
+/** Subscriber (transport session) queue and stream rates
+ */
+typedef struct tlm_subscriber {
+	mailbox_t mb;
+	msg_t mb_buf[TLM_QUEUE];
+	uint32_t dropped;		//!< not queued (queue full)
+	struct tlm_timer timers[TS_MAX];
+	/* SensorStats window of this subscriber */
+	running_stats_t stats[SS_MAX];
+	systime_t stats_start;
+} tlm_subscriber_t;
+
+void telemetry_init(void);
+void tlm_subscribe(tlm_subscriber_t *sub);
+void tlm_unsubscribe(tlm_subscriber_t *sub);
+tlm_buffer_t *tlm_fetch(tlm_subscriber_t *sub, systime_t timeout);
+void tlm_set_defaults(tlm_subscriber_t *sub);
+uint32_t tlm_set_interval(tlm_subscriber_t *sub, enum tlm_stream stream, uint32_t interval_ms);
+uint32_t tlm_get_interval(tlm_subscriber_t *sub, enum tlm_stream stream);
+tlm_buffer_t *tlm_alloc(systime_t timeout);
+void tlm_publish(tlm_buffer_t *buf);
+void tlm_publish_to(tlm_buffer_t *buf, uint32_t sub_mask);
+void tlm_release(tlm_buffer_t *buf);
+bool tlm_is_exclusive(tlm_buffer_t *buf);
+
+#endif /* COMM_TELEMETRY_H */
@@ -23,14 +23,17 @@
 #include "alert_led.h"
 #include "th_comm_pbstx.h"
 #include "pbstx.h"
+#include "telemetry.h"
 #include "pb_encode.h"
 #include "pb_decode.h"
 #include "param.h"
-#include "adc/th_adc.h"
-#include "th_rpm.h"
+#include "cpu_load.h"
 #include "command.h"
 #include "hw/rtc_time.h"
-#include "hw/ectl_pads.h"
+#include <string.h>
+#if SERIAL1_USE_DMA
+# include "hw/serial1_dma.h"
+#endif
 
 /* global parameters */
 
@@ -44,32 +47,83 @@ bool gp_debug_enable_memdump;
 typedef struct {
 	PBStxDev dev;
 	pbstx_message_t msg;
+	tlm_subscriber_t tlm;
+	thread_t *tx_thread;		//!< telemetry sender
 } PBStxComm;
 
-#define MAX_INSTANCES	2
+#define MAX_INSTANCES	TLM_MAX_SUBSCRIBERS
 PBStxComm *m_instances[MAX_INSTANCES] = {};
 
+//! Message.status { link } appended to telemetry Status
+#define LINK_CHUNK_BYTES	96
+//! debug_printf() wait for free buffer
+#define DEBUG_ALLOC_TIMEOUT	MS2ST(20)
+//! telemetry sender checks termination request
+#define TX_POLL_TIMEOUT		MS2ST(100)
+
 /* PBStx methods */
-static void send_status(PBStxComm *self);
+static THD_FUNCTION(th_pbstx_tx, arg);
 static void recv_time_reference(PBStxComm *self, pb_istream_t *instream);
 static void recv_command(PBStxComm *self, pb_istream_t *instream);
 static void recv_param_request(PBStxComm *self, pb_istream_t *instream);
 static void recv_param_set(PBStxComm *self, pb_istream_t *instream);
 static void recv_log_request(PBStxComm *self, pb_istream_t *instream);
 static void recv_memory_dump_request(PBStxComm *self, pb_istream_t *instream);
+static void recv_cpu_diagnostics_request(PBStxComm *self, pb_istream_t *instream);
+static void recv_telemetry_request(PBStxComm *self, pb_istream_t *instream);
 
 /* memdump.c */
 #define MEMDUMP_SIZE	64
 int32_t memdump_int_ram(uint32_t address, void *buffer, size_t size);
 int32_t memdump_ext_flash(uint32_t address, void *buffer, size_t size);
+int32_t memdump_capture(uint32_t address, void *buffer, size_t size);
 
 // -*- helpers -*-
 
+/** Find submessage field of @a messagetype in @a fields
+ */
+static const pb_field_t *pbstxFindField(const pb_field_t fields[], const pb_field_t messagetype[])
+{
+	const pb_field_t *field;
+	for (field = fields; field->tag != 0; field++) {
+		if (field->ptr == messagetype)
+			return field;
+	}
+
+	return NULL;
+}
+
 /**
- * This helper function encodes union-like message miniecu.Message and send
+ * This helper function encodes union-like message miniecu.Message
  *
  * Based on nanopb example using_union_messages/encode.c
  *
+ * @param payload	output buffer
+ * @param bufsize	size of @a payload
+ * @param[out] size	encoded size
+ * @param messagetype	submessage type defenition
+ * @param message	submessage struct
+ *
+ * @return true on success
+ */
+bool pbstxEncode(uint8_t *payload, size_t bufsize, uint16_t *size,
+		const pb_field_t messagetype[], const void *message)
+{
+	pb_ostream_t outstream = pb_ostream_from_buffer(payload, bufsize);
+	const pb_field_t *field = pbstxFindField(miniecu_Message_fields, messagetype);
+
+	if (field == NULL ||
+			!pb_encode_tag_for_field(&outstream, field) ||
+			!pb_encode_submessage(&outstream, messagetype, message))
+		return false;
+
+	*size = outstream.bytes_written;
+	return true;
+}
+
+/**
+ * Encode miniecu.Message and send
+ *
  * @param dev		PBStx proto object
  * @param msg		message buffer
  * @param messagetype	submessage type defenition
@@ -79,23 +133,9 @@ int32_t memdump_ext_flash(uint32_t address, void *buffer, size_t size);
  */
 static msg_t pbstxEncodeSend(PBStxDev *dev, pbstx_message_t *msg, const pb_field_t messagetype[], const void *message)
 {
-	pb_ostream_t outstream = pb_ostream_from_buffer(msg->payload, PBSTX_PAYLOAD_BYTES);
-
-	const pb_field_t *field;
-	for (field = miniecu_Message_fields; field->tag != 0; field++) {
-		if (field->ptr == messagetype) {
-			if (!pb_encode_tag_for_field(&outstream, field))
-				goto err_out;
-
-			if (!pb_encode_submessage(&outstream, messagetype, message))
-				goto err_out;
-
-			msg->size = outstream.bytes_written;
-			return pbstxSend(dev, msg);
-		}
-	}
+	if (pbstxEncode(msg->payload, PBSTX_PAYLOAD_BYTES, &msg->size, messagetype, message))
+		return pbstxSend(dev, msg);
 
-err_out:
 	alert_component(ALS_COMM, AL_FAIL);
 	return MSG_RESET;
 }
@@ -181,6 +221,9 @@ static bool pbstxDecodeMessage(pb_istream_t *stream, const pb_field_t messagetyp
  * @param severity message level
  * @param fmt formatting string @a chprintf()
  *
+ * Encoded once to shared buffer and queued to all sessions
+ * (same as telemetry), so no frame buffer on caller stack.
+ *
  * NOTE: baed on @a chsnprintf()
  */
 void debug_printf(enum severity severity, char *fmt, ...)
@@ -188,7 +231,7 @@ void debug_printf(enum severity severity, char *fmt, ...)
 	va_list ap;
 	MemoryStream ms;
 	BaseSequentialStream *chp;
-	pbstx_message_t msg;
+	tlm_buffer_t *buf;
 	miniecu_StatusText st;
 
 	msObjectInit(&ms, (uint8_t *)st.text, sizeof(st.text), 0);
@@ -203,7 +246,14 @@ void debug_printf(enum severity severity, char *fmt, ...)
 	/* final zero */
 	chSequentialStreamPut(chp, 0);
 
-	pbstxEncodeSendBroadcast(&msg, miniecu_StatusText_fields, &st);
+	buf = tlm_alloc(DEBUG_ALLOC_TIMEOUT);
+	if (buf == NULL)
+		return;
+
+	if (pbstxEncode(buf->msg.payload, PBSTX_PAYLOAD_BYTES, &buf->msg.size, miniecu_StatusText_fields, &st))
+		tlm_publish(buf);
+	else
+		tlm_release(buf);
 }
 
 
@@ -216,7 +266,6 @@ static THD_FUNCTION(th_comm_pbstx, arg)
 
 	msg_t ret;
 	int instance_id;
-	systime_t send_time = 0;
 	PBStxComm self;
 
 	chRegSetThreadName("pbstx");
@@ -232,15 +281,20 @@ static THD_FUNCTION(th_comm_pbstx, arg)
 	if (instance_id >= MAX_INSTANCES)
 		return MSG_RESET;
 
+	/* telemetry sent by own thread: receive may block up to SER_TIMEOUT */
+	tlm_subscribe(&self.tlm);
+	self.tx_thread = chThdCreateFromHeap(NULL, PBSTX_TX_WASZ, chThdGetPriorityX(), th_pbstx_tx, &self);
+	if (self.tx_thread == NULL) {
+		alert_component(ALS_COMM, AL_FAIL);
+		tlm_unsubscribe(&self.tlm);
+		m_instances[instance_id] = NULL;
+		return MSG_RESET;
+	}
+
 	alert_component(ALS_COMM, AL_NORMAL);
 
 	//debug_printf(DP_DEBUG, "pbstx%d: started", instance_id);
 	while (!chThdShouldTerminateX()) {
-		if (chVTTimeElapsedSinceX(send_time) >= MS2ST(gp_status_period)) {
-			send_status(&self);
-			send_time = osalOsGetSystemTimeX();
-		}
-
 		ret = pbstxReceive(&self.dev, &self.msg);
 		if (ret != MSG_OK)
 			continue;
@@ -258,10 +312,17 @@ static THD_FUNCTION(th_comm_pbstx, arg)
 			recv_command(&self, &instream);
 		else if (field == miniecu_LogRequest_fields)
 			recv_log_request(&self, &instream);
-		else if (field == miniecu_MemoryDumpRequest_fields && gp_debug_enable_memdump)
+		else if (field == miniecu_MemoryDumpRequest_fields)
 			recv_memory_dump_request(&self, &instream);
+		else if (field == miniecu_CPUDiagnosticsRequest_fields)
+			recv_cpu_diagnostics_request(&self, &instream);
+		else if (field == miniecu_TelemetryRequest_fields)
+			recv_telemetry_request(&self, &instream);
 	}
 
+	chThdTerminate(self.tx_thread);
+	chThdWait(self.tx_thread);
+	tlm_unsubscribe(&self.tlm);
 	if (m_instances[instance_id] != NULL)
 		m_instances[instance_id] = NULL;
 
@@ -283,77 +344,106 @@ thread_t *pbstxCreate(void *chn, size_t size, tprio_t prio)
  * @{
  */
 
-/** Send miniecu.Status message
+/** Append Message.status with only Status.link of this port
+ *
+ * Decoder merges it with Status encoded by telemetry publisher.
  */
-static void send_status(PBStxComm *self)
+static bool append_link_status(PBStxComm *self, pbstx_message_t *msg)
 {
-	miniecu_Status status = miniecu_Status_init_default;
-	uint32_t flags = 0;
-
-	if (time_is_known())		flags |= miniecu_Status_Flags_TIME_KNOWN;
-	if (ctl_ignition_state())	flags |= miniecu_Status_Flags_IGNITION_ENABLED;
-	if (ctl_starter_state())	flags |= miniecu_Status_Flags_STARTER_ENABLED;
-	if (rpm_is_engine_running())	flags |= miniecu_Status_Flags_ENGINE_RUNNING;
-
-	if (alert_check_error())	flags |= miniecu_Status_Flags_ERROR;
-	if (batt_check_voltage())	flags |= miniecu_Status_Flags_UNDERVOLTAGE;
-	if (temp_check_temperature())	flags |= miniecu_Status_Flags_OVERHEAT;
-	if (rpm_check_limit())		flags |= miniecu_Status_Flags_HIGH_RPM;
-	if (flow_check_fuel())		flags |= miniecu_Status_Flags_LOW_FUEL;
-
-	status.engine_id = gp_engine_id;
-	status.status = flags;
-
-	/* time */
-	status.system_time = time_get_systime();
-	status.has_timestamp_ms = time_is_known();
-	status.timestamp_ms = time_get_timestamp();
-
-	/* RPM */
-	status.rpm = rpm_get_filtered();
-
-	/* battery */
-	status.battery.voltage = batt_get_voltage();
-	status.battery.has_remaining = batt_get_remaining(&status.battery.remaining);
-
-	/* temperature */
-	status.temperature.engine1 = temp_get_temperature();
-	status.temperature.has_engine2 = oilp_get_temperature(&status.temperature.engine2);
-
-	/* CPU status */
-	//status.cpu.load = 0; /* TODO */
-	status.cpu.has_temperature = true;
-	status.cpu.temperature = cpu_get_temperature();
-	status.cpu.has_rtc_vbat = cpu_get_rtc_voltage(&status.cpu.rtc_vbat);
-
-	/* Oil pressure */
-	//status.has_oil_pressure = oilp_get_pressure(&status.oil_pressure);
-
-	/* Fuel flow status */
-	if ((status.has_fuel = flow_get_flow(&status.fuel.flow_ml)) == true) {
-		status.fuel.total_used_ml = flow_get_used_ml();
-		status.fuel.has_remaining = flow_get_remaining(&status.fuel.remaining);
+	miniecu_LinkStatus link = miniecu_LinkStatus_init_default;
+	uint8_t chunk[LINK_CHUNK_BYTES];
+	pb_ostream_t chunkstream = pb_ostream_from_buffer(chunk, sizeof(chunk));
+	pb_ostream_t outstream = pb_ostream_from_buffer(msg->payload + msg->size,
+			PBSTX_PAYLOAD_BYTES - msg->size);
+	const pb_field_t *link_field = pbstxFindField(miniecu_Status_fields, miniecu_LinkStatus_fields);
+	const pb_field_t *status_field = pbstxFindField(miniecu_Message_fields, miniecu_Status_fields);
+
+	link.tx_frames = self->dev.stats.tx_frames;
+	link.tx_bytes = self->dev.stats.tx_bytes;
+	link.rx_frames = self->dev.stats.rx_frames;
+	link.rx_bytes = self->dev.stats.rx_bytes;
+	link.has_dma = true;
+	link.dma = self->dev.dma;
+	link.has_rx_crc_errors = true;
+	link.has_rx_overflows = true;
+	link.has_rx_timeouts = true;
+	link.has_rx_resyncs = true;
+	link.has_rx_dropped = true;
+	link.rx_crc_errors = self->dev.stats.rx_crc_errors;
+	link.rx_overflows = self->dev.stats.rx_overflows;
+	link.rx_timeouts = self->dev.stats.rx_timeouts;
+	link.rx_resyncs = self->dev.stats.rx_resyncs;
+	link.rx_dropped = self->dev.stats.rx_dropped;
+	link.has_tx_dropped = true;
+	link.tx_dropped = self->tlm.dropped;
+#if SERIAL1_USE_DMA
+	if (self->dev.dma) {
+		link.has_tx_cycles = true;
+		link.has_rx_cycles = true;
+		link.has_rx_overruns = true;
+		link.tx_cycles = self->dev.stats.tx_cycles;
+		link.rx_cycles = self->dev.stats.rx_cycles;
+		link.rx_overruns = serial1_dma_get_overruns();
 	}
+#endif
+
+	if (!pb_encode_tag_for_field(&chunkstream, link_field) ||
+			!pb_encode_submessage(&chunkstream, miniecu_LinkStatus_fields, &link))
+		return false;
 
-	if (gp_debug_enable_adc_raw) {
-		status.has_adc_raw = true;
+	if (!pb_encode_tag_for_field(&outstream, status_field) ||
+			!pb_encode_string(&outstream, chunk, chunkstream.bytes_written))
+		return false;
 
-		status.adc_raw.flt_temp = adc_getflt_temp();
-		status.adc_raw.flt_oilp = adc_getflt_oilp();
-		status.adc_raw.flt_flow = adc_getflt_flow();
-		status.adc_raw.flt_vbat = adc_getflt_vbat();
-		status.adc_raw.flt_vrtc = adc_getflt_vrtc();
+	msg->size += outstream.bytes_written;
+	return true;
+}
 
-		status.adc_raw.raw_temp = adc_getraw_temp();
-		status.adc_raw.raw_oilp = adc_getraw_oilp();
-		status.adc_raw.raw_flow = adc_getraw_flow();
-		status.adc_raw.raw_vbat = adc_getraw_vbat();
-		status.adc_raw.raw_vrtc = adc_getraw_vrtc();
-	}
+/** Telemetry sender of session
+ *
+ * Wakes on each buffer posted to session queue, so telemetry
+ * is not held back by blocking receive in session thread.
+ * Replies of session thread are serialized by pbstxSend().
+ *
+ * Last holder of buffer frames it in place, while other subscriber
+ * still holds it (own seq and link) payload is copied first.
+ */
+static THD_FUNCTION(th_pbstx_tx, arg)
+{
+	PBStxComm *self = arg;
+	pbstx_message_t shared;
+
+	chRegSetThreadName("pbstx_tx");
 
-	/* TODO: Fill status */
+	while (!chThdShouldTerminateX()) {
+		tlm_buffer_t *buf = tlm_fetch(&self->tlm, TX_POLL_TIMEOUT);
+		pbstx_message_t *msg = &shared;
+		uint8_t flags;
 
-	pbstxEncodeSendComm(self, miniecu_Status_fields, &status);
+		if (buf == NULL)
+			continue;
+
+		flags = buf->flags;
+		if (tlm_is_exclusive(buf)) {
+			msg = &buf->msg;
+		}
+		else {
+			memcpy(shared.payload, buf->msg.payload, buf->msg.size);
+			shared.size = buf->msg.size;
+			tlm_release(buf);
+			buf = NULL;
+		}
+
+		/* Status is sent without link if it does not fit */
+		if (flags & TLM_F_STATUS)
+			append_link_status(self, msg);
+
+		pbstxSend(&self->dev, msg);
+		if (buf != NULL)
+			tlm_release(buf);
+	}
+
+	return MSG_OK;
 }
 
 static void recv_time_reference(PBStxComm *self, pb_istream_t *instream)
@@ -529,6 +619,9 @@ static void recv_memory_dump_request(PBStxComm *self, pb_istream_t *instream)
 	if (dump_req.engine_id != (unsigned)gp_engine_id)
 		return;
 
+	if (!gp_debug_enable_memdump && dump_req.type != miniecu_MemoryDumpRequest_Type_CAPTURE)
+		return;
+
 	switch (dump_req.type) {
 	case miniecu_MemoryDumpRequest_Type_RAM:
 		memdump = memdump_int_ram;
@@ -536,6 +629,9 @@ static void recv_memory_dump_request(PBStxComm *self, pb_istream_t *instream)
 	case miniecu_MemoryDumpRequest_Type_FLASH:
 		memdump = memdump_ext_flash;
 		break;
+	case miniecu_MemoryDumpRequest_Type_CAPTURE:
+		memdump = memdump_capture;
+		break;
 
 	default:
 		debug_printf(DP_ERROR, "MemDump: unknown type");
@@ -563,3 +659,84 @@ static void recv_memory_dump_request(PBStxComm *self, pb_istream_t *instream)
 		pbstxEncodeSendComm(self, miniecu_MemoryDumpPage_fields, &page_msg);
 	}
 }
+
+static void recv_cpu_diagnostics_request(PBStxComm *self, pb_istream_t *instream)
+{
+	miniecu_CPUDiagnosticsRequest diag_req;
+	miniecu_CPUDiagnostics diag = miniecu_CPUDiagnostics_init_default;
+	thread_t *tp;
+
+	if (!pbstxDecodeMessage(instream, miniecu_CPUDiagnosticsRequest_fields, &diag_req)) {
+		alert_component(ALS_COMM, AL_FAIL);
+		return;
+	}
+
+	if (diag_req.engine_id != (unsigned)gp_engine_id)
+		return;
+
+	diag.engine_id = gp_engine_id;
+	diag.load = cpu_load_get();
+	diag.window = cpu_load_get_window();
+
+	tp = chRegFirstThread();
+	do {
+		if (diag.threads_count < ARRAY_SIZE(diag.threads)) {
+			miniecu_CPUDiagnostics_Entry *e = &diag.threads[diag.threads_count++];
+
+			strncpy(e->name, (tp->p_name != NULL) ? tp->p_name : "?", sizeof(e->name) - 1);
+			e->load = cpu_load_get_thread(tp);
+		}
+
+		tp = chRegNextThread(tp);
+	} while (tp != NULL);
+
+	for (size_t i = 0; i < CLI_MAX && i < ARRAY_SIZE(diag.isrs); i++) {
+		miniecu_CPUDiagnostics_Entry *e = &diag.isrs[diag.isrs_count++];
+
+		strncpy(e->name, cpu_load_get_isr_name(i), sizeof(e->name) - 1);
+		e->load = cpu_load_get_isr(i);
+	}
+
+	pbstxEncodeSendComm(self, miniecu_CPUDiagnostics_fields, &diag);
+}
+
+/** Set telemetry stream intervals of this session
+ *
+ * Response lists intervals in effect for all streams.
+ */
+static void recv_telemetry_request(PBStxComm *self, pb_istream_t *instream)
+{
+	miniecu_TelemetryRequest tlm_req;
+
+	if (!pbstxDecodeMessage(instream, miniecu_TelemetryRequest_fields, &tlm_req)) {
+		alert_component(ALS_COMM, AL_FAIL);
+		return;
+	}
+
+	if (tlm_req.engine_id != (unsigned)gp_engine_id)
+		return;
+
+	/* ignore echo */
+	if (tlm_req.has_response && tlm_req.response)
+		return;
+
+	if (tlm_req.has_reset && tlm_req.reset)
+		tlm_set_defaults(&self->tlm);
+
+	for (size_t i = 0; i < tlm_req.streams_count; i++)
+		tlm_set_interval(&self->tlm, (enum tlm_stream)tlm_req.streams[i].stream,
+				tlm_req.streams[i].interval_ms);
+
+	tlm_req.has_reset = false;
+	tlm_req.has_response = true;
+	tlm_req.response = true;
+	tlm_req.streams_count = 0;
+	for (size_t i = 0; i < TS_MAX && i < ARRAY_SIZE(tlm_req.streams); i++) {
+		miniecu_TelemetryRequest_Entry *e = &tlm_req.streams[tlm_req.streams_count++];
+
+		e->stream = (miniecu_TelemetryRequest_Stream)i;
+		e->interval_ms = tlm_get_interval(&self->tlm, i);
+	}
+
+	pbstxEncodeSendComm(self, miniecu_TelemetryRequest_fields, &tlm_req);
+}
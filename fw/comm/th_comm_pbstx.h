@@ -24,9 +24,12 @@
 #define TH_COMM_PBSTX_H
 
 #include "fw_common.h"
+#include "pb.h"
 
 /* public functions */
 thread_t *pbstxCreate(void *chn, size_t size, tprio_t prio);
+bool pbstxEncode(uint8_t *payload, size_t bufsize, uint16_t *size,
+		const pb_field_t messagetype[], const void *message);
 /* debug_printf() defined in fw_common.h */
 
 #endif /* TH_COMM_PBSTX_H */
@@ -26,6 +26,65 @@
 #include "hw/ext_flash.h"
 #include "miniecu.pb.h"
 #include "param.h"
+#include "th_rpm.h"
+#include "adc/th_adc.h"
+#include "adc/adc_channel.h"
+#include "hw/rtc_time.h"
+#include "log/capture.h"
+#include "lib_crc16.h"
+
+#define CRC_BENCH_SIZE		1024
+#define CRC_BENCH_ROUNDS	16
+
+/** Measure throughput of crc16part() variants
+ *
+ * Each variant result printed as StatusText [bytes/s].
+ */
+static uint32_t crc_bench(void)
+{
+	static const struct crc_variant {
+		const char *name;
+		uint16_t (*func)(const uint8_t *src, size_t len, uint16_t crc16val);
+	} variants[] = {
+		{ "bytewise", crc16part_bytewise },
+		{ "slice4", crc16part_slice4 },
+		{ "slice8", crc16part_slice8 },
+#if CRC16_USE_HW
+		{ "hw", crc16part_hw },
+#endif
+		{ "crc16part", crc16part },
+	};
+	static uint8_t buf[CRC_BENCH_SIZE];
+	uint32_t ret = miniecu_Command_Response_ACK;
+	uint16_t ref;
+
+	for (size_t i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 181 + 17;
+
+	ref = crc16part_bytewise(buf, sizeof(buf), 0);
+
+	for (size_t v = 0; v < ARRAY_SIZE(variants); v++) {
+		const struct crc_variant *cv = &variants[v];
+		rtcnt_t start = chSysGetRealtimeCounterX();
+		uint32_t cycles;
+		uint16_t crc = 0;
+
+		for (size_t r = 0; r < CRC_BENCH_ROUNDS; r++)
+			crc = cv->func(buf, sizeof(buf), 0);
+
+		cycles = chSysGetRealtimeCounterX() - start;
+		if (crc != ref) {
+			debug_printf(DP_ERROR, "CRC16: %s mismatch %04x != %04x", cv->name, crc, ref);
+			ret = miniecu_Command_Response_NAK;
+			continue;
+		}
+
+		debug_printf(DP_INFO, "CRC16: %s %" PRIu32 " B/s", cv->name,
+				(uint32_t)((uint64_t)sizeof(buf) * CRC_BENCH_ROUNDS * STM32_SYSCLK / cycles));
+	}
+
+	return ret;
+}
 
 
 uint32_t command_request(uint32_t cmdid)
@@ -33,12 +92,14 @@ uint32_t command_request(uint32_t cmdid)
 	switch (cmdid) {
 	case miniecu_Command_Operation_EMERGENCY_STOP:
 		// TODO: stop other modules (if needed)
+		rpm_limiter_cancel();
 		ctl_ignition_set(false);
 		ctl_starter_set(false);
 		break;
 
 	case miniecu_Command_Operation_IGNITION_ENABLE:
 	case miniecu_Command_Operation_IGNITION_DISABLE:
+		rpm_limiter_cancel();
 		ctl_ignition_set(cmdid == miniecu_Command_Operation_IGNITION_ENABLE);
 		return miniecu_Command_Response_ACK;
 
@@ -53,8 +114,8 @@ uint32_t command_request(uint32_t cmdid)
 	//	break;
 
 	case miniecu_Command_Operation_REFUEL_DONE:
-		// XXX: wait flow module
-		break;
+		flow_refuel_done();
+		return miniecu_Command_Response_ACK;
 
 	case miniecu_Command_Operation_SAVE_CONFIG:
 		if (flash_connect() != MSG_OK)
@@ -84,9 +145,39 @@ uint32_t command_request(uint32_t cmdid)
 		/* TODO */
 		break;
 
+	case miniecu_Command_Operation_DO_CAPTURE:
+		capture_trigger(CC_COMMAND, 0);
+		return miniecu_Command_Response_ACK;
+
+	case miniecu_Command_Operation_DO_CRC_BENCH:
+		return crc_bench();
+
 	default:
 		break;
 	}
 
 	return miniecu_Command_Response_NAK;
 }
+
+/** Current miniecu.Status flags
+ */
+uint32_t status_get_flags(void)
+{
+	uint32_t flags = 0;
+
+	if (time_is_known())		flags |= miniecu_Status_Flags_TIME_KNOWN;
+	if (ctl_ignition_state())	flags |= miniecu_Status_Flags_IGNITION_ENABLED;
+	if (ctl_starter_state())	flags |= miniecu_Status_Flags_STARTER_ENABLED;
+	if (rpm_is_engine_running())	flags |= miniecu_Status_Flags_ENGINE_RUNNING;
+
+	if (alert_check_error())	flags |= miniecu_Status_Flags_ERROR;
+	if (batt_check_voltage())	flags |= miniecu_Status_Flags_UNDERVOLTAGE;
+	if (temp_check_temperature())	flags |= miniecu_Status_Flags_OVERHEAT;
+	if (rpm_check_limit())		flags |= miniecu_Status_Flags_HIGH_RPM;
+	if (flow_check_fuel())		flags |= miniecu_Status_Flags_LOW_FUEL;
+	if (oilp_check_pressure())	flags |= miniecu_Status_Flags_LOW_OIL_PRESSURE;
+	if (adc_channel_check_alarm())	flags |= miniecu_Status_Flags_SENSOR_ALARM;
+	if (adc_channel_check_fault())	flags |= miniecu_Status_Flags_SENSOR_FAULT;
+
+	return flags;
+}
@@ -28,4 +28,7 @@
 /* subsystem functions */
 uint32_t command_request(uint32_t cmdid);
 
+/* system status */
+uint32_t status_get_flags(void);
+
 #endif /* COMMAND_H */
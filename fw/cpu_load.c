@@ -0,0 +1,192 @@
+/**
+ * @file       cpu_load.c
+ * @brief      CPU load measurement
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "cpu_load.h"
+
+/* Notes:
+ * Time measured by DWT cycle counter (realtime counter).
+ *
+ * Context switch hook charges time slice to the thread leaving CPU
+ * (thread extra field load_cycles, see chconf.h).
+ * ISR handlers report own time by cpu_load_isr_account(), it is
+ * subtracted from the preempted thread slice. Other ISRs counted
+ * to preempted thread.
+ *
+ * Load is time not spent in idle thread.
+ */
+
+/* -*- private data -*- */
+
+static rtcnt_t m_slice_start;
+static uint32_t m_slice_isr;			// accounted ISR time in current slice
+static uint32_t m_isr_cycles[CLI_MAX];		// current window
+static uint32_t m_isr_last[CLI_MAX];		// last window
+static rtcnt_t m_window_start;
+static uint32_t m_window_cycles;		// last window length
+static uint32_t m_load;				// [%]
+
+static const char *const m_isr_names[CLI_MAX] = {
+	[CLI_RPM] = "rpm",
+	[CLI_ADC1] = "adc1",
+	[CLI_SDADC1] = "sdadc1",
+	[CLI_SDADC3] = "sdadc3",
+	[CLI_SERIAL1] = "serial1",
+};
+
+/* -*- local -*- */
+
+/** Charge time slice to thread (called in critical zone)
+ */
+static void charge_slice(thread_t *tp, rtcnt_t now)
+{
+	uint32_t slice = now - m_slice_start;
+
+	if (m_slice_isr < slice)
+		tp->load_cycles += slice - m_slice_isr;
+
+	m_slice_start = now;
+	m_slice_isr = 0;
+}
+
+static uint32_t to_load(uint32_t cycles)
+{
+	if (m_window_cycles == 0)
+		return 0;
+
+	return (uint64_t)cycles * CPU_LOAD_SCALE / m_window_cycles;
+}
+
+/* -*- public functions -*- */
+
+/** Context switch hook (called in critical zone)
+ *
+ * @param otp	thread leaving CPU
+ */
+void cpu_load_switch(thread_t *otp)
+{
+	charge_slice(otp, chSysGetRealtimeCounterX());
+}
+
+/** Account ISR handler time
+ *
+ * @param isr		handler
+ * @param start		realtime counter at handler entry
+ */
+void cpu_load_isr_account(enum cpu_load_isr isr, rtcnt_t start)
+{
+	uint32_t cycles = chSysGetRealtimeCounterX() - start;
+
+	chSysLockFromISR();
+	m_isr_cycles[isr] += cycles;
+	m_slice_isr += cycles;
+	chSysUnlockFromISR();
+}
+
+/** Close measurement window and compute load
+ *
+ * Should be called periodically, window must be shorter than
+ * realtime counter wrap (~59 s at 72 MHz).
+ */
+void cpu_load_update(void)
+{
+	thread_t *tp;
+	rtcnt_t now;
+	uint32_t idle;
+
+	chSysLock();
+	now = chSysGetRealtimeCounterX();
+	charge_slice(chThdGetSelfX(), now);
+	m_window_cycles = now - m_window_start;
+	m_window_start = now;
+	for (size_t i = 0; i < CLI_MAX; i++) {
+		m_isr_last[i] = m_isr_cycles[i];
+		m_isr_cycles[i] = 0;
+	}
+	chSysUnlock();
+
+	/* registry walk can't be done in lock,
+	 * so each thread window is shifted a bit.
+	 */
+	tp = chRegFirstThread();
+	do {
+		chSysLock();
+		tp->load_last = tp->load_cycles;
+		tp->load_cycles = 0;
+		chSysUnlock();
+
+		tp = chRegNextThread(tp);
+	} while (tp != NULL);
+
+	if (m_window_cycles == 0)
+		return;
+
+	idle = chSysGetIdleThreadX()->load_last;
+	if (idle > m_window_cycles)
+		idle = m_window_cycles;
+
+	m_load = (uint64_t)(m_window_cycles - idle) * 100 / m_window_cycles;
+}
+
+/** CPU load in last window [%]
+ */
+uint32_t cpu_load_get(void)
+{
+	return m_load;
+}
+
+/** Thread CPU time in last window [1/CPU_LOAD_SCALE]
+ */
+uint32_t cpu_load_get_thread(const thread_t *tp)
+{
+	return to_load(tp->load_last);
+}
+
+/** ISR handler CPU time in last window [1/CPU_LOAD_SCALE]
+ */
+uint32_t cpu_load_get_isr(enum cpu_load_isr isr)
+{
+	return to_load(m_isr_last[isr]);
+}
+
+/** Sum of accounted ISR time in last window [1/CPU_LOAD_SCALE]
+ */
+uint32_t cpu_load_get_isr_total(void)
+{
+	uint32_t sum = 0;
+
+	for (size_t i = 0; i < CLI_MAX; i++)
+		sum += m_isr_last[i];
+
+	return to_load(sum);
+}
+
+const char *cpu_load_get_isr_name(enum cpu_load_isr isr)
+{
+	return m_isr_names[isr];
+}
+
+/** Last window length [CPU cycles]
+ */
+uint32_t cpu_load_get_window(void)
+{
+	return m_window_cycles;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file       cpu_load.h
+ * @brief      CPU load measurement
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef CPU_LOAD_H
+#define CPU_LOAD_H
+
+#include "fw_common.h"
+
+//! Per-thread and ISR load units: 0.01 %
+#define CPU_LOAD_SCALE		10000
+
+/** Accounted ISR handlers
+ */
+enum cpu_load_isr {
+	CLI_RPM = 0,	//!< RPM capture (TIM3 revolution, DMA)
+	CLI_ADC1,	//!< ADC1 block handler
+	CLI_SDADC1,	//!< SDADC1 block handler
+	CLI_SDADC3,	//!< SDADC3 block handler
+	CLI_SERIAL1,	//!< SERIAL1 DMA and idle line
+	CLI_MAX
+};
+
+void cpu_load_switch(thread_t *otp);
+void cpu_load_isr_account(enum cpu_load_isr isr, rtcnt_t start);
+void cpu_load_update(void);
+uint32_t cpu_load_get(void);
+uint32_t cpu_load_get_thread(const thread_t *tp);
+uint32_t cpu_load_get_isr(enum cpu_load_isr isr);
+uint32_t cpu_load_get_isr_total(void);
+const char *cpu_load_get_isr_name(enum cpu_load_isr isr);
+uint32_t cpu_load_get_window(void);
+
+#endif /* CPU_LOAD_H */
@@ -8,6 +8,8 @@ include ${MINIECU}/fw/adc/adc.mk
 # List of all the board related files.
 FWSRC = ${MINIECU}/fw/main.c \
 	${MINIECU}/fw/alert_led.c \
+	${MINIECU}/fw/cpu_load.c \
+	${MINIECU}/fw/sensors.c \
 	${PARAMSRC} \
 	${FWLIBSRC} \
 	${HWSRC} \
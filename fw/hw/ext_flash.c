@@ -29,6 +29,7 @@
 SST25Driver FLASHD1;
 
 SST25Driver FLASHD1_config;	//!< Config partition
+SST25Driver FLASHD1_fuel;	//!< Fuel used checkpoints partition
 SST25Driver FLASHD1_error;	//!< Error log partition
 SST25Driver FLASHD1_log;	//!< Log partition
 
@@ -57,13 +58,15 @@ static const SST25Config flash1_cfg = {
  *
  * Partitions:
  * - config: 16 KiB
+ * - fuel: 8 KiB
  * - error: 64 KiB
  * - log: chip size - config - error
  */
 static const struct sst25_partition init_parts[] = {
 	{ &FLASHD1_config, { .name = "config", .start_page = 0, .nr_pages = EPAGES * 4 /* 16 KiB */ } },
-	{ &FLASHD1_error, { .name = "error", .start_page = EPAGES * 4, .nr_pages = EPAGES * 16 /* 64 KiB */ } },
-	{ &FLASHD1_log, { .name = "log", .start_page = EPAGES * 4 + EPAGES * 16, .nr_pages = UINT32_MAX /* all above */ } },
+	{ &FLASHD1_fuel, { .name = "fuel", .start_page = EPAGES * 4, .nr_pages = EPAGES * 2 /* 8 KiB */ } },
+	{ &FLASHD1_error, { .name = "error", .start_page = EPAGES * 6, .nr_pages = EPAGES * 16 /* 64 KiB */ } },
+	{ &FLASHD1_log, { .name = "log", .start_page = EPAGES * 6 + EPAGES * 16, .nr_pages = UINT32_MAX /* all above */ } },
 	{ NULL }
 };
 
@@ -74,6 +77,7 @@ void flash_init(void)
 {
 	sst25ObjectInit(&FLASHD1);
 	sst25ObjectInit(&FLASHD1_config);
+	sst25ObjectInit(&FLASHD1_fuel);
 	sst25ObjectInit(&FLASHD1_error);
 	sst25ObjectInit(&FLASHD1_log);
 	sst25Start(&FLASHD1, &flash1_cfg);
@@ -29,6 +29,7 @@
 
 extern SST25Driver FLASHD1;
 extern SST25Driver FLASHD1_config;
+extern SST25Driver FLASHD1_fuel;
 extern SST25Driver FLASHD1_error;
 extern SST25Driver FLASHD1_log;
 
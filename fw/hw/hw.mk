@@ -1,6 +1,8 @@
 HWSRC = ${MINIECU}/fw/hw/usb_vcom.c \
 	${MINIECU}/fw/hw/serial1.c \
+	${MINIECU}/fw/hw/serial1_dma.c \
 	${MINIECU}/fw/hw/rtc_time.c \
-	${MINIECU}/fw/hw/ext_flash.c
+	${MINIECU}/fw/hw/ext_flash.c \
+	${MINIECU}/fw/hw/rpm_capture.c
 
 HWINC =
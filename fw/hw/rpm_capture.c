@@ -0,0 +1,223 @@
+/**
+ * @file       hw/rpm_capture.c
+ * @brief      Crank edge timestamp capture (TIM2 + DMA)
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "alert_led.h"
+#include "rpm_capture.h"
+#include "cpu_load.h"
+
+#ifndef BOARD_MINIECU_V2
+# error "unsupported board"
+#endif
+
+/* Notes:
+ * RPM_IN (PA0) is TIM2_CH1. TIM2_CH1 DMA request shares DMA1 channel 5
+ * with USART1_RX, so we capture on CH2 with IC2 mapped on TI1
+ * and use TIM2_CH2 request (DMA1 channel 7) instead.
+ *
+ * TIM2 is 32-bit and runs free at 1 MHz, so timestamp wraps after ~71 min,
+ * differences are computed with unsigned arithmetic.
+ *
+ * Revolution counter: CC1 also captures TI1 (without DMA) and TIM2 TRGO
+ * sends compare pulse on each CC1IF. TIM3 counts these pulses
+ * (external clock mode 1, ITR1 = TIM2) and makes update interrupt
+ * once per revolution. Its phase is set by rpm_capture_align_rev()
+ * from decoder revolutions, before first alignment interrupt
+ * may be late up to rev_edges - 1 edges (or batch timeout).
+ */
+
+#define CAPTURE_TIM		STM32_TIM2
+#define CAPTURE_DMA_STREAM	STM32_DMA1_STREAM7
+#define REV_TIM			STM32_TIM3
+
+/* -*- private data -*- */
+
+static volatile uint32_t m_ring[RPM_CAPTURE_RING_SIZE];
+static volatile uint32_t m_laps;
+static thread_t *m_rev_thread;
+static eventmask_t m_rev_events;
+
+
+/* -*- local -*- */
+
+static void capture_dma_cb(void *p ATTR_UNUSED, uint32_t flags)
+{
+	rtcnt_t start = chSysGetRealtimeCounterX();
+
+	if (flags & STM32_DMA_ISR_TEIF) {
+		alert_component(ALS_RPM, AL_FAIL);
+		return;
+	}
+
+	// ring wrapped, only interrupt on capture path
+	m_laps++;
+	cpu_load_isr_account(CLI_RPM, start);
+}
+
+/** TIM3 update: full revolution
+ */
+CH_IRQ_HANDLER(STM32_TIM3_HANDLER)
+{
+	rtcnt_t start = chSysGetRealtimeCounterX();
+
+	CH_IRQ_PROLOGUE();
+
+	REV_TIM->SR = 0;
+
+	chSysLockFromISR();
+	if (m_rev_thread != NULL)
+		chEvtSignalI(m_rev_thread, m_rev_events);
+	chSysUnlockFromISR();
+
+	cpu_load_isr_account(CLI_RPM, start);
+	CH_IRQ_EPILOGUE();
+}
+
+
+/* -*- public functions -*- */
+
+/** Start TIM2 capture with DMA transfer to timestamp ring
+ *
+ * @param rev_edges	edges per revolution
+ * @param tp		thread signaled on each revolution
+ * @param events	events to signal
+ */
+void rpm_capture_start(uint32_t rev_edges, thread_t *tp, eventmask_t events)
+{
+	bool b;
+
+	m_laps = 0;
+	m_rev_thread = tp;
+	m_rev_events = events;
+
+	rccEnableTIM2(FALSE);
+	rccResetTIM2();
+
+	b = dmaStreamAllocate(CAPTURE_DMA_STREAM, RPM_DMA_IRQ_PRIORITY,
+			capture_dma_cb, NULL);
+	osalDbgAssert(!b, "stream already allocated");
+
+	dmaStreamSetPeripheral(CAPTURE_DMA_STREAM, &CAPTURE_TIM->CCR[1]);
+	dmaStreamSetMemory0(CAPTURE_DMA_STREAM, m_ring);
+	dmaStreamSetTransactionSize(CAPTURE_DMA_STREAM, RPM_CAPTURE_RING_SIZE);
+	dmaStreamSetMode(CAPTURE_DMA_STREAM,
+			STM32_DMA_CR_PL(RPM_DMA_PRIORITY) |
+			STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_MINC | STM32_DMA_CR_CIRC |
+			STM32_DMA_CR_PSIZE_WORD | STM32_DMA_CR_MSIZE_WORD |
+			STM32_DMA_CR_TCIE | STM32_DMA_CR_TEIE);
+	dmaStreamEnable(CAPTURE_DMA_STREAM);
+
+	CAPTURE_TIM->CR1 = 0;
+	CAPTURE_TIM->PSC = STM32_TIMCLK1 / RPM_CAPTURE_FREQUENCY - 1;
+	CAPTURE_TIM->ARR = 0xffffffff;
+	/* IC1 <- TI1, IC2 <- TI1, filter fCK_INT N=8 */
+	CAPTURE_TIM->CCMR1 = STM32_TIM_CCMR1_CC1S(1) | STM32_TIM_CCMR1_IC1F(3) |
+		STM32_TIM_CCMR1_CC2S(2) | STM32_TIM_CCMR1_IC2F(3);
+	/* falling edge (same as ICU_INPUT_ACTIVE_LOW period) */
+	CAPTURE_TIM->CCER = STM32_TIM_CCER_CC1E | STM32_TIM_CCER_CC1P |
+		STM32_TIM_CCER_CC2E | STM32_TIM_CCER_CC2P;
+	/* TRGO: compare pulse */
+	CAPTURE_TIM->CR2 = STM32_TIM_CR2_MMS(3);
+	CAPTURE_TIM->DIER = STM32_TIM_DIER_CC2DE;
+	CAPTURE_TIM->EGR = STM32_TIM_EGR_UG;
+	CAPTURE_TIM->SR = 0;
+
+	/* revolution counter */
+	rccEnableTIM3(FALSE);
+	rccResetTIM3();
+
+	REV_TIM->CR1 = 0;
+	REV_TIM->PSC = 0;
+	REV_TIM->ARR = rev_edges - 1;
+	REV_TIM->SMCR = STM32_TIM_SMCR_TS(1) | STM32_TIM_SMCR_SMS(7);
+	REV_TIM->EGR = STM32_TIM_EGR_UG;
+	REV_TIM->SR = 0;
+	REV_TIM->DIER = STM32_TIM_DIER_UIE;
+	REV_TIM->CR1 = STM32_TIM_CR1_URS | STM32_TIM_CR1_CEN;
+	nvicEnableVector(STM32_TIM3_NUMBER, RPM_REV_IRQ_PRIORITY);
+
+	CAPTURE_TIM->CR1 = STM32_TIM_CR1_CEN;
+}
+
+/** Change revolution counter period
+ */
+void rpm_capture_set_rev_edges(uint32_t rev_edges)
+{
+	REV_TIM->ARR = rev_edges - 1;
+}
+
+/** Phase align revolution counter
+ *
+ * Next revolution interrupt will come rev_edges after edge n.
+ * Edge captured between count read and CNT write makes it
+ * one edge late, corrected by next call.
+ *
+ * @param n	monotonic number of revolution start edge
+ */
+void rpm_capture_align_rev(uint32_t n)
+{
+	uint32_t rev_edges = REV_TIM->ARR + 1;
+	uint32_t since = rpm_capture_get_count() - 1 - n;
+
+	REV_TIM->CNT = since % rev_edges;
+}
+
+/** Monotonic count of captured edges
+ *
+ * Index of next write in the ring is count % RPM_CAPTURE_RING_SIZE.
+ */
+uint32_t rpm_capture_get_count(void)
+{
+	uint32_t laps, pos;
+
+	/* re-read if TC interrupt happens between reads */
+	do {
+		laps = m_laps;
+		pos = RPM_CAPTURE_RING_SIZE - dmaStreamGetTransactionSize(CAPTURE_DMA_STREAM);
+	} while (laps != m_laps);
+
+	return laps * RPM_CAPTURE_RING_SIZE + pos;
+}
+
+/** Get timestamp of edge n (monotonic number)
+ *
+ * Caller should not lag more than RPM_CAPTURE_RING_SIZE edges.
+ */
+uint32_t rpm_capture_get_timestamp(uint32_t n)
+{
+	return m_ring[n % RPM_CAPTURE_RING_SIZE];
+}
+
+/** Timestamp ring for batch access
+ *
+ * Edge n is at index n % RPM_CAPTURE_RING_SIZE.
+ */
+const volatile uint32_t *rpm_capture_get_ring(void)
+{
+	return m_ring;
+}
+
+/** Current time of capture timer [us]
+ */
+uint32_t rpm_capture_now(void)
+{
+	return CAPTURE_TIM->CNT;
+}
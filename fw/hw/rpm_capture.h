@@ -0,0 +1,41 @@
+/**
+ * @file       hw/rpm_capture.h
+ * @brief      Crank edge timestamp capture (TIM2 + DMA)
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef HW_RPM_CAPTURE_H
+#define HW_RPM_CAPTURE_H
+
+#include "fw_common.h"
+
+//! Timestamp ring size (power of 2), 2 KiB of RAM
+#define RPM_CAPTURE_RING_SIZE	512
+//! Capture timer resolution
+#define RPM_CAPTURE_FREQUENCY	1000000
+
+void rpm_capture_start(uint32_t rev_edges, thread_t *tp, eventmask_t events);
+void rpm_capture_set_rev_edges(uint32_t rev_edges);
+void rpm_capture_align_rev(uint32_t n);
+uint32_t rpm_capture_get_count(void);
+uint32_t rpm_capture_get_timestamp(uint32_t n);
+const volatile uint32_t *rpm_capture_get_ring(void);
+uint32_t rpm_capture_now(void);
+
+#endif /* HW_RPM_CAPTURE_H */
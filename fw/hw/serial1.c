@@ -22,11 +22,18 @@
 
 #include "alert_led.h"
 #include "param.h"
+#include "serial1.h"
+#if SERIAL1_USE_DMA
+# include "serial1_dma.h"
+#endif
 
 /* global parameters */
 int32_t gp_serial1_baud;
 
 
+static uint32_t m_baud = SERIAL_DEFAULT_BITRATE;
+
+#if !SERIAL1_USE_DMA
 static SerialConfig serial1_cfg = {
 	.speed = SERIAL_DEFAULT_BITRATE,
 	.cr1 = 0,
@@ -34,6 +41,27 @@ static SerialConfig serial1_cfg = {
 	.cr2 = USART_CR2_STOP1_BITS | USART_CR2_ABREN | USART_CR2_ABRMODE_0,
 	.cr3 = 0
 };
+#endif
+
+void serial1_init(void)
+{
+#if SERIAL1_USE_DMA
+	serial1_dma_start(m_baud);
+#else
+	sdStart(&SERIAL1_SD, NULL);
+#endif
+}
+
+/** Channel for protocol thread
+ */
+BaseChannel *serial1_get_channel(void)
+{
+#if SERIAL1_USE_DMA
+	return serial1_dma_get_channel();
+#else
+	return (BaseChannel *)&SERIAL1_SD;
+#endif
+}
 
 void on_change_serial1_baud(const struct param_entry *p ATTR_UNUSED)
 {
@@ -47,12 +75,17 @@ void on_change_serial1_baud(const struct param_entry *p ATTR_UNUSED)
 	case 460800:
 	case 921600:
 		debug_printf(DP_WARN, "serial1 baud change: %" PRIi32, gp_serial1_baud);
-		serial1_cfg.speed = gp_serial1_baud;
+		m_baud = gp_serial1_baud;
+#if SERIAL1_USE_DMA
+		serial1_dma_start(m_baud);
+#else
+		serial1_cfg.speed = m_baud;
 		sdStart(&SERIAL1_SD, &serial1_cfg);
+#endif
 		break;
 
 	default:
-		gp_serial1_baud = serial1_cfg.speed;
+		gp_serial1_baud = m_baud;
 		break;
 	}
 }
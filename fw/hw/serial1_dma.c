@@ -0,0 +1,414 @@
+/**
+ * @file       hw/serial1_dma.c
+ * @brief      SERIAL1 (USART1) DMA transport
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "alert_led.h"
+#include "serial1_dma.h"
+#include "cpu_load.h"
+#include <string.h>
+
+#ifndef BOARD_MINIECU_V2
+# error "unsupported board"
+#endif
+
+#if SERIAL1_USE_DMA
+
+#if STM32_SERIAL_USE_USART1 || STM32_UART_USE_USART1
+# error "SERIAL1_USE_DMA requires USART1 not used by ChibiOS drivers"
+#endif
+
+/* Notes:
+ * USART1_RX DMA request is DMA1 channel 5 (so RPM capture uses TIM2_CH2),
+ * USART1_TX is DMA1 channel 4.
+ *
+ * RX DMA runs circular into the ring, received byte count is monotonic
+ * (laps counted on TC, same as rpm_capture). Reader is woken up
+ * by IDLE line (end of burst) and by HT/TC for long bursts.
+ * Ring tail is owned by one reader thread.
+ *
+ * TX sends one contiguous buffer per DMA transaction, caller waits
+ * for transfer complete, so buffer is not copied.
+ */
+
+#define SERIAL1_USART		USART1
+#define RX_DMA_STREAM		STM32_DMA1_STREAM5
+#define TX_DMA_STREAM		STM32_DMA1_STREAM4
+
+#define RX_DMA_MODE	(STM32_DMA_CR_PL(SERIAL1_DMA_PRIORITY) | \
+		STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_MINC | STM32_DMA_CR_CIRC | \
+		STM32_DMA_CR_PSIZE_BYTE | STM32_DMA_CR_MSIZE_BYTE | \
+		STM32_DMA_CR_HTIE | STM32_DMA_CR_TCIE | STM32_DMA_CR_TEIE)
+#define TX_DMA_MODE	(STM32_DMA_CR_PL(SERIAL1_DMA_PRIORITY) | \
+		STM32_DMA_CR_DIR_M2P | STM32_DMA_CR_MINC | \
+		STM32_DMA_CR_PSIZE_BYTE | STM32_DMA_CR_MSIZE_BYTE | \
+		STM32_DMA_CR_TCIE | STM32_DMA_CR_TEIE)
+
+/* -*- private data -*- */
+
+static uint8_t m_rx_ring[SERIAL1_DMA_RX_SIZE];
+static volatile uint32_t m_rx_laps;
+static volatile uint32_t m_rx_events;
+static volatile uint32_t m_rx_errors;	// USART overrun/framing/noise
+static uint32_t m_rx_tail;
+static uint32_t m_rx_overruns;		// ring overrun
+static thread_reference_t m_rx_thread;
+static thread_reference_t m_tx_thread;
+static MUTEX_DECL(m_tx_mtx);
+static bool m_started;
+
+static const struct BaseChannelVMT m_vmt;
+static BaseChannel m_channel = { .vmt = &m_vmt };
+
+
+/* -*- local -*- */
+
+static uint32_t rx_count(void)
+{
+	uint32_t laps, pos;
+
+	/* re-read if TC interrupt happens between reads */
+	do {
+		laps = m_rx_laps;
+		pos = SERIAL1_DMA_RX_SIZE - dmaStreamGetTransactionSize(RX_DMA_STREAM);
+	} while (laps != m_rx_laps);
+
+	return laps * SERIAL1_DMA_RX_SIZE + pos;
+}
+
+static void rx_wakeup_i(void)
+{
+	m_rx_events++;
+	osalThreadResumeI(&m_rx_thread, MSG_OK);
+}
+
+static void rx_dma_cb(void *p ATTR_UNUSED, uint32_t flags)
+{
+	rtcnt_t start = chSysGetRealtimeCounterX();
+
+	if (flags & STM32_DMA_ISR_TEIF) {
+		alert_component(ALS_COMM, AL_FAIL);
+		return;
+	}
+
+	chSysLockFromISR();
+	if (flags & STM32_DMA_ISR_TCIF)
+		m_rx_laps++;
+	rx_wakeup_i();
+	chSysUnlockFromISR();
+
+	cpu_load_isr_account(CLI_SERIAL1, start);
+}
+
+static void tx_dma_cb(void *p ATTR_UNUSED, uint32_t flags)
+{
+	rtcnt_t start = chSysGetRealtimeCounterX();
+
+	dmaStreamDisable(TX_DMA_STREAM);
+
+	chSysLockFromISR();
+	osalThreadResumeI(&m_tx_thread, (flags & STM32_DMA_ISR_TEIF) ? MSG_RESET : MSG_OK);
+	chSysUnlockFromISR();
+
+	cpu_load_isr_account(CLI_SERIAL1, start);
+}
+
+/** USART1: idle line and receive errors
+ */
+CH_IRQ_HANDLER(STM32_USART1_HANDLER)
+{
+	rtcnt_t start = chSysGetRealtimeCounterX();
+	uint32_t isr;
+
+	CH_IRQ_PROLOGUE();
+
+	isr = SERIAL1_USART->ISR;
+	SERIAL1_USART->ICR = isr & (USART_ICR_IDLECF | USART_ICR_ORECF |
+			USART_ICR_NCF | USART_ICR_FECF);
+
+	if (isr & (USART_ISR_ORE | USART_ISR_NE | USART_ISR_FE))
+		m_rx_errors++;
+
+	if (isr & USART_ISR_IDLE) {
+		chSysLockFromISR();
+		rx_wakeup_i();
+		chSysUnlockFromISR();
+	}
+
+	cpu_load_isr_account(CLI_SERIAL1, start);
+	CH_IRQ_EPILOGUE();
+}
+
+/* -*- BaseChannel methods -*- */
+
+static size_t vmt_writet(void *ip ATTR_UNUSED, const uint8_t *bp, size_t n, systime_t time)
+{
+	return (serial1_dma_send(bp, n, time) == MSG_OK) ? n : 0;
+}
+
+static size_t vmt_readt(void *ip ATTR_UNUSED, uint8_t *bp, size_t n, systime_t time)
+{
+	size_t done = 0;
+
+	while (done < n && serial1_dma_rx_wait(1, time) == MSG_OK) {
+		const uint8_t *p;
+		size_t len = serial1_dma_rx_span(0, &p);
+		size_t avail = serial1_dma_rx_available();
+
+		if (len > avail)
+			len = avail;
+		if (len > n - done)
+			len = n - done;
+
+		memcpy(bp + done, p, len);
+		if (!serial1_dma_rx_consume(len))
+			continue;
+
+		done += len;
+	}
+
+	return done;
+}
+
+static msg_t vmt_putt(void *ip ATTR_UNUSED, uint8_t b, systime_t time)
+{
+	return serial1_dma_send(&b, 1, time);
+}
+
+static msg_t vmt_gett(void *ip ATTR_UNUSED, systime_t time)
+{
+	msg_t ret = serial1_dma_rx_wait(1, time);
+
+	if (ret != MSG_OK)
+		return ret;
+
+	ret = serial1_dma_rx_peek(0);
+	return serial1_dma_rx_consume(1) ? ret : MSG_RESET;
+}
+
+static size_t vmt_write(void *ip, const uint8_t *bp, size_t n)
+{
+	return vmt_writet(ip, bp, n, TIME_INFINITE);
+}
+
+static size_t vmt_read(void *ip, uint8_t *bp, size_t n)
+{
+	return vmt_readt(ip, bp, n, TIME_INFINITE);
+}
+
+static msg_t vmt_put(void *ip, uint8_t b)
+{
+	return vmt_putt(ip, b, TIME_INFINITE);
+}
+
+static msg_t vmt_get(void *ip)
+{
+	return vmt_gett(ip, TIME_INFINITE);
+}
+
+static const struct BaseChannelVMT m_vmt = {
+	.write = vmt_write,
+	.read = vmt_read,
+	.put = vmt_put,
+	.get = vmt_get,
+	.putt = vmt_putt,
+	.gett = vmt_gett,
+	.writet = vmt_writet,
+	.readt = vmt_readt
+};
+
+
+/* -*- public functions -*- */
+
+/** Start USART1 with DMA or change baudrate
+ *
+ * RX DMA keeps running on baudrate change, TX frame in progress is finished.
+ */
+void serial1_dma_start(uint32_t baud)
+{
+	bool b;
+
+	chMtxLock(&m_tx_mtx);
+
+	if (!m_started) {
+		rccEnableUSART1(FALSE);
+		rccResetUSART1();
+
+		b = dmaStreamAllocate(RX_DMA_STREAM, SERIAL1_IRQ_PRIORITY, rx_dma_cb, NULL);
+		osalDbgAssert(!b, "stream already allocated");
+		b = dmaStreamAllocate(TX_DMA_STREAM, SERIAL1_IRQ_PRIORITY, tx_dma_cb, NULL);
+		osalDbgAssert(!b, "stream already allocated");
+
+		dmaStreamSetPeripheral(RX_DMA_STREAM, &SERIAL1_USART->RDR);
+		dmaStreamSetMemory0(RX_DMA_STREAM, m_rx_ring);
+		dmaStreamSetTransactionSize(RX_DMA_STREAM, SERIAL1_DMA_RX_SIZE);
+		dmaStreamSetMode(RX_DMA_STREAM, RX_DMA_MODE);
+		dmaStreamEnable(RX_DMA_STREAM);
+
+		dmaStreamSetPeripheral(TX_DMA_STREAM, &SERIAL1_USART->TDR);
+
+		nvicEnableVector(STM32_USART1_NUMBER, SERIAL1_IRQ_PRIORITY);
+		m_started = true;
+	}
+
+	SERIAL1_USART->CR1 = 0;
+	SERIAL1_USART->BRR = STM32_USART1CLK / baud;
+	/* 8N1, autobaud mode 1 */
+	SERIAL1_USART->CR2 = USART_CR2_ABREN | USART_CR2_ABRMODE_0;
+	SERIAL1_USART->CR3 = USART_CR3_DMAR | USART_CR3_DMAT | USART_CR3_EIE;
+	SERIAL1_USART->ICR = 0xffffffff;
+	SERIAL1_USART->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE | USART_CR1_IDLEIE;
+
+	chMtxUnlock(&m_tx_mtx);
+}
+
+/** BaseChannel interface of SERIAL1
+ */
+BaseChannel *serial1_dma_get_channel(void)
+{
+	return &m_channel;
+}
+
+/** Check if channel is SERIAL1 DMA, so frame functions may be used
+ */
+bool serial1_dma_is_channel(BaseChannel *chp)
+{
+	return chp == &m_channel;
+}
+
+/** Send buffer in one DMA transaction
+ *
+ * Blocks until transfer complete, so buffer may be on the stack.
+ */
+msg_t serial1_dma_send(const uint8_t *buf, size_t n, systime_t timeout)
+{
+	msg_t ret;
+
+	if (!m_started)
+		return MSG_RESET;
+	if (n == 0)
+		return MSG_OK;
+
+	chMtxLock(&m_tx_mtx);
+
+	dmaStreamSetMemory0(TX_DMA_STREAM, buf);
+	dmaStreamSetTransactionSize(TX_DMA_STREAM, n);
+	dmaStreamSetMode(TX_DMA_STREAM, TX_DMA_MODE);
+
+	chSysLock();
+	dmaStreamEnable(TX_DMA_STREAM);
+	ret = osalThreadSuspendTimeoutS(&m_tx_thread, timeout);
+	if (ret == MSG_TIMEOUT)
+		dmaStreamDisable(TX_DMA_STREAM);
+	chSysUnlock();
+
+	chMtxUnlock(&m_tx_mtx);
+	return ret;
+}
+
+/** Wait until at least n bytes received
+ *
+ * @return MSG_OK or MSG_TIMEOUT
+ */
+msg_t serial1_dma_rx_wait(size_t n, systime_t timeout)
+{
+	systime_t start = osalOsGetSystemTimeX();
+
+	osalDbgCheck(n <= SERIAL1_DMA_RX_SIZE);
+
+	while (true) {
+		uint32_t events = m_rx_events;
+		systime_t elapsed;
+
+		if (serial1_dma_rx_available() >= n)
+			return MSG_OK;
+
+		elapsed = chVTTimeElapsedSinceX(start);
+		if (timeout != TIME_INFINITE && elapsed >= timeout)
+			return MSG_TIMEOUT;
+
+		/* sleep only if no RX event since counter read */
+		chSysLock();
+		if (events == m_rx_events)
+			osalThreadSuspendTimeoutS(&m_rx_thread,
+					(timeout == TIME_INFINITE) ? TIME_INFINITE : timeout - elapsed);
+		chSysUnlock();
+	}
+}
+
+/** Received bytes not consumed yet
+ *
+ * On ring overrun all pending data dropped.
+ */
+size_t serial1_dma_rx_available(void)
+{
+	uint32_t head = rx_count();
+
+	if (head - m_rx_tail > SERIAL1_DMA_RX_SIZE) {
+		m_rx_overruns++;
+		m_rx_tail = head;
+		alert_component(ALS_COMM, AL_FAIL);
+	}
+
+	return head - m_rx_tail;
+}
+
+/** Get pending byte at offset from tail
+ */
+uint8_t serial1_dma_rx_peek(size_t offset)
+{
+	return m_rx_ring[(m_rx_tail + offset) % SERIAL1_DMA_RX_SIZE];
+}
+
+/** Contiguous part of the ring starting at offset from tail
+ *
+ * @return bytes to ring end, caller limits it by available data
+ */
+size_t serial1_dma_rx_span(size_t offset, const uint8_t **ptr)
+{
+	uint32_t idx = (m_rx_tail + offset) % SERIAL1_DMA_RX_SIZE;
+
+	*ptr = &m_rx_ring[idx];
+	return SERIAL1_DMA_RX_SIZE - idx;
+}
+
+/** Release n bytes
+ *
+ * @return false if ring overran while data was in use
+ */
+bool serial1_dma_rx_consume(size_t n)
+{
+	if (rx_count() - m_rx_tail > SERIAL1_DMA_RX_SIZE) {
+		serial1_dma_rx_available();
+		return false;
+	}
+
+	m_rx_tail += n;
+	return true;
+}
+
+/** Lost bytes events: ring overruns and USART errors
+ */
+uint32_t serial1_dma_get_overruns(void)
+{
+	return m_rx_overruns + m_rx_errors;
+}
+
+#endif /* SERIAL1_USE_DMA */
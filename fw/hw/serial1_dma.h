@@ -0,0 +1,44 @@
+/**
+ * @file       hw/serial1_dma.h
+ * @brief      SERIAL1 (USART1) DMA transport
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef HW_SERIAL1_DMA_H
+#define HW_SERIAL1_DMA_H
+
+#include "fw_common.h"
+
+//! RX ring size (power of 2), ~11 ms at 921600 baud
+#define SERIAL1_DMA_RX_SIZE	1024
+
+void serial1_dma_start(uint32_t baud);
+BaseChannel *serial1_dma_get_channel(void);
+bool serial1_dma_is_channel(BaseChannel *chp);
+
+/* zero-copy frame access */
+msg_t serial1_dma_send(const uint8_t *buf, size_t n, systime_t timeout);
+msg_t serial1_dma_rx_wait(size_t n, systime_t timeout);
+size_t serial1_dma_rx_available(void);
+uint8_t serial1_dma_rx_peek(size_t offset);
+size_t serial1_dma_rx_span(size_t offset, const uint8_t **ptr);
+bool serial1_dma_rx_consume(size_t n);
+uint32_t serial1_dma_get_overruns(void);
+
+#endif /* HW_SERIAL1_DMA_H */
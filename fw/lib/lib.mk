@@ -1,5 +1,6 @@
 FWLIBSRC = ${MINIECU}/fw/lib/lib_crc16.c \
 	   ${MINIECU}/fw/lib/ntc.c \
-	   ${MINIECU}/fw/lib/lowpassfilter2p.c
+	   ${MINIECU}/fw/lib/lowpassfilter2p.c \
+	   ${MINIECU}/fw/lib/trigger_decoder.c
 
 FWLIBINC = ${MINIECU}/fw/lib
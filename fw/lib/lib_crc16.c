@@ -55,6 +55,29 @@
 
 #include "fw_common.h"
 #include "lib_crc16.h"
+#include <string.h>
+
+/************************************************************************************************
+ * Pre-processor Definitions
+ ************************************************************************************************/
+
+/* Note: crc16part() is the "augmented" form, data byte is xored after the shift,
+ * so result is (crc16val * x^(8 len) + data) mod P, P = 0x11021.
+ * Slicing and hardware variants keep exactly this value (stored parameters
+ * and PBStx frames depend on it).
+ *
+ * Slicing-by-N: N bytes per step,
+ *   crc' = (crc * x^(8 N) + b0 * x^(8 (N-1)) + ... + b(N-1)) mod P,
+ * where every term above x^15 is a table lookup (CRC16_TAB(k)[v] = v * x^(8 (k+2)) mod P)
+ * and last two bytes are taken as is.
+ */
+
+#define CRC16_TAB(k)  ((k) == 0 ? crc16_tab : crc16_slice_tab[(k) - 1])
+
+#if CRC16_USE_HW
+/* STM32F37x CRC unit: programmable polynomial, POLYSIZE 16 */
+#  define CRC_CR_POLYSIZE_16  CRC_CR_POLYSIZE_0
+#endif
 
 /************************************************************************************************
  * Private Data
@@ -62,7 +85,7 @@
 
 /* crc16_tab calculated by Mark G. Mendel, Network Systems Corporation */
 
-static uint16_t crc16_tab[256] =
+static const uint16_t crc16_tab[256] =
 {
   0x0000,  0x1021,  0x2042,  0x3063,  0x4084,  0x50a5,  0x60c6,  0x70e7,
   0x8108,  0x9129,  0xa14a,  0xb16b,  0xc18c,  0xd1ad,  0xe1ce,  0xf1ef,
@@ -98,18 +121,26 @@ static uint16_t crc16_tab[256] =
   0x6e17,  0x7e36,  0x4e55,  0x5e74,  0x2e93,  0x3eb2,  0x0ed1,  0x1ef0
 };
 
+/* crc16_tab * x^8k, generated by tools/crc16_tables.py */
+
+#include "lib_crc16_slice.h"
+
+#if CRC16_USE_HW
+static MUTEX_DECL(crc16_hw_mtx);
+#endif
+
 /************************************************************************************************
  * Public Functions
  ************************************************************************************************/
 /************************************************************************************************
- * Name: crc16part
+ * Name: crc16part_bytewise
  *
  * Description:
- *   Continue CRC calculation on a part of the buffer.
+ *   Reference implementation, one table lookup per byte.
  *
  ************************************************************************************************/
 
-uint16_t crc16part(const uint8_t *src, size_t len, uint16_t crc16val)
+uint16_t crc16part_bytewise(const uint8_t *src, size_t len, uint16_t crc16val)
 {
   size_t i;
 
@@ -121,6 +152,150 @@ uint16_t crc16part(const uint8_t *src, size_t len, uint16_t crc16val)
   return crc16val;
 }
 
+/************************************************************************************************
+ * Name: crc16part_slice4
+ *
+ * Description:
+ *   Slicing-by-4 variant of crc16part_bytewise().
+ *
+ ************************************************************************************************/
+
+uint16_t crc16part_slice4(const uint8_t *src, size_t len, uint16_t crc16val)
+{
+  for (; len >= 4;  len -= 4, src += 4)
+    {
+      crc16val = CRC16_TAB(3)[crc16val >> 8] ^ CRC16_TAB(2)[crc16val & 255] ^
+                 CRC16_TAB(1)[src[0]] ^ CRC16_TAB(0)[src[1]] ^
+                 (src[2] << 8) ^ src[3];
+    }
+
+  return crc16part_bytewise(src, len, crc16val);
+}
+
+/************************************************************************************************
+ * Name: crc16part_slice8
+ *
+ * Description:
+ *   Slicing-by-8 variant of crc16part_bytewise().
+ *
+ ************************************************************************************************/
+
+uint16_t crc16part_slice8(const uint8_t *src, size_t len, uint16_t crc16val)
+{
+  for (; len >= 8;  len -= 8, src += 8)
+    {
+      crc16val = CRC16_TAB(7)[crc16val >> 8] ^ CRC16_TAB(6)[crc16val & 255] ^
+                 CRC16_TAB(5)[src[0]] ^ CRC16_TAB(4)[src[1]] ^
+                 CRC16_TAB(3)[src[2]] ^ CRC16_TAB(2)[src[3]] ^
+                 CRC16_TAB(1)[src[4]] ^ CRC16_TAB(0)[src[5]] ^
+                 (src[6] << 8) ^ src[7];
+    }
+
+  return crc16part_bytewise(src, len, crc16val);
+}
+
+#if CRC16_USE_HW
+/************************************************************************************************
+ * Name: crc16_hw_init
+ *
+ * Description:
+ *   Enable CRC unit and setup it for polynomial 0x1021, initial value 0.
+ *
+ ************************************************************************************************/
+
+void crc16_hw_init(void)
+{
+  rccEnableAHB(RCC_AHBENR_CRCEN, FALSE);
+
+  CRC->POL = 0x1021;
+  CRC->INIT = 0;
+  CRC->CR = CRC_CR_POLYSIZE_16 | CRC_CR_RESET;
+}
+
+/************************************************************************************************
+ * Name: crc16part_hw
+ *
+ * Description:
+ *   crc16part() on CRC unit.
+ *
+ *   Unit computes plain (non augmented) CRC: (init * x^(8 n) + data * x^16) mod P.
+ *   So stream "crc16val, src" is fed without last two bytes, which are xored to result:
+ *   (crc16val * x^(8 len) + src) mod P == crc16part(src, len, crc16val).
+ *
+ ************************************************************************************************/
+
+uint16_t crc16part_hw(const uint8_t *src, size_t len, uint16_t crc16val)
+{
+  volatile uint8_t *dr8 = (volatile uint8_t *)&CRC->DR;
+  uint16_t tail;
+  uint32_t w;
+
+  if (len == 0)
+    {
+      return crc16val;
+    }
+
+  chMtxLock(&crc16_hw_mtx);
+  CRC->CR = CRC_CR_POLYSIZE_16 | CRC_CR_RESET;
+
+  *dr8 = crc16val >> 8;
+  if (len == 1)
+    {
+      tail = ((crc16val & 255) << 8) | src[0];
+    }
+  else
+    {
+      *dr8 = crc16val & 255;
+      len -= 2;
+      tail = (src[len] << 8) | src[len + 1];
+
+      /* unit takes word MSB first */
+      for (; len >= 4;  len -= 4, src += 4)
+        {
+          memcpy(&w, src, sizeof(w));
+          CRC->DR = __REV(w);
+        }
+
+      for (; len > 0;  len--)
+        {
+          *dr8 = *src++;
+        }
+    }
+
+  crc16val = CRC->DR ^ tail;
+  chMtxUnlock(&crc16_hw_mtx);
+
+  return crc16val;
+}
+#endif
+
+/************************************************************************************************
+ * Name: crc16part
+ *
+ * Description:
+ *   Continue CRC calculation on a part of the buffer.
+ *
+ ************************************************************************************************/
+
+uint16_t crc16part(const uint8_t *src, size_t len, uint16_t crc16val)
+{
+#if CRC16_USE_HW
+  /* short parts are faster without mutex */
+  if (len >= CRC16_HW_MIN_LEN)
+    {
+      return crc16part_hw(src, len, crc16val);
+    }
+#endif
+
+#if CRC16_SLICE == 8
+  return crc16part_slice8(src, len, crc16val);
+#elif CRC16_SLICE == 4
+  return crc16part_slice4(src, len, crc16val);
+#else
+  return crc16part_bytewise(src, len, crc16val);
+#endif
+}
+
 /************************************************************************************************
  * Name: crc16
  *
@@ -42,6 +42,29 @@
 
 //#include <sys/types.h>
 #include <stdint.h>
+#include <stddef.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Software variant used by crc16part(): 8, 4 or 1 (bytewise) */
+
+#ifndef CRC16_SLICE
+#  define CRC16_SLICE 8
+#endif
+
+/* Use CRC calculation unit (STM32F37x/F30x, programmable polynomial) */
+
+#ifndef CRC16_USE_HW
+#  define CRC16_USE_HW 0
+#endif
+
+/* Shorter parts calculated by software */
+
+#ifndef CRC16_HW_MIN_LEN
+#  define CRC16_HW_MIN_LEN 32
+#endif
 
 /****************************************************************************
  * Public Function Prototypes
@@ -75,6 +98,32 @@ uint16_t crc16part(const uint8_t *src, size_t len, uint16_t crc16val);
 
 uint16_t crc16(const uint8_t *src, size_t len);
 
+/****************************************************************************
+ * Name: crc16part_bytewise, crc16part_slice4, crc16part_slice8
+ *
+ * Description:
+ *   Software variants of crc16part(), all give the same result.
+ *
+ ****************************************************************************/
+
+uint16_t crc16part_bytewise(const uint8_t *src, size_t len, uint16_t crc16val);
+uint16_t crc16part_slice4(const uint8_t *src, size_t len, uint16_t crc16val);
+uint16_t crc16part_slice8(const uint8_t *src, size_t len, uint16_t crc16val);
+
+#if CRC16_USE_HW
+/****************************************************************************
+ * Name: crc16part_hw
+ *
+ * Description:
+ *   crc16part() on CRC calculation unit, crc16_hw_init() should be
+ *   called once before. Thread context only (locks mutex).
+ *
+ ****************************************************************************/
+
+void crc16_hw_init(void);
+uint16_t crc16part_hw(const uint8_t *src, size_t len, uint16_t crc16val);
+#endif
+
 #undef EXTERN
 #ifdef __cplusplus
 }
@@ -99,3 +99,162 @@ float lpf2pReset(LowPassFilter2p *instp, float sample) {
 	instp->delay_element_1 = instp->delay_element_2 = sample;
 	return lpf2pApply(instp, sample);
 }
+
+/** Take design of @a src (cutoff and coefficients), keep delay elements
+ */
+void lpf2pCopyCoefficients(LowPassFilter2p *instp, const LowPassFilter2p *src)
+{
+	instp->cutoff_freq = src->cutoff_freq;
+	instp->a1 = src->a1;
+	instp->a2 = src->a2;
+	instp->b0 = src->b0;
+	instp->b1 = src->b1;
+	instp->b2 = src->b2;
+}
+
+/* Block kernel: same math as lpf2pApply, but coefficients and state
+ * are held in registers for whole block (FPU on Cortex-M4F).
+ * Bad values are checked per sample as in lpf2pApply,
+ * so one bad sample can not poison rest of the block.
+ */
+static void lpf2p_apply_strided(LowPassFilter2p *instp, float *data, size_t n, size_t stride)
+{
+	if (instp->cutoff_freq <= 0.0f || n == 0) {
+		// no filtering
+		return;
+	}
+
+	const float a1 = instp->a1, a2 = instp->a2;
+	const float b0 = instp->b0, b1 = instp->b1, b2 = instp->b2;
+	float d1 = instp->delay_element_1;
+	float d2 = instp->delay_element_2;
+
+	for (; n > 0; n--, data += stride) {
+		float d0 = *data - d1 * a1 - d2 * a2;
+
+		if (!isfinite(d0)) {
+			// don't allow bad values to propagate via the filter
+			d0 = *data;
+		}
+
+		*data = d0 * b0 + d1 * b1 + d2 * b2;
+		d2 = d1;
+		d1 = d0;
+	}
+
+	instp->delay_element_1 = d1;
+	instp->delay_element_2 = d2;
+}
+
+/** Filter block of samples in place
+ */
+void lpf2pApplyBlock(LowPassFilter2p *instp, float *data, size_t n)
+{
+	lpf2p_apply_strided(instp, data, n, 1);
+}
+
+/** Filter block of interleaved channels in place
+ *
+ * data layout: { ch0, ch1, ..., ch0, ch1, ... }, n samples per channel.
+ * Each channel filtered in own pass, so its state stays in registers.
+ */
+void lpf2pApplyInterleaved(LowPassFilter2p *const filters[], float *data,
+		size_t channels, size_t n)
+{
+	for (size_t ch = 0; ch < channels; ch++)
+		lpf2p_apply_strided(filters[ch], data + ch, n, channels);
+}
+
+#define Q30(x)	((int32_t) lrintf((x) * (float)(1 << 30)))
+
+void lpf2pqObjectInit(LowPassFilter2pQ *instp)
+{
+	instp->a1 = instp->a2 = 0;
+	instp->b0 = instp->b1 = instp->b2 = 0;
+	instp->x1 = instp->x2 = 0;
+	instp->y1 = instp->y2 = 0;
+	instp->err = 0;
+	instp->enabled = 0;
+}
+
+/** Design filter in float (thread context) and convert coefficients
+ *
+ * At low cutoff 1 + a1 + a2 is few Q30 LSB, independently rounded
+ * coefficients give DC gain error (~20 % at fs/fc ~ 10^4),
+ * so a1 is derived from rounded b and a2 to keep DC gain exactly 1.
+ */
+void lpf2pqSetCutoffFrequency(LowPassFilter2pQ *instp, float sample_freq, float cutoff_freq)
+{
+	LowPassFilter2p flt;
+
+	lpf2pObjectInit(&flt);
+	lpf2pSetCutoffFrequency(&flt, sample_freq, cutoff_freq);
+
+	instp->enabled = cutoff_freq > 0.0f;
+	instp->b0 = Q30(flt.b0);
+	instp->b1 = 2 * instp->b0;
+	instp->b2 = instp->b0;
+	instp->a2 = Q30(flt.a2);
+	instp->a1 = 4 * instp->b0 - instp->a2 - (1 << 30);
+}
+
+/** Take design of @a src (enabled and coefficients), keep filter state
+ */
+void lpf2pqCopyCoefficients(LowPassFilter2pQ *instp, const LowPassFilter2pQ *src)
+{
+	instp->enabled = src->enabled;
+	instp->a1 = src->a1;
+	instp->a2 = src->a2;
+	instp->b0 = src->b0;
+	instp->b1 = src->b1;
+	instp->b2 = src->b2;
+}
+
+/** Filter one channel of block
+ *
+ * Max |x| is 2^29, so sum of five products fits int64.
+ *
+ * @param data		int16 samples (channel 0 of interleaved block)
+ * @param stride	channels in block
+ * @return last output, scaled by 2^LPF2PQ_SHIFT
+ */
+int32_t lpf2pqApplyBlock(LowPassFilter2pQ *instp, const int16_t *data, size_t n, size_t stride)
+{
+	if (n == 0)
+		return instp->y1;
+
+	if (!instp->enabled) {
+		// no filtering, hold state at input for bumpless enable
+		instp->x1 = instp->x2 = (int32_t)data[(n - 1) * stride] << LPF2PQ_SHIFT;
+		instp->y1 = instp->y2 = instp->x1;
+		instp->err = 0;
+		return instp->y1;
+	}
+
+	const int32_t a1 = instp->a1, a2 = instp->a2;
+	const int32_t b0 = instp->b0, b1 = instp->b1, b2 = instp->b2;
+	int32_t x1 = instp->x1, x2 = instp->x2;
+	int32_t y1 = instp->y1, y2 = instp->y2;
+	int64_t err = instp->err;
+
+	for (; n > 0; n--, data += stride) {
+		int32_t x0 = (int32_t)*data << LPF2PQ_SHIFT;
+		int64_t acc = err
+			+ (int64_t)b0 * x0 + (int64_t)b1 * x1 + (int64_t)b2 * x2
+			- (int64_t)a1 * y1 - (int64_t)a2 * y2;
+		int32_t y0 = acc >> 30;
+
+		err = acc - ((int64_t)y0 << 30);
+		x2 = x1;
+		x1 = x0;
+		y2 = y1;
+		y1 = y0;
+	}
+
+	instp->x1 = x1;
+	instp->x2 = x2;
+	instp->y1 = y1;
+	instp->y2 = y2;
+	instp->err = err;
+	return y1;
+}
@@ -43,6 +43,9 @@
 #ifndef LOWPASSFILTER2P_H
 #define LOWPASSFILTER2P_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef struct {
 	float cutoff_freq;
 	float a1;
@@ -54,9 +57,37 @@ typedef struct {
 	float delay_element_2;
 } LowPassFilter2p;
 
+/** Fixed point variant (Direct Form I)
+ *
+ * Coefficients Q2.30, input int16 samples scaled by 2^LPF2PQ_SHIFT,
+ * output in same scale. Only integer ops in apply functions.
+ */
+#define LPF2PQ_SHIFT	14
+
+typedef struct {
+	int32_t a1;
+	int32_t a2;
+	int32_t b0;
+	int32_t b1;
+	int32_t b2;
+	int32_t x1, x2;
+	int32_t y1, y2;
+	int64_t err;		//!< truncation error feedback
+	int32_t enabled;
+} LowPassFilter2pQ;
+
 void lpf2pObjectInit(LowPassFilter2p *instp);
 void lpf2pSetCutoffFrequency(LowPassFilter2p *instp, float sample_freq, float cutoff_freq);
 float lpf2pApply(LowPassFilter2p *instp, float sample);
 float lpf2pReset(LowPassFilter2p *instp, float sample);
+void lpf2pCopyCoefficients(LowPassFilter2p *instp, const LowPassFilter2p *src);
+void lpf2pApplyBlock(LowPassFilter2p *instp, float *data, size_t n);
+void lpf2pApplyInterleaved(LowPassFilter2p *const filters[], float *data,
+		size_t channels, size_t n);
+
+void lpf2pqObjectInit(LowPassFilter2pQ *instp);
+void lpf2pqSetCutoffFrequency(LowPassFilter2pQ *instp, float sample_freq, float cutoff_freq);
+void lpf2pqCopyCoefficients(LowPassFilter2pQ *instp, const LowPassFilter2pQ *src);
+int32_t lpf2pqApplyBlock(LowPassFilter2pQ *instp, const int16_t *data, size_t n, size_t stride);
 
 #endif /* LOWPASSFILTER2P_H */
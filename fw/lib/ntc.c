@@ -71,3 +71,96 @@ float ntc_K_to_C(float K)
 	return K - KELV;
 }
 
+/*
+ * Lookup table: calculating Shteinhart-Hart equation is too slow
+ * for hot path (logf, cube and division), so it calculated only when
+ * parameters changed. Points are uniform in log(R) from 10 Ohm to 2 MOhm,
+ * max error against equation is 0.09 C° in -40..160 C° range
+ * (with default coefficients and 10k divider).
+ *
+ * Voltage stored in uV: hot end of default NTC is ~10 Ohm, only few mV
+ * on 10k divider, 0.1 mV step there was 2 % of R (0.37 C° error).
+ */
+
+#define TABLE_LOG_R_MIN		2.302585f	/* log(10) */
+#define TABLE_LOG_R_MAX		14.508658f	/* log(2e6) */
+
+/**
+ * Build voltage divider lookup table
+ *
+ * @param ntc_is_r1	NTC is R1 (high side), else R2
+ * @param Vin		divider voltage
+ * @param R		other resistor of divider
+ * @return false if equation is not monotonic (bad coefficients)
+ */
+bool ntc_table_build(struct ntc_table *t, bool ntc_is_r1, float Vin, float R,
+		float sh_a, float sh_b, float sh_c)
+{
+	const float step = (TABLE_LOG_R_MAX - TABLE_LOG_R_MIN) / (NTC_TABLE_SIZE - 1);
+
+	t->valid = false;
+	for (size_t i = 0; i < NTC_TABLE_SIZE; i++) {
+		float ntc_r = expf(TABLE_LOG_R_MIN + i * step);
+		float temp = ntc_K_to_C(ntc_get_K(ntc_r, sh_a, sh_b, sh_c));
+		float vout;
+		size_t idx;
+
+		/* voltage must be ascending */
+		if (ntc_is_r1) {
+			vout = Vin * R / (ntc_r + R);
+			idx = NTC_TABLE_SIZE - 1 - i;
+		}
+		else {
+			vout = Vin * ntc_r / (ntc_r + R);
+			idx = i;
+		}
+
+		if (isnan(temp) || temp < -300.0f || temp > 300.0f)
+			return false;
+
+		t->volt[idx] = lrintf(vout * 1e6f);
+		t->temp[idx] = lrintf(temp * 100.0f);
+	}
+
+	for (size_t i = 1; i < NTC_TABLE_SIZE; i++) {
+		if (t->volt[i] <= t->volt[i - 1])
+			return false;
+		if ((t->temp[i] - t->temp[i - 1]) * (t->temp[1] - t->temp[0]) <= 0)
+			return false;
+	}
+
+	t->valid = true;
+	return true;
+}
+
+/**
+ * Convert divider voltage to temperature [C°]
+ *
+ * Binary search and linear interpolation,
+ * out of table values are clamped.
+ */
+float ntc_table_lookup(const struct ntc_table *t, float Vout)
+{
+	int32_t v = lrintf(Vout * 1e6f);
+	size_t lo = 0, hi = NTC_TABLE_SIZE - 1;
+
+	if (!t->valid)
+		return NAN;
+
+	if (v <= t->volt[lo])
+		return t->temp[lo] * 0.01f;
+	if (v >= t->volt[hi])
+		return t->temp[hi] * 0.01f;
+
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (t->volt[mid] <= v)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return (t->temp[lo] + (float)(t->temp[hi] - t->temp[lo]) * (v - t->volt[lo])
+			/ (t->volt[hi] - t->volt[lo])) * 0.01f;
+}
+
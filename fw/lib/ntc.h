@@ -30,4 +30,24 @@ float ntc_get_R2(float Vout, float Vin, float R1);
 float ntc_get_K(float R, float sh_a, float sh_b, float sh_c);
 float ntc_K_to_C(float K);
 
+//! Default Steinhart-Hart koeffs (10k NTC, parameters.yaml SH_*)
+#define NTC_SH_A_DEFAULT	2.1085e-3f
+#define NTC_SH_B_DEFAULT	0.7979e-4f
+#define NTC_SH_C_DEFAULT	6.5351e-7f
+
+//! Lookup table points (uniform in log(R))
+#define NTC_TABLE_SIZE	64
+
+/** Voltage to temperature lookup table
+ */
+struct ntc_table {
+	bool valid;
+	int32_t volt[NTC_TABLE_SIZE];	//!< [uV] ascending
+	int16_t temp[NTC_TABLE_SIZE];	//!< [0.01 C°] monotonic
+};
+
+bool ntc_table_build(struct ntc_table *t, bool ntc_is_r1, float Vin, float R,
+		float sh_a, float sh_b, float sh_c);
+float ntc_table_lookup(const struct ntc_table *t, float Vout);
+
 #endif /* NTC_H */
@@ -0,0 +1,94 @@
+/**
+ * @file       running_stats.h
+ * @brief      Online statistics (Welford)
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef RUNNING_STATS_H
+#define RUNNING_STATS_H
+
+#include <stdint.h>
+#include <math.h>
+
+/* Constant time and memory mean/variance, numerically stable
+ * (B. P. Welford, 1962):
+ *   delta = x - mean
+ *   mean += delta / n
+ *   m2 += delta * (x - mean)
+ *   variance = m2 / (n - 1)
+ */
+
+typedef struct {
+	uint32_t n;
+	float mean;
+	float m2;
+	float min;
+	float max;
+} running_stats_t;
+
+static inline void rstats_reset(running_stats_t *rs)
+{
+	rs->n = 0;
+	rs->mean = 0.0f;
+	rs->m2 = 0.0f;
+	rs->min = INFINITY;
+	rs->max = -INFINITY;
+}
+
+static inline void rstats_push(running_stats_t *rs, float x)
+{
+	float delta = x - rs->mean;
+
+	rs->n++;
+	rs->mean += delta / rs->n;
+	rs->m2 += delta * (x - rs->mean);
+
+	if (x < rs->min)	rs->min = x;
+	if (x > rs->max)	rs->max = x;
+}
+
+/** Merge statistics of other set (Chan et al. pairwise update)
+ */
+static inline void rstats_merge(running_stats_t *rs, const running_stats_t *other)
+{
+	uint32_t n = rs->n + other->n;
+	float delta = other->mean - rs->mean;
+
+	if (other->n == 0)
+		return;
+
+	rs->mean += delta * other->n / n;
+	rs->m2 += other->m2 + delta * delta * ((float)rs->n * other->n / n);
+	rs->n = n;
+
+	if (other->min < rs->min)	rs->min = other->min;
+	if (other->max > rs->max)	rs->max = other->max;
+}
+
+static inline float rstats_variance(const running_stats_t *rs)
+{
+	return (rs->n > 1) ? rs->m2 / (rs->n - 1) : 0.0f;
+}
+
+static inline float rstats_stddev(const running_stats_t *rs)
+{
+	return sqrtf(rstats_variance(rs));
+}
+
+#endif /* RUNNING_STATS_H */
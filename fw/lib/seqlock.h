@@ -0,0 +1,91 @@
+/**
+ * @file       seqlock.h
+ * @brief      Sequence lock with double buffer
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Single writer, many readers, lock free.
+ *
+ * Writer updates both copies of data, sequence counter selects copy
+ * which is not modified now. So reader never waits writer,
+ * even if it preempts writer, it only retries if writer was run
+ * during reading.
+ *
+ * Writer:
+ *   seqlock_write_begin(&sl);	// readers use copy 1
+ *   update copy 0
+ *   seqlock_write_next(&sl);	// readers use copy 0
+ *   update copy 1
+ *
+ * Reader:
+ *   do {
+ *     seq = seqlock_read_begin(&sl);
+ *     copy from seqlock_read_index(seq)
+ *   } while (seqlock_read_retry(&sl, seq));
+ */
+
+#define seqlock_barrier()	__asm__ volatile ("" ::: "memory")
+
+typedef struct {
+	volatile uint32_t seq;
+} seqlock_t;
+
+static inline void seqlock_init(seqlock_t *sl)
+{
+	sl->seq = 0;
+}
+
+static inline void seqlock_write_begin(seqlock_t *sl)
+{
+	sl->seq++;
+	seqlock_barrier();
+}
+
+static inline void seqlock_write_next(seqlock_t *sl)
+{
+	seqlock_barrier();
+	sl->seq++;
+	seqlock_barrier();
+}
+
+static inline uint32_t seqlock_read_begin(const seqlock_t *sl)
+{
+	uint32_t seq = sl->seq;
+	seqlock_barrier();
+	return seq;
+}
+
+static inline unsigned seqlock_read_index(uint32_t seq)
+{
+	return seq & 1;
+}
+
+static inline bool seqlock_read_retry(const seqlock_t *sl, uint32_t seq)
+{
+	seqlock_barrier();
+	return sl->seq != seq;
+}
+
+#endif /* SEQLOCK_H */
@@ -0,0 +1,220 @@
+/**
+ * @file       trigger_decoder.c
+ * @brief      Crank trigger wheel decoder
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "trigger_decoder.h"
+
+/* Notes:
+ * Decoder works on edge timestamps, so it don't depend on capture hardware.
+ *
+ * Missing tooth: gap period is (missing + 1) times regular period,
+ * detected if it longer than 0.75 of that.
+ * Edge after gap is tooth 0.
+ *
+ * Extra tooth: splits one regular period in two short ones,
+ * detected if period shorter than 0.75 of regular.
+ * Edge after extra tooth is tooth 0.
+ * Period longer than 1.5 of regular is dropped edge: sync lost and
+ * regular period relearned (else next regular teeth look like extra).
+ *
+ * In synced mode revolution starts at tooth 0,
+ * otherwise after each trgdecEdgesPerRev() edges.
+ */
+
+/* -*- local -*- */
+
+static void rev_start(TriggerDecoder *instp, uint32_t ts, bool emit)
+{
+	if (emit && instp->rev_cb != 0)
+		instp->rev_cb(instp->cb_arg, ts, ts - instp->rev_ts);
+
+	instp->rev_ts = ts;
+	instp->rev_edges = 0;
+}
+
+static void lose_sync(TriggerDecoder *instp)
+{
+	instp->sync_loss++;
+	instp->sync = TS_SYNCING;
+	instp->gap_seen = false;
+}
+
+/** Found sync pattern, ts is tooth 0
+ */
+static void sync_point(TriggerDecoder *instp, uint32_t ts)
+{
+	uint16_t last_tooth = instp->wheel.teeth - instp->wheel.missing - 1;
+
+	if (instp->sync == TS_SYNCED) {
+		if (instp->tooth != last_tooth) {
+			lose_sync(instp);
+			instp->gap_seen = true;
+		}
+		else
+			rev_start(instp, ts, true);
+	}
+	else if (instp->gap_seen && instp->tooth == last_tooth) {
+		instp->sync = TS_SYNCED;
+		rev_start(instp, ts, false);
+	}
+	else
+		instp->gap_seen = true;
+
+	instp->tooth = 0;
+}
+
+static void process_edge(TriggerDecoder *instp, uint32_t ts)
+{
+	const TriggerWheel *w = &instp->wheel;
+	uint32_t period;
+	bool is_sync = false;
+
+	if (!instp->started) {
+		instp->started = true;
+		instp->last_ts = ts;
+		instp->rev_ts = ts;
+		return;
+	}
+
+	period = ts - instp->last_ts;
+	if (period < instp->min_period)
+		return;	// glitch
+
+	instp->last_ts = ts;
+	instp->edges++;
+	instp->rev_edges++;
+
+	if (w->missing > 0) {
+		if (instp->last_period > 0 &&
+				period * 4 > instp->last_period * 3 * (w->missing + 1)) {
+			is_sync = true;
+			period /= w->missing + 1;
+		}
+	}
+	else if (w->extra > 0) {
+		if (instp->after_extra) {
+			/* complement of extra tooth period */
+			instp->after_extra = false;
+			is_sync = true;
+			period = instp->last_period;
+		}
+		else if (instp->last_period > 0 &&
+				period * 4 < instp->last_period * 3) {
+			/* extra tooth, not regular */
+			instp->after_extra = true;
+			return;
+		}
+		else if (instp->last_period > 0 &&
+				period * 2 > instp->last_period * 3) {
+			/* dropped edge */
+			instp->last_period = 0;
+			if (instp->sync == TS_SYNCED)
+				lose_sync(instp);
+			return;
+		}
+	}
+
+	instp->last_period = period;
+
+	if (instp->sync == TS_NONE) {
+		/* even wheel */
+		if (instp->rev_edges >= w->teeth)
+			rev_start(instp, ts, true);
+		return;
+	}
+
+	if (is_sync)
+		sync_point(instp, ts);
+	else if (++instp->tooth > w->teeth - w->missing - 1 && instp->sync == TS_SYNCED)
+		lose_sync(instp);	// expected sync pattern not found
+
+	if (instp->sync != TS_SYNCED && instp->rev_edges >= trgdecEdgesPerRev(instp))
+		rev_start(instp, ts, true);
+}
+
+/* -*- public functions -*- */
+
+/** Initialize decoder
+ *
+ * @param wheel		trigger wheel definition
+ * @param min_period	glitch filter
+ * @param rev_cb	revolution callback
+ */
+void trgdecObjectInit(TriggerDecoder *instp, const TriggerWheel *wheel,
+		uint32_t min_period, trgdec_rev_cb_t rev_cb, void *cb_arg)
+{
+	instp->wheel = *wheel;
+	instp->min_period = min_period;
+	instp->rev_cb = rev_cb;
+	instp->cb_arg = cb_arg;
+	instp->edges = 0;
+	instp->sync_loss = 0;
+
+	trgdecReset(instp);
+}
+
+/** Reset decoder state (e.g. after engine stop)
+ */
+void trgdecReset(TriggerDecoder *instp)
+{
+	if (instp->wheel.missing > 0 || instp->wheel.extra > 0)
+		instp->sync = TS_SYNCING;
+	else
+		instp->sync = TS_NONE;
+
+	instp->started = false;
+	instp->after_extra = false;
+	instp->gap_seen = false;
+	instp->tooth = 0;
+	instp->rev_edges = 0;
+	instp->last_ts = 0;
+	instp->last_period = 0;
+	instp->rev_ts = 0;
+}
+
+/** Process batch of edge timestamps
+ */
+void trgdecProcess(TriggerDecoder *instp, const volatile uint32_t *ts, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		process_edge(instp, ts[i]);
+}
+
+/** Edges per one revolution
+ */
+uint16_t trgdecEdgesPerRev(const TriggerDecoder *instp)
+{
+	return instp->wheel.teeth - instp->wheel.missing + instp->wheel.extra;
+}
+
+/** Crank angle of last tooth
+ *
+ * @param[out] angle	degrees from tooth 0
+ * @return true if synced
+ */
+bool trgdecGetAngle(const TriggerDecoder *instp, float *angle)
+{
+	if (instp->sync != TS_SYNCED)
+		return false;
+
+	*angle = 360.0f * instp->tooth / instp->wheel.teeth;
+	return true;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file       trigger_decoder.h
+ * @brief      Crank trigger wheel decoder
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef TRIGGER_DECODER_H
+#define TRIGGER_DECODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Trigger wheel definition
+ *
+ * Examples:
+ * - even N:	{ N, 0, 0 }
+ * - 36-1:	{ 36, 1, 0 }
+ * - 60-2:	{ 60, 2, 0 }
+ * - N+1:	{ N, 0, 1 }	(extra sync tooth between two regular)
+ */
+typedef struct {
+	uint8_t teeth;		//!< tooth positions on the wheel
+	uint8_t missing;	//!< missing teeth (gap)
+	uint8_t extra;		//!< extra sync tooth (0 or 1)
+} TriggerWheel;
+
+enum trigger_sync {
+	TS_NONE = 0,	//!< wheel without phase information
+	TS_SYNCING,	//!< waiting sync pattern
+	TS_SYNCED	//!< phase known
+};
+
+/** Revolution callback
+ * @param ts		timestamp of revolution start edge
+ * @param period	revolution period (same units as ts)
+ */
+typedef void (*trgdec_rev_cb_t)(void *arg, uint32_t ts, uint32_t period);
+
+typedef struct {
+	TriggerWheel wheel;
+	uint32_t min_period;	//!< shorter periods are glitches
+	trgdec_rev_cb_t rev_cb;
+	void *cb_arg;
+
+	enum trigger_sync sync;
+	bool started;
+	bool after_extra;	//!< previous edge was extra tooth
+	bool gap_seen;		//!< at least one sync pattern seen
+	uint16_t tooth;		//!< regular tooth index from sync point
+	uint16_t rev_edges;	//!< edges from revolution start
+	uint32_t last_ts;
+	uint32_t last_period;	//!< last regular tooth period
+	uint32_t rev_ts;
+
+	/* statistics */
+	uint32_t edges;
+	uint32_t sync_loss;
+} TriggerDecoder;
+
+void trgdecObjectInit(TriggerDecoder *instp, const TriggerWheel *wheel,
+		uint32_t min_period, trgdec_rev_cb_t rev_cb, void *cb_arg);
+void trgdecReset(TriggerDecoder *instp);
+void trgdecProcess(TriggerDecoder *instp, const volatile uint32_t *ts, size_t n);
+uint16_t trgdecEdgesPerRev(const TriggerDecoder *instp);
+bool trgdecGetAngle(const TriggerDecoder *instp, float *angle);
+
+#endif /* TRIGGER_DECODER_H */
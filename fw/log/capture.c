@@ -0,0 +1,312 @@
+/**
+ * @file       log/capture.c
+ * @brief      Triggered capture of raw sensor data
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "alert_led.h"
+#include "capture.h"
+#include "command.h"
+#include "sensors.h"
+#include "param_table.h"
+#include "lib_crc16.h"
+#include "adc/th_adc.h"
+#include "hw/ext_flash.h"
+#include "hw/rtc_time.h"
+#include "miniecu.pb.h"
+#include <string.h>
+#include <stddef.h>
+
+/* -*- parameters -*- */
+bool gp_capture_enable;
+int32_t gp_capture_pre;		// [%] pre-trigger part of capture
+int32_t gp_capture_decimate;
+
+/* Notes:
+ * SDADC1 callback copies raw frames into RAM ring, RPM thread adds
+ * revolution periods. On trigger the ring keeps recording post-trigger
+ * part, then it frozen until log thread writes it to FLASHD1_error.
+ * One record per 4 KiB erase sector, sectors used sequentially,
+ * record with max sequence number is the last one.
+ *
+ * Triggers: component alert turns to AL_FAIL, rising Status flag
+ * (polled by log thread), host command. Hold-off limits flash wear.
+ */
+
+//! SST25 pages per erase sector
+#define EPAGES			(4096/256)
+#define HOLDOFF			S2ST(10)
+#define TRIGGER_FLAGS		(miniecu_Status_Flags_UNDERVOLTAGE | \
+				 miniecu_Status_Flags_OVERHEAT | \
+				 miniecu_Status_Flags_LOW_OIL_PRESSURE | \
+				 miniecu_Status_Flags_HIGH_RPM | \
+				 miniecu_Status_Flags_SENSOR_ALARM | \
+				 miniecu_Status_Flags_SENSOR_FAULT)
+
+enum capture_state {
+	CS_RUN = 0,		//!< recording, armed
+	CS_POST,		//!< recording post-trigger part
+	CS_FROZEN		//!< waiting for write
+};
+
+/* -*- private data -*- */
+
+static int16_t m_frames[CAPTURE_FRAMES][3];
+static uint32_t m_revs[CAPTURE_REVS];
+static volatile enum capture_state m_state;
+static uint32_t m_frame_head;		// monotonic frame count
+static uint32_t m_rev_head;		// monotonic revolution count
+static uint32_t m_decim_phase;
+static uint32_t m_post_left;
+static uint32_t m_trigger_frame;
+static uint32_t m_trigger_rev;
+static systime_t m_trigger_time;
+static systime_t m_last_trigger;
+static capture_header_t m_trigger;	// cause, detail, status
+static uint32_t m_last_flags;
+
+static uint32_t m_seq;
+static uint32_t m_slot;			// next sector to write
+static uint32_t m_count;		// records written since boot
+
+
+/* -*- producers -*- */
+
+/** Add block of SDADC1 samples (interleaved VBAT, OILP, TEMP)
+ * Called from SDADC1 callback.
+ */
+void capture_sdadc1_block(const adcsample_t *buffer, size_t n)
+{
+	const int16_t *blk = (const int16_t *) buffer;
+
+	if (!gp_capture_enable || m_state == CS_FROZEN)
+		return;
+
+	for (size_t i = 0; i < n; i++, blk += 3) {
+		if (++m_decim_phase < (uint32_t)gp_capture_decimate)
+			continue;
+
+		int16_t *f = m_frames[m_frame_head % CAPTURE_FRAMES];
+
+		m_decim_phase = 0;
+		f[0] = blk[0];
+		f[1] = blk[1];
+		f[2] = blk[2];
+		m_frame_head++;
+
+		if (m_state == CS_POST && --m_post_left == 0) {
+			m_state = CS_FROZEN;
+			break;
+		}
+	}
+}
+
+/** Add revolution period
+ * Called from RPM thread.
+ */
+void capture_revolution(uint32_t rev_period_us)
+{
+	syssts_t sts = chSysGetStatusAndLockX();
+
+	if (gp_capture_enable && m_state != CS_FROZEN)
+		m_revs[m_rev_head++ % CAPTURE_REVS] = rev_period_us;
+
+	chSysRestoreStatusX(sts);
+}
+
+/** Trigger capture
+ * Can be called from thread or ISR, ignored if capture in progress
+ * or in hold-off time.
+ */
+void capture_trigger(enum capture_cause cause, uint32_t detail)
+{
+	syssts_t sts = chSysGetStatusAndLockX();
+	systime_t now = osalOsGetSystemTimeX();
+
+	if (gp_capture_enable && m_state == CS_RUN && m_frame_head >= CAPTURE_FRAMES &&
+			(m_last_trigger == 0 || now - m_last_trigger >= HOLDOFF)) {
+		m_post_left = CAPTURE_FRAMES * (100 - gp_capture_pre) / 100;
+		m_state = (m_post_left > 0) ? CS_POST : CS_FROZEN;
+		m_trigger_frame = m_frame_head;
+		m_trigger_rev = m_rev_head;
+		m_trigger_time = now;
+		m_trigger.cause = cause;
+		m_trigger.detail = detail;
+		m_trigger.status = m_last_flags;
+		m_last_trigger = now;
+	}
+
+	chSysRestoreStatusX(sts);
+}
+
+/** Check Status flags, trigger on rising flag
+ * Called periodically from log thread.
+ */
+void capture_poll(void)
+{
+	uint32_t flags = status_get_flags();
+	uint32_t rising = flags & ~m_last_flags & TRIGGER_FLAGS;
+
+	m_last_flags = flags;
+	if (rising)
+		capture_trigger(CC_STATUS, rising);
+}
+
+/** Capture is frozen and waiting for capture_write()
+ */
+bool capture_is_pending(void)
+{
+	return m_state == CS_FROZEN;
+}
+
+/** Records written since boot
+ */
+uint32_t capture_get_count(void)
+{
+	return m_count;
+}
+
+
+/* -*- flash record -*- */
+
+struct page_writer {
+	uint32_t page;
+	size_t pos;
+	bool error;
+	uint8_t buff[256];	//!< SST25 page
+};
+
+static void writer_flush(struct page_writer *w)
+{
+	if (w->pos == 0 || w->error)
+		return;
+
+	memset(w->buff + w->pos, 0xff, sizeof(w->buff) - w->pos);
+	if (blkWrite(&FLASHD1_error, w->page, w->buff, 1) != HAL_SUCCESS)
+		w->error = true;
+
+	w->page++;
+	w->pos = 0;
+}
+
+static void writer_put(struct page_writer *w, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len > 0) {
+		size_t sz = sizeof(w->buff) - w->pos;
+
+		if (sz > len)
+			sz = len;
+
+		memcpy(w->buff + w->pos, p, sz);
+		w->pos += sz;
+		p += sz;
+		len -= sz;
+
+		if (w->pos == sizeof(w->buff))
+			writer_flush(w);
+	}
+}
+
+/** Find last record, so new records continue sequence
+ */
+void capture_load(void)
+{
+	uint32_t slots = mtdGetSize(&FLASHD1_error) / mtdGetPageSize(&FLASHD1_error) / EPAGES;
+	uint8_t buff[mtdGetPageSize(&FLASHD1_error)];
+	capture_header_t hdr;
+	bool found = false;
+
+	for (uint32_t slot = 0; slot < slots; slot++) {
+		if (blkRead(&FLASHD1_error, slot * EPAGES, buff, 1) != HAL_SUCCESS)
+			continue;
+
+		memcpy(&hdr, buff, sizeof(hdr));
+		if (hdr.signature != CAPTURE_SIGNATURE)
+			continue;
+
+		if (!found || (int32_t)(hdr.seq - m_seq) > 0) {
+			found = true;
+			m_seq = hdr.seq;
+			m_slot = (slot + 1) % slots;
+		}
+	}
+}
+
+/** Write frozen capture to flash and rearm
+ * Called from log thread.
+ */
+void capture_write(void)
+{
+	uint32_t slots = mtdGetSize(&FLASHD1_error) / mtdGetPageSize(&FLASHD1_error) / EPAGES;
+	uint32_t frame_start = m_frame_head - CAPTURE_FRAMES;
+	uint32_t revs = (m_rev_head < CAPTURE_REVS) ? m_rev_head : CAPTURE_REVS;
+	uint32_t rev_start = m_rev_head - revs;
+	uint32_t ago_ms = ST2MS(osalOsGetSystemTimeX() - m_trigger_time);
+	struct page_writer w = { .page = m_slot * EPAGES };
+	capture_header_t hdr = m_trigger;
+	uint16_t crc;
+
+	osalDbgAssert(sizeof(hdr) + sizeof(m_frames) + sizeof(m_revs) <= EPAGES * sizeof(w.buff),
+			"capture size");
+
+	hdr.signature = CAPTURE_SIGNATURE;
+	hdr.seq = m_seq + 1;
+	hdr.timestamp_ms = time_is_known() ? time_get_timestamp() - ago_ms : 0;
+	hdr.system_time = time_get_systime() - ago_ms;
+	hdr.frame_rate = adc_get_sample_rate(SG_SDADC1) / gp_capture_decimate;
+	hdr.frames = CAPTURE_FRAMES;
+	hdr.trigger_frame = m_trigger_frame - frame_start;
+	hdr.revs = revs;
+	hdr.trigger_rev = (m_trigger_rev > rev_start) ? m_trigger_rev - rev_start : 0;
+	hdr.reserved = 0;
+
+	crc = crc16part((const uint8_t *)&hdr, offsetof(capture_header_t, crc16), 0);
+	for (uint32_t i = frame_start; i != m_frame_head; i++)
+		crc = crc16part((const uint8_t *)m_frames[i % CAPTURE_FRAMES], sizeof(m_frames[0]), crc);
+	for (uint32_t i = rev_start; i != m_rev_head; i++)
+		crc = crc16part((const uint8_t *)&m_revs[i % CAPTURE_REVS], sizeof(m_revs[0]), crc);
+	hdr.crc16 = crc;
+
+	mtdErase(&FLASHD1_error, m_slot * EPAGES, EPAGES);
+
+	writer_put(&w, &hdr, sizeof(hdr));
+	for (uint32_t i = frame_start; i != m_frame_head; i++)
+		writer_put(&w, m_frames[i % CAPTURE_FRAMES], sizeof(m_frames[0]));
+	for (uint32_t i = rev_start; i != m_rev_head; i++)
+		writer_put(&w, &m_revs[i % CAPTURE_REVS], sizeof(m_revs[0]));
+	writer_flush(&w);
+
+	if (w.error) {
+		alert_component(ALS_FLASH, AL_FAIL);
+		debug_printf(DP_ERROR, "CAPTURE: write error");
+	}
+	else {
+		m_seq = hdr.seq;
+		m_slot = (m_slot + 1) % slots;
+		m_count++;
+		debug_printf(DP_INFO, "CAPTURE: #%" PRIu32 " cause %u/%u", m_seq, hdr.cause, hdr.detail);
+	}
+
+	/* rearm */
+	chSysLock();
+	m_state = CS_RUN;
+	chSysUnlock();
+}
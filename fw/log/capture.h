@@ -0,0 +1,76 @@
+/**
+ * @file       log/capture.h
+ * @brief      Triggered capture of raw sensor data
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef LOG_CAPTURE_H
+#define LOG_CAPTURE_H
+
+#include "fw_common.h"
+
+//! SDADC1 frames (VBAT, OILP, TEMP raw counts) in ring, 3 KiB
+#define CAPTURE_FRAMES		512
+//! Revolution periods in ring
+#define CAPTURE_REVS		128
+//! 'capt' in little endian
+#define CAPTURE_SIGNATURE	0x74706163
+
+/** Capture trigger cause
+ */
+enum capture_cause {
+	CC_ALERT = 1,		//!< detail: enum alert_source
+	CC_STATUS,		//!< detail: new Status flags
+	CC_COMMAND		//!< requested by host
+};
+
+/** Capture record in FLASHD1_error partition, one per erase sector
+ *
+ * Followed by:
+ *  int16_t frames[frames][3]	SDADC1 SE zero counts: VBAT / 3, OILP, TEMP,
+ *				V = (count + 32767) * 3.3 / 65535
+ *  uint32_t revs[revs]		revolution periods [us]
+ */
+typedef struct {
+	uint32_t signature;
+	uint32_t seq;
+	uint64_t timestamp_ms;		//!< UNIX time of trigger, 0 if unknown
+	uint32_t system_time;		//!< [ms] at trigger
+	uint32_t status;		//!< Status flags at trigger
+	uint16_t cause;			//!< enum capture_cause
+	uint16_t detail;
+	float frame_rate;		//!< [Hz]
+	uint16_t frames;
+	uint16_t trigger_frame;		//!< first frame after trigger
+	uint16_t revs;
+	uint16_t trigger_rev;		//!< first revolution after trigger
+	uint16_t reserved;
+	uint16_t crc16;			//!< header (up to crc16) and data
+} capture_header_t;
+
+void capture_sdadc1_block(const adcsample_t *buffer, size_t n);
+void capture_revolution(uint32_t rev_period_us);
+void capture_trigger(enum capture_cause cause, uint32_t detail);
+void capture_load(void);
+void capture_poll(void);
+bool capture_is_pending(void);
+void capture_write(void);
+uint32_t capture_get_count(void);
+
+#endif /* LOG_CAPTURE_H */
@@ -1,3 +1,4 @@
-LOGSRC = ${MINIECU}/fw/log/th_log.c
+LOGSRC = ${MINIECU}/fw/log/th_log.c \
+	 ${MINIECU}/fw/log/capture.c
 
 LOGINC =
@@ -22,9 +22,13 @@
 
 #include "alert_led.h"
 #include "th_log.h"
+#include "capture.h"
+#include "adc/th_adc.h"
 #include "flash-mtd.h"
 
 #define INIT_TIMEOUT	MS2ST(5000)
+//! Status flags poll period for capture trigger
+#define POLL_PERIOD_MS	10
 
 /* -*- local data -*- */
 static MUTEX_DECL(m_init_mtx);
@@ -35,12 +39,22 @@ static THD_WORKING_AREA(wa_log, LOG_WASZ);
 /* -*- thread -*- */
 static THD_FUNCTION(th_log, arg ATTR_UNUSED)
 {
+	chRegSetThreadName("log");
+
 	/* TODO */
+	capture_load();
+	flow_checkpoint_load();
 
 	chCondSignal(&m_log_init_done);
 	while (true) {
 		/* TODO */
-		chThdSleepMilliseconds(1000);
+		chThdSleepMilliseconds(POLL_PERIOD_MS);
+
+		capture_poll();
+		if (capture_is_pending())
+			capture_write();
+		if (flow_checkpoint_is_pending())
+			flow_checkpoint_write();
 	}
 
 	return MSG_OK;
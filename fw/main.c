@@ -17,16 +17,21 @@
 #include "fw_common.h"
 #include "alert_led.h"
 #include "comm/th_comm_pbstx.h"
+#include "comm/telemetry.h"
 #include "adc/th_adc.h"
 #include "log/th_log.h"
 #include "th_rpm.h"
+#include "sensors.h"
+#include "cpu_load.h"
 #include "param.h"
 #include "hw/led.h"
 #include "hw/usb_vcom.h"
+#include "hw/serial1.h"
 #include "hw/rtc_time.h"
 #include "hw/ext_flash.h"
 #include "hw/ectl_pads.h"
 #include "param_table.h"
+#include "lib_crc16.h"
 #include <string.h>
 
 
@@ -60,7 +65,7 @@ static void serial1_comm_create(void)
 	(strcasecmp(gp_serial1_proto, SERIAL1_PROTO__ ## proto) == 0)
 
 	if (SERIAL1_PROTO_IS(PBStx))
-		pbstxCreate(&SERIAL1_SD, PBSTX_WASZ, PBSTX_PRIO);
+		pbstxCreate(serial1_get_channel(), PBSTX_WASZ, PBSTX_PRIO);
 
 #undef SERIAL1_PROTO_IS
 }
@@ -80,12 +85,17 @@ int main(void) {
 	halInit();
 	chSysInit();
 
-	sdStart(&SERIAL1_SD, NULL);
+#if CRC16_USE_HW
+	crc16_hw_init();
+#endif
+	serial1_init();
 	alert_led_init();
 	vcom_init();
 	rtc_time_init();
 	flash_init();
 	param_init();
+	sensors_init();
+	telemetry_init();
 	serial1_comm_create();
 	// start logging after pbstx, so we can hear errors
 	log_init();
@@ -117,5 +127,6 @@ int main(void) {
 		}
 
 		chThdSleepMilliseconds(500);
+		cpu_load_update();
 	}
 }
@@ -31,12 +31,12 @@ int32_t memdump_int_ram(uint32_t address, void *buffer, size_t size)
 	return size;
 }
 
-int32_t memdump_ext_flash(uint32_t address, void *buffer, size_t size)
+static int32_t memdump_mtd(SST25Driver *flp, uint32_t address, void *buffer, size_t size)
 {
-	uint8_t rd_buff[mtdGetPageSize(&FLASHD1)];	// C99 dynamic array
+	uint8_t rd_buff[mtdGetPageSize(flp)];	// C99 dynamic array
 	int32_t size_ret = 0;
 
-	if (blkGetDriverState(&FLASHD1) != BLK_ACTIVE)
+	if (blkGetDriverState(flp) != BLK_ACTIVE)
 		return -1;
 
 	while (size_ret < (signed)size) {
@@ -46,7 +46,7 @@ int32_t memdump_ext_flash(uint32_t address, void *buffer, size_t size)
 
 		if (sz > (signed)size - size_ret)
 			sz = size - size_ret;
-		if (blkRead(&FLASHD1, page, rd_buff, 1) != HAL_SUCCESS)
+		if (blkRead(flp, page, rd_buff, 1) != HAL_SUCCESS)
 			return -1;
 
 		memcpy(buffer, rd_buff + off, sz);
@@ -58,3 +58,14 @@ int32_t memdump_ext_flash(uint32_t address, void *buffer, size_t size)
 	return size_ret;
 }
 
+int32_t memdump_ext_flash(uint32_t address, void *buffer, size_t size)
+{
+	return memdump_mtd(&FLASHD1, address, buffer, size);
+}
+
+/** Dump capture records (FLASHD1_error partition)
+ */
+int32_t memdump_capture(uint32_t address, void *buffer, size_t size)
+{
+	return memdump_mtd(&FLASHD1_error, address, buffer, size);
+}
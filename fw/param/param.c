@@ -155,6 +155,19 @@ static THD_FUNCTION(th_param_load, arg ATTR_UNUSED)
 	return MSG_OK;
 }
 
+static volatile bool m_save_pending;
+
+static THD_FUNCTION(th_param_save, arg ATTR_UNUSED)
+{
+	chRegSetThreadName("paramsv");
+
+	if (flash_connect() == MSG_OK)
+		param_save();
+
+	m_save_pending = false;
+	return MSG_OK;
+}
+
 /* -*- global -*- */
 
 msg_t param_set(const char *id, miniecu_ParamType *value)
@@ -250,3 +263,28 @@ void param_init(void)
 	chThdWait(paramld);
 }
 
+/** Save parameters in background
+ *
+ * For modules which change own params (learned values)
+ * and run on small stack or high priority.
+ * Request ignored if previous save is not finished.
+ */
+void param_save_async(void)
+{
+	thread_t *tp;
+
+	if (m_save_pending)
+		return;
+
+	m_save_pending = true;
+	tp = chThdCreateFromHeap(NULL, PARAMLD_WASZ, PARAMLD_PRIO, th_param_save, NULL);
+	if (tp == NULL) {
+		m_save_pending = false;
+		debug_printf(DP_ERROR, "param save: no memory");
+		return;
+	}
+
+	/* memory released by registry when thread ends */
+	chThdRelease(tp);
+}
+
@@ -90,5 +90,6 @@ size_t param_count(void);
 void param_init(void);
 void param_load(void);
 void param_save(void);
+void param_save_async(void);
 
 #endif /* PARAM_H */
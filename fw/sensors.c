@@ -0,0 +1,222 @@
+/**
+ * @file       sensors.c
+ * @brief      Sensor state snapshot
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "sensors.h"
+#include "lib/seqlock.h"
+#include <string.h>
+
+/* Each group published by its producer (ISR or thread) under own
+ * seqlock into double buffered snapshot, so consumers get tear-free copy
+ * without critical sections.
+ */
+
+/* -*- private data -*- */
+
+struct sensor_group_def {
+	size_t offset;
+	size_t size;
+};
+
+#define GROUP_DEF(field)	\
+	{ offsetof(struct sensor_snapshot, field), sizeof(((struct sensor_snapshot *)0)->field) }
+
+static const struct sensor_group_def m_groups[SG_MAX] = {
+	[SG_ADC1] = GROUP_DEF(adc1),
+	[SG_SDADC1] = GROUP_DEF(sdadc1),
+	[SG_SDADC3] = GROUP_DEF(sdadc3),
+	[SG_RPM] = GROUP_DEF(rpm)
+};
+
+#undef GROUP_DEF
+
+static seqlock_t m_locks[SG_MAX];
+static struct sensor_snapshot m_buffers[2];
+
+/* Statistics are accumulated by producers and taken (with reset)
+ * by reporter. Update and take are short, so both in critical section.
+ * ADC ISRs add integer sums of counts, those are converted
+ * and merged in sensors_stats_take() (thread).
+ */
+static running_stats_t m_stats[SS_MAX];
+static struct sensor_count_stats m_count_stats[SS_MAX];
+static float m_count_offset[SS_MAX];
+static float m_count_k[SS_MAX];
+static systime_t m_stats_start;
+
+static void count_stats_reset(struct sensor_count_stats *cs)
+{
+	cs->n = 0;
+	cs->min = INT32_MAX;
+	cs->max = INT32_MIN;
+	cs->sum = 0;
+	cs->sumsq = 0;
+}
+
+/** Counts to float statistics (thread)
+ * Sums are exact, M2 = sumsq - sum * mean in double has no cancellation.
+ */
+static void count_stats_convert(running_stats_t *rs, const struct sensor_count_stats *cs,
+		enum sensor_stat id)
+{
+	const float off = m_count_offset[id], k = m_count_k[id];
+	double mean = (double)cs->sum / cs->n;
+
+	rs->n = cs->n;
+	rs->mean = (mean + off) * k;
+	rs->m2 = ((double)cs->sumsq - (double)cs->sum * mean) * k * k;
+	rs->min = (cs->min + off) * k;
+	rs->max = (cs->max + off) * k;
+}
+
+
+/* -*- public functions -*- */
+
+void sensors_init(void)
+{
+	for (int i = 0; i < SG_MAX; i++)
+		seqlock_init(&m_locks[i]);
+
+	memset(m_buffers, 0, sizeof(m_buffers));
+
+	for (int i = 0; i < SS_MAX; i++) {
+		rstats_reset(&m_stats[i]);
+		count_stats_reset(&m_count_stats[i]);
+		m_count_offset[i] = 0.0f;
+		m_count_k[i] = 1.0f;
+	}
+
+	m_stats_start = osalOsGetSystemTimeX();
+}
+
+/** Publish group data
+ * Must be called only by group producer.
+ *
+ * @param group	sensor group
+ * @param data	pointer to group struct (e.g. struct sensor_adc1)
+ */
+void sensors_publish(enum sensor_group group, const void *data)
+{
+	const struct sensor_group_def *g = &m_groups[group];
+	seqlock_t *sl = &m_locks[group];
+
+	seqlock_write_begin(sl);
+	memcpy((uint8_t *)&m_buffers[0] + g->offset, data, g->size);
+	seqlock_write_next(sl);
+	memcpy((uint8_t *)&m_buffers[1] + g->offset, data, g->size);
+}
+
+/** Get copy of all sensor groups
+ * Can be called from any thread.
+ */
+void sensors_get_snapshot(struct sensor_snapshot *out)
+{
+	out->version = 0;
+
+	for (int i = 0; i < SG_MAX; i++) {
+		const struct sensor_group_def *g = &m_groups[i];
+		const seqlock_t *sl = &m_locks[i];
+		uint32_t seq;
+
+		do {
+			seq = seqlock_read_begin(sl);
+			memcpy((uint8_t *)out + g->offset,
+					(uint8_t *)&m_buffers[seqlock_read_index(seq)] + g->offset,
+					g->size);
+		} while (seqlock_read_retry(sl, seq));
+
+		out->version += seq / 2;
+	}
+}
+
+/** Add sample to sensor statistics
+ * Can be called from thread or ISR (sensor producer).
+ */
+void sensors_stats_push(enum sensor_stat id, float x)
+{
+	syssts_t sts = chSysGetStatusAndLockX();
+
+	rstats_push(&m_stats[id], x);
+	chSysRestoreStatusX(sts);
+}
+
+/** Set conversion of counts added by sensors_stats_add_counts()
+ * Called from thread before producer starts.
+ */
+void sensors_stats_set_count_scale(enum sensor_stat id, float offset, float k)
+{
+	m_count_offset[id] = offset;
+	m_count_k[id] = k;
+}
+
+/** Add block of ADC counts to sensor statistics
+ * Integer only, can be called from ISR (sensor producer).
+ * Counts stop (n would wrap) if nobody takes statistics.
+ */
+void sensors_stats_add_counts(enum sensor_stat id, const struct sensor_count_stats *cs)
+{
+	struct sensor_count_stats *acc = &m_count_stats[id];
+	syssts_t sts = chSysGetStatusAndLockX();
+
+	if (acc->n + cs->n >= acc->n) {
+		acc->n += cs->n;
+		acc->sum += cs->sum;
+		acc->sumsq += cs->sumsq;
+		if (cs->min < acc->min)	acc->min = cs->min;
+		if (cs->max > acc->max)	acc->max = cs->max;
+	}
+
+	chSysRestoreStatusX(sts);
+}
+
+/** Get statistics and start new window
+ *
+ * @param[out] out	statistics of all sensors
+ * @return window length [ms]
+ */
+uint32_t sensors_stats_take(running_stats_t out[SS_MAX])
+{
+	struct sensor_count_stats counts[SS_MAX];
+	systime_t now;
+
+	chSysLock();
+	now = osalOsGetSystemTimeX();
+	memcpy(out, m_stats, sizeof(m_stats));
+	memcpy(counts, m_count_stats, sizeof(m_count_stats));
+	for (int i = 0; i < SS_MAX; i++) {
+		rstats_reset(&m_stats[i]);
+		count_stats_reset(&m_count_stats[i]);
+	}
+	chSysUnlock();
+
+	for (int i = 0; i < SS_MAX; i++) {
+		if (counts[i].n > 0) {
+			running_stats_t rs;
+
+			count_stats_convert(&rs, &counts[i], i);
+			rstats_merge(&out[i], &rs);
+		}
+	}
+
+	uint32_t window = ST2MS(now - m_stats_start);
+	m_stats_start = now;
+	return window;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file       sensors.h
+ * @brief      Sensor state snapshot
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include "fw_common.h"
+#include "lib/running_stats.h"
+
+/** Sensor groups, each group has only one producer
+ */
+enum sensor_group {
+	SG_ADC1 = 0,	//!< ADC1 callback
+	SG_SDADC1,	//!< SDADC1 callback
+	SG_SDADC3,	//!< SDADC3 callback
+	SG_RPM,		//!< RPM thread
+	SG_MAX
+};
+
+#ifndef ADC_FIXED_POINT
+# define ADC_FIXED_POINT	FALSE
+#endif
+
+#ifndef ADC_XP2_INPUTS
+# define ADC_XP2_INPUTS		FALSE
+#endif
+
+/** ADC values type depends on ADC pipeline build,
+ * use SENSOR_VOLT() and SENSOR_TEMP() to get float [V], [C°]
+ */
+#if ADC_FIXED_POINT
+typedef int32_t sensor_volt_t;	//!< [uV]
+typedef int32_t sensor_temp_t;	//!< [mC°]
+# define SENSOR_VOLT(v)		((v) * 1e-6f)
+# define SENSOR_TEMP(v)		((v) * 1e-3f)
+#else
+typedef float sensor_volt_t;	//!< [V]
+typedef float sensor_temp_t;	//!< [C°]
+# define SENSOR_VOLT(v)		(v)
+# define SENSOR_TEMP(v)		(v)
+#endif
+
+//! ADC1: internal temperature, RTC battery [, XP2 analog inputs]
+struct sensor_adc1 {
+	sensor_temp_t raw_int_temp;
+	sensor_volt_t raw_vrtc;
+	sensor_temp_t flt_int_temp;
+	sensor_volt_t flt_vrtc;
+#if ADC_XP2_INPUTS
+	sensor_volt_t raw_xp2_pa1;
+	sensor_volt_t raw_xp2_pa2;
+	sensor_volt_t flt_xp2_pa1;
+	sensor_volt_t flt_xp2_pa2;
+#endif
+};
+
+//! SDADC1: battery, OIL_P, TEMP
+struct sensor_sdadc1 {
+	sensor_volt_t raw_vbat;		// on ADC input (VD1 drop added later)
+	sensor_volt_t raw_oilp_volt;	// raw voltage on OIL_P
+	sensor_volt_t raw_temp_volt;	// before conversion to temp
+	sensor_volt_t flt_vbat;
+	sensor_volt_t flt_oilp_volt;
+	sensor_volt_t flt_temp_volt;
+};
+
+//! SDADC3: flow sensor
+struct sensor_sdadc3 {
+	sensor_volt_t raw_flow_volt;	// before conversion to FLOW
+	sensor_volt_t flt_flow_volt;
+	int64_t flow_sqrt_sum;		// sum of sqrt(dP) of all samples, see flow_block_sqrt_sum()
+	uint32_t samples;		// samples count in flow_sqrt_sum
+};
+
+//! RPM
+struct sensor_rpm {
+	float rpm;
+	float acceleration;	// [RPM/s]
+	uint32_t rev_period_us;
+};
+
+/** Consistent copy of all sensor values
+ */
+struct sensor_snapshot {
+	uint32_t version;	//!< incremented on each publish
+	struct sensor_adc1 adc1;
+	struct sensor_sdadc1 sdadc1;
+	struct sensor_sdadc3 sdadc3;
+	struct sensor_rpm rpm;
+};
+
+/** Sensors with full rate statistics (Welford), one producer each
+ */
+enum sensor_stat {
+	SS_RPM = 0,	//!< [RPM] per revolution
+	SS_VBAT,	//!< [V] on ADC input
+	SS_OILP,	//!< [V]
+	SS_TEMP,	//!< [V]
+	SS_FLOW,	//!< [V]
+	SS_MAX
+};
+
+/** Integer statistics of ADC counts, accumulated by ISR producers
+ * (no FPU use), value = (count + offset) * k
+ * @see sensors_stats_set_count_scale()
+ */
+struct sensor_count_stats {
+	uint32_t n;
+	int32_t min;
+	int32_t max;
+	int64_t sum;
+	int64_t sumsq;
+};
+
+void sensors_init(void);
+void sensors_publish(enum sensor_group group, const void *data);
+void sensors_get_snapshot(struct sensor_snapshot *out);
+void sensors_stats_push(enum sensor_stat id, float x);
+void sensors_stats_set_count_scale(enum sensor_stat id, float offset, float k);
+void sensors_stats_add_counts(enum sensor_stat id, const struct sensor_count_stats *cs);
+uint32_t sensors_stats_take(running_stats_t out[SS_MAX]);
+
+#endif /* SENSORS_H */
@@ -23,6 +23,12 @@
 #include "alert_led.h"
 #include "th_rpm.h"
 #include "param.h"
+#include "param_table.h"
+#include "hw/rpm_capture.h"
+#include "hw/ectl_pads.h"
+#include "sensors.h"
+#include "trigger_decoder.h"
+#include "log/capture.h"
 #include <string.h>
 
 #ifndef BOARD_MINIECU_V2
@@ -33,31 +39,49 @@
 int32_t gp_pulses_per_revolution;
 int32_t gp_rpm_limit;
 int32_t gp_rpm_min_idle;
+int32_t gp_rpm_hard_limit;
+int32_t gp_rpm_hard_hyst;
+char gp_rpm_wheel[PT_STRING_SIZE];
 
 /* -*- private data -*- */
 
-#define PERIODS_MAX		24
 #define UPDATE_TIMEOUT_US	2000000
+/* Filter out unrealistic period (100 usec ==> RPM 9375.0 with 64 pulses) */
+#define PERIOD_MIN_US		100
+/* Batch timeout if no revolution event (low RPM or engine stopped),
+ * ring must not be overrun during it:
+ * 512 edges / (9375 RPM * 64 / 60) => 51 ms
+ */
+#define BATCH_PERIOD_MS		20
+#define EVT_REVOLUTION		EVENT_MASK(0)
 
 static float m_curr_rpm;
-static uint32_t m_periods_us[PERIODS_MAX];
+static float m_rpm_accel;		// [RPM/s]
+static uint32_t m_rev_period_us;
 static systime_t m_last_update;
-static uint32_t m_periods_cnt;
-static uint32_t m_periods_idx;
+static uint32_t m_edges_lost;
+static uint32_t m_latency_us;		// last revolution detection latency
+static uint32_t m_latency_max_us;	// worst case since boot
+static uint32_t m_limiter_cuts;
+static bool m_limiter_active;
+static bool m_rev_seen;			// revolution found in current batch
+static uint32_t m_rev_ts;		// its start edge timestamp
 static THD_WORKING_AREA(wa_rpm, RPM_WASZ);
 
-static void period_handler(ICUDriver *icup);
-static void empty_handler(ICUDriver *icup ATTR_UNUSED);
-static void overflow_handler(ICUDriver *icup ATTR_UNUSED);
-
-static const ICUConfig tim2_cfg = {
-	.mode = ICU_INPUT_ACTIVE_LOW,
-	.frequency = 1000000,		// 1 MHz
-	.width_cb = empty_handler,	// XXX: wait chibios git update with fix
-	.period_cb = period_handler,
-	.overflow_cb = overflow_handler,
-	.channel = ICU_CHANNEL_1,
-	.dier = 0
+/* batch processing state */
+static uint32_t m_tail;			// next edge to process
+static TriggerDecoder m_decoder;
+static volatile bool m_wheel_changed;
+
+/* RPM_WHEEL definitions, teeth 0 - RPM_NPULSES */
+static const struct wheel_def {
+	const char *name;
+	TriggerWheel wheel;
+} m_wheels[] = {
+	{ RPM_WHEEL__Even, { 0, 0, 0 } },
+	{ RPM_WHEEL__Miss36_1, { 36, 1, 0 } },
+	{ RPM_WHEEL__Miss60_2, { 60, 2, 0 } },
+	{ RPM_WHEEL__Plus1, { 0, 0, 1 } },
 };
 
 /* -*- public functions -*- */
@@ -78,37 +102,230 @@ bool rpm_is_engine_running(void)
 		&& m_curr_rpm > gp_rpm_min_idle;
 }
 
+/** Period of last full revolution [us]
+ */
+uint32_t rpm_get_rev_period(void)
+{
+	return m_rev_period_us;
+}
+
+/** Angular acceleration between last two revolutions [RPM/s]
+ */
+int32_t rpm_get_acceleration(void)
+{
+	return m_rpm_accel;
+}
+
+/** Captured edges count (total, lost by ring overrun)
+ */
+uint32_t rpm_get_edges(uint32_t *lost)
+{
+	if (lost != NULL)
+		*lost = m_edges_lost;
+
+	return m_decoder.edges;
+}
+
+/** Revolution detection latency [us]
+ *
+ * Time from last edge of revolution to RPM update (and limiter decision).
+ */
+uint32_t rpm_get_latency(uint32_t *max)
+{
+	if (max != NULL)
+		*max = m_latency_max_us;
+
+	return m_latency_us;
+}
+
+/** Hard rev limiter ignition cuts count
+ */
+uint32_t rpm_get_limiter_cuts(void)
+{
+	return m_limiter_cuts;
+}
+
+/** Forget ignition cut state
+ *
+ * Should be called if somebody else changes ignition,
+ * so limiter do not restore it.
+ */
+void rpm_limiter_cancel(void)
+{
+	m_limiter_active = false;
+}
+
+/** Trigger decoder sync state and sync loss count
+ */
+enum trigger_sync rpm_get_sync(uint32_t *sync_loss)
+{
+	if (sync_loss != NULL)
+		*sync_loss = m_decoder.sync_loss;
+
+	return m_decoder.sync;
+}
+
+/** Crank angle of last tooth [deg], false if not synced
+ */
+bool rpm_get_crank_angle(float *angle)
+{
+	return trgdecGetAngle(&m_decoder, angle);
+}
+
+/** RPM_NPULSES and RPM_WHEEL change: decoder reinit in rpm thread
+ */
+void on_change_rpm_npulses(const struct param_entry *p ATTR_UNUSED)
+{
+	m_wheel_changed = true;
+}
+
 /* -*- local -*- */
 
-static void empty_handler(ICUDriver *icup ATTR_UNUSED)
+/** Hard rev limiter
+ * Cut ignition above RPM_HARD_LIMIT, restore below limit - hysteresis.
+ *
+ * Called only for measured revolution. Edge timeout (engine stopped
+ * while cut) does not restore ignition, cut stays until next measured
+ * revolution or rpm_limiter_cancel() (ignition commands).
+ */
+static void rev_limiter(float rpm)
+{
+	if (gp_rpm_hard_limit == 0)
+		return;
+
+	if (!m_limiter_active) {
+		if (rpm > gp_rpm_hard_limit && ctl_ignition_state()) {
+			ctl_ignition_set(false);
+			m_limiter_active = true;
+			m_limiter_cuts++;
+		}
+	}
+	else if (rpm < gp_rpm_hard_limit - gp_rpm_hard_hyst) {
+		ctl_ignition_set(true);
+		m_limiter_active = false;
+	}
+}
+
+static void publish_rpm(void)
+{
+	struct sensor_rpm s = {
+		.rpm = m_curr_rpm,
+		.acceleration = m_rpm_accel,
+		.rev_period_us = m_rev_period_us
+	};
+
+	sensors_publish(SG_RPM, &s);
+}
+
+static void reset_revolution(void)
 {
+	trgdecReset(&m_decoder);
+	m_curr_rpm = 0.0f;
+	m_rpm_accel = 0.0f;
+	m_rev_period_us = 0;
+	publish_rpm();
 }
 
-static void period_handler(ICUDriver *icup)
+static void process_revolution(void *arg ATTR_UNUSED, uint32_t edge_ts, uint32_t rev_period)
 {
-	// store period in circular buffer
-	m_periods_cnt = (m_periods_cnt < PERIODS_MAX)? m_periods_cnt + 1 : PERIODS_MAX;
-	m_periods_idx = (m_periods_idx >= PERIODS_MAX)? 0 : m_periods_idx;
-	m_periods_us[m_periods_idx++] = icuGetPeriodX(icup);
+	float rpm = 60.0f * RPM_CAPTURE_FREQUENCY / rev_period;
+
+	if (m_rev_period_us != 0)
+		m_rpm_accel = (rpm - m_curr_rpm) * RPM_CAPTURE_FREQUENCY / rev_period;
+
+	m_rev_period_us = rev_period;
+	m_curr_rpm = rpm;
+	publish_rpm();
+	sensors_stats_push(SS_RPM, rpm);
+	capture_revolution(rev_period);
+
+	rev_limiter(rpm);
+
+	m_rev_seen = true;
+	m_rev_ts = edge_ts;
+	m_latency_us = rpm_capture_now() - edge_ts;
+	if (m_latency_us > m_latency_max_us)
+		m_latency_max_us = m_latency_us;
+}
 
-	m_last_update = osalOsGetSystemTimeX();
+/** Phase align TIM3 revolution interrupt to decoder revolution
+ *
+ * TIM3 counts edges from capture start, not from sync tooth
+ * (also glitches dropped by decoder), so without alignment
+ * its interrupt comes up to a revolution after decoder revolution end.
+ */
+static void align_rev_counter(uint32_t first, uint32_t head)
+{
+	for (uint32_t n = head; n-- != first; ) {
+		if (rpm_capture_get_timestamp(n) == m_rev_ts) {
+			rpm_capture_align_rev(n);
+			return;
+		}
+	}
 }
 
-static void overflow_handler(ICUDriver *icup ATTR_UNUSED)
+/** Process all edges captured since last call
+ */
+static void process_batch(void)
 {
-	// clear buffer if overflow
-	m_periods_cnt = 0;
-	m_periods_idx = 0;
+	uint32_t head = rpm_capture_get_count();
+	uint32_t first;
+
+	if (head - m_tail > RPM_CAPTURE_RING_SIZE) {
+		/* ring overrun, drop old data */
+		m_edges_lost += head - m_tail - RPM_CAPTURE_RING_SIZE;
+		m_tail = head - RPM_CAPTURE_RING_SIZE;
+		reset_revolution();
+	}
+
+	if (m_decoder.started && head != m_tail &&
+			rpm_capture_get_timestamp(m_tail) - m_decoder.last_ts >= UPDATE_TIMEOUT_US) {
+		/* first edge after stop */
+		reset_revolution();
+	}
+
+	/* feed decoder with contiguous parts of the ring */
+	first = m_tail;
+	m_rev_seen = false;
+	while (m_tail != head) {
+		uint32_t idx = m_tail % RPM_CAPTURE_RING_SIZE;
+		uint32_t n = head - m_tail;
+
+		if (n > RPM_CAPTURE_RING_SIZE - idx)
+			n = RPM_CAPTURE_RING_SIZE - idx;
+
+		trgdecProcess(&m_decoder, rpm_capture_get_ring() + idx, n);
+		m_tail += n;
+		m_last_update = osalOsGetSystemTimeX();
+	}
+
+	if (m_rev_seen)
+		align_rev_counter(first, head);
+
+	if (m_decoder.started && rpm_capture_now() - m_decoder.last_ts >= UPDATE_TIMEOUT_US)
+		reset_revolution();
 }
 
-static uint32_t get_period_average(void)
+/** Setup decoder for RPM_WHEEL and RPM_NPULSES
+ */
+static void setup_decoder(void)
 {
-	uint32_t acc = 0;
+	const struct wheel_def *def = &m_wheels[0];
+	TriggerWheel wheel;
+
+	for (size_t i = 0; i < ARRAY_SIZE(m_wheels); i++) {
+		if (strcasecmp(gp_rpm_wheel, m_wheels[i].name) == 0) {
+			def = &m_wheels[i];
+			break;
+		}
+	}
 
-	for (size_t i = 0; i < m_periods_cnt; i++)
-		acc += m_periods_us[i];
+	wheel = def->wheel;
+	if (wheel.teeth == 0)
+		wheel.teeth = gp_pulses_per_revolution;
 
-	return acc / m_periods_cnt;
+	trgdecObjectInit(&m_decoder, &wheel, PERIOD_MIN_US, process_revolution, NULL);
+	m_wheel_changed = false;
 }
 
 static THD_FUNCTION(th_rpm, arg ATTR_UNUSED)
@@ -116,34 +333,28 @@ static THD_FUNCTION(th_rpm, arg ATTR_UNUSED)
 	chRegSetThreadName("rpm");
 
 	// setup initial values
-	m_periods_idx = 0;
-	m_periods_cnt = 0;
+	m_tail = 0;
+	setup_decoder();
+	reset_revolution();
 
 	/* Start input capture
-	 *
-	 * HACK: TIM2 32-bit timer, but driver uses it as 16-bit
-	 * by setting ARR to 0xffff.
+	 * TIM2 used as 32-bit free running timer,
+	 * every edge timestamp transferred by DMA.
+	 * Thread wakes up on each revolution (or by timeout).
 	 */
-	icuStart(&ICUD2, &tim2_cfg);
-	ICUD2.tim->ARR = UPDATE_TIMEOUT_US;
-	icuStartCapture(&ICUD2);
-	icuEnableNotifications(&ICUD2);
+	rpm_capture_start(trgdecEdgesPerRev(&m_decoder), chThdGetSelfX(), EVT_REVOLUTION);
 
 	alert_component(ALS_RPM, AL_NORMAL);
 	while (true) {
-		// Update rate: 10 Hz
-		chThdSleepMilliseconds(100);
-
-		uint32_t period = get_period_average();
-		systime_t elapsed_time = chVTTimeElapsedSinceX(m_last_update);
-
-		/* Filter out unrealistic period (100 usec ==> RPM 9375.0 with 64 pulses)
-		 * Or if timed out.
-		 */
-		if (period > 100 && elapsed_time < US2ST(UPDATE_TIMEOUT_US))
-			m_curr_rpm = 60.0f * 1e6 / (period * gp_pulses_per_revolution);
-		else
-			m_curr_rpm = 0.0f;
+		chEvtWaitAnyTimeout(EVT_REVOLUTION, MS2ST(BATCH_PERIOD_MS));
+
+		if (m_wheel_changed) {
+			setup_decoder();
+			reset_revolution();
+			rpm_capture_set_rev_edges(trgdecEdgesPerRev(&m_decoder));
+		}
+
+		process_batch();
 	}
 
 	return MSG_OK;
@@ -24,10 +24,19 @@
 #define TH_RPM_H
 
 #include "fw_common.h"
+#include "trigger_decoder.h"
 
 void rpm_init(void);
 uint32_t rpm_get_filtered(void);
 bool rpm_check_limit(void);
 bool rpm_is_engine_running(void);
+uint32_t rpm_get_rev_period(void);
+int32_t rpm_get_acceleration(void);
+uint32_t rpm_get_edges(uint32_t *lost);
+uint32_t rpm_get_latency(uint32_t *max);
+uint32_t rpm_get_limiter_cuts(void);
+void rpm_limiter_cancel(void);
+enum trigger_sync rpm_get_sync(uint32_t *sync_loss);
+bool rpm_get_crank_angle(float *angle);
 
 #endif /* TH_ADC_H */
@@ -0,0 +1,175 @@
+/**
+ * @file       host_stubs.c
+ * @brief      Host side of shim: time, pads, flash, debug output
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "hw/ext_flash.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+
+systime_t host_systime;
+uint32_t host_pads[8];
+int host_failures;
+uint32_t host_param_saves;
+
+/* -*- flash -*- */
+
+#define FLASH_PAGE	256
+#define FLASH_PAGES	64
+
+static uint8_t m_fuel_mem[FLASH_PAGE * FLASH_PAGES];
+
+SST25Driver FLASHD1_fuel = { m_fuel_mem, FLASH_PAGE, FLASH_PAGES };
+
+bool blkRead(SST25Driver *flp, uint32_t startblk, uint8_t *buffer, uint32_t n)
+{
+	if (startblk + n > flp->pages)
+		return HAL_FAILED;
+
+	memcpy(buffer, flp->mem + startblk * flp->page_size, n * flp->page_size);
+	return HAL_SUCCESS;
+}
+
+bool blkWrite(SST25Driver *flp, uint32_t startblk, const uint8_t *buffer, uint32_t n)
+{
+	if (startblk + n > flp->pages)
+		return HAL_FAILED;
+
+	/* NOR: program only clears bits */
+	uint8_t *p = flp->mem + startblk * flp->page_size;
+	for (size_t i = 0; i < n * flp->page_size; i++)
+		p[i] &= buffer[i];
+
+	return HAL_SUCCESS;
+}
+
+bool mtdErase(SST25Driver *flp, uint32_t startblk, uint32_t n)
+{
+	if (startblk >= flp->pages)
+		return HAL_FAILED;
+	if (n > flp->pages - startblk)
+		n = flp->pages - startblk;
+
+	memset(flp->mem + startblk * flp->page_size, 0xff, n * flp->page_size);
+	return HAL_SUCCESS;
+}
+
+void host_flash_erase(void)
+{
+	memset(m_fuel_mem, 0xff, sizeof(m_fuel_mem));
+}
+
+/* -*- fw services -*- */
+
+void debug_printf(enum severity severity, char *fmt, ...)
+{
+	static const char *names[] = { "DEBUG", "INFO", "WARN", "ERROR", "FAIL" };
+	va_list ap;
+
+	if (severity < DP_WARN && getenv("HOST_VERBOSE") == NULL)
+		return;
+
+	fflush(stdout);
+	fprintf(stderr, "%s: ", names[severity]);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+void param_save_async(void)
+{
+	host_param_saves++;
+}
+
+/* -*- recorded data -*- */
+
+/** Open logutil.py CSV export, find columns
+ *
+ * @return number of found columns, -1 on error
+ */
+int host_csv_open(struct host_csv *csv, const char *file, const char *const columns[], size_t ncol)
+{
+	char line[HOST_CSV_LINE];
+	int found = 0;
+
+	memset(csv, 0, sizeof(*csv));
+	csv->fd = fopen(file, "r");
+	if (csv->fd == NULL) {
+		perror(file);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), csv->fd) != NULL) {
+		if (line[0] == '#')
+			continue;
+
+		size_t col = 0;
+		for (char *tok = strtok(line, "\t\r\n"); tok != NULL; tok = strtok(NULL, "\t\r\n"), col++) {
+			for (size_t i = 0; i < ncol; i++) {
+				if (strcmp(tok, columns[i]) == 0) {
+					csv->index[i] = col;
+					found++;
+				}
+			}
+		}
+
+		csv->ncol = ncol;
+		return found;
+	}
+
+	return -1;
+}
+
+/** Read next record
+ *
+ * @return false on end of file
+ */
+bool host_csv_read(struct host_csv *csv, double values[])
+{
+	char line[HOST_CSV_LINE];
+	char *cells[HOST_CSV_MAX_CELLS];
+
+	while (fgets(line, sizeof(line), csv->fd) != NULL) {
+		size_t n = 0;
+		for (char *tok = strtok(line, "\t\r\n"); tok != NULL && n < HOST_CSV_MAX_CELLS;
+				tok = strtok(NULL, "\t\r\n"))
+			cells[n++] = tok;
+
+		if (n == 0)
+			continue;
+
+		for (size_t i = 0; i < csv->ncol; i++)
+			values[i] = (csv->index[i] < n) ? strtod(cells[csv->index[i]], NULL) : NAN;
+
+		return true;
+	}
+
+	return false;
+}
+
+void host_csv_close(struct host_csv *csv)
+{
+	if (csv->fd != NULL)
+		fclose(csv->fd);
+}
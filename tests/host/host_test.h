@@ -0,0 +1,62 @@
+/**
+ * @file       host_test.h
+ * @brief      Host tests of fw sources
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include "fw_common.h"
+#include <stdio.h>
+#include <math.h>
+
+/* Notes:
+ * Each test is a program, fw sources linked as is
+ * (shim/ replaces ChibiOS, HAL and pgen output).
+ * Exit status is number of failed checks.
+ */
+
+extern int host_failures;
+extern uint32_t host_param_saves;	//!< param_save_async() calls
+
+#define CHECK(cond, fmt, ...) do {					\
+		if (!(cond)) {						\
+			host_failures++;				\
+			printf("FAIL %s:%d: " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__); \
+		}							\
+	} while (0)
+
+#define HOST_CSV_LINE		4096
+#define HOST_CSV_MAX_CELLS	64
+#define HOST_CSV_MAX_COLS	8
+
+struct host_csv {
+	FILE *fd;
+	size_t ncol;
+	size_t index[HOST_CSV_MAX_COLS];
+};
+
+int host_csv_open(struct host_csv *csv, const char *file, const char *const columns[], size_t ncol);
+bool host_csv_read(struct host_csv *csv, double values[]);
+void host_csv_close(struct host_csv *csv);
+
+void host_flash_erase(void);
+
+#endif /* HOST_TEST_H */
@@ -0,0 +1,64 @@
+/**
+ * @file       ch.h
+ * @brief      Host stand-in for ChibiOS/RT API used by fw sources
+ */
+
+#ifndef CH_H
+#define CH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef TRUE
+# define TRUE	1
+# define FALSE	0
+#endif
+
+typedef uint32_t systime_t;
+typedef uint32_t rtcnt_t;
+typedef int32_t msg_t;
+
+#define MSG_OK		0
+#define MSG_TIMEOUT	-1
+#define MSG_RESET	-2
+
+#define NORMALPRIO	64
+#define LOWPRIO		2
+
+#define CH_CFG_ST_FREQUENCY	1000
+#define S2ST(sec)	((systime_t)((sec) * CH_CFG_ST_FREQUENCY))
+#define MS2ST(msec)	((systime_t)((msec) * CH_CFG_ST_FREQUENCY / 1000))
+#define ST2MS(n)	((n) * 1000 / CH_CFG_ST_FREQUENCY)
+
+//! system time, advanced by test
+extern systime_t host_systime;
+
+static inline systime_t osalOsGetSystemTimeX(void)
+{
+	return host_systime;
+}
+
+#define chVTGetSystemTimeX()		osalOsGetSystemTimeX()
+#define chVTTimeElapsedSinceX(start)	((systime_t)(host_systime - (start)))
+
+/* single threaded */
+#define chSysLock()
+#define chSysUnlock()
+#define chSysLockFromISR()
+#define chSysUnlockFromISR()
+
+typedef uint32_t syssts_t;
+#define chSysGetStatusAndLockX()	((syssts_t)0)
+#define chSysRestoreStatusX(sts)	((void)(sts))
+#define chSysGetRealtimeCounterX()	((rtcnt_t)0)
+
+typedef struct { int locked; } mutex_t;
+#define osalMutexObjectInit(mp)	((mp)->locked = 0)
+#define chMtxLock(mp)		((mp)->locked++)
+#define chMtxUnlock(mp)		((mp)->locked--)
+
+#define osalDbgCheck(c)		((void)(c))
+#define osalDbgAssert(c, r)	((void)(c))
+
+#endif /* CH_H */
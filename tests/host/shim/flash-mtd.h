@@ -0,0 +1,31 @@
+/**
+ * @file       flash-mtd.h
+ * @brief      Host stand-in for flash25 MTD driver, RAM backed
+ */
+
+#ifndef FLASH_MTD_H
+#define FLASH_MTD_H
+
+#include "hal.h"
+
+typedef struct {
+	uint8_t *mem;
+	uint32_t page_size;
+	uint32_t pages;
+} SST25Driver;
+
+static inline uint32_t mtdGetPageSize(SST25Driver *flp)
+{
+	return flp->page_size;
+}
+
+static inline uint32_t mtdGetSize(SST25Driver *flp)
+{
+	return flp->page_size * flp->pages;
+}
+
+bool blkRead(SST25Driver *flp, uint32_t startblk, uint8_t *buffer, uint32_t n);
+bool blkWrite(SST25Driver *flp, uint32_t startblk, const uint8_t *buffer, uint32_t n);
+bool mtdErase(SST25Driver *flp, uint32_t startblk, uint32_t n);
+
+#endif /* FLASH_MTD_H */
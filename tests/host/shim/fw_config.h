@@ -0,0 +1,21 @@
+#ifndef _FW_CONFIG_H_
+#define _FW_CONFIG_H_
+
+/* Host test build: same pipeline options as boards/miniecu_v2,
+ * no target peripherals.
+ */
+
+#define USE_RT_KERNEL
+
+// ADC pipeline: TRUE - fixed point (no FPU use in ADC handlers), FALSE - float
+#define ADC_FIXED_POINT		TRUE
+#define ADC_XP2_INPUTS		FALSE
+
+// CRC16: no CRC unit on host
+#define CRC16_USE_HW		FALSE
+#define CRC16_SLICE		8
+
+// PBSTX: BaseChannel path only
+#define SERIAL1_USE_DMA		FALSE
+
+#endif /* _FW_CONFIG_H_ */
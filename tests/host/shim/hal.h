@@ -0,0 +1,32 @@
+/**
+ * @file       hal.h
+ * @brief      Host stand-in for ChibiOS/HAL API used by fw sources
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#include "ch.h"
+
+#define HAL_SUCCESS	false
+#define HAL_FAILED	true
+
+/* PAL: ports are words of host_pads[] */
+#define GPIOE		4
+#define GPIOE_IGN_EN	0
+#define GPIOE_STARTER	1
+
+extern uint32_t host_pads[8];
+
+#define palReadPad(port, pad)	((host_pads[(port)] >> (pad)) & 1)
+#define palSetPad(port, pad)	(host_pads[(port)] |= 1U << (pad))
+#define palClearPad(port, pad)	(host_pads[(port)] &= ~(1U << (pad)))
+
+/* Channel: struct BaseChannel and chn* functions defined by test */
+typedef struct BaseChannel BaseChannel;
+
+msg_t chnGetTimeout(BaseChannel *chp, systime_t timeout);
+size_t chnReadTimeout(BaseChannel *chp, uint8_t *buf, size_t n, systime_t timeout);
+size_t chnWriteTimeout(BaseChannel *chp, const uint8_t *buf, size_t n, systime_t timeout);
+
+#endif /* HAL_H */
@@ -0,0 +1 @@
+/* host build: no nanopb messages */
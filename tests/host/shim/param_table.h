@@ -0,0 +1,39 @@
+/**
+ * @file       param_table.h
+ * @brief      Host stand-in for pgen output (build/pgen/param_table.h)
+ *
+ * Only values used by tested modules, keep in sync with fw/parameters.yaml.
+ */
+
+#ifndef PARAM_TABLE_H_INCLUEDED
+#define PARAM_TABLE_H_INCLUEDED
+
+#include "param.h"
+
+//! Values for param: BATT_TYPE
+#define BATT_TYPE__LiFePo		"LiFePo"
+#define BATT_TYPE__LiIon		"LiIon"
+#define BATT_TYPE__LiPo		"LiPo"
+#define BATT_TYPE__NiCd		"NiCd"
+#define BATT_TYPE__NiMH		"NiMH"
+#define BATT_TYPE__Pb		"Pb"
+
+//! Values for param: TEMP_R
+enum temp_r {
+	TEMP_R__R1 = 1,
+	TEMP_R__R2 = 2
+};
+
+//! Values for param: OILP_MODE
+#define OILP_MODE__Disabled		"Disabled"
+#define OILP_MODE__NTC10k		"NTC10k"
+#define OILP_MODE__Ratiometric		"Ratiometric"
+#define OILP_MODE__Current		"Current"
+
+//! Values for param: OILP_R
+enum oilp_r {
+	OILP_R__R1 = 1,
+	OILP_R__R2 = 2
+};
+
+#endif /* PARAM_TABLE_H_INCLUEDED */
@@ -0,0 +1,215 @@
+/**
+ * @file       test_batt.c
+ * @brief      Battery state of charge estimator (adc_batt.c)
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "th_adc.h"
+#include "adc_channel.h"
+#include "param_table.h"
+#include "hw/ectl_pads.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Notes:
+ * Recorded battery.voltage (tests/flow_*.csv, Status messages) is fed
+ * as filtered ADC voltage with zero BATT_VTRIMM, starter from
+ * Status.status flags. Recorded battery.remaining is old linear map,
+ * estimator reports should be steadier.
+ */
+
+#define STARTER_ENABLED	8	// miniecu.Status.Flags
+
+extern int32_t gp_batt_cells;
+extern char gp_batt_type[PT_STRING_SIZE];
+extern float gp_batt_voltage_trimm;
+extern float gp_batt_i_starter;
+extern float gp_batt_i_load;
+
+void on_change_batt_type(struct param_entry *p);
+void adc_handle_battery(const struct sensor_snapshot *s);
+
+/* -*- fw stubs -*- */
+
+static const struct adc_channel m_batt_channel = { .name = "BATT" };
+
+const struct adc_channel *adc_channel_find(const char *name)
+{
+	return (strcmp(name, "BATT") == 0) ? &m_batt_channel : NULL;
+}
+
+bool adc_channel_is_ok(const struct adc_channel *ch)
+{
+	return ch != NULL;
+}
+
+/* -*- helpers -*- */
+
+static void batt_setup(const char *type, int32_t cells)
+{
+	struct param_entry p = { .id = "BATT_TYPE", .default_value.s = BATT_TYPE__NiMH };
+
+	gp_batt_cells = cells;
+	gp_batt_voltage_trimm = 0.0f;
+	gp_batt_i_starter = 20.0f;
+	gp_batt_i_load = 0.3f;
+	strcpy(gp_batt_type, type);
+	on_change_batt_type(&p);
+}
+
+static void batt_sample(systime_t t, double volt, bool starter)
+{
+	struct sensor_snapshot s = { .version = 0 };
+
+	s.sdadc1.flt_vbat = lrint(volt * 1e6);
+	if (starter)
+		palSetPad(GPIOE, GPIOE_STARTER);
+	else
+		palClearPad(GPIOE, GPIOE_STARTER);
+
+	host_systime = t;
+	adc_handle_battery(&s);
+}
+
+static int32_t batt_soc(void)
+{
+	uint32_t soc;
+
+	return batt_get_remaining(&soc) ? (int32_t)soc : -1;
+}
+
+/* -*- tests -*- */
+
+/** Rested OCV table points, chemistry selection
+ */
+static void test_ocv(void)
+{
+	static const struct { const char *type; int32_t cells; double volt; int32_t soc; } points[] = {
+		{ BATT_TYPE__NiMH, 4, 4 * 1.240, 50 },
+		{ BATT_TYPE__LiPo, 3, 3 * 4.200, 100 },
+		{ BATT_TYPE__LiPo, 3, 3 * 3.790, 40 },
+		{ BATT_TYPE__Pb, 6, 6 * 2.010, 50 },
+		{ BATT_TYPE__LiFePo, 4, 4 * 2.400, 0 },
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(points); i++) {
+		batt_setup(points[i].type, points[i].cells);
+		/* load compensation: no cranking seen, r_int 0 */
+		batt_sample(1000 * (i + 1), points[i].volt, false);
+
+		int32_t soc = batt_soc();
+		CHECK(soc == points[i].soc, "%s %.3f V: soc %" PRId32 " %%, expected %" PRId32,
+				points[i].type, points[i].volt, soc, points[i].soc);
+	}
+
+	batt_setup("Unknown", 4);
+	CHECK(strcmp(gp_batt_type, BATT_TYPE__NiMH) == 0, "unknown type: %s", gp_batt_type);
+}
+
+/** Cranking sag gives internal resistance, SoC held while cranking and recovering
+ */
+static void test_cranking(void)
+{
+	systime_t t = 100000;
+	uint32_t r_mohm;
+
+	batt_setup(BATT_TYPE__Pb, 6);
+	batt_sample(t, 12.06, false);
+	int32_t rest = batt_soc();
+
+	for (int i = 0; i < 10; i++)
+		batt_sample(t += 100, 10.06, true);	// 2 V sag at 20 A
+	CHECK(batt_soc() == rest, "cranking: soc %" PRId32 " %%, rest %" PRId32, batt_soc(), rest);
+
+	batt_sample(t += 100, 11.5, false);		// recovering
+	batt_sample(t += 1500, 11.8, false);
+	CHECK(batt_soc() == rest, "recovery: soc %" PRId32 " %%, rest %" PRId32, batt_soc(), rest);
+
+	CHECK(batt_get_resistance(&r_mohm) && r_mohm == 100, "resistance %" PRIu32 " mOhm", r_mohm);
+
+	/* after recovery: smoothed toward loaded OCV, 30 s time constant */
+	for (int i = 0; i < 10; i++)
+		batt_sample(t += 1000, 12.06, false);
+	int32_t soc = batt_soc();
+	CHECK(soc >= rest && soc <= rest + 5, "after recovery: soc %" PRId32 " %%, rest %" PRId32, soc, rest);
+}
+
+/* -*- replay -*- */
+
+static const char *const columns[] = { "system_time", "status", "battery.voltage", "battery.remaining" };
+
+/** Replay recorded run
+ * Jitter is largest step between consecutive reports.
+ */
+static void replay(const char *file)
+{
+	struct host_csv csv;
+	double rec[ARRAY_SIZE(columns)];
+	int32_t last = -1, last_rec = -1, jitter = 0, rec_jitter = 0, soc = -1;
+	double volt_sum = 0.0;
+	size_t count = 0;
+
+	if (host_csv_open(&csv, file, columns, ARRAY_SIZE(columns)) != ARRAY_SIZE(columns)) {
+		CHECK(false, "%s: no columns", file);
+		return;
+	}
+
+	batt_setup(BATT_TYPE__NiMH, 4);
+	while (host_csv_read(&csv, rec)) {
+		batt_sample(rec[0], rec[2] / 1000.0, (int)rec[1] & STARTER_ENABLED);
+		soc = batt_soc();
+
+		if (last >= 0 && abs(soc - last) > jitter)
+			jitter = abs(soc - last);
+		if (last_rec >= 0 && abs((int32_t)rec[3] - last_rec) > rec_jitter)
+			rec_jitter = abs((int32_t)rec[3] - last_rec);
+
+		last = soc;
+		last_rec = rec[3];
+		volt_sum += rec[2] / 1000.0;
+		count++;
+	}
+
+	host_csv_close(&csv);
+
+	const char *name = strrchr(file, '/');
+	printf("%-20s %7zu %7.3f %6" PRId32 "%% %8" PRId32 "%% %8" PRId32 "%% %8" PRId32 "%%\n",
+			name ? name + 1 : file, count, volt_sum / count, soc, last_rec, jitter, rec_jitter);
+
+	CHECK(soc >= 0 && soc <= 100, "%s: soc %" PRId32 " %%", file, soc);
+	CHECK(jitter < rec_jitter, "%s: jitter %" PRId32 " %%, recorded %" PRId32 " %%",
+			file, jitter, rec_jitter);
+}
+
+int main(int argc, char *argv[])
+{
+	/* recorded runs first: no cranking in them, internal resistance
+	 * (module state) unknown as after boot */
+	printf("%-20s %7s %7s %7s %9s %9s %9s\n",
+			"run", "records", "volt", "soc", "recorded", "jitter", "rec jit");
+	for (int i = 1; i < argc; i++)
+		replay(argv[i]);
+
+	test_ocv();
+	test_cranking();
+
+	printf("batt: %d failed\n", host_failures);
+	return host_failures;
+}
@@ -0,0 +1,260 @@
+/**
+ * @file       test_channel.c
+ * @brief      Sensor channel registry: conversion and health checks
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "adc_channel.h"
+
+/* Notes:
+ * Table is written here in pgen output form (channel_table.c.tmpl),
+ * one channel per input, all with 10 ms period.
+ */
+
+/* -*- channel table -*- */
+
+static const float poly_gen[] = { 1.0f, 2.0f };		// 1 + 2 V
+static const float lut_x_gen[] = { 1.0f, 3.0f, 5.0f };
+static const float lut_y_gen[] = { 0.0f, 100.0f, 120.0f };
+static const float alarm_high_gen = 110.0f;
+
+static struct adc_channel_state state_gen, state_health, state_opt;
+static bool m_opt_enabled;
+static unsigned m_opt_calls;
+
+static bool opt_enabled(void)
+{
+	return m_opt_enabled;
+}
+
+static void opt_handler(const struct sensor_snapshot *s ATTR_UNUSED)
+{
+	m_opt_calls++;
+}
+
+const struct adc_channel adc_channel_table[] = {
+	{
+		.name = "GEN",
+		.inputs = AI_MASK(AI_TEMP),
+		.input = AI_TEMP,
+		.period_ms = 10,
+		.poly = poly_gen,
+		.poly_size = ARRAY_SIZE(poly_gen),
+		.lut_x = lut_x_gen,
+		.lut_y = lut_y_gen,
+		.lut_size = ARRAY_SIZE(lut_x_gen),
+		.alarm_high = &alarm_high_gen,
+		.state = &state_gen
+	},
+	{
+		.name = "HEALTH",
+		.inputs = AI_MASK(AI_VBAT),
+		.input = AI_VBAT,
+		.period_ms = 10,
+		.range_min = 1.0f,
+		.range_max = 3.0f,
+		.rate_max = 10.0f,
+		.stuck_ms = 1000,
+		.state = &state_health
+	},
+	{
+		.name = "OPT",
+		.inputs = AI_MASK(AI_OILP),
+		.input = AI_OILP,
+		.period_ms = 10,
+		.handler = opt_handler,
+		.enabled = opt_enabled,
+		.range_min = 0.05f,
+		.range_max = 3.25f,
+		.rate_max = 1.0f,
+		.state = &state_opt
+	},
+};
+
+const size_t adc_channel_table_size = ARRAY_SIZE(adc_channel_table);
+
+/* -*- helpers -*- */
+
+static struct sensor_snapshot m_snap;
+
+#define UV(v)	((int32_t)lrint((v) * 1e6))
+
+/** Set input (filtered and raw) and run one channel tick
+ */
+static void tick(void)
+{
+	host_systime += MS2ST(ADC_CHANNEL_TICK_MS);
+	adc_channel_process(&m_snap, false);
+}
+
+static void set_input(sensor_volt_t *flt, sensor_volt_t *raw, double volt)
+{
+	*flt = UV(volt);
+	*raw = UV(volt);
+}
+
+/* -*- tests -*- */
+
+static void test_conversion(void)
+{
+	static const struct { double volt, value; bool alarm; } points[] = {
+		{ -1.0, 0.0, false },	// poly -1 V, LUT clamped low
+		{ 0.5, 50.0, false },	// poly 2 V, first segment
+		{ 1.0, 100.0, false },	// LUT point
+		{ 1.5, 110.0, false },
+		{ 1.75, 115.0, true },
+		{ 3.0, 120.0, true },	// LUT clamped high
+	};
+	const struct adc_channel *ch = adc_channel_find("GEN");
+	float value;
+
+	CHECK(ch == &adc_channel_table[0], "find GEN");
+	CHECK(adc_channel_find("NONE") == NULL, "find unknown");
+
+	for (size_t i = 0; i < ARRAY_SIZE(points); i++) {
+		set_input(&m_snap.sdadc1.flt_temp_volt, &m_snap.sdadc1.raw_temp_volt, points[i].volt);
+		tick();
+
+		CHECK(adc_channel_get_value(ch, &value) && fabs(value - points[i].value) < 1e-3,
+				"GEN %.2f V: %.3f, expected %.3f", points[i].volt, value, points[i].value);
+		CHECK(adc_channel_check_alarm() == points[i].alarm, "GEN %.2f V: alarm %d",
+				points[i].volt, adc_channel_check_alarm());
+	}
+
+	CHECK(!adc_channel_get_value(&adc_channel_table[2], &value), "handler channel has value");
+}
+
+static void expect_health(const struct adc_channel *ch, enum adc_channel_health health,
+		uint32_t faults, const char *what)
+{
+	CHECK(ch->state->health == health, "%s: %s: health %d, expected %d",
+			ch->name, what, ch->state->health, health);
+	CHECK(ch->state->faults == faults, "%s: %s: faults %" PRIu32 ", expected %" PRIu32,
+			ch->name, what, ch->state->faults, faults);
+}
+
+/** Range, rate and stuck transitions, fault counted on entering fault
+ */
+static void test_health(void)
+{
+	const struct adc_channel *ch = adc_channel_find("HEALTH");
+	sensor_volt_t *flt = &m_snap.sdadc1.flt_vbat, *raw = &m_snap.sdadc1.raw_vbat;
+
+	set_input(flt, raw, 2.0);
+	tick();
+	expect_health(ch, ACH_OK, 0, "in range");
+
+	set_input(flt, raw, 0.5);
+	tick();
+	expect_health(ch, ACH_LOW, 1, "below range");
+	CHECK(!adc_channel_is_ok(ch) && adc_channel_check_fault(), "LOW: not faulted");
+	tick();
+	expect_health(ch, ACH_LOW, 1, "still below");
+
+	set_input(flt, raw, 3.5);
+	tick();
+	expect_health(ch, ACH_HIGH, 1, "fault to fault");	// not counted again
+
+	/* back in range: rate from 3.5 V in 10 ms is over limit */
+	set_input(flt, raw, 2.9);
+	tick();
+	expect_health(ch, ACH_RATE, 1, "step");
+	set_input(flt, raw, 2.95);	// 5 V/s
+	tick();
+	expect_health(ch, ACH_OK, 1, "slow change");
+	CHECK(adc_channel_is_ok(ch) && !adc_channel_check_fault(), "OK: faulted");
+
+	/* raw unchanged for stuck time */
+	for (int i = 0; i < 99; i++)
+		tick();
+	expect_health(ch, ACH_OK, 1, "constant 990 ms");
+	tick();
+	expect_health(ch, ACH_STUCK, 2, "constant 1000 ms");
+	m_snap.sdadc1.raw_vbat += 1;
+	tick();
+	expect_health(ch, ACH_OK, 2, "raw changed");
+
+	m_snap.sdadc1.flt_vbat = 0;
+	tick();
+	expect_health(ch, ACH_LOW, 3, "zero");
+	set_input(flt, raw, 2.95);
+	tick();
+}
+
+/** Disabled channel: N/A, no fault, handler still called
+ */
+static void test_enable(void)
+{
+	const struct adc_channel *ch = adc_channel_find("OPT");
+	sensor_volt_t *flt = &m_snap.sdadc1.flt_oilp_volt, *raw = &m_snap.sdadc1.raw_oilp_volt;
+	unsigned calls = m_opt_calls;
+
+	/* unconnected input of disabled sensor */
+	m_opt_enabled = false;
+	set_input(flt, raw, 0.0);
+	for (int i = 0; i < 10; i++)
+		tick();
+
+	expect_health(ch, ACH_NA, 0, "disabled");
+	CHECK(!adc_channel_check_fault(), "disabled channel is fault");
+	CHECK(m_opt_calls == calls + 10, "handler calls %u", m_opt_calls - calls);
+
+	/* enabled: checked, no rate fault against input before disable */
+	m_opt_enabled = true;
+	set_input(flt, raw, 2.0);
+	tick();
+	expect_health(ch, ACH_OK, 0, "enabled");
+	set_input(flt, raw, 3.0);
+	tick();
+	expect_health(ch, ACH_RATE, 1, "enabled step");
+
+	m_opt_enabled = false;
+	tick();
+	expect_health(ch, ACH_NA, 1, "disabled again");
+	CHECK(!adc_channel_check_fault(), "disabled channel is fault");
+
+	m_opt_enabled = true;
+	set_input(flt, raw, 0.0);
+	tick();
+	expect_health(ch, ACH_LOW, 2, "enabled open input");
+}
+
+/** Table queries for ADC setup
+ */
+static void test_queries(void)
+{
+	CHECK(adc_channel_get_period(AI_MASK(AI_VBAT)) == 10, "VBAT period");
+	CHECK(adc_channel_get_period(AI_MASK(AI_FLOW)) == UINT32_MAX, "no FLOW channel");
+	CHECK(adc_channel_get_cutoff(AI_TEMP) == ADC_CHANNEL_DEFAULT_CUTOFF, "default cutoff");
+}
+
+int main(void)
+{
+	host_systime = S2ST(1);
+	set_input(&m_snap.sdadc1.flt_vbat, &m_snap.sdadc1.raw_vbat, 2.0);
+
+	test_conversion();
+	test_health();
+	test_enable();
+	test_queries();
+
+	printf("channel: %d failed\n", host_failures);
+	return host_failures;
+}
@@ -0,0 +1,234 @@
+/**
+ * @file       test_crc16.c
+ * @brief      crc16part variants against bytewise reference
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "lib_crc16.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Notes:
+ * Host has no CRC unit (CRC16_USE_HW FALSE), so crc16part_hw() is
+ * checked as model: same feed as in lib_crc16.c (crc16val bytes,
+ * data without last two bytes, 32-bit words MSB first) into plain
+ * (non augmented) CRC register, then tail xor.
+ * Bitwise reference is augmented form (crc * x^(8 n) + data) mod P.
+ */
+
+#define MAX_LEN		300
+#define NRANDOM		20000
+#define BENCH_BYTES	(64 * 1024)
+#define BENCH_ROUNDS	200
+
+typedef uint16_t (*crc16part_fn)(const uint8_t *src, size_t len, uint16_t crc16val);
+
+static uint8_t m_data[BENCH_BYTES];
+
+/* -*- CRC unit model -*- */
+
+/** CRC->DR, POLYSIZE 16, POL 0x1021, INIT 0
+ */
+struct crc_unit {
+	uint16_t dr;
+};
+
+static void crc_unit_reset(struct crc_unit *u)
+{
+	u->dr = 0;
+}
+
+static void crc_unit_write8(struct crc_unit *u, uint8_t b)
+{
+	u->dr ^= b << 8;
+	for (int i = 0; i < 8; i++)
+		u->dr = (u->dr & 0x8000) ? (u->dr << 1) ^ 0x1021 : u->dr << 1;
+}
+
+static void crc_unit_write32(struct crc_unit *u, uint32_t w)
+{
+	for (int i = 24; i >= 0; i -= 8)
+		crc_unit_write8(u, w >> i);
+}
+
+static uint16_t crc16part_hw_model(const uint8_t *src, size_t len, uint16_t crc16val)
+{
+	struct crc_unit u;
+	uint16_t tail;
+
+	if (len == 0)
+		return crc16val;
+
+	crc_unit_reset(&u);
+	crc_unit_write8(&u, crc16val >> 8);
+	if (len == 1) {
+		tail = ((crc16val & 255) << 8) | src[0];
+	}
+	else {
+		crc_unit_write8(&u, crc16val & 255);
+		len -= 2;
+		tail = (src[len] << 8) | src[len + 1];
+
+		for (; len >= 4; len -= 4, src += 4)
+			crc_unit_write32(&u, ((uint32_t)src[0] << 24) | (src[1] << 16) | (src[2] << 8) | src[3]);
+
+		for (; len > 0; len--)
+			crc_unit_write8(&u, *src++);
+	}
+
+	return u.dr ^ tail;
+}
+
+/* -*- reference -*- */
+
+/** (crc16val * x^(8 len) + src) mod 0x11021, bit by bit
+ */
+static uint16_t crc16part_bitwise(const uint8_t *src, size_t len, uint16_t crc16val)
+{
+	uint32_t r = crc16val;
+
+	for (size_t i = 0; i < len; i++) {
+		for (int b = 7; b >= 0; b--) {
+			r = (r << 1) | ((src[i] >> b) & 1);
+			if (r & 0x10000)
+				r ^= 0x11021;
+		}
+	}
+
+	return r;
+}
+
+/* -*- tests -*- */
+
+static const struct variant {
+	const char *name;
+	crc16part_fn fn;
+} m_variants[] = {
+	{ "bytewise", crc16part_bytewise },
+	{ "slice4", crc16part_slice4 },
+	{ "slice8", crc16part_slice8 },
+	{ "hw model", crc16part_hw_model },
+	{ "crc16part", crc16part },
+};
+
+static void fill_random(uint8_t *buf, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		buf[i] = rand();
+}
+
+static void test_reference(void)
+{
+	srand(1);
+	for (int i = 0; i < 1000; i++) {
+		size_t len = rand() % (MAX_LEN + 1);
+		uint16_t init = rand();
+
+		fill_random(m_data, len);
+		uint16_t ref = crc16part_bitwise(m_data, len, init);
+		uint16_t crc = crc16part_bytewise(m_data, len, init);
+
+		CHECK(crc == ref, "bytewise: len %zu init %04x: %04x != %04x", len, init, crc, ref);
+	}
+}
+
+/** Random lengths 0..MAX_LEN and initial values
+ */
+static void test_random(void)
+{
+	srand(2);
+	for (int i = 0; i < NRANDOM; i++) {
+		size_t len = rand() % (MAX_LEN + 1);
+		size_t off = rand() % 8;	// unaligned src
+		uint16_t init = rand();
+
+		fill_random(m_data + off, len);
+		uint16_t ref = crc16part_bytewise(m_data + off, len, init);
+
+		for (size_t v = 1; v < ARRAY_SIZE(m_variants); v++) {
+			uint16_t crc = m_variants[v].fn(m_data + off, len, init);
+
+			CHECK(crc == ref, "%s: len %zu init %04x: %04x != %04x",
+					m_variants[v].name, len, init, crc, ref);
+		}
+	}
+}
+
+/** Buffer split in random parts, each continues previous result
+ */
+static void test_chained(void)
+{
+	srand(3);
+	for (int i = 0; i < 2000; i++) {
+		size_t len = rand() % (MAX_LEN + 1);
+
+		fill_random(m_data, len);
+		uint16_t ref = crc16(m_data, len);
+
+		for (size_t v = 0; v < ARRAY_SIZE(m_variants); v++) {
+			uint16_t crc = 0;
+
+			for (size_t pos = 0; pos < len; ) {
+				size_t part = rand() % (len - pos + 1);
+
+				crc = m_variants[v].fn(m_data + pos, part, crc);
+				pos += part;
+			}
+
+			CHECK(crc == ref, "%s: chained len %zu: %04x != %04x",
+					m_variants[v].name, len, crc, ref);
+		}
+	}
+}
+
+static void test_timing(void)
+{
+	fill_random(m_data, BENCH_BYTES);
+
+	for (size_t v = 0; v < ARRAY_SIZE(m_variants); v++) {
+		volatile uint16_t sink = 0;
+		struct timespec t0, t1;
+		int rounds = BENCH_ROUNDS;
+
+		if (m_variants[v].fn == crc16part_hw_model)
+			rounds /= 10;	// bit loop
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (int r = 0; r < rounds; r++)
+			sink = m_variants[v].fn(m_data, BENCH_BYTES, sink);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+		printf("%-10s %8.1f MB/s\n", m_variants[v].name,
+				(double)rounds * BENCH_BYTES / sec * 1e-6);
+	}
+}
+
+int main(void)
+{
+	test_reference();
+	test_random();
+	test_chained();
+	test_timing();
+
+	printf("crc16: %d failed\n", host_failures);
+	return host_failures;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file       test_decoder.c
+ * @brief      Trigger decoder on generated wheel edges
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "trigger_decoder.h"
+
+#define TOOTH_US	1000	// regular tooth period
+#define MIN_PERIOD	50	// glitch filter
+#define MAX_EDGES	4096
+#define MAX_REVS	64
+
+/* -*- edge generator -*- */
+
+/** Edges of revs revolutions, first edge is tooth 0
+ *
+ * @param k	tooth period factor (< 1 accelerating)
+ */
+static size_t gen_edges(const TriggerWheel *w, uint32_t start, size_t revs, double k, uint32_t *ts)
+{
+	double t = start, period = TOOTH_US;
+	size_t n = 0;
+
+	for (size_t r = 0; r < revs; r++) {
+		for (size_t pos = 0; pos < w->teeth; pos++) {
+			if (pos < (size_t)(w->teeth - w->missing))
+				ts[n++] = (uint32_t)llround(t);
+			if (w->extra && pos == w->teeth - 1u)
+				ts[n++] = (uint32_t)llround(t + period / 2);
+
+			t += period;
+			period *= k;
+		}
+	}
+
+	return n;
+}
+
+/* -*- revolution callback -*- */
+
+struct revs {
+	size_t n;
+	uint32_t period[MAX_REVS];
+};
+
+static void rev_cb(void *arg, uint32_t ts ATTR_UNUSED, uint32_t period)
+{
+	struct revs *r = arg;
+
+	if (r->n < MAX_REVS)
+		r->period[r->n++] = period;
+}
+
+static const struct {
+	const char *name;
+	TriggerWheel wheel;
+	enum trigger_sync sync;
+} m_wheels[] = {
+	{ "4", { 4, 0, 0 }, TS_NONE },
+	{ "36-1", { 36, 1, 0 }, TS_SYNCED },
+	{ "60-2", { 60, 2, 0 }, TS_SYNCED },
+	{ "12+1", { 12, 0, 1 }, TS_SYNCED },
+};
+
+static uint32_t m_ts[MAX_EDGES];
+
+/** Constant speed, from start timestamp
+ * Revolution period exact after sync, no sync loss.
+ */
+static void test_constant(const TriggerWheel *w, enum trigger_sync sync, uint32_t start, const char *name)
+{
+	TriggerDecoder dec;
+	struct revs revs = { 0 };
+	size_t n = gen_edges(w, start, 10, 1.0, m_ts);
+
+	trgdecObjectInit(&dec, w, MIN_PERIOD, rev_cb, &revs);
+	trgdecProcess(&dec, m_ts, n);
+
+	CHECK(dec.sync == sync, "%s: sync %d", name, dec.sync);
+	CHECK(dec.sync_loss == 0, "%s: sync loss %" PRIu32, name, dec.sync_loss);
+	CHECK(revs.n >= 8, "%s: %zu revolutions", name, revs.n);
+	for (size_t i = 1; i < revs.n; i++)
+		CHECK(revs.period[i] == w->teeth * TOOTH_US, "%s: rev %zu period %" PRIu32,
+				name, i, revs.period[i]);
+}
+
+/** Tooth period changes by 0.5 % per tooth (~30 % per rev)
+ */
+static void test_accel(const TriggerWheel *w, double k, const char *name)
+{
+	TriggerDecoder dec;
+	size_t n = gen_edges(w, 0, 3, k, m_ts);
+
+	trgdecObjectInit(&dec, w, MIN_PERIOD, NULL, NULL);
+	trgdecProcess(&dec, m_ts, n);
+
+	CHECK(dec.sync == TS_SYNCED, "%s: k %.3f sync %d", name, k, dec.sync);
+	CHECK(dec.sync_loss == 0, "%s: k %.3f sync loss %" PRIu32, name, k, dec.sync_loss);
+}
+
+/** Glitch between teeth is ignored, dropped tooth loses sync then resyncs
+ */
+static void test_noise(const TriggerWheel *w, const char *name)
+{
+	TriggerDecoder dec;
+	size_t n = gen_edges(w, 0, 10, 1.0, m_ts);
+	size_t edges = trgdecEdgesPerRev(&(TriggerDecoder){ .wheel = *w });
+	size_t at = 4 * edges + 5;
+	uint32_t glitch = m_ts[at] + MIN_PERIOD / 2;
+
+	trgdecObjectInit(&dec, w, MIN_PERIOD, NULL, NULL);
+	trgdecProcess(&dec, m_ts, at + 1);
+	trgdecProcess(&dec, &glitch, 1);
+	trgdecProcess(&dec, m_ts + at + 1, n - at - 1);
+
+	CHECK(dec.sync == TS_SYNCED && dec.sync_loss == 0, "%s: glitch: sync %d loss %" PRIu32,
+			name, dec.sync, dec.sync_loss);
+
+	/* drop one regular tooth in 5th revolution */
+	trgdecObjectInit(&dec, w, MIN_PERIOD, NULL, NULL);
+	trgdecProcess(&dec, m_ts, at);
+	trgdecProcess(&dec, m_ts + at + 1, n - at - 1);
+
+	CHECK(dec.sync_loss == 1, "%s: dropped: sync loss %" PRIu32, name, dec.sync_loss);
+	CHECK(dec.sync == TS_SYNCED, "%s: dropped: no resync", name);
+}
+
+/** Crank angle of last processed tooth
+ */
+static void test_angle(const TriggerWheel *w, const char *name)
+{
+	TriggerDecoder dec;
+	size_t edges = trgdecEdgesPerRev(&(TriggerDecoder){ .wheel = *w });
+	float angle;
+
+	gen_edges(w, 0, 4, 1.0, m_ts);
+	trgdecObjectInit(&dec, w, MIN_PERIOD, NULL, NULL);
+	trgdecProcess(&dec, m_ts, 3 * edges + 11);	// tooth 10 of 4th revolution
+
+	CHECK(trgdecGetAngle(&dec, &angle), "%s: no angle", name);
+	CHECK(fabsf(angle - 360.0f * 10 / w->teeth) < 1e-3f, "%s: angle %.2f", name, angle);
+}
+
+int main(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_wheels); i++) {
+		const TriggerWheel *w = &m_wheels[i].wheel;
+		const char *name = m_wheels[i].name;
+
+		test_constant(w, m_wheels[i].sync, 0, name);
+		test_constant(w, m_wheels[i].sync, UINT32_MAX - 3 * w->teeth * TOOTH_US, name);	// timer wrap
+
+		if (m_wheels[i].sync != TS_SYNCED)
+			continue;
+
+		test_accel(w, 0.995, name);
+		test_accel(w, 1.005, name);
+		test_noise(w, name);
+		test_angle(w, name);
+	}
+
+	printf("decoder: %d failed\n", host_failures);
+	return host_failures;
+}
@@ -0,0 +1,272 @@
+/**
+ * @file       test_filter.c
+ * @brief      lpf2p block kernels against scalar filter
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "lowpassfilter2p.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <time.h>
+
+/* Notes:
+ * Block kernels do same math in same order as lpf2pApply(),
+ * so outputs must be bit exact, including around NaN/Inf samples.
+ * Timing: ADC handler blocks (ADC_BLOCK_DEPTH sequences) through
+ * block kernels vs per-sample lpf2pApply() loop, same copy in both.
+ */
+
+#define SAMPLE_FREQ	1000.0f	// Hz
+#define CUTOFF		50.0f	// Hz
+#define NSAMPLES	1024
+#define CHANNELS	3
+#define BENCH_BLOCK	128	// ADC_BLOCK_DEPTH
+#define BENCH_ROUNDS	2000
+
+static float m_input[NSAMPLES * CHANNELS];
+
+static void gen_input(void)
+{
+	srand(1);
+	for (size_t i = 0; i < ARRAY_SIZE(m_input); i++)
+		m_input[i] = 1.5f + 0.5f * sinf(i * 0.01f) + (rand() % 1000) * 1e-4f;
+}
+
+static void filter_init(LowPassFilter2p *flt, float cutoff)
+{
+	lpf2pObjectInit(flt);
+	lpf2pSetCutoffFrequency(flt, SAMPLE_FREQ, cutoff);
+	lpf2pReset(flt, m_input[0]);
+}
+
+/** Scalar reference
+ */
+static void scalar(float *out, const float *in, size_t n, size_t stride, float cutoff)
+{
+	LowPassFilter2p flt;
+
+	filter_init(&flt, cutoff);
+	for (size_t i = 0; i < n; i++)
+		out[i * stride] = lpf2pApply(&flt, in[i * stride]);
+}
+
+/** Compare with scalar, NaN equal to NaN
+ */
+static size_t mismatch(const float *a, const float *b, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		if (memcmp(&a[i], &b[i], sizeof(float)) != 0 && !(isnan(a[i]) && isnan(b[i])))
+			return i;
+	}
+
+	return n;
+}
+
+/** lpf2pApplyBlock() in blocks of different length
+ */
+static void test_block(const float *in, const char *name)
+{
+	static const size_t sizes[] = { 1, 7, 16, 64, NSAMPLES };
+	float ref[NSAMPLES], out[NSAMPLES];
+
+	scalar(ref, in, NSAMPLES, 1, CUTOFF);
+
+	for (size_t s = 0; s < ARRAY_SIZE(sizes); s++) {
+		LowPassFilter2p flt;
+
+		filter_init(&flt, CUTOFF);
+		memcpy(out, in, sizeof(out));
+		for (size_t i = 0; i < NSAMPLES; i += sizes[s])
+			lpf2pApplyBlock(&flt, out + i, (NSAMPLES - i < sizes[s]) ? NSAMPLES - i : sizes[s]);
+
+		size_t at = mismatch(out, ref, NSAMPLES);
+		CHECK(at == NSAMPLES, "%s: block %zu: sample %zu: %g != %g",
+				name, sizes[s], at, out[at], ref[at]);
+	}
+}
+
+/** lpf2pApplyInterleaved(), channels with different cutoff
+ */
+static void test_interleaved(void)
+{
+	static const float cutoff[CHANNELS] = { CUTOFF, 5.0f, 0.0f };
+	LowPassFilter2p flt[CHANNELS];
+	LowPassFilter2p *const filters[CHANNELS] = { &flt[0], &flt[1], &flt[2] };
+	float ref[NSAMPLES * CHANNELS], out[NSAMPLES * CHANNELS];
+
+	for (size_t ch = 0; ch < CHANNELS; ch++) {
+		scalar(ref + ch, m_input + ch, NSAMPLES, CHANNELS, cutoff[ch]);
+		filter_init(&flt[ch], cutoff[ch]);
+	}
+
+	memcpy(out, m_input, sizeof(out));
+	for (size_t i = 0; i < NSAMPLES; i += 16)
+		lpf2pApplyInterleaved(filters, out + i * CHANNELS, CHANNELS, 16);
+
+	size_t at = mismatch(out, ref, ARRAY_SIZE(out));
+	CHECK(at == ARRAY_SIZE(out), "interleaved: sample %zu: %g != %g", at, out[at], ref[at]);
+}
+
+/** Bad sample does not poison filter state
+ * Non-finite state is reset to input, output is finite again
+ * when bad value leaves delay line (third sample).
+ */
+static void test_bad_sample(float bad, const char *name)
+{
+	float in[NSAMPLES], out[NSAMPLES];
+	LowPassFilter2p flt;
+
+	memcpy(in, m_input, sizeof(in));
+	in[100] = bad;
+	test_block(in, name);
+
+	filter_init(&flt, CUTOFF);
+	memcpy(out, in, sizeof(out));
+	lpf2pApplyBlock(&flt, out, NSAMPLES);
+
+	for (size_t i = 103; i < NSAMPLES; i++) {
+		if (!isfinite(out[i])) {
+			CHECK(false, "%s: sample %zu: %g", name, i, out[i]);
+			break;
+		}
+	}
+}
+
+/** Design in other object, copy to running filter (design_filters())
+ */
+static void test_copy(void)
+{
+	LowPassFilter2p design, flt;
+	float out[NSAMPLES];
+
+	lpf2pObjectInit(&flt);
+	lpf2pReset(&flt, m_input[0]);
+
+	lpf2pObjectInit(&design);
+	lpf2pSetCutoffFrequency(&design, SAMPLE_FREQ, CUTOFF);
+	lpf2pCopyCoefficients(&flt, &design);
+
+	memcpy(out, m_input, sizeof(out));
+	lpf2pApplyBlock(&flt, out, NSAMPLES);
+
+	CHECK(flt.cutoff_freq == CUTOFF, "copy: cutoff %g", flt.cutoff_freq);
+	CHECK(memcmp(out, m_input, sizeof(out)) != 0, "copy: filter is pass-through");
+}
+
+static double elapsed_ns(const struct timespec *t0)
+{
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec);
+}
+
+/** Block kernels vs per-sample loop [ns/sample]
+ */
+static void test_timing(void)
+{
+	static const float cutoff[CHANNELS] = { CUTOFF, 5.0f, 10.0f };
+	LowPassFilter2p flt[CHANNELS];
+	LowPassFilter2p *const filters[CHANNELS] = { &flt[0], &flt[1], &flt[2] };
+	float out[BENCH_BLOCK * CHANNELS];
+	const size_t nblocks = NSAMPLES / BENCH_BLOCK;
+	const double nsamples = (double)BENCH_ROUNDS * NSAMPLES;
+	volatile float sink = 0.0f;
+	struct timespec t0;
+	double loop_ns, block_ns;
+
+	/* one channel */
+	filter_init(&flt[0], CUTOFF);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t r = 0; r < BENCH_ROUNDS; r++) {
+		for (size_t b = 0; b < nblocks; b++) {
+			const float *in = m_input + b * BENCH_BLOCK;
+
+			for (size_t i = 0; i < BENCH_BLOCK; i++)
+				out[i] = lpf2pApply(&flt[0], in[i]);
+			sink = out[BENCH_BLOCK - 1];
+		}
+	}
+	loop_ns = elapsed_ns(&t0) / nsamples;
+
+	filter_init(&flt[0], CUTOFF);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t r = 0; r < BENCH_ROUNDS; r++) {
+		for (size_t b = 0; b < nblocks; b++) {
+			memcpy(out, m_input + b * BENCH_BLOCK, BENCH_BLOCK * sizeof(float));
+			lpf2pApplyBlock(&flt[0], out, BENCH_BLOCK);
+			sink = out[BENCH_BLOCK - 1];
+		}
+	}
+	block_ns = elapsed_ns(&t0) / nsamples;
+
+	printf("block:       loop %5.2f ns/sample, block %5.2f ns/sample (%.1fx)\n",
+			loop_ns, block_ns, loop_ns / block_ns);
+
+	/* interleaved channels, per channel sample */
+	for (size_t ch = 0; ch < CHANNELS; ch++)
+		filter_init(&flt[ch], cutoff[ch]);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t r = 0; r < BENCH_ROUNDS; r++) {
+		for (size_t b = 0; b < nblocks; b++) {
+			const float *in = m_input + b * BENCH_BLOCK * CHANNELS;
+
+			for (size_t i = 0; i < BENCH_BLOCK * CHANNELS; i += CHANNELS)
+				for (size_t ch = 0; ch < CHANNELS; ch++)
+					out[i + ch] = lpf2pApply(&flt[ch], in[i + ch]);
+			sink = out[0];
+		}
+	}
+	loop_ns = elapsed_ns(&t0) / (nsamples * CHANNELS);
+
+	for (size_t ch = 0; ch < CHANNELS; ch++)
+		filter_init(&flt[ch], cutoff[ch]);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t r = 0; r < BENCH_ROUNDS; r++) {
+		for (size_t b = 0; b < nblocks; b++) {
+			memcpy(out, m_input + b * BENCH_BLOCK * CHANNELS, sizeof(out));
+			lpf2pApplyInterleaved(filters, out, CHANNELS, BENCH_BLOCK);
+			sink = out[0];
+		}
+	}
+	block_ns = elapsed_ns(&t0) / (nsamples * CHANNELS);
+	(void)sink;
+
+	printf("interleaved: loop %5.2f ns/sample, block %5.2f ns/sample (%.1fx)\n",
+			loop_ns, block_ns, loop_ns / block_ns);
+}
+
+int main(void)
+{
+	gen_input();
+
+	test_block(m_input, "finite");
+	test_interleaved();
+	test_bad_sample(NAN, "nan");
+	test_bad_sample(INFINITY, "inf");
+	test_bad_sample(-INFINITY, "-inf");
+	test_bad_sample(FLT_MAX, "overflow");
+	test_copy();
+	test_timing();
+
+	printf("filter: %d failed\n", host_failures);
+	return host_failures;
+}
@@ -0,0 +1,252 @@
+/**
+ * @file       test_filter_q.c
+ * @brief      Fixed point lpf2pq against double precision biquad
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "lowpassfilter2p.h"
+#include <stdlib.h>
+#include <time.h>
+
+/* Notes:
+ * Reference is same Butterworth design in double (Direct Form I),
+ * so error is Q2.30 coefficient rounding plus state truncation.
+ * Rates and cutoffs are ADC groups designs (th_adc.c).
+ * Timing: float path (int16 -> float block, lpf2pApplyBlock()) vs
+ * lpf2pqApplyBlock() on same blocks, both per input sample.
+ */
+
+#define NSAMPLES	20000
+#define BLOCK		16	// ADC_BLOCK_DEPTH
+#define MAX_ERROR_LSB	0.5	// [input LSB]
+#define BENCH_ROUNDS	200
+
+static int16_t m_input[NSAMPLES];
+
+struct ref_biquad {
+	double a1, a2, b0, b1, b2;
+	double x1, x2, y1, y2;
+};
+
+static void ref_design(struct ref_biquad *r, double fs, double fc, double x0)
+{
+	double ohm = tan(M_PI * fc / fs);
+	double c = 1.0 + 2.0 * cos(M_PI_4) * ohm + ohm * ohm;
+
+	r->b0 = ohm * ohm / c;
+	r->b1 = 2.0 * r->b0;
+	r->b2 = r->b0;
+	r->a1 = 2.0 * (ohm * ohm - 1.0) / c;
+	r->a2 = (1.0 - 2.0 * cos(M_PI_4) * ohm + ohm * ohm) / c;
+	r->x1 = r->x2 = r->y1 = r->y2 = x0;
+}
+
+static double ref_apply(struct ref_biquad *r, double x0)
+{
+	double y0 = r->b0 * x0 + r->b1 * r->x1 + r->b2 * r->x2
+		- r->a1 * r->y1 - r->a2 * r->y2;
+
+	r->x2 = r->x1;
+	r->x1 = x0;
+	r->y2 = r->y1;
+	r->y1 = y0;
+	return y0;
+}
+
+static void filter_init(LowPassFilter2pQ *flt, float fs, float fc, int16_t x0)
+{
+	lpf2pqObjectInit(flt);
+	lpf2pqSetCutoffFrequency(flt, fs, fc);
+	flt->x1 = flt->x2 = flt->y1 = flt->y2 = (int32_t)x0 << LPF2PQ_SHIFT;
+}
+
+/** Max error of block outputs [LSB]
+ */
+static double max_error(float fs, float fc, const int16_t *in, size_t n)
+{
+	LowPassFilter2pQ flt;
+	struct ref_biquad ref;
+	double err = 0.0;
+
+	filter_init(&flt, fs, fc, in[0]);
+	ref_design(&ref, fs, fc, in[0]);
+
+	for (size_t i = 0; i + BLOCK <= n; i += BLOCK) {
+		int32_t y = lpf2pqApplyBlock(&flt, in + i, BLOCK, 1);
+		double yr = 0.0;
+
+		for (size_t j = i; j < i + BLOCK; j++)
+			yr = ref_apply(&ref, in[j]);
+
+		double e = fabs(y / (double)(1 << LPF2PQ_SHIFT) - yr);
+		if (e > err)
+			err = e;
+	}
+
+	return err;
+}
+
+static double elapsed_ns(const struct timespec *t0)
+{
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec);
+}
+
+/** Float and fixed point block filter time [ns/sample]
+ */
+static void time_filters(float fs, float fc, const int16_t *in, size_t n,
+		double *float_ns, double *q_ns)
+{
+	const size_t nblocks = n / BLOCK;
+	const double nsamples = (double)BENCH_ROUNDS * nblocks * BLOCK;
+	LowPassFilter2p flt;
+	LowPassFilter2pQ fltq;
+	volatile float sink = 0.0f;
+	volatile int32_t sinkq = 0;
+	float blk[BLOCK];
+	struct timespec t0;
+
+	lpf2pObjectInit(&flt);
+	lpf2pSetCutoffFrequency(&flt, fs, fc);
+	lpf2pReset(&flt, in[0]);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t r = 0; r < BENCH_ROUNDS; r++) {
+		for (size_t b = 0; b < nblocks; b++) {
+			for (size_t i = 0; i < BLOCK; i++)
+				blk[i] = in[b * BLOCK + i];
+			lpf2pApplyBlock(&flt, blk, BLOCK);
+			sink = blk[BLOCK - 1];
+		}
+	}
+	*float_ns = elapsed_ns(&t0) / nsamples;
+
+	filter_init(&fltq, fs, fc, in[0]);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t r = 0; r < BENCH_ROUNDS; r++) {
+		for (size_t b = 0; b < nblocks; b++)
+			sinkq = lpf2pqApplyBlock(&fltq, in + b * BLOCK, BLOCK, 1);
+	}
+	*q_ns = elapsed_ns(&t0) / nsamples;
+
+	(void)sink;
+	(void)sinkq;
+}
+
+static void gen_noise(int16_t *out, size_t n, int32_t mean, int32_t amp)
+{
+	srand(1);
+	for (size_t i = 0; i < n; i++)
+		out[i] = mean + amp * sin(i * 0.003) + rand() % 201 - 100;
+}
+
+static void test_accuracy(void)
+{
+	static const struct { float fs, fc; } designs[] = {
+		{ 17780.0f * 2 / 3, 50.0f },	// ADC1
+		{ 5560.0f, 50.0f },		// SDADC1
+		{ 5560.0f, 10.0f },		// SDADC1 BATT, TEMP
+		{ 5560.0f, 5.0f },		// lowest in parameters.yaml
+		{ 16680.0f, 50.0f },		// SDADC3
+	};
+
+	gen_noise(m_input, NSAMPLES, 0, 20000);
+
+	for (size_t i = 0; i < ARRAY_SIZE(designs); i++) {
+		double err = max_error(designs[i].fs, designs[i].fc, m_input, NSAMPLES);
+		double float_ns, q_ns;
+
+		time_filters(designs[i].fs, designs[i].fc, m_input, NSAMPLES, &float_ns, &q_ns);
+		printf("fs %7.1f fc %4.1f: max error %.4f LSB, float %5.2f ns, q %5.2f ns\n",
+				designs[i].fs, designs[i].fc, err, float_ns, q_ns);
+		CHECK(err < MAX_ERROR_LSB, "fs %.1f fc %.1f: error %.4f LSB",
+				designs[i].fs, designs[i].fc, err);
+	}
+}
+
+/** Constant input settles to exact value
+ * (DC gain of rounded coefficients, error feedback), low cutoff
+ */
+static void test_dc(void)
+{
+	static const int16_t levels[] = { INT16_MIN, -12345, 0, 1, 12345, INT16_MAX };
+
+	for (size_t l = 0; l < ARRAY_SIZE(levels); l++) {
+		int16_t in[BLOCK];
+		LowPassFilter2pQ flt;
+		int32_t y = 0;
+
+		for (size_t i = 0; i < BLOCK; i++)
+			in[i] = levels[l];
+
+		filter_init(&flt, 16680.0f, 1.0f, 0);
+		for (size_t i = 0; i < 10 * 16680 / BLOCK; i++)
+			y = lpf2pqApplyBlock(&flt, in, BLOCK, 1);
+
+		CHECK(y == (int32_t)levels[l] << LPF2PQ_SHIFT, "dc %d: output %.4f",
+				levels[l], y / (double)(1 << LPF2PQ_SHIFT));
+	}
+}
+
+/** Full scale square wave: no accumulator overflow
+ */
+static void test_full_scale(void)
+{
+	for (size_t i = 0; i < NSAMPLES; i++)
+		m_input[i] = ((i / 64) & 1) ? INT16_MAX : INT16_MIN;
+
+	double err = max_error(5560.0f, 1000.0f, m_input, NSAMPLES);
+	CHECK(err < MAX_ERROR_LSB, "full scale: error %.4f LSB", err);
+}
+
+/** Interleaved channel (stride), disabled filter, copied design
+ */
+static void test_modes(void)
+{
+	int16_t in[3 * BLOCK];
+	LowPassFilter2pQ flt, design;
+
+	for (size_t i = 0; i < ARRAY_SIZE(in); i++)
+		in[i] = (i % 3 == 1) ? (int16_t)(1000 + i) : -1;
+
+	lpf2pqObjectInit(&flt);
+	CHECK(lpf2pqApplyBlock(&flt, in + 1, BLOCK, 3) == (int32_t)in[3 * BLOCK - 2] << LPF2PQ_SHIFT,
+			"disabled: not last sample of channel");
+
+	lpf2pqObjectInit(&design);
+	lpf2pqSetCutoffFrequency(&design, 5560.0f, 50.0f);
+	lpf2pqCopyCoefficients(&flt, &design);
+	CHECK(flt.enabled, "copy: filter is pass-through");
+
+	int32_t y = lpf2pqApplyBlock(&flt, in + 1, BLOCK, 3);
+	CHECK(y > 0 && y < (int32_t)in[3 * BLOCK - 2] << LPF2PQ_SHIFT, "copy: output %" PRId32, y);
+}
+
+int main(void)
+{
+	test_accuracy();
+	test_dc();
+	test_full_scale();
+	test_modes();
+
+	printf("filter_q: %d failed\n", host_failures);
+	return host_failures;
+}
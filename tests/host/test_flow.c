@@ -0,0 +1,619 @@
+/**
+ * @file       test_flow.c
+ * @brief      Replay recorded flow tests through adc_flow.c
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "th_adc.h"
+#include "lowpassfilter2p.h"
+#include "hw/ectl_pads.h"
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Notes:
+ * Runs are Status messages of tests/flow_test.dblog (tools/miniecu/sql_log.py),
+ * raw_flow is held until next record and fed at SDADC3 rate as blocks
+ * to flow_block_sqrt_sum() and lpf2pqApplyBlock(), as adc_flow_cb() does,
+ * adc_handle_flow() runs each FLOW channel period, as ADC thread does.
+ *
+ * Known volume is 10 mL of water per run, recorded runs fit Cd ~0.3
+ * (FLOW_CD default 0.75), so volume error is reported, not checked,
+ * but fitted Cd must agree between runs. Run "flow test h2 3" gives
+ * ~60% of volume of others with any zero estimate (first, last or
+ * quietest records), so it is reported and not used.
+ * Flow math is checked on synthetic blocks.
+ * Zero learning gets filtered voltage with gaussian noise per handler
+ * call, after replay (learned noise is dead band of flow).
+ */
+
+#define SDADC3_RATE	16680.0f	// samples/s, measured (th_adc.c)
+#define ADC_BLOCK	128		// ADC_BLOCK_DEPTH
+#define FLOW_CUTOFF	50.0f		// Hz, FLOW channel cutoff
+#define HANDLER_MS	20		// FLOW channel period
+#define MAX_GAP_MS	1000		// do not integrate over log gaps
+#define V0_RECORDS	10		// records for FLOW_V0
+#define TRUTH_ML	10.0
+#define TEST_V0		0.6f		// V
+#define CD_SPREAD	0.2		// fitted Cd vs median of runs
+#define MAX_RUNS	16
+#define ZERO_WINDOW_MS	10000		// ZERO_WINDOW
+#define ZERO_V0		0.7		// V, true sensor zero
+
+extern bool gp_flow_enable;
+extern float gp_flow_v0;
+extern bool gp_flow_v0_auto;
+extern float gp_flow_dia1;
+extern float gp_flow_dia2;
+extern float gp_flow_cd;
+extern float gp_flow_ro;
+
+void adc_handle_flow(const struct sensor_snapshot *s);
+
+struct run {
+	char name[64];
+	size_t count;
+	double (*rec)[2];	//!< system_time [ms], raw_flow [V]
+};
+
+static const char *const m_outliers[] = { "flow test h2 3" };
+
+/* -*- fw stubs -*- */
+
+static bool m_engine_running;
+
+bool rpm_is_engine_running(void)
+{
+	return m_engine_running;
+}
+
+float adc_get_sample_rate(enum sensor_group group ATTR_UNUSED)
+{
+	return SDADC3_RATE;
+}
+
+/* -*- SDADC3 -*- */
+
+static struct sensor_snapshot m_snap;
+static LowPassFilter2pQ m_filter;
+static int16_t m_blk[ADC_BLOCK];
+static size_t m_blk_fill;
+static double m_sample_clock;		// samples due, fraction
+static uint64_t m_samples_fed;
+
+static int16_t volt_to_count(double volt)
+{
+	long c = lrint(volt / SDADC_COUNT_VOLT) - 32767;
+
+	if (c > INT16_MAX)	c = INT16_MAX;
+	else if (c < INT16_MIN)	c = INT16_MIN;
+	return c;
+}
+
+/** scaled counts to [uV], as sdadc_sez_to_voltage() (th_adc.c)
+ */
+static int32_t sez_to_voltage(int32_t y)
+{
+	return ((int64_t)y + (32767 << LPF2PQ_SHIFT)) * 3300000
+		/ ((int64_t)SDADC_GAIN * 65535 << LPF2PQ_SHIFT);
+}
+
+/** Block done: same as adc_flow_cb()
+ */
+static void sdadc3_block(const int16_t *blk, size_t n)
+{
+	m_snap.sdadc3.flow_sqrt_sum += flow_block_sqrt_sum(blk, n);
+	m_snap.sdadc3.samples += n;
+	m_snap.sdadc3.raw_flow_volt = sez_to_voltage((int32_t)blk[n - 1] << LPF2PQ_SHIFT);
+	m_snap.sdadc3.flt_flow_volt = sez_to_voltage(lpf2pqApplyBlock(&m_filter, blk, n, 1));
+	m_samples_fed += n;
+}
+
+/** Feed held voltage for ms, blocks emitted when full
+ */
+static void feed(double volt, uint32_t ms)
+{
+	int16_t count = volt_to_count(volt);
+
+	m_sample_clock += ms * SDADC3_RATE / 1000.0;
+	for (; m_sample_clock >= 1.0; m_sample_clock -= 1.0) {
+		m_blk[m_blk_fill++] = count;
+		if (m_blk_fill == ADC_BLOCK) {
+			sdadc3_block(m_blk, ADC_BLOCK);
+			m_blk_fill = 0;
+		}
+	}
+}
+
+/* -*- dblog -*- */
+
+/** Protobuf field of message: LEN span, fixed32 pointer or varint
+ */
+static bool pb_field(const uint8_t *p, const uint8_t *end, uint32_t field,
+		const uint8_t **value, size_t *len, uint64_t *varint)
+{
+	while (p < end) {
+		uint64_t key = 0, v = 0;
+		const uint8_t *start;
+		int shift;
+
+		for (shift = 0; p < end; shift += 7) {
+			key |= (uint64_t)(*p & 0x7f) << shift;
+			if (!(*p++ & 0x80))
+				break;
+		}
+
+		switch (key & 7) {
+		case 0:
+			for (shift = 0; p < end; shift += 7) {
+				v |= (uint64_t)(*p & 0x7f) << shift;
+				if (!(*p++ & 0x80))
+					break;
+			}
+			if ((key >> 3) == field) {
+				*varint = v;
+				return true;
+			}
+			break;
+
+		case 1:
+			p += 8;
+			break;
+
+		case 2:
+			for (shift = 0; p < end; shift += 7) {
+				v |= (uint64_t)(*p & 0x7f) << shift;
+				if (!(*p++ & 0x80))
+					break;
+			}
+			if ((key >> 3) == field && p + v <= end) {
+				*value = p;
+				*len = v;
+				return true;
+			}
+			p += v;
+			break;
+
+		case 5:
+			start = p;
+			p += 4;
+			if ((key >> 3) == field && p <= end) {
+				*value = start;
+				return true;
+			}
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	return false;
+}
+
+/** Message.status: system_time, adc_raw.raw_flow
+ */
+static bool decode_status(const uint8_t *msg, size_t size, double rec[2])
+{
+	const uint8_t *status, *adc_raw, *raw_flow;
+	size_t status_len, adc_raw_len;
+	uint64_t system_time;
+	float volt;
+
+	if (!pb_field(msg, msg + size, 1, &status, &status_len, NULL) ||
+			!pb_field(status, status + status_len, 2, NULL, NULL, &system_time) ||
+			!pb_field(status, status + status_len, 40, &adc_raw, &adc_raw_len, NULL) ||
+			!pb_field(adc_raw, adc_raw + adc_raw_len, 13, &raw_flow, NULL, NULL))
+		return false;
+
+	memcpy(&volt, raw_flow, sizeof(volt));
+	rec[0] = system_time;
+	rec[1] = volt;
+	return true;
+}
+
+/** Load received Status records of each log
+ *
+ * @return runs count, -1 on error
+ */
+static int load_dblog(const char *file, struct run runs[MAX_RUNS])
+{
+	sqlite3 *db;
+	sqlite3_stmt *logs, *data;
+	int nruns = 0;
+
+	if (sqlite3_open_v2(file, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK ||
+			sqlite3_prepare_v2(db, "SELECT id, name FROM log ORDER BY id", -1, &logs, NULL) != SQLITE_OK ||
+			sqlite3_prepare_v2(db, "SELECT pb_message FROM log_data "
+				"WHERE log_id = ? AND direction = 'RECV' ORDER BY id", -1, &data, NULL) != SQLITE_OK) {
+		printf("%s: %s\n", file, sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return -1;
+	}
+
+	while (nruns < MAX_RUNS && sqlite3_step(logs) == SQLITE_ROW) {
+		struct run *r = &runs[nruns++];
+		size_t size = 256;
+
+		snprintf(r->name, sizeof(r->name), "%s", sqlite3_column_text(logs, 1));
+		r->rec = malloc(size * sizeof(*r->rec));
+		r->count = 0;
+
+		sqlite3_bind_int(data, 1, sqlite3_column_int(logs, 0));
+		while (sqlite3_step(data) == SQLITE_ROW) {
+			if (!decode_status(sqlite3_column_blob(data, 0),
+						sqlite3_column_bytes(data, 0), r->rec[r->count]))
+				continue;
+
+			if (++r->count == size) {
+				size *= 2;
+				r->rec = realloc(r->rec, size * sizeof(*r->rec));
+			}
+		}
+		sqlite3_reset(data);
+	}
+
+	sqlite3_finalize(data);
+	sqlite3_finalize(logs);
+	sqlite3_close(db);
+	return nruns;
+}
+
+/* -*- tests -*- */
+
+/** Flow [mL/s] for constant voltage by orifice equation
+ */
+static double orifice_mlsec(double volt)
+{
+	double dP = (volt - TEST_V0) * 3920.0 / (3.3 - TEST_V0);
+	double A2 = M_PI * pow(gp_flow_dia2 / 1000.0, 2) / 4.0;
+	double C = gp_flow_cd / sqrt(1 - pow(gp_flow_dia2 / gp_flow_dia1, 4));
+
+	return C * A2 * sqrt(2.0 * dP / gp_flow_ro) * 1e6;
+}
+
+/** Feed 1 s of samples alternating between two voltages
+ *
+ * @return flow_get_flow() [mL/s]
+ */
+static double synthetic_flow(double v1, double v2)
+{
+	int16_t blk[ADC_BLOCK];
+	uint32_t flow;
+
+	for (size_t i = 0; i < ADC_BLOCK; i++)
+		blk[i] = volt_to_count((i & 1) ? v2 : v1);
+
+	for (size_t n = 0; n < SDADC3_RATE; n += ADC_BLOCK)
+		sdadc3_block(blk, ADC_BLOCK);
+
+	host_systime += S2ST(1);
+	adc_handle_flow(&m_snap);
+	flow_get_flow(&flow);
+	return flow / 1e6;
+}
+
+static void test_synthetic(void)
+{
+	gp_flow_enable = true;
+	gp_flow_v0 = TEST_V0;
+	gp_flow_v0_auto = false;
+	adc_handle_flow(&m_snap);	// init, zero codes
+
+	/* steady flow: orifice equation */
+	double q = synthetic_flow(1.0, 1.0);
+	double expected = orifice_mlsec(1.0);
+	CHECK(fabs(q - expected) / expected < 0.005, "steady: %.4f mL/s, expected %.4f", q, expected);
+
+	/* pulsating flow: mean of Q, not Q of mean voltage */
+	q = synthetic_flow(TEST_V0, 1.4);
+	expected = orifice_mlsec(1.4) / 2;
+	CHECK(fabs(q - expected) / expected < 0.005, "pulsating: %.4f mL/s, expected %.4f (Q of mean %.4f)",
+			q, expected, orifice_mlsec(1.0));
+
+	/* below zero: no flow */
+	q = synthetic_flow(TEST_V0 - 0.1, TEST_V0);
+	CHECK(q == 0.0, "below zero: %.4f mL/s", q);
+}
+
+/* -*- zero learning -*- */
+
+static double gauss(void)
+{
+	double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/** Quiet sensor (no flow) at @a mean with @a sigma noise for @a ms,
+ * handler called every @a period_ms
+ */
+static void zero_feed(double mean, double sigma, uint32_t ms, uint32_t period_ms)
+{
+	for (uint32_t t = 0; t < ms; t += period_ms) {
+		m_snap.sdadc3.samples += lrint(SDADC3_RATE * period_ms / 1000.0);
+		m_snap.sdadc3.flt_flow_volt = lrint((mean + sigma * gauss()) * 1e6);
+		host_systime += period_ms;
+		adc_handle_flow(&m_snap);
+	}
+}
+
+struct zero_case {
+	const char *name;
+	double v0;			//!< FLOW_V0 before [V]
+	double mean, sigma;		//!< sensor [V]
+	uint32_t period_ms;		//!< handler period
+	bool learned, saved;
+};
+
+static void check_zero(const struct zero_case *c, uint32_t ms)
+{
+	uint32_t count0, count, noise_uv, saves0 = host_param_saves;
+
+	flow_get_zero(&noise_uv, &count0);
+	gp_flow_v0 = c->v0;
+	zero_feed(c->mean, c->sigma, ms, c->period_ms);
+	flow_get_zero(&noise_uv, &count);
+
+	bool learned = count != count0;
+	bool saved = host_param_saves != saves0;
+
+	printf("zero %-12s %6.3f V +- %5.3f V: v0 %.4f V, noise %4" PRIu32 " uV%s%s\n",
+			c->name, c->mean, c->sigma, gp_flow_v0, noise_uv,
+			learned ? ", learned" : "", saved ? ", saved" : "");
+
+	CHECK(learned == c->learned, "zero %s: learned %d", c->name, learned);
+	CHECK(saved == c->saved, "zero %s: saved %d", c->name, saved);
+	if (c->learned) {
+		CHECK(count == count0 + 1, "zero %s: %" PRIu32 " calibrations", c->name, count - count0);
+		CHECK(fabs(gp_flow_v0 - c->mean) < 3 * c->sigma / sqrt(ms / c->period_ms) + 1e-5,
+				"zero %s: v0 %.4f V, mean %.4f V", c->name, gp_flow_v0, c->mean);
+		CHECK(fabs(noise_uv / 1e6 - c->sigma) < 0.2 * c->sigma + 1e-5,
+				"zero %s: noise %" PRIu32 " uV, sigma %.0f uV", c->name, noise_uv, c->sigma * 1e6);
+	}
+	else
+		CHECK(gp_flow_v0 == (float)c->v0, "zero %s: v0 moved to %.4f V", c->name, gp_flow_v0);
+}
+
+/** FLOW_V0 learned from quiet window while engine is stopped
+ */
+static void test_zero(void)
+{
+	static const struct zero_case cases[] = {
+		/* name          v0       mean     sigma   period learned saved */
+		{ "drift",       0.6,     ZERO_V0, 0.002,  HANDLER_MS, true,  true  },
+		{ "small move",  ZERO_V0 + 0.005, ZERO_V0, 0.002, HANDLER_MS, true, false },
+		{ "noisy",       0.6,     ZERO_V0, 0.010,  HANDLER_MS, false, false },
+		{ "step",        0.3,     ZERO_V0, 0.002,  HANDLER_MS, false, false },
+		{ "few samples", 0.6,     ZERO_V0, 0.002,  200,        false, false },
+	};
+	struct zero_case quiet = { "engine", 0.6, ZERO_V0, 0.002, HANDLER_MS, false, false };
+	const uint32_t window = ZERO_WINDOW_MS + 100;
+
+	srand(1);
+	gp_flow_enable = true;
+	gp_flow_v0_auto = true;
+	m_engine_running = false;
+	palClearPad(GPIOE, GPIOE_STARTER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+		/* one call window (rejected, too few) aligns next window
+		 * to case: evaluated on its last call
+		 */
+		zero_feed(cases[i].mean, 0.0, ZERO_WINDOW_MS, ZERO_WINDOW_MS);
+		check_zero(&cases[i], ZERO_WINDOW_MS);
+	}
+
+	/* engine running, starter, auto off: window never completes */
+	m_engine_running = true;
+	check_zero(&quiet, 2 * window);
+	m_engine_running = false;
+
+	quiet.name = "starter";
+	palSetPad(GPIOE, GPIOE_STARTER);
+	check_zero(&quiet, 2 * window);
+	palClearPad(GPIOE, GPIOE_STARTER);
+
+	quiet.name = "auto off";
+	gp_flow_v0_auto = false;
+	check_zero(&quiet, 2 * window);
+	gp_flow_v0_auto = true;
+
+	/* starter in window restarts it */
+	zero_feed(ZERO_V0, 0.0, ZERO_WINDOW_MS, ZERO_WINDOW_MS);
+	gp_flow_v0 = 0.6;
+	zero_feed(ZERO_V0, 0.002, 6000, HANDLER_MS);
+	palSetPad(GPIOE, GPIOE_STARTER);
+	zero_feed(ZERO_V0, 0.002, HANDLER_MS, HANDLER_MS);
+	palClearPad(GPIOE, GPIOE_STARTER);
+	zero_feed(ZERO_V0, 0.002, 6000, HANDLER_MS);
+	CHECK(gp_flow_v0 == 0.6f, "starter: learned %.4f V in restarted window", gp_flow_v0);
+	zero_feed(ZERO_V0, 0.002, 4000 + HANDLER_MS, HANDLER_MS);
+	CHECK(fabs(gp_flow_v0 - ZERO_V0) < 0.001, "starter: v0 %.4f V after full window", gp_flow_v0);
+
+	gp_flow_v0_auto = false;
+}
+
+/** Replay one run
+ *
+ * @return volume [mL] integrated from flow_get_flow()
+ */
+static double replay(const struct run *r, uint32_t *used_ml)
+{
+	double v0 = 0.0, volume = 0.0;
+	size_t nv0 = (r->count < V0_RECORDS) ? r->count : V0_RECORDS;
+	systime_t next_tick;
+
+	for (size_t i = 0; i < nv0; i++)
+		v0 += r->rec[i][1] / nv0;
+
+	gp_flow_enable = true;
+	gp_flow_v0 = v0;
+	gp_flow_v0_auto = false;
+	flow_refuel_done();
+	host_flash_erase();
+
+	host_systime = r->rec[0][0];
+	adc_handle_flow(&m_snap);
+	next_tick = host_systime + HANDLER_MS;
+
+	for (size_t i = 1; i < r->count; i++) {
+		systime_t now = r->rec[i - 1][0], t = r->rec[i][0];
+		double volt = r->rec[i - 1][1];		// held until next record
+		uint32_t flow;
+
+		if (t - now > MAX_GAP_MS) {
+			/* log gap: no samples, no volume */
+			host_systime = t;
+			next_tick = t + HANDLER_MS;
+			continue;
+		}
+
+		for (; next_tick <= t; next_tick += HANDLER_MS) {
+			feed(volt, next_tick - now);
+			now = host_systime = next_tick;
+			adc_handle_flow(&m_snap);
+
+			if (flow_get_flow(&flow))
+				volume += flow / 1e6 * HANDLER_MS / 1000.0;
+		}
+
+		feed(volt, t - now);
+	}
+
+	*used_ml = flow_get_used_ml();
+	return volume;
+}
+
+static double median(double *v, size_t n)
+{
+	for (size_t i = 1; i < n; i++)
+		for (size_t j = i; j > 0 && v[j - 1] > v[j]; j--) {
+			double tmp = v[j];
+			v[j] = v[j - 1];
+			v[j - 1] = tmp;
+		}
+
+	return (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static bool is_outlier(const char *name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(m_outliers); i++) {
+		if (strcmp(name, m_outliers[i]) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	struct run runs[MAX_RUNS];
+	double fit_cd[MAX_RUNS], agree[MAX_RUNS];
+	size_t nagree = 0;
+	struct timespec t0, t1;
+	int first = 1, nruns;
+
+	/* orifice of flow test, water */
+	gp_flow_dia1 = 9.0f;
+	gp_flow_dia2 = 0.9f;
+	gp_flow_cd = 0.75f;
+	gp_flow_ro = 1000.0f;
+
+	lpf2pqObjectInit(&m_filter);
+	lpf2pqSetCutoffFrequency(&m_filter, SDADC3_RATE, FLOW_CUTOFF);
+
+	test_synthetic();
+
+	if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+		gp_flow_cd = atof(argv[2]);
+		first = 3;
+	}
+
+	if (first >= argc || (nruns = load_dblog(argv[first], runs)) <= 0) {
+		CHECK(false, "no runs, usage: %s [-c cd] flow_test.dblog", argv[0]);
+		test_zero();
+		printf("flow: %d failed\n", host_failures);
+		return host_failures;
+	}
+
+	printf("%-16s %7s %6s %9s %7s %8s %7s\n",
+			"run", "records", "v0", "volume", "used", "error", "fit cd");
+
+	m_samples_fed = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (int i = 0; i < nruns; i++) {
+		const struct run *r = &runs[i];
+		uint32_t used_ml;
+
+		if (r->count < 2) {
+			CHECK(false, "%s: no records", r->name);
+			continue;
+		}
+
+		double volume = replay(r, &used_ml);
+		double error = (volume - TRUTH_ML) / TRUTH_ML;
+
+		fit_cd[i] = gp_flow_cd * TRUTH_ML / volume;
+		if (!is_outlier(r->name))
+			agree[nagree++] = fit_cd[i];
+
+		printf("%-16s %7zu %6.3f %7.2fmL %5" PRIu32 "mL %7.1f%% %7.3f%s\n",
+				r->name, r->count, gp_flow_v0,
+				volume, used_ml, error * 100.0, fit_cd[i],
+				is_outlier(r->name) ? " (outlier)" : "");
+
+		/* integrator keeps whole uL, flow output is truncated */
+		CHECK(fabs(used_ml - volume) < 1.0, "%s: used %" PRIu32 " mL, flow integral %.2f mL",
+				r->name, used_ml, volume);
+		CHECK(volume > 0.0, "%s: no flow", r->name);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	printf("replay: %" PRIu64 " samples, %.1f Msamples/s (%.0fx SDADC3 rate)\n",
+			m_samples_fed, m_samples_fed / sec / 1e6, m_samples_fed / sec / SDADC3_RATE);
+
+	/* runs are same orifice and volume: one Cd */
+	CHECK(nagree >= 2, "fit cd: %zu runs", nagree);
+	if (nagree >= 2) {
+		double cd = median(agree, nagree);
+
+		for (int i = 0; i < nruns; i++) {
+			if (!is_outlier(runs[i].name))
+				CHECK(fabs(fit_cd[i] / cd - 1.0) < CD_SPREAD, "%s: fit cd %.3f, median %.3f",
+						runs[i].name, fit_cd[i], cd);
+		}
+		printf("fit cd: median %.3f of %zu runs\n", cd, nagree);
+	}
+
+	for (int i = 0; i < nruns; i++)
+		free(runs[i].rec);
+
+	test_zero();
+
+	printf("flow: %d failed\n", host_failures);
+	return host_failures;
+}
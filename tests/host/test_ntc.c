@@ -0,0 +1,246 @@
+/**
+ * @file       test_ntc.c
+ * @brief      NTC lookup table against Steinhart-Hart equation
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "th_adc.h"
+#include "adc_channel.h"
+#include "param_table.h"
+#include "ntc.h"
+#include <string.h>
+#include <time.h>
+
+/* Notes:
+ * Divider voltage for temperature is found in double by inverting
+ * equation (bisection on log(R)), then looked up in table,
+ * as adc_temp.c and adc_oilp.c do (10k divider, 3.3 V).
+ * Table lookup replaced direct Steinhart-Hart per sample
+ * (ntc_get_R1/R2, ntc_get_K, ntc_K_to_C), both are timed.
+ * Host has fast logf and divider, so ratio is reported, not checked:
+ * on Cortex-M4F logf is a libm software routine.
+ */
+
+#define NTC_R		10e3
+#define AVCC		3.3
+#define SH_A		2.1085e-3	// parameters.yaml defaults
+#define SH_B		0.7979e-4
+#define SH_C		6.5351e-7
+#define T_MIN		-40.0
+#define T_MAX		160.0
+#define MAX_ERROR	0.1	// C°, ntc.c claims 0.09
+#define BENCH_N		(1 << 22)
+#define BENCH_VOLTS	1024
+
+/* another 10k NTC (B ~3950) */
+#define ALT_SH_A	1.129148e-3
+#define ALT_SH_B	2.34125e-4
+#define ALT_SH_C	8.76741e-8
+
+extern int32_t gp_temp_r;
+extern float gp_temp_sh_a;
+extern float gp_temp_sh_b;
+extern float gp_temp_sh_c;
+
+void on_change_temp_ntc(const struct param_entry *p);
+void adc_handle_temperature(const struct sensor_snapshot *s);
+
+/* -*- fw stubs -*- */
+
+const struct adc_channel *adc_channel_find(const char *name)
+{
+	return NULL;
+}
+
+bool adc_channel_is_ok(const struct adc_channel *ch)
+{
+	return false;
+}
+
+bool cpu_check_temperature(void)
+{
+	return false;
+}
+
+static double sh_celsius_k(double R, double a, double b, double c)
+{
+	double l = log(R);
+	return 1.0 / (a + b * l + c * l * l * l) - 273.15;
+}
+
+static double sh_celsius(double R)
+{
+	return sh_celsius_k(R, SH_A, SH_B, SH_C);
+}
+
+/** Divider output at temperature
+ */
+static double divider_volt(double T, bool ntc_is_r1)
+{
+	double lo = log(1.0), hi = log(1e7);
+
+	for (int i = 0; i < 100; i++) {
+		double mid = (lo + hi) / 2;
+		if (sh_celsius(exp(mid)) > T)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	double R = exp(lo);
+	return ntc_is_r1 ? AVCC * NTC_R / (R + NTC_R) : AVCC * R / (R + NTC_R);
+}
+
+static void test_sweep(bool ntc_is_r1, const char *name)
+{
+	struct ntc_table t;
+	double max_err = 0.0, at = 0.0;
+
+	CHECK(ntc_table_build(&t, ntc_is_r1, AVCC, NTC_R, SH_A, SH_B, SH_C), "%s: build failed", name);
+
+	for (double T = T_MIN; T <= T_MAX; T += 0.01) {
+		double err = fabs(ntc_table_lookup(&t, divider_volt(T, ntc_is_r1)) - T);
+
+		if (err > max_err) {
+			max_err = err;
+			at = T;
+		}
+	}
+
+	printf("%s: max error %.3f C° at %.1f C°\n", name, max_err, at);
+	CHECK(max_err < MAX_ERROR, "%s: max error %.3f C° at %.1f C°", name, max_err, at);
+}
+
+/** Out of range input clamps to table ends, bad coefficients rejected
+ */
+static void test_limits(void)
+{
+	struct ntc_table t;
+
+	ntc_table_build(&t, false, AVCC, NTC_R, SH_A, SH_B, SH_C);
+	float hot = ntc_table_lookup(&t, 0.0f);
+	float cold = ntc_table_lookup(&t, AVCC);
+	float neg = ntc_table_lookup(&t, -0.1f);
+
+	CHECK(hot >= T_MAX && isfinite(hot), "R2: 0 V: %.2f C°", hot);
+	CHECK(cold <= T_MIN && isfinite(cold), "R2: AVCC: %.2f C°", cold);
+	CHECK(neg == hot, "R2: negative input: %.2f C°", neg);
+
+	CHECK(!ntc_table_build(&t, false, AVCC, NTC_R, 0.0f, 0.0f, 0.0f), "zero koeffs accepted");
+}
+
+/** adc_temp.c temperature [C°] for divider voltage
+ */
+static double temp_at(double volt)
+{
+	struct sensor_snapshot s;
+
+	memset(&s, 0, sizeof(s));
+	s.sdadc1.flt_temp_volt = lrint(volt * 1e6);
+	adc_handle_temperature(&s);
+	return temp_get_temperature() / 1000.0;
+}
+
+/** Bad koeffs: previous table kept, default koeffs if none
+ */
+static void test_bad_koeffs(void)
+{
+	const double volt = divider_volt(25.0, false);
+	double R = NTC_R * volt / (AVCC - volt);
+	double alt = sh_celsius_k(R, ALT_SH_A, ALT_SH_B, ALT_SH_C);
+	double T;
+
+	/* first table, bad koeffs: defaults */
+	gp_temp_r = TEMP_R__R2;
+	gp_temp_sh_a = gp_temp_sh_b = gp_temp_sh_c = 0.0f;
+	T = temp_at(volt);
+	CHECK(fabs(T - 25.0) < MAX_ERROR, "no table, bad koeffs: %.2f C°, expected defaults 25.00", T);
+
+	gp_temp_sh_a = ALT_SH_A;
+	gp_temp_sh_b = ALT_SH_B;
+	gp_temp_sh_c = ALT_SH_C;
+	on_change_temp_ntc(NULL);
+	T = temp_at(volt);
+	CHECK(fabs(T - alt) < MAX_ERROR, "good koeffs: %.2f C°, expected %.2f", T, alt);
+
+	gp_temp_sh_a = NAN;
+	on_change_temp_ntc(NULL);
+	T = temp_at(volt);
+	CHECK(fabs(T - alt) < MAX_ERROR, "bad koeffs: %.2f C°, previous table %.2f", T, alt);
+
+	gp_temp_sh_a = gp_temp_sh_b = gp_temp_sh_c = 0.0f;
+	on_change_temp_ntc(NULL);
+	T = temp_at(volt);
+	CHECK(fabs(T - alt) < MAX_ERROR, "zero koeffs: %.2f C°, previous table %.2f", T, alt);
+}
+
+static double bench_ns(struct timespec *t0)
+{
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return ((t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec)) / BENCH_N;
+}
+
+/** Table lookup vs direct Steinhart-Hart per conversion
+ */
+static void test_timing(bool ntc_is_r1, const char *name)
+{
+	static float volts[BENCH_VOLTS];
+	volatile float sink;
+	struct ntc_table t;
+	struct timespec t0;
+	double table_ns, direct_ns;
+
+	ntc_table_build(&t, ntc_is_r1, AVCC, NTC_R, SH_A, SH_B, SH_C);
+	for (size_t i = 0; i < BENCH_VOLTS; i++)
+		volts[i] = divider_volt(T_MIN + (T_MAX - T_MIN) * i / BENCH_VOLTS, ntc_is_r1);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t i = 0; i < BENCH_N; i++)
+		sink = ntc_table_lookup(&t, volts[i % BENCH_VOLTS]);
+	table_ns = bench_ns(&t0);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t i = 0; i < BENCH_N; i++) {
+		float v = volts[i % BENCH_VOLTS];
+		float R = ntc_is_r1 ? ntc_get_R1(v, AVCC, NTC_R) : ntc_get_R2(v, AVCC, NTC_R);
+
+		sink = ntc_K_to_C(ntc_get_K(R, SH_A, SH_B, SH_C));
+	}
+	direct_ns = bench_ns(&t0);
+
+	(void)sink;
+	printf("%s: table %.1f ns, Steinhart-Hart %.1f ns per conversion (%.1fx)\n",
+			name, table_ns, direct_ns, direct_ns / table_ns);
+}
+
+int main(void)
+{
+	test_sweep(true, "R1");
+	test_sweep(false, "R2");
+	test_limits();
+	test_bad_koeffs();
+	test_timing(true, "R1");
+	test_timing(false, "R2");
+
+	printf("ntc: %d failed\n", host_failures);
+	return host_failures;
+}
@@ -0,0 +1,287 @@
+/**
+ * @file       test_oilp.c
+ * @brief      OILP pressure calibration and low pressure arming
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "th_adc.h"
+#include "adc_channel.h"
+#include "param_table.h"
+#include <string.h>
+
+/* Notes:
+ * Filtered OIL_P voltage is fed to adc_handle_oilp() as ADC thread does,
+ * pressure is read back by oilp_get_pressure() [Pa] and compared
+ * with calibration line through used points (input span in double).
+ * Arming: engine state from stub, time from host_systime,
+ * handler runs every HANDLER_MS.
+ */
+
+#define AVCC		3.3
+#define CURRENT_MIN	4e-3	// [A]
+#define CURRENT_SPAN	16e-3	// [A]
+#define MAX_ERROR	2.0	// [Pa], float and truncation to Pa
+#define HANDLER_MS	10
+#define ARM_DELAY_MS	5000
+#define LOW_KPA		100.0f
+
+extern char gp_oilp_mode[PT_STRING_SIZE];
+extern float gp_oilp_shunt;
+extern float gp_oilp_cal_x1;
+extern float gp_oilp_cal_p1;
+extern float gp_oilp_cal_x2;
+extern float gp_oilp_cal_p2;
+extern float gp_oilp_cal_x3;
+extern float gp_oilp_cal_p3;
+extern float gp_oilp_cal_x4;
+extern float gp_oilp_cal_p4;
+extern float gp_oilp_low;
+extern int32_t gp_oilp_arm_delay;
+
+void on_change_oilp_mode(struct param_entry *p);
+void on_change_oilp_cal(const struct param_entry *p);
+void adc_handle_oilp(const struct sensor_snapshot *s);
+
+/* -*- fw stubs -*- */
+
+static bool m_engine_running;
+static const struct adc_channel m_oilp_channel = { .name = "OILP" };
+
+bool rpm_is_engine_running(void)
+{
+	return m_engine_running;
+}
+
+const struct adc_channel *adc_channel_find(const char *name)
+{
+	return (strcmp(name, "OILP") == 0) ? &m_oilp_channel : NULL;
+}
+
+bool adc_channel_is_ok(const struct adc_channel *ch)
+{
+	return ch != NULL;
+}
+
+/* -*- helpers -*- */
+
+static void oilp_setup(const char *mode, const float x[4], const float p[4])
+{
+	struct param_entry pe = { .id = "OILP_MODE", .default_value.s = OILP_MODE__Disabled };
+
+	gp_oilp_cal_x1 = x[0];
+	gp_oilp_cal_x2 = x[1];
+	gp_oilp_cal_x3 = x[2];
+	gp_oilp_cal_x4 = x[3];
+	gp_oilp_cal_p1 = p[0];
+	gp_oilp_cal_p2 = p[1];
+	gp_oilp_cal_p3 = p[2];
+	gp_oilp_cal_p4 = p[3];
+	strcpy(gp_oilp_mode, mode);
+	on_change_oilp_mode(&pe);
+}
+
+static void oilp_sample(double volt)
+{
+	struct sensor_snapshot s = { .version = 0 };
+
+	s.sdadc1.flt_oilp_volt = lrint(volt * 1e6);
+	adc_handle_oilp(&s);
+}
+
+/** Pressure [Pa] at @a volt, NAN if not reported
+ */
+static double oilp_pressure(double volt)
+{
+	int32_t pa;
+
+	oilp_sample(volt);
+	return oilp_get_pressure(&pa) ? pa : NAN;
+}
+
+/** Expected pressure [kPa]: line through used points, @a v in span [%]
+ */
+static double cal_line(const float x[], const float p[], size_t n, double span)
+{
+	size_t i;
+
+	for (i = 0; i < n - 2 && span >= x[i + 1]; i++);
+
+	return p[i] + (p[i + 1] - p[i]) * (span - x[i]) / (x[i + 1] - x[i]);
+}
+
+static void check_cal(const char *name, const float x[], const float p[], size_t n,
+		double (*volt_to_span)(double), const double volts[], size_t nvolts)
+{
+	for (size_t i = 0; i < nvolts; i++) {
+		double expected = cal_line(x, p, n, volt_to_span(volts[i])) * 1000.0;
+		double pa = oilp_pressure(volts[i]);
+
+		CHECK(fabs(pa - expected) < MAX_ERROR + fabs(expected) * 1e-6,
+				"%s %.3f V: %.1f Pa, expected %.1f Pa", name, volts[i], pa, expected);
+	}
+}
+
+static double ratiometric_span(double volt)
+{
+	return volt / AVCC * 100.0;
+}
+
+static double current_span(double volt)
+{
+	return (volt / gp_oilp_shunt - CURRENT_MIN) / CURRENT_SPAN * 100.0;
+}
+
+/* -*- tests -*- */
+
+/** Ratiometric span, points with X not ascending skipped,
+ * end segments extrapolated
+ */
+static void test_ratiometric(void)
+{
+	static const double volts[] = { 0.0, 0.2, 0.33, 1.0, 1.65, 2.5, 2.97, 3.3 };
+	static const float x_used[] = { 10.0f, 50.0f, 90.0f };
+	static const float p_used[] = { 0.0f, 400.0f, 800.0f };
+	static const struct { const char *name; float x[4], p[4]; } cases[] = {
+		{ "ratio x4 equal", { 10, 50, 90, 90 }, { 0, 400, 800, 999 } },
+		{ "ratio x2 lower", { 10, 5, 50, 90 }, { 0, 999, 400, 800 } },
+		{ "ratio x3 lower", { 10, 50, 20, 90 }, { 0, 400, 999, 800 } },
+	};
+
+	for (size_t c = 0; c < ARRAY_SIZE(cases); c++) {
+		oilp_setup(OILP_MODE__Ratiometric, cases[c].x, cases[c].p);
+		check_cal(cases[c].name, x_used, p_used, ARRAY_SIZE(x_used),
+				ratiometric_span, volts, ARRAY_SIZE(volts));
+	}
+
+	/* all four points */
+	static const float x4[] = { 0.0f, 20.0f, 60.0f, 100.0f };
+	static const float p4[] = { -50.0f, 100.0f, 300.0f, 1000.0f };
+
+	oilp_setup(OILP_MODE__Ratiometric, x4, p4);
+	check_cal("ratio 4 points", x4, p4, ARRAY_SIZE(x4),
+			ratiometric_span, volts, ARRAY_SIZE(volts));
+}
+
+/** 4-20 mA span on OILP_SHUNT, shunt change rebuilds segments
+ */
+static void test_current(void)
+{
+	static const double volts[] = { 0.3, 0.6, 1.2, 1.8, 2.4, 3.0, 3.3 };
+	static const float x[] = { 0.0f, 100.0f, 0.0f, 0.0f };
+	static const float p[] = { 0.0f, 1000.0f, 0.0f, 0.0f };
+
+	gp_oilp_shunt = 150.0f;
+	oilp_setup(OILP_MODE__Current, x, p);
+	check_cal("current 150R", x, p, 2, current_span, volts, ARRAY_SIZE(volts));
+
+	double pa = oilp_pressure(1.8);
+	CHECK(fabs(pa - 500e3) < MAX_ERROR, "current 150R: 12 mA: %.1f Pa", pa);
+
+	gp_oilp_shunt = 100.0f;
+	on_change_oilp_cal(NULL);
+	check_cal("current 100R", x, p, 2, current_span, volts, ARRAY_SIZE(volts));
+
+	pa = oilp_pressure(1.2);
+	CHECK(fabs(pa - 500e3) < MAX_ERROR, "current 100R: 12 mA: %.1f Pa", pa);
+	gp_oilp_shunt = 150.0f;
+}
+
+/** Less than two ascending points: no pressure
+ */
+static void test_no_segments(void)
+{
+	static const float x[] = { 50.0f, 50.0f, 10.0f, 0.0f };
+	static const float p[] = { 100.0f, 200.0f, 300.0f, 400.0f };
+
+	oilp_setup(OILP_MODE__Ratiometric, x, p);
+	CHECK(isnan(oilp_pressure(1.0)), "no segments: pressure reported");
+}
+
+/** Low pressure alarm armed OILP_ARM_DELAY after engine start
+ */
+static void test_arming(void)
+{
+	static const float x[] = { 0.0f, 100.0f, 0.0f, 0.0f };
+	static const float p[] = { 0.0f, 1000.0f, 0.0f, 0.0f };
+	const double low_volt = 0.05 * AVCC;	// 50 kPa
+	const double ok_volt = 0.5 * AVCC;	// 500 kPa
+	systime_t start;
+
+	gp_oilp_low = LOW_KPA;
+	gp_oilp_arm_delay = ARM_DELAY_MS;
+	oilp_setup(OILP_MODE__Ratiometric, x, p);
+
+	/* stopped */
+	m_engine_running = false;
+	host_systime = 10000;
+	oilp_sample(low_volt);
+	CHECK(!oilp_check_pressure(), "stopped: low reported");
+
+	/* start, low until armed */
+	m_engine_running = true;
+	start = host_systime;
+	for (; host_systime - start < MS2ST(ARM_DELAY_MS); host_systime += MS2ST(HANDLER_MS)) {
+		oilp_sample(low_volt);
+		if (oilp_check_pressure()) {
+			CHECK(false, "armed after %u ms", (unsigned)ST2MS(host_systime - start));
+			break;
+		}
+	}
+
+	host_systime = start + MS2ST(ARM_DELAY_MS);
+	oilp_sample(low_volt);
+	CHECK(oilp_check_pressure(), "not armed after %d ms", ARM_DELAY_MS);
+
+	oilp_sample(ok_volt);
+	CHECK(!oilp_check_pressure(), "armed: pressure ok reported low");
+
+	/* stop disarms, restart waits whole delay again */
+	oilp_sample(low_volt);
+	m_engine_running = false;
+	host_systime += MS2ST(HANDLER_MS);
+	oilp_sample(low_volt);
+	CHECK(!oilp_check_pressure(), "stopped: still armed");
+
+	m_engine_running = true;
+	start = host_systime;
+	host_systime += MS2ST(ARM_DELAY_MS - HANDLER_MS);
+	oilp_sample(low_volt);
+	CHECK(!oilp_check_pressure(), "restart: armed before delay");
+
+	host_systime = start + MS2ST(ARM_DELAY_MS);
+	oilp_sample(low_volt);
+	CHECK(oilp_check_pressure(), "restart: not armed after delay");
+
+	/* disabled input */
+	oilp_setup(OILP_MODE__Disabled, x, p);
+	CHECK(!oilp_is_enabled(), "disabled: input enabled");
+	m_engine_running = false;
+}
+
+int main(void)
+{
+	test_ratiometric();
+	test_current();
+	test_no_segments();
+	test_arming();
+
+	printf("oilp: %d failed\n", host_failures);
+	return host_failures;
+}
@@ -0,0 +1,341 @@
+/**
+ * @file       test_pbstx.c
+ * @brief      PBSTX BaseChannel receiver resync on corrupted streams
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "pbstx.h"
+#include "alert_led.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Notes:
+ * Frames are written by pbstxSend() to fake channel, stream is
+ * corrupted and parsed back by pbstxReceive() (BaseChannel path).
+ * Fake channel has no more data => timeout, as serial after
+ * SER_PAYLOAD_TIMEOUT. Every frame with intact bytes must be received,
+ * in order, and nothing else.
+ */
+
+#define STREAM_BYTES	(1024 * 1024)
+#define MAX_FRAMES	4000
+#define STX		0xae
+
+struct BaseChannel {
+	uint8_t *data;
+	size_t len;
+	size_t pos;
+};
+
+struct frame_ref {
+	size_t start, end;	//!< bytes in stream
+	uint16_t size;
+	uint16_t idx;		//!< payload pattern
+	bool intact;
+};
+
+static uint8_t m_stream[STREAM_BYTES];
+static BaseChannel m_ch = { m_stream, 0, 0 };
+static struct frame_ref m_frames[MAX_FRAMES];
+static size_t m_nframes;
+static PBStxDev m_tx;
+
+void alert_component(enum alert_source src, enum alert_status st)
+{
+}
+
+/* -*- fake channel -*- */
+
+msg_t chnGetTimeout(BaseChannel *chp, systime_t timeout)
+{
+	if (chp->pos == chp->len)
+		return MSG_TIMEOUT;
+
+	return chp->data[chp->pos++];
+}
+
+size_t chnReadTimeout(BaseChannel *chp, uint8_t *buf, size_t n, systime_t timeout)
+{
+	if (n > chp->len - chp->pos)
+		n = chp->len - chp->pos;
+
+	memcpy(buf, chp->data + chp->pos, n);
+	chp->pos += n;
+	return n;
+}
+
+size_t chnWriteTimeout(BaseChannel *chp, const uint8_t *buf, size_t n, systime_t timeout)
+{
+	if (n > STREAM_BYTES - chp->len)
+		n = STREAM_BYTES - chp->len;
+
+	memcpy(chp->data + chp->len, buf, n);
+	chp->len += n;
+	return n;
+}
+
+/* -*- stream -*- */
+
+static uint8_t payload_byte(uint16_t idx, size_t i)
+{
+	return idx * 31 + i * 7 + (i >> 3);
+}
+
+static void stream_reset(void)
+{
+	m_ch.len = m_ch.pos = 0;
+	m_nframes = 0;
+	pbstxObjectInit(&m_tx, &m_ch);
+}
+
+static void add_frame(uint16_t size)
+{
+	static pbstx_message_t msg;
+	struct frame_ref *f = &m_frames[m_nframes];
+
+	f->idx = m_nframes;
+	f->size = size;
+	f->intact = true;
+	for (size_t i = 0; i < size; i++)
+		msg.payload[i] = payload_byte(f->idx, i);
+
+	msg.size = size;
+	f->start = m_ch.len;
+	CHECK(pbstxSend(&m_tx, &msg) == MSG_OK, "send failed");
+	f->end = m_ch.len;
+	m_nframes++;
+}
+
+static void add_bytes(const uint8_t *buf, size_t n)
+{
+	chnWriteTimeout(&m_ch, buf, n, 0);
+}
+
+/** Corrupt stream byte, frame containing it is lost
+ */
+static void corrupt(size_t pos, uint8_t xor)
+{
+	m_stream[pos] ^= xor;
+	for (size_t i = 0; i < m_nframes; i++) {
+		if (pos >= m_frames[i].start && pos < m_frames[i].end)
+			m_frames[i].intact = false;
+	}
+}
+
+/** Parse whole stream, check received against intact frames
+ *
+ * @return received frames
+ */
+static size_t receive_all(const char *name, PBStxDev *rx)
+{
+	static pbstx_message_t msg;
+	size_t next = 0, received = 0, extra = 0;
+
+	m_ch.pos = 0;
+	pbstxObjectInit(rx, &m_ch);
+
+	for (size_t iter = 0; iter < 4 * STREAM_BYTES; iter++) {
+		msg_t ret = pbstxReceive(rx, &msg);
+
+		if (ret == MSG_TIMEOUT && m_ch.pos == m_ch.len && rx->rx_len == 0)
+			break;
+		if (ret != MSG_OK)
+			continue;
+
+		while (next < m_nframes && !m_frames[next].intact)
+			next++;
+
+		const struct frame_ref *f = &m_frames[next];
+		bool match = next < m_nframes && msg.size == f->size;
+
+		for (size_t i = 0; match && i < msg.size; i++)
+			match = msg.payload[i] == payload_byte(f->idx, i);
+
+		if (match) {
+			received++;
+			next++;
+		}
+		else
+			extra++;
+	}
+
+	size_t intact = 0;
+	for (size_t i = 0; i < m_nframes; i++)
+		intact += m_frames[i].intact;
+
+	CHECK(received == intact, "%s: received %zu of %zu intact frames", name, received, intact);
+	CHECK(extra == 0, "%s: %zu unexpected frames", name, extra);
+	CHECK(rx->stats.rx_frames == received + extra, "%s: rx_frames %u", name,
+			(unsigned)rx->stats.rx_frames);
+
+	printf("%-10s %6zu %6zu %6u %6u %6u %6u %6u\n", name, m_nframes, received,
+			(unsigned)rx->stats.rx_crc_errors, (unsigned)rx->stats.rx_overflows,
+			(unsigned)rx->stats.rx_timeouts, (unsigned)rx->stats.rx_resyncs,
+			(unsigned)rx->stats.rx_dropped);
+	return received;
+}
+
+/* -*- tests -*- */
+
+static void test_clean(void)
+{
+	PBStxDev rx;
+
+	stream_reset();
+	for (int i = 0; i < 300; i++)
+		add_frame(rand() % (PBSTX_PAYLOAD_BYTES + 1));
+
+	receive_all("clean", &rx);
+	CHECK(rx.stats.rx_resyncs == 0 && rx.stats.rx_dropped == 0,
+			"clean: resyncs %u dropped %u",
+			(unsigned)rx.stats.rx_resyncs, (unsigned)rx.stats.rx_dropped);
+}
+
+/** Bytes without STX between frames are skipped
+ */
+static void test_garbage(void)
+{
+	static const uint8_t garbage[] = { 0x00, 0xff, 0x55, 0xaa, 0x12 };
+	size_t dropped = 0;
+	PBStxDev rx;
+
+	stream_reset();
+	for (int i = 0; i < 100; i++) {
+		size_t n = rand() % sizeof(garbage);
+
+		add_bytes(garbage, n);
+		dropped += n;
+		add_frame(rand() % 64);
+	}
+
+	receive_all("garbage", &rx);
+	CHECK(rx.stats.rx_dropped == dropped, "garbage: dropped %u != %zu",
+			(unsigned)rx.stats.rx_dropped, dropped);
+}
+
+/** CRC error: frame lost, next one received
+ */
+static void test_crc(void)
+{
+	PBStxDev rx;
+	size_t bad = 0;
+
+	stream_reset();
+	for (int i = 0; i < 100; i++)
+		add_frame(8 + rand() % 64);
+	for (size_t i = 0; i < m_nframes; i += 3, bad++)
+		corrupt(m_frames[i].start + PBSTX_HEADER_BYTES + 1, 0x10);
+
+	receive_all("crc", &rx);
+	CHECK(rx.stats.rx_crc_errors >= bad, "crc: errors %u < %zu",
+			(unsigned)rx.stats.rx_crc_errors, bad);
+}
+
+/** LEN > PBSTX_PAYLOAD_BYTES: only STX dropped
+ */
+static void test_overflow(void)
+{
+	PBStxDev rx;
+
+	stream_reset();
+	for (int i = 0; i < 50; i++)
+		add_frame(8 + rand() % 64);
+	for (size_t i = 1; i < m_nframes; i += 4)
+		corrupt(m_frames[i].start + 3, 0x80);
+
+	receive_all("overflow", &rx);
+	CHECK(rx.stats.rx_overflows > 0, "overflow: not counted");
+}
+
+/** Broken header with LEN covering next frames:
+ * frames inside it must be found after resync
+ */
+static void test_nested(void)
+{
+	const uint8_t bogus[] = { STX, 0x01, 100, 0x00 };
+	PBStxDev rx;
+
+	stream_reset();
+	add_frame(20);
+	add_bytes(bogus, sizeof(bogus));
+	for (int i = 0; i < 5; i++)
+		add_frame(30);
+	add_bytes(bogus, 3);	// truncated header
+	add_frame(10);
+
+	receive_all("nested", &rx);
+	CHECK(rx.stats.rx_crc_errors >= 1, "nested: crc error not counted");
+}
+
+/** Stream ends inside frame: timeout, previous frames received
+ */
+static void test_truncated(void)
+{
+	PBStxDev rx;
+
+	stream_reset();
+	for (int i = 0; i < 10; i++)
+		add_frame(40);
+
+	m_ch.len -= 20;
+	m_frames[m_nframes - 1].intact = false;
+
+	receive_all("truncated", &rx);
+	CHECK(rx.stats.rx_timeouts >= 1, "truncated: timeout not counted");
+}
+
+/** Random bit errors
+ */
+static void test_noise(double ber)
+{
+	PBStxDev rx;
+	char name[16];
+
+	stream_reset();
+	for (int i = 0; i < 2000; i++)
+		add_frame(8 + rand() % 120);
+
+	for (size_t bit = 0; bit < m_ch.len * 8; bit++) {
+		if (rand() < ber * RAND_MAX)
+			corrupt(bit / 8, 1 << (bit % 8));
+	}
+
+	snprintf(name, sizeof(name), "ber %.0e", ber);
+	receive_all(name, &rx);
+}
+
+int main(void)
+{
+	srand(1);
+
+	printf("%-10s %6s %6s %6s %6s %6s %6s %6s\n", "case", "frames", "recv",
+			"crc", "ovf", "tmout", "resync", "drop");
+	test_clean();
+	test_garbage();
+	test_crc();
+	test_overflow();
+	test_nested();
+	test_truncated();
+	test_noise(1e-4);
+	test_noise(1e-3);
+
+	printf("pbstx: %d failed\n", host_failures);
+	return host_failures;
+}
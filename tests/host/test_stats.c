@@ -0,0 +1,156 @@
+/**
+ * @file       test_stats.c
+ * @brief      Sensor statistics from integer ADC count blocks
+ * @author     Vladimir Ermakov Copyright (C) 2014.
+ * @see        The GNU Public License (GPL) Version 3
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "host_test.h"
+#include "sensors.h"
+#include <stdlib.h>
+
+/* Notes:
+ * Blocks are summed as sdadc_block_stats() in th_adc.c does,
+ * window is a second of SDADC3 (16.6 kHz, blocks of 128),
+ * reference is computed in double from volts.
+ */
+
+#define COUNT_VOLT	(3.3 / 65535)	// as SDADC_COUNT_VOLT
+#define BLOCK		128
+#define BLOCKS		130
+
+struct ref {
+	size_t n;
+	double sum, sumsq, min, max;
+};
+
+static void block_counts(struct sensor_count_stats *cs, const int16_t *blk, size_t n)
+{
+	cs->n = n;
+	cs->min = INT16_MAX;
+	cs->max = INT16_MIN;
+	cs->sum = 0;
+	cs->sumsq = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		int32_t x = blk[i];
+
+		cs->sum += x;
+		cs->sumsq += x * x;
+		if (x < cs->min)	cs->min = x;
+		if (x > cs->max)	cs->max = x;
+	}
+}
+
+static void ref_push(struct ref *r, double v)
+{
+	if (r->n == 0 || v < r->min)	r->min = v;
+	if (r->n == 0 || v > r->max)	r->max = v;
+	r->n++;
+	r->sum += v;
+	r->sumsq += v * v;
+}
+
+static void check_stats(const char *name, const running_stats_t *rs, const struct ref *r, double tol)
+{
+	double mean = r->sum / r->n;
+	double var = (r->sumsq - r->sum * mean) / (r->n - 1);
+	double sd = sqrt(var > 0 ? var : 0);
+
+	CHECK(rs->n == r->n, "%s: n %u != %zu", name, (unsigned)rs->n, r->n);
+	CHECK(fabs(rs->mean - mean) < tol, "%s: mean %f != %f", name, rs->mean, mean);
+	CHECK(fabs(rstats_stddev(rs) - sd) < tol, "%s: stddev %f != %f", name, rstats_stddev(rs), sd);
+	CHECK(fabs(rs->min - r->min) < tol, "%s: min %f != %f", name, rs->min, r->min);
+	CHECK(fabs(rs->max - r->max) < tol, "%s: max %f != %f", name, rs->max, r->max);
+}
+
+/** SDADC window with given mean and noise (counts)
+ */
+static void test_counts(enum sensor_stat id, const char *name, double gain, int mean, int noise)
+{
+	running_stats_t out[SS_MAX];
+	struct ref r = {};
+	int16_t blk[BLOCK];
+
+	sensors_stats_set_count_scale(id, 32767, gain * COUNT_VOLT);
+
+	for (int b = 0; b < BLOCKS; b++) {
+		struct sensor_count_stats cs;
+
+		for (int i = 0; i < BLOCK; i++) {
+			int x = mean + (noise ? rand() % (2 * noise + 1) - noise : 0);
+
+			if (x > INT16_MAX)	x = INT16_MAX;
+			if (x < INT16_MIN)	x = INT16_MIN;
+			blk[i] = x;
+			ref_push(&r, (x + 32767) * gain * COUNT_VOLT);
+		}
+
+		block_counts(&cs, blk, BLOCK);
+		sensors_stats_add_counts(id, &cs);
+	}
+
+	sensors_stats_take(out);
+	check_stats(name, &out[id], &r, 1e-4 * gain);
+	printf("%-10s %8d %6d %10.6f %10.6f\n", name, mean, noise,
+			out[id].mean, rstats_stddev(&out[id]));
+
+	/* take resets window */
+	sensors_stats_take(out);
+	CHECK(out[id].n == 0, "%s: not reset, n %u", name, (unsigned)out[id].n);
+}
+
+/** Float pushes (RPM thread) and counts for other id do not mix
+ */
+static void test_mixed(void)
+{
+	running_stats_t out[SS_MAX];
+	struct sensor_count_stats cs;
+	int16_t blk[BLOCK];
+
+	for (int i = 0; i < BLOCK; i++)
+		blk[i] = 0;
+
+	sensors_stats_push(SS_RPM, 1000.0f);
+	sensors_stats_push(SS_RPM, 3000.0f);
+	block_counts(&cs, blk, BLOCK);
+	sensors_stats_add_counts(SS_TEMP, &cs);
+
+	sensors_stats_take(out);
+	CHECK(out[SS_RPM].n == 2 && out[SS_RPM].mean == 2000.0f,
+			"rpm: n %u mean %f", (unsigned)out[SS_RPM].n, out[SS_RPM].mean);
+	CHECK(out[SS_TEMP].n == BLOCK, "temp: n %u", (unsigned)out[SS_TEMP].n);
+	CHECK(out[SS_VBAT].n == 0 && out[SS_FLOW].n == 0, "empty stats not empty");
+}
+
+int main(void)
+{
+	sensors_init();
+	srand(1);
+
+	printf("%-10s %8s %6s %10s %10s\n", "case", "mean", "noise", "V", "stddev");
+	test_counts(SS_FLOW, "flat", 1.0, 1000, 0);
+	test_counts(SS_FLOW, "noise", 1.0, -12000, 200);
+	test_counts(SS_OILP, "full", 1.0, 0, 32767);
+	test_counts(SS_VBAT, "vbat", 3.0, 15000, 50);
+	test_counts(SS_TEMP, "low", 1.0, -32760, 20);
+	test_mixed();
+
+	printf("stats: %d failed\n", host_failures);
+	return host_failures;
+}
@@ -0,0 +1,152 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# vim:set ts=4 sw=4 et
+
+"""
+Download and decode triggered captures (fw/log/capture.h)
+
+Captures are read from FLASHD1_error partition by MemoryDumpRequest
+(type CAPTURE), each record is exported to CSV.
+"""
+
+from __future__ import print_function
+
+import sys
+import struct
+import random
+import argparse
+from miniecu import msgs, PBStx, ReceiveError
+from miniecu.xmodem_crc16 import xmodem_crc16
+from miniecu.utils import make_ParamSet, wrap_msg, wrap_logger
+
+
+PARTITION_SIZE = 64 * 1024
+SECTOR_SIZE = 4096
+SIGNATURE = 0x74706163
+
+# capture_header_t
+HEADER = struct.Struct('<IIQIIHHfHHHHHH4x')
+CAUSES = {1: 'alert', 2: 'status', 3: 'command'}
+# SE zero counts to volts, VBAT input divider
+VOLT = 3.3 / 65535
+CHANNELS = (('vbat', 3.0), ('oilp', 1.0), ('temp', 1.0))
+
+
+def download(args):
+    pbstx = PBStx(args.device, args.baudrate)
+    pbstx = wrap_logger(pbstx, args.log_db, args.log_name, "%s @ %s" % (args.device, args.baudrate))
+
+    pbstx.send(make_ParamSet(args.id, 'STATUS_PERIOD', 5000))
+
+    stream_id = random.randint(0, 0xffffffff)
+    pbstx.send(wrap_msg(msgs.MemoryDumpRequest(
+        engine_id=args.id,
+        type=msgs.MemoryDumpRequest.CAPTURE,
+        stream_id=stream_id,
+        address=0,
+        size=args.size)))
+
+    buf = bytearray()
+    while len(buf) < args.size:
+        try:
+            m = pbstx.receive()
+            if m.HasField('memory_dump_page'):
+                page = m.memory_dump_page
+                if page.stream_id != stream_id:
+                    continue
+
+                if len(buf) < page.address:
+                    print('page missing, lost %d bytes' % (page.address - len(buf)), file=sys.stderr)
+                    buf.extend(b'\xff' * (page.address - len(buf)))
+
+                buf.extend(page.page)
+                print('\r%d / %d' % (len(buf), args.size), end='', file=sys.stderr)
+
+            elif m.HasField('status_text') or args.verbose:
+                print(m, file=sys.stderr)
+        except ReceiveError as ex:
+            print(repr(ex), file=sys.stderr)
+
+    print(file=sys.stderr)
+    return bytes(buf)
+
+
+def parse(data):
+    """Yield (header dict, frames, revs) of valid records"""
+    for off in range(0, len(data) - HEADER.size, SECTOR_SIZE):
+        fields = HEADER.unpack_from(data, off)
+        if fields[0] != SIGNATURE:
+            continue
+
+        hdr = dict(zip(('signature', 'seq', 'timestamp_ms', 'system_time', 'status', 'cause',
+                        'detail', 'frame_rate', 'frames', 'trigger_frame', 'revs',
+                        'trigger_rev', 'reserved', 'crc16'), fields))
+
+        dlen = hdr['frames'] * 6 + hdr['revs'] * 4
+        body = data[off + HEADER.size:off + HEADER.size + dlen]
+        crc = xmodem_crc16(bytearray(body), xmodem_crc16(bytearray(data[off:off + HEADER.size - 6])))
+        hdr['crc_ok'] = crc == hdr['crc16']
+
+        frames = struct.unpack_from('<%dh' % (hdr['frames'] * 3), body)
+        frames = [frames[i:i + 3] for i in range(0, len(frames), 3)]
+        revs = struct.unpack_from('<%dI' % hdr['revs'], body, hdr['frames'] * 6)
+
+        yield hdr, frames, revs
+
+
+def export_csv(prefix, hdr, frames, revs):
+    name = '%s%04d.csv' % (prefix, hdr['seq'])
+    with open(name, 'w') as fd:
+        print('# seq %(seq)d cause %(cause)d/%(detail)d status 0x%(status)x '
+              'system_time %(system_time)d timestamp_ms %(timestamp_ms)d' % hdr, file=fd)
+        print('t_ms\t' + '\t'.join(c for c, _ in CHANNELS), file=fd)
+        for i, f in enumerate(frames):
+            t = (i - hdr['trigger_frame']) * 1000.0 / hdr['frame_rate']
+            print('%.3f\t' % t + '\t'.join('%.4f' % ((x + 32767) * VOLT * k)
+                                           for x, (_, k) in zip(f, CHANNELS)), file=fd)
+
+        print('\n# revolutions (first after trigger: %d)' % hdr['trigger_rev'], file=fd)
+        print('rev\tperiod_us\trpm', file=fd)
+        for i, p in enumerate(revs):
+            print('%d\t%d\t%.1f' % (i - hdr['trigger_rev'], p, 60e6 / p if p else 0), file=fd)
+
+    return name
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Download triggered captures")
+    parser.add_argument("device", help="com port device file or partition image (-f)")
+    parser.add_argument("baudrate", help="com port baudrate", type=int, nargs='?', default=57600)
+    parser.add_argument("-f", "--file", help="read partition image instead of device", action='store_true')
+    parser.add_argument("-i", "--id", help="engine id", type=int, default=1)
+    parser.add_argument("-s", "--size", help="partition size", type=int, default=PARTITION_SIZE)
+    parser.add_argument("-o", "--output", help="CSV file prefix", default='capture_')
+    parser.add_argument("-r", "--raw", help="save partition image")
+    parser.add_argument("-v", "--verbose", help="verbose io print", action='store_true')
+    parser.add_argument("-l", "--log-db", help="logging to sql db")
+    parser.add_argument("-n", "--log-name", help="log name")
+
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.device, 'rb') as fd:
+            data = fd.read()
+    else:
+        data = download(args)
+
+    if args.raw:
+        with open(args.raw, 'wb') as fd:
+            fd.write(data)
+
+    records = sorted(parse(data), key=lambda r: r[0]['seq'])
+    for hdr, frames, revs in records:
+        name = export_csv(args.output, hdr, frames, revs)
+        print("#{seq:<5} {cause:<8} detail {detail:<6} status 0x{status:04x} "
+              "{frames} frames @ {frame_rate:.0f} Hz, {revs} revs, crc {crc}: {name}".format(
+                  cause=CAUSES.get(hdr['cause'], hdr['cause']),
+                  crc='ok' if hdr['crc_ok'] else 'BAD', name=name, **dict(
+                      (k, v) for k, v in hdr.items() if k != 'cause')))
+
+
+if __name__ == '__main__':
+    main()
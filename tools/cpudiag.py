@@ -0,0 +1,60 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# vim:set ts=4 sw=4 et
+
+from __future__ import print_function
+
+import sys
+import time
+import argparse
+from miniecu import msgs, PBStx, ReceiveError
+from miniecu.utils import wrap_msg, wrap_logger
+
+
+def print_diag(diag):
+    print('load: %d %%, window: %d cycles' % (diag.load, diag.window))
+    for title, entries in (('threads', diag.threads), ('isrs', diag.isrs)):
+        print('  %s:' % title)
+        for e in entries:
+            print('    %-10s %6.2f %%' % (e.name, e.load / 100.0))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("device", help="com port device file")
+    parser.add_argument("baudrate", help="com port baudrate", type=int, nargs='?', default=57600)
+    parser.add_argument("-i", "--id", help="engine id", type=int, default=1)
+    parser.add_argument("-p", "--period", help="request period [s], 0 - once", type=float, default=0)
+    parser.add_argument("-v", "--verbose", help="verbose io print", action='store_true')
+    parser.add_argument("-l", "--log-db", help="logging to sql db")
+    parser.add_argument("-n", "--log-name", help="log name")
+
+    args = parser.parse_args()
+
+    pbstx = PBStx(args.device, args.baudrate)
+    pbstx = wrap_logger(pbstx, args.log_db, args.log_name, "%s @ %s" % (args.device, args.baudrate))
+
+    diag_request = wrap_msg(msgs.CPUDiagnosticsRequest(engine_id=args.id))
+
+    while True:
+        pbstx.send(diag_request)
+        sent = time.time()
+
+        while time.time() - sent < 2.0:
+            try:
+                m = pbstx.receive()
+                if m.HasField('cpu_diagnostics'):
+                    print_diag(m.cpu_diagnostics)
+                    break
+                elif m.HasField('status_text') or args.verbose:
+                    print(m, file=sys.stderr)
+            except ReceiveError as ex:
+                print(repr(ex), file=sys.stderr)
+
+        if args.period <= 0:
+            break
+
+        time.sleep(args.period)
+
+if __name__ == '__main__':
+    main()
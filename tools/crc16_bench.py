@@ -0,0 +1,106 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# vim:set ts=4 sw=4 et
+
+"""
+CRC16 variants bench
+
+Host: all miniecu.xmodem_crc16 variants are checked against bytewise
+reference on random buffers (random initial value, unaligned tails)
+and throughput printed in bytes/s.
+
+Target (device given): sends Command DO_CRC_BENCH and prints
+StatusText results of lib_crc16.c variants (bytewise, slicing, CRC unit).
+"""
+
+from __future__ import print_function
+
+import sys
+import time
+import random
+import argparse
+from miniecu.xmodem_crc16 import xmodem_crc16_bytewise, xmodem_crc16_slice4, xmodem_crc16_slice8
+
+VARIANTS = (
+    ('bytewise', xmodem_crc16_bytewise),
+    ('slice4', xmodem_crc16_slice4),
+    ('slice8', xmodem_crc16_slice8),
+)
+
+
+def check(args):
+    rnd = random.Random(args.seed)
+    for i in range(args.checks):
+        data = bytearray(rnd.getrandbits(8) for j in range(rnd.randint(0, 300)))
+        crc = rnd.getrandbits(16)
+        ref = xmodem_crc16_bytewise(data, crc)
+        for name, func in VARIANTS:
+            res = func(data, crc)
+            if res != ref:
+                print("MISMATCH {}: len {} init 0x{:04x}: 0x{:04x} != 0x{:04x}".format(
+                    name, len(data), crc, res, ref))
+                return False
+
+    print("{} random buffers: all variants match".format(args.checks))
+    return True
+
+
+def bench_host(args):
+    rnd = random.Random(args.seed)
+    data = bytearray(rnd.getrandbits(8) for i in range(args.size))
+
+    print("{:<10} {:>12}".format("variant", "bytes/s"))
+    for name, func in VARIANTS:
+        start = time.time()
+        for i in range(args.repeat):
+            func(data)
+        elapsed = time.time() - start
+        print("{:<10} {:>12.0f}".format(name, args.size * args.repeat / elapsed))
+
+
+def bench_target(args):
+    from miniecu import msgs, PBStx, ReceiveError
+    from miniecu.utils import make_Command
+
+    pbstx = PBStx(args.device, args.baudrate)
+    pbstx.send(make_Command(args.id, msgs.Command.DO_CRC_BENCH))
+
+    deadline = time.time() + args.timeout
+    while time.time() < deadline:
+        try:
+            m = pbstx.receive()
+        except ReceiveError as ex:
+            print(repr(ex), file=sys.stderr)
+            continue
+
+        if m.HasField('status_text') and m.status_text.text.startswith('CRC16:'):
+            print(m.status_text.text)
+        elif m.HasField('command') and m.command.operation == msgs.Command.DO_CRC_BENCH:
+            print("target:", msgs.Command.Response.Name(m.command.response))
+            break
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Check and bench CRC16 variants")
+    parser.add_argument("device", help="com port device file (run bench on target)", nargs='?')
+    parser.add_argument("baudrate", help="com port baudrate", type=int, nargs='?', default=57600)
+    parser.add_argument("-i", "--id", help="engine id", type=int, default=1)
+    parser.add_argument("-s", "--size", help="host bench buffer size", type=int, default=65536)
+    parser.add_argument("-r", "--repeat", help="host bench repeats", type=int, default=4)
+    parser.add_argument("-c", "--checks", help="random buffers to cross check", type=int, default=2000)
+    parser.add_argument("-t", "--timeout", help="target response timeout [s]", type=float, default=10.0)
+    parser.add_argument("--seed", type=int, default=1)
+
+    args = parser.parse_args()
+
+    if not check(args):
+        sys.exit(1)
+
+    bench_host(args)
+
+    if args.device:
+        bench_target(args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,43 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# vim:set ts=4 sw=4 et
+
+"""
+Generate slicing-by-N tables for fw/lib/lib_crc16.c
+
+Rows 1..7 of CRC16_SLICE_TAB (row 0 is crc16_tab itself).
+"""
+
+from __future__ import print_function
+
+import sys
+import argparse
+from miniecu.xmodem_crc16 import CRC16_SLICE_TAB
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate lib_crc16 slicing tables")
+    parser.add_argument("-o", "--output", type=argparse.FileType('w'), default=sys.stdout,
+                        help="output header (fw/lib/lib_crc16_slice.h)")
+    args = parser.parse_args()
+    out = args.output
+
+    print("/* AUTOGENERATED FILE, DO NOT EDIT", file=out)
+    print(" *", file=out)
+    print(" * Generated by tools/crc16_tables.py", file=out)
+    print(" * crc16_slice_tab[k - 1][v] = v * x^(8 (k + 2)) mod 0x11021", file=out)
+    print(" */", file=out)
+    print("", file=out)
+    print("static const uint16_t crc16_slice_tab[7][256] =", file=out)
+    print("{", file=out)
+    for k in range(1, 8):
+        print("  {", file=out)
+        row = CRC16_SLICE_TAB[k]
+        for i in range(0, 256, 8):
+            print("    " + ", ".join("0x{:04x}".format(v) for v in row[i:i + 8]) + ",", file=out)
+        print("  },", file=out)
+    print("};", file=out)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,82 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# vim:set ts=4 sw=4 et
+
+"""
+Link throughput and per frame CPU cost from Status.link
+
+Optionally loads the link by repeated ParamRequest (all params),
+each answered by a ParamValue per parameter.
+"""
+
+from __future__ import print_function
+
+import sys
+import time
+import argparse
+from miniecu import msgs, PBStx, ReceiveError
+from miniecu.utils import wrap_msg, wrap_logger
+
+
+CPU_FREQUENCY = 72e6
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("device", help="com port device file")
+    parser.add_argument("baudrate", help="com port baudrate", type=int, nargs='?', default=57600)
+    parser.add_argument("-i", "--id", help="engine id", type=int, default=1)
+    parser.add_argument("-L", "--load", help="request all params every N seconds", type=float, default=0)
+    parser.add_argument("-v", "--verbose", help="verbose io print", action='store_true')
+    parser.add_argument("-l", "--log-db", help="logging to sql db")
+    parser.add_argument("-n", "--log-name", help="log name")
+
+    args = parser.parse_args()
+
+    pbstx = PBStx(args.device, args.baudrate)
+    pbstx = wrap_logger(pbstx, args.log_db, args.log_name, "%s @ %s" % (args.device, args.baudrate))
+
+    load_request = wrap_msg(msgs.ParamRequest(engine_id=args.id))
+    load_time = 0
+    last = None
+
+    print("{:>8} {:>9} {:>9} {:>7} {:>7} {:>8} {:>8} {:>5} {:>5} {:>6} {:>5}".format(
+        "time", "tx B/s", "rx B/s", "tx f/s", "rx f/s", "tx us/f", "rx us/f", "ovr", "crc", "resync", "drop"))
+
+    while True:
+        if args.load > 0 and time.time() - load_time >= args.load:
+            pbstx.send(load_request)
+            load_time = time.time()
+
+        try:
+            m = pbstx.receive()
+        except ReceiveError as ex:
+            print(repr(ex), file=sys.stderr)
+            continue
+
+        if m.HasField('status_text') or args.verbose:
+            print(m, file=sys.stderr)
+
+        if not m.HasField('status') or m.status.engine_id != args.id or not m.status.HasField('link'):
+            continue
+
+        st = m.status
+        if last is not None and st.system_time > last.system_time:
+            dt = (st.system_time - last.system_time) / 1000.0
+            ln, ll = st.link, last.link
+
+            print("{:8.1f} {:9.0f} {:9.0f} {:7.1f} {:7.1f} {:>8} {:>8} {:>5} {:>5} {:>6} {:>5}".format(
+                st.system_time / 1000.0,
+                (ln.tx_bytes - ll.tx_bytes) / dt, (ln.rx_bytes - ll.rx_bytes) / dt,
+                (ln.tx_frames - ll.tx_frames) / dt, (ln.rx_frames - ll.rx_frames) / dt,
+                "%.1f" % (ln.tx_cycles / CPU_FREQUENCY * 1e6) if ln.HasField('tx_cycles') else '-',
+                "%.1f" % (ln.rx_cycles / CPU_FREQUENCY * 1e6) if ln.HasField('rx_cycles') else '-',
+                ln.rx_overruns if ln.HasField('rx_overruns') else '-',
+                ln.rx_crc_errors, ln.rx_resyncs,
+                ln.tx_dropped if ln.HasField('tx_dropped') else '-'))
+
+        last = st
+
+
+if __name__ == '__main__':
+    main()
@@ -12,6 +12,7 @@ Message format:
 
 __all__ = (
     'PBStx',
+    'FrameParser',
     'ReceiveError',
     'msgs',
 )
@@ -46,6 +47,7 @@ class PBStx(object):
         self.ser.setTimeout(2.0)
         self._tx_seq = 0
         self._rx_seq = 0
+        self.parser = FrameParser()
 
     def __del__(self):
         self.terminate.set()
@@ -68,48 +70,117 @@ class PBStx(object):
         self.ser.write(buf)
 
     def receive(self):
-        seq = 0
-        len_ = 0
-        payload = bytearray()
-        crc = 0
-        rx_crc = 0
-        hdr_len = struct.calcsize(PBStx.DHEADER)
-        crc_len = struct.calcsize(PBStx.CRCFMT)
+        """Receive next message
 
+        Parsed frame is always returned first. Broken frames are
+        counted by parser (stats()) and queued errors raised as
+        ReceiveError only when no frame is ready, parser state is kept,
+        so next call continues from the following bytes.
+        """
         while not self.terminate.is_set():
-            # 1. wait start marker
-            c = self.ser.read(1)
-            if len(c) == 0 or ord(c[0]) != PBStx.STX:
-                continue
-
-            # 2. read header
-            buf = self._read_or_die(hdr_len)
-            rx_crc = xmodem_crc16(buf)
-            seq, len_ = struct.unpack(PBStx.DHEADER, buf)
-
-            # 3. read payload
-            payload = self._read_or_die(len_)
-            rx_crc = xmodem_crc16(payload, rx_crc)
-
-            # 4. read crc
-            buf = self._read_or_die(crc_len)
-            crc, = struct.unpack(PBStx.CRCFMT, buf)
-
-            # 5. check crc
-            if crc == rx_crc:
+            frame = self.parser.next_frame()
+            if frame is not None:
+                seq, payload = frame
+                self._rx_seq = seq
                 return self._deserialize(seq, payload)
-            else:
-                raise ReceiveError("CRC mismatch: 0x{:04x} != 0x{:04x}".format(
-                    crc, rx_crc))
 
-    def _read_or_die(self, rq_len):
-        buf = self.ser.read(rq_len)
-        if len(buf) != rq_len:
-            raise ReceiveError("short read: {} != {}".format(len(buf), rq_len))
+            if self.parser.errors:
+                raise ReceiveError(self.parser.errors.pop(0))
 
-        return buf
+            buf = self.ser.read(self.ser.inWaiting() or 1)
+            if len(buf) == 0:
+                # timeout: incomplete frame will not be finished
+                self.parser.expire()
+            else:
+                self.parser.feed(buf)
 
     def _deserialize(self, seq, payload):
         pb = msgs.Message()
         pb.ParseFromString(payload)
         return pb
+
+
+class FrameParser(object):
+    """Incremental PBStx frame parser
+
+    Bytes are buffered until used. On bad length or crc only STX byte
+    is dropped and parsing restarts from the next STX, so a valid frame
+    inside the broken one is not lost.
+    Same rules as pbstxReceive() in fw/comm/pbstx.c.
+    """
+
+    HEADER_LEN = struct.calcsize(PBStx.EHEADER)
+    CRC_LEN = struct.calcsize(PBStx.CRCFMT)
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.errors = []
+        # session counters
+        self.frames = 0
+        self.crc_errors = 0
+        self.overflows = 0
+        self.timeouts = 0
+        self.resyncs = 0
+        self.dropped = 0
+
+    def feed(self, data):
+        self.buf.extend(data)
+
+    def expire(self):
+        """Drop STX of incomplete frame (no more data came)"""
+        if self.buf:
+            self.timeouts += 1
+            self.errors.append("incomplete frame: {} bytes".format(len(self.buf)))
+            self._resync()
+
+    def next_frame(self):
+        """Parse next frame from buffered bytes
+
+        @return (seq, payload) or None if more data needed
+        """
+        buf = self.buf
+        while True:
+            # 1. resync: drop bytes before STX
+            if buf and buf[0] != PBStx.STX:
+                idx = buf.find(b'\xae')
+                skip = idx if idx >= 0 else len(buf)
+                del buf[:skip]
+                self.dropped += skip
+
+            # 2. header
+            if len(buf) < self.HEADER_LEN:
+                return None
+
+            seq, len_ = struct.unpack_from(PBStx.DHEADER, buf, 1)
+            if len_ > PBStx.MAX_LEN:
+                self.overflows += 1
+                self.errors.append("length overflow: {}".format(len_))
+                self._resync()
+                continue
+
+            # 3. payload and crc
+            size = self.HEADER_LEN + len_ + self.CRC_LEN
+            if len(buf) < size:
+                return None
+
+            crc, = struct.unpack_from(PBStx.CRCFMT, buf, size - self.CRC_LEN)
+            rx_crc = xmodem_crc16(buf[1:size - self.CRC_LEN])
+            if crc != rx_crc:
+                self.crc_errors += 1
+                self.errors.append("CRC mismatch: 0x{:04x} != 0x{:04x}".format(crc, rx_crc))
+                self._resync()
+                continue
+
+            payload = bytes(buf[self.HEADER_LEN:size - self.CRC_LEN])
+            del buf[:size]
+            self.frames += 1
+            return seq, payload
+
+    def _resync(self):
+        # drop STX only, next frame may start inside the broken one
+        del self.buf[:1]
+        self.resyncs += 1
+
+    def stats(self):
+        return dict((k, getattr(self, k)) for k in
+                    ('frames', 'crc_errors', 'overflows', 'timeouts', 'resyncs', 'dropped'))
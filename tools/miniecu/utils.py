@@ -11,7 +11,9 @@ MESSAGE_FIELD_TYPE = (
     ('param_request', msgs.ParamRequest),
     ('param_set', msgs.ParamSet),
     ('time_reference', msgs.TimeReference),
-    ('memory_dump_request', msgs.MemoryDumpRequest)
+    ('memory_dump_request', msgs.MemoryDumpRequest),
+    ('cpu_diagnostics_request', msgs.CPUDiagnosticsRequest),
+    ('telemetry_request', msgs.TelemetryRequest)
 )
 
 PARAM_TYPE_FIELD_TYPE = (
@@ -2,13 +2,21 @@
 # vim:set ts=4 sw=4 et
 
 __all__ = (
-    'xmodem_crc16'
+    'xmodem_crc16',
+    'xmodem_crc16_bytewise',
+    'xmodem_crc16_slice4',
+    'xmodem_crc16_slice8',
 )
 
 # Notes:
 #   CRC table exact the same as declared in crcmod.predefined for 'xmodem' algo
 #   but i get different values from that module, so i decided to copy C-code
 #   used in firmware.
+#
+#   It is "augmented" form: data byte xored after shift, so result is
+#   (crc * x^(8n) + data) mod P, not CRC-16/XMODEM (data * x^16 mod P).
+#   Slicing tables: CRC16_SLICE_TAB[k][v] = v * x^(8(k+2)) mod P,
+#   row 0 is XMODEM_CRC16_TAB (same as lib_crc16.c).
 
 
 XMODEM_CRC16_TAB = [
@@ -47,7 +55,18 @@ XMODEM_CRC16_TAB = [
 ]
 
 
-def xmodem_crc16(data, crc16val=0):
+def _slice_tables(rows):
+    tabs = [XMODEM_CRC16_TAB]
+    for k in range(1, rows):
+        prev = tabs[-1]
+        tabs.append([XMODEM_CRC16_TAB[v >> 8] ^ ((v << 8) & 0xff00) for v in prev])
+    return tabs
+
+
+CRC16_SLICE_TAB = _slice_tables(8)
+
+
+def xmodem_crc16_bytewise(data, crc16val=0):
     if isinstance(data, basestring):
         data = bytearray(data)
 
@@ -58,3 +77,35 @@ def xmodem_crc16(data, crc16val=0):
         crc16val = XMODEM_CRC16_TAB[(crc16val >> 8) & 255] ^ ((crc16val << 8) & 0xff00) ^ b
 
     return crc16val
+
+
+def xmodem_crc16_slice4(data, crc16val=0):
+    """Slicing-by-4, same as crc16part_slice4()"""
+    if isinstance(data, basestring):
+        data = bytearray(data)
+
+    t0, t1, t2, t3 = CRC16_SLICE_TAB[:4]
+    tail = len(data) & ~3
+    for i in range(0, tail, 4):
+        crc16val = (t3[crc16val >> 8] ^ t2[crc16val & 255] ^
+                    t1[data[i]] ^ t0[data[i + 1]] ^ (data[i + 2] << 8) ^ data[i + 3])
+
+    return xmodem_crc16_bytewise(data[tail:], crc16val)
+
+
+def xmodem_crc16_slice8(data, crc16val=0):
+    """Slicing-by-8, same as crc16part_slice8()"""
+    if isinstance(data, basestring):
+        data = bytearray(data)
+
+    t0, t1, t2, t3, t4, t5, t6, t7 = CRC16_SLICE_TAB
+    tail = len(data) & ~7
+    for i in range(0, tail, 8):
+        crc16val = (t7[crc16val >> 8] ^ t6[crc16val & 255] ^
+                    t5[data[i]] ^ t4[data[i + 1]] ^ t3[data[i + 2]] ^ t2[data[i + 3]] ^
+                    t1[data[i + 4]] ^ t0[data[i + 5]] ^ (data[i + 6] << 8) ^ data[i + 7])
+
+    return xmodem_crc16_bytewise(data[tail:], crc16val)
+
+
+xmodem_crc16 = xmodem_crc16_slice8
@@ -0,0 +1,135 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# vim:set ts=4 sw=4 et
+
+"""
+PBStx parser bench with injected bit errors
+
+Random frames are encoded, bits flipped with given BER and stream
+is fed in chunks to FrameParser (resynchronising) and to a copy of
+the old stream parser, which drops the bytes of a broken frame.
+"""
+
+from __future__ import print_function
+
+import time
+import random
+import struct
+import argparse
+from miniecu.pbstx import PBStx, FrameParser
+from miniecu.xmodem_crc16 import xmodem_crc16
+
+
+def encode(seq, payload):
+    buf = struct.pack(PBStx.EHEADER, PBStx.STX, seq & 0xff, len(payload)) + payload
+    return buf + struct.pack(PBStx.CRCFMT, xmodem_crc16(bytearray(buf[1:])))
+
+
+def make_stream(args):
+    rnd = random.Random(args.seed)
+    frames = []
+    for seq in range(args.frames):
+        n = rnd.randint(args.min_len, args.max_len)
+        frames.append(bytes(bytearray(rnd.getrandbits(8) for i in range(n))))
+
+    stream = bytearray(b''.join(encode(seq, p) for seq, p in enumerate(frames)))
+
+    flips = 0
+    if args.ber > 0:
+        # geometric gaps between flipped bits
+        pos = int(rnd.expovariate(args.ber))
+        while pos < len(stream) * 8:
+            stream[pos // 8] ^= 1 << (pos % 8)
+            flips += 1
+            pos += 1 + int(rnd.expovariate(args.ber))
+
+    return frames, bytes(stream), flips
+
+
+def run_resync(stream, chunk):
+    parser = FrameParser()
+    out = []
+    for i in range(0, len(stream), chunk):
+        parser.feed(stream[i:i + chunk])
+        while True:
+            f = parser.next_frame()
+            if f is None:
+                break
+            out.append(f)
+
+    parser.expire()
+    return out, parser.stats()
+
+
+def run_legacy(stream, chunk):
+    """Old PBStx.receive(): bytes of failed frame are lost"""
+    out = []
+    stats = dict(frames=0, crc_errors=0, overflows='-')
+    pos = 0
+    hdr_len = struct.calcsize(PBStx.DHEADER)
+    crc_len = struct.calcsize(PBStx.CRCFMT)
+
+    # chunking does not change result of stream parser
+    while pos < len(stream):
+        c = ord(stream[pos:pos + 1])
+        pos += 1
+        if c != PBStx.STX:
+            continue
+
+        if pos + hdr_len > len(stream):
+            break
+
+        seq, len_ = struct.unpack_from(PBStx.DHEADER, stream, pos)
+        rx_crc = xmodem_crc16(bytearray(stream[pos:pos + hdr_len]))
+        pos += hdr_len
+
+        # no length check, as old host parser
+        payload = stream[pos:pos + len_]
+        pos += len_
+        crc, = struct.unpack_from(PBStx.CRCFMT, stream[pos:pos + crc_len].ljust(crc_len, b'\0'))
+        pos += crc_len
+
+        if xmodem_crc16(bytearray(payload), rx_crc) == crc:
+            out.append((seq, payload))
+            stats['frames'] += 1
+        else:
+            stats['crc_errors'] += 1
+
+    return out, stats
+
+
+def main():
+    parser = argparse.ArgumentParser(description="PBStx parser bench with injected bit errors")
+    parser.add_argument("-f", "--frames", type=int, default=20000, help="frame count")
+    parser.add_argument("--min-len", type=int, default=8, help="min payload")
+    parser.add_argument("--max-len", type=int, default=120, help="max payload")
+    parser.add_argument("-b", "--ber", type=float, nargs='+', default=[0, 1e-5, 1e-4, 1e-3],
+                        help="bit error rates")
+    parser.add_argument("-c", "--chunk", type=int, default=64, help="read chunk size")
+    parser.add_argument("-s", "--seed", type=int, default=1)
+
+    args = parser.parse_args()
+
+    print("{:<8} {:<7} {:>6} {:>7} {:>7} {:>5} {:>5} {:>6} {:>7} {:>9}".format(
+        "ber", "parser", "flips", "frames", "lost", "crc", "ovf", "resync", "dropped", "MB/s"))
+
+    for ber in args.ber:
+        args.ber = ber
+        frames, stream, flips = make_stream(args)
+        sent = set(frames)
+
+        for name, fn in (('resync', run_resync), ('legacy', run_legacy)):
+            start = time.time()
+            out, st = fn(stream, args.chunk)
+            elapsed = time.time() - start
+
+            # frames with crc collisions are not counted as received
+            good = sum(1 for seq, p in out if p in sent)
+            print("{:<8g} {:<7} {:>6} {:>7} {:>7} {:>5} {:>5} {:>6} {:>7} {:>9.2f}".format(
+                ber, name, flips, good, len(frames) - good, st['crc_errors'], st['overflows'],
+                st.get('resyncs', '-'), st.get('dropped', '-'),
+                len(stream) / elapsed / 1e6 if elapsed > 0 else float('inf')))
+
+
+if __name__ == '__main__':
+    main()
@@ -5,7 +5,7 @@ import time
 import struct
 import argparse
 import yaml
-from yaml_tags import Parameter, PtBool, PtInt32, PtFloat, PtString
+from yaml_tags import Parameter, PtBool, PtInt32, PtFloat, PtString, Channel
 from mako.template import Template
 from os import path
 from sys import exit
@@ -23,6 +23,9 @@ class ParameterTable(object):
 
         self.format_version = data.get('format_version')
         self.parameters = data.get('parameters')
+        self.channels = sorted((Channel(k, v) for k, v in
+                                data.get('channels', {}).iteritems()),
+                               key=lambda c: c.name)
 
     @property
     def format_version_int(self):
@@ -70,6 +73,28 @@ class ParameterTable(object):
                     if len(sv) > Parameter.MAX_STRING:
                         raise ValueError("ParamId: {}, value: {} is too long ({})".format(k, sv, len(sv)))
 
+        # validate channels
+        cutoffs = {}
+        for ch in self.channels:
+            if len(ch.name) > Channel.MAX_NAME:
+                raise KeyError("Channel: {} is to long ({})".format(ch.name, len(ch.name)))
+
+            for alarm in (ch.alarm_low, ch.alarm_high):
+                if isinstance(alarm, basestring) and \
+                        not isinstance(self.parameters.get(alarm), PtFloat):
+                    raise ValueError("Channel: {}, alarm: {} is not float param".format(ch.name, alarm))
+
+            if ch.cutoff > 0:
+                for i in ch.inputs:
+                    if cutoffs.setdefault(i, ch.cutoff) != ch.cutoff:
+                        raise ValueError("Channel: {}, input: {} cutoff conflicts".format(ch.name, i))
+
+    def param_var(self, param_id):
+        var_def = self.parameters[param_id]
+        if var_def.var is None:
+            return 'gp_' + param_id.lower()
+        return var_def.var
+
 
 class Generator(object):
     def __init__(self):
@@ -77,6 +102,7 @@ class Generator(object):
 
         self.tmpl_c = Template(filename=path.join(module_path, 'param_table.c.tmpl'))
         self.tmpl_h = Template(filename=path.join(module_path, 'param_table.h.tmpl'))
+        self.tmpl_ch = Template(filename=path.join(module_path, 'channel_table.c.tmpl'))
 
     def generate(self, source_file, out_dir, param_table):
         render_agrs = dict(
@@ -86,6 +112,7 @@ class Generator(object):
 
         gen_h = self.tmpl_h.render(**render_agrs)
         gen_c = self.tmpl_c.render(**render_agrs)
+        gen_ch = self.tmpl_ch.render(**render_agrs)
 
         with open(path.join(out_dir, 'param_table.h'), 'w') as fd:
             fd.write(gen_h)
@@ -93,6 +120,9 @@ class Generator(object):
         with open(path.join(out_dir, 'param_table.c'), 'w') as fd:
             fd.write(gen_c)
 
+        with open(path.join(out_dir, 'channel_table.c'), 'w') as fd:
+            fd.write(gen_ch)
+
 
 def main(argv=None):
     def dirtype(dir_):
@@ -130,3 +130,74 @@ class PtString(Y.YAMLObject, Parameter):
     _accept_values = True
     _need_minmax = False
     _norm_type = str
+
+
+class Channel(object):
+    """Sensor channel definition (channels section, not yaml tag)"""
+
+    MAX_NAME = 15
+
+    # must match enum adc_input in fw/adc/adc_channel.h
+    INPUTS = ('INT_TEMP', 'VRTC', 'XP2_PA1', 'XP2_PA2', 'VBAT', 'OILP', 'TEMP', 'FLOW')
+
+    def __init__(self, name, definition):
+        self.name = name
+        self.desc = definition.get('desc')
+        self.inputs = definition.get('inputs')
+        self.period = int(definition.get('period', 100))
+        self.fast_period = int(definition.get('fast_period', 0))
+        self.cutoff = float(definition.get('cutoff', 0))
+        self.handler = definition.get('handler')
+        self.enable = definition.get('enable')
+        self.poly = [float(v) for v in definition.get('poly', [])]
+        self.lut = [(float(x), float(y)) for x, y in definition.get('lut', [])]
+        self.alarm_low = definition.get('alarm_low')
+        self.alarm_high = definition.get('alarm_high')
+        self.range = [float(v) for v in definition.get('range', [])]
+        self.rate_max = float(definition.get('rate_max', 0))
+        self.stuck_time = int(definition.get('stuck_time', 0))
+
+        if self.desc is None:
+            self.raise_definition_error('desc')
+
+        if not self.inputs:
+            self.raise_definition_error('inputs')
+
+        for i in self.inputs:
+            if i not in self.INPUTS:
+                raise DefinitionError("Channel: {}: unknown input: {}".format(name, i))
+
+        if self.handler is not None and (self.poly or self.lut
+                                         or self.alarm_low is not None
+                                         or self.alarm_high is not None):
+            raise DefinitionError("Channel: {}: handler channel can't have conversion".format(name))
+
+        if len(self.poly) > 255 or len(self.lut) > 255:
+            raise DefinitionError("Channel: {}: conversion too long".format(name))
+
+        if len(self.lut) == 1:
+            raise DefinitionError("Channel: {}: lut needs at least two points".format(name))
+
+        for (x0, _), (x1, _) in zip(self.lut, self.lut[1:]):
+            if x1 <= x0:
+                raise DefinitionError("Channel: {}: lut x not ascending".format(name))
+
+        if self.range and (len(self.range) != 2 or self.range[0] >= self.range[1]):
+            raise DefinitionError("Channel: {}: range must be [min, max]".format(name))
+
+        if self.rate_max < 0 or self.stuck_time < 0:
+            raise DefinitionError("Channel: {}: negative health limit".format(name))
+
+    def __repr__(self):
+        return "Channel({}: {})".format(self.name, ", ".join(self.inputs))
+
+    def raise_definition_error(self, tag):
+        raise DefinitionError("Channel: {}: {}: not defined".format(self.name, tag))
+
+    @property
+    def input(self):
+        return self.inputs[0]
+
+    @property
+    def ident(self):
+        return self.name.lower()
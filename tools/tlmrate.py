@@ -0,0 +1,113 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# vim:set ts=4 sw=4 et
+
+"""
+Telemetry stream rates
+
+Sets per session stream intervals (TelemetryRequest)
+and prints measured message rate of each stream.
+"""
+
+from __future__ import print_function
+
+import sys
+import time
+import argparse
+from miniecu import msgs, PBStx, ReceiveError
+from miniecu.utils import wrap_msg, wrap_logger
+
+
+Stream = msgs.TelemetryRequest
+
+# Telemetry field of each group stream
+GROUP_FIELDS = (
+    (Stream.RPM, 'rpm_info'),
+    (Stream.TEMPERATURE, 'temperature'),
+    (Stream.BATTERY, 'battery'),
+    (Stream.FUEL, 'fuel'),
+    (Stream.OIL_PRESSURE, 'oil_pressure'),
+    (Stream.CPU, 'cpu'),
+    (Stream.ADC_RAW, 'adc_raw'),
+)
+
+
+def stream_name(stream):
+    return Stream.Stream.Name(stream).lower()
+
+
+def parse_rate(s):
+    """name=interval_ms"""
+    name, _, interval = s.partition('=')
+    return msgs.TelemetryRequest.Entry(stream=Stream.Stream.Value(name.upper()),
+                                       interval_ms=int(interval))
+
+
+def received_streams(m, engine_id):
+    """Streams carried by message"""
+    if m.HasField('status') and m.status.engine_id == engine_id and m.status.HasField('system_time'):
+        yield Stream.STATUS
+    if m.HasField('sensor_health') and m.sensor_health.engine_id == engine_id:
+        yield Stream.SENSOR_HEALTH
+    if m.HasField('sensor_stats') and m.sensor_stats.engine_id == engine_id:
+        yield Stream.SENSOR_STATS
+    if m.HasField('telemetry') and m.telemetry.engine_id == engine_id:
+        for stream, field in GROUP_FIELDS:
+            if m.telemetry.HasField(field):
+                yield stream
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("device", help="com port device file")
+    parser.add_argument("baudrate", help="com port baudrate", type=int, nargs='?', default=57600)
+    parser.add_argument("-i", "--id", help="engine id", type=int, default=1)
+    parser.add_argument("-r", "--rate", help="stream interval, e.g. rpm=20 (0 - disable)",
+                        type=parse_rate, action='append', default=[])
+    parser.add_argument("--reset", help="restore default intervals first", action='store_true')
+    parser.add_argument("-p", "--period", help="report period [s]", type=float, default=2.0)
+    parser.add_argument("-v", "--verbose", help="verbose io print", action='store_true')
+    parser.add_argument("-l", "--log-db", help="logging to sql db")
+    parser.add_argument("-n", "--log-name", help="log name")
+
+    args = parser.parse_args()
+
+    pbstx = PBStx(args.device, args.baudrate)
+    pbstx = wrap_logger(pbstx, args.log_db, args.log_name, "%s @ %s" % (args.device, args.baudrate))
+
+    req = msgs.TelemetryRequest(engine_id=args.id, reset=args.reset)
+    req.streams.extend(args.rate)
+    pbstx.send(wrap_msg(req))
+
+    names = [stream_name(s) for s in Stream.Stream.values()]
+    intervals = {}
+    counts = dict.fromkeys(Stream.Stream.values(), 0)
+    start = time.time()
+
+    while True:
+        try:
+            m = pbstx.receive()
+        except ReceiveError as ex:
+            print(repr(ex), file=sys.stderr)
+            continue
+
+        if m.HasField('status_text') or args.verbose:
+            print(m, file=sys.stderr)
+
+        if m.HasField('telemetry_request') and m.telemetry_request.response:
+            intervals = dict((e.stream, e.interval_ms) for e in m.telemetry_request.streams)
+            print(" ".join("{:>13}".format(n) for n in names))
+            print(" ".join("{:>10} ms".format(intervals.get(s, '-')) for s in Stream.Stream.values()))
+
+        for stream in received_streams(m, args.id):
+            counts[stream] += 1
+
+        elapsed = time.time() - start
+        if elapsed >= args.period:
+            print(" ".join("{:>11.1f}/s".format(counts[s] / elapsed) for s in Stream.Stream.values()))
+            counts = dict.fromkeys(counts, 0)
+            start = time.time()
+
+
+if __name__ == '__main__':
+    main()